@@ -6,6 +6,7 @@
 #include <iostream>
 
 #include "3DPosition.h"
+#include "FastTrig.h"
 
 BBC_AUDIOTOOLBOX_START
 
@@ -169,9 +170,17 @@ Quaternion& Quaternion::SetFromAngleAxis(double angle, double _x, double _y, dou
   // Quaternion version of rotation of phi degrees of (_x, _y, _z) axis is:
   // cos(phi * pi / 360) + (_x.i + _y.j + _z.k).sin(phi * pi / 360)
   double s, m = sqrt(_x * _x + _y * _y + _z * _z);      // calculate magnitude of pure axistor
-  angle *= M_PI / 360.0;                                // convert from degrees to radians and half angle
-  w = cos(angle);
-  s = sin(angle) / ((m > 0.0) ? m : 1.0);               // divide sin multiplier by magnitude of (_x, _y, _z) magnitude to ensure it is a unit axistor
+  if (FastTrig::Enabled())
+  {
+    FastTrig::SinCos(angle * 0.5, s, w);                // half angle (in degrees)
+  }
+  else
+  {
+    angle *= M_PI / 360.0;                              // convert from degrees to radians and half angle
+    w = cos(angle);
+    s = sin(angle);
+  }
+  s /= ((m > 0.0) ? m : 1.0);                           // divide sin multiplier by magnitude of (_x, _y, _z) magnitude to ensure it is a unit axistor
   x = s * _x;
   y = s * _y;
   z = s * _z;
@@ -239,8 +248,15 @@ Quaternion operator / (const Quaternion& obj1, const Quaternion& obj2)
 /*--------------------------------------------------------------------------------*/
 Position operator * (const Position& pos, const Quaternion& rotation)
 {
-  // calculate p' = qp(q^-1)
-  return ((rotation * Quaternion(pos)) * rotation.Invert()).GetAxis();
+  // calculate p' = qp(q^-1) using the equivalent rotation matrix
+  Position _pos = pos.Cart();
+  double r[9];
+
+  rotation.ToRotationMatrix(r);
+
+  return Position(r[0] * _pos.pos.x + r[1] * _pos.pos.y + r[2] * _pos.pos.z,
+                  r[3] * _pos.pos.x + r[4] * _pos.pos.y + r[5] * _pos.pos.z,
+                  r[6] * _pos.pos.x + r[7] * _pos.pos.y + r[8] * _pos.pos.z);
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -265,8 +281,15 @@ Quaternion operator / (const Quaternion& obj1, double val)
 /*--------------------------------------------------------------------------------*/
 Position operator / (const Position& pos, const Quaternion& rotation)
 {
-  // calculate p' = (q^-1)pq
-  return ((rotation.Invert() * Quaternion(pos)) * rotation).GetAxis();
+  // calculate p' = (q^-1)pq using the transpose of the equivalent rotation matrix
+  Position _pos = pos.Cart();
+  double r[9];
+
+  rotation.ToRotationMatrix(r);
+
+  return Position(r[0] * _pos.pos.x + r[3] * _pos.pos.y + r[6] * _pos.pos.z,
+                  r[1] * _pos.pos.x + r[4] * _pos.pos.y + r[7] * _pos.pos.z,
+                  r[2] * _pos.pos.x + r[5] * _pos.pos.y + r[8] * _pos.pos.z);
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -469,7 +492,7 @@ Quaternion Slerp(const Quaternion& q0, const Quaternion& q1, double t)
     return (q0 * sin(angle * (1.0 - t)) + q * sin(angle * t)) / sin(angle);
   } else {
     // small angle between them, use linear interpolation
-    return Lerp(q0, q1,t);
+    return Lerp(q0, q, t);
   }
 }
 
@@ -514,6 +537,28 @@ void Quaternion::SetParameters(ParameterSet& parameters, const std::string& name
   parameters.Set(name + ".z", z);
 }
 
+/*--------------------------------------------------------------------------------*/
+/** Calculate 3x3 rotation matrix (row-major) equivalent to rotating a position by this Quaternion
+ */
+/*--------------------------------------------------------------------------------*/
+void Quaternion::ToRotationMatrix(double *r) const
+{
+  // expansion of qp(q^-1) for p = (0, px, py, pz), valid for non-unit Quaternions as well
+  double ww = w * w, xx = x * x, yy = y * y, zz = z * z;
+  double wx = w * x, wy = w * y, wz = w * z;
+  double xy = x * y, xz = x * z, yz = y * z;
+
+  r[0] = ww + xx - yy - zz;
+  r[1] = 2.0 * (xy - wz);
+  r[2] = 2.0 * (xz + wy);
+  r[3] = 2.0 * (xy + wz);
+  r[4] = ww - xx + yy - zz;
+  r[5] = 2.0 * (yz - wx);
+  r[6] = 2.0 * (xz - wy);
+  r[7] = 2.0 * (yz + wx);
+  r[8] = ww - xx - yy + zz;
+}
+
 /*--------------------------------------------------------------------------------*/
 /** Generate friendly text string
  */
@@ -617,26 +662,81 @@ PositionTransform PositionTransform::operator - () const
 }
 
 /*--------------------------------------------------------------------------------*/
-/** Apply transform to position
+/** Calculate 3x4 affine matrix (row-major) equivalent to ApplyTransform()
  */
 /*--------------------------------------------------------------------------------*/
-void PositionTransform::ApplyTransform(Position& pos) const
+void PositionTransform::CalcMatrix(double *m) const
+{
+  // p' = R(p + pre) + post = Rp + (R.pre + post)
+  Position pre  = pretranslation.Cart();
+  Position post = posttranslation.Cart();
+  double   r[9];
+  uint_t   i;
+
+  rotation.ToRotationMatrix(r);
+
+  for (i = 0; i < 3; i++)
+  {
+    const double *row = r + 3 * i;
+
+    m[4 * i + 0] = row[0];
+    m[4 * i + 1] = row[1];
+    m[4 * i + 2] = row[2];
+    m[4 * i + 3] = row[0] * pre.pos.x + row[1] * pre.pos.y + row[2] * pre.pos.z + post.pos.elements[i];
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Apply 3x4 affine matrix to a position
+ */
+/*--------------------------------------------------------------------------------*/
+static inline void ApplyMatrix(const double *m, const Position& pos, Position& res)
 {
   if (pos.polar)
   {
     // convert to cartesian, transform and then convert back
-    pos = pos.Cart();
-    ApplyTransform(pos);
-    pos = pos.Polar();
+    Position cart = pos.Cart();
+    ApplyMatrix(m, cart, cart);
+    res = cart.Polar();
   }
   else
   {
-    pos += pretranslation;
-    pos *= rotation;
-    pos += posttranslation;
+    // read all components first to allow in-place transformation
+    double x = pos.pos.x, y = pos.pos.y, z = pos.pos.z;
+
+    res.polar = false;
+    res.pos.x = m[0] * x + m[1] * y + m[2]  * z + m[3];
+    res.pos.y = m[4] * x + m[5] * y + m[6]  * z + m[7];
+    res.pos.z = m[8] * x + m[9] * y + m[10] * z + m[11];
   }
 }
 
+/*--------------------------------------------------------------------------------*/
+/** Apply transform to position
+ */
+/*--------------------------------------------------------------------------------*/
+void PositionTransform::ApplyTransform(Position& pos) const
+{
+  double m[12];
+
+  CalcMatrix(m);
+  ApplyMatrix(m, pos, pos);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Apply transform to an array of positions
+ */
+/*--------------------------------------------------------------------------------*/
+void PositionTransform::ApplyTransform(const Position *in, Position *out, size_t n) const
+{
+  double m[12];
+  size_t i;
+
+  CalcMatrix(m);
+
+  for (i = 0; i < n; i++) ApplyMatrix(m, in[i], out[i]);
+}
+
 /*--------------------------------------------------------------------------------*/
 /** Remove transform to position
  */
@@ -785,7 +885,7 @@ Position Position::Polar() const
       double z = pos.z / newpos.pos.d;
 
       // since z = sin(el), el = asin(z)
-      newpos.pos.el = asin(z) * 180.0 / M_PI;
+      newpos.pos.el = FastTrig::Enabled() ? FastTrig::Asin(z) : asin(z) * 180.0 / M_PI;
       // since x = -sin(az) * cos(el)
       //   and y =  cos(az) * cos(el)
       //     x/y = -sin(az) / cos(az) = -tan(az)
@@ -793,7 +893,7 @@ Position Position::Polar() const
       if ((x != 0.0) || (y != 0.0))
       {
         // can do atan2
-        newpos.pos.az = atan2(-x, y) * 180.0 / M_PI;
+        newpos.pos.az = FastTrig::Enabled() ? FastTrig::Atan2(-x, y) : atan2(-x, y) * 180.0 / M_PI;
       }
     }
   }
@@ -816,9 +916,22 @@ Position Position::Cart() const
     // z =  sin(el)
 
     newpos.polar = false;
-    newpos.pos.x = pos.d * -sin(pos.az * M_PI / 180.0) * cos(pos.el * M_PI / 180.0);
-    newpos.pos.y = pos.d *  cos(pos.az * M_PI / 180.0) * cos(pos.el * M_PI / 180.0);
-    newpos.pos.z = pos.d *  sin(pos.el * M_PI / 180.0);
+    if (FastTrig::Enabled())
+    {
+      double sinaz, cosaz, sinel, cosel;
+
+      FastTrig::SinCos(pos.az, sinaz, cosaz);
+      FastTrig::SinCos(pos.el, sinel, cosel);
+      newpos.pos.x = pos.d * -sinaz * cosel;
+      newpos.pos.y = pos.d *  cosaz * cosel;
+      newpos.pos.z = pos.d *  sinel;
+    }
+    else
+    {
+      newpos.pos.x = pos.d * -sin(pos.az * M_PI / 180.0) * cos(pos.el * M_PI / 180.0);
+      newpos.pos.y = pos.d *  cos(pos.az * M_PI / 180.0) * cos(pos.el * M_PI / 180.0);
+      newpos.pos.z = pos.d *  sin(pos.el * M_PI / 180.0);
+    }
   }
         
   return newpos;
@@ -1149,8 +1262,11 @@ std::ostream& operator<<(std::ostream& out, const Position& p)
 /*--------------------------------------------------------------------------------*/
 double Angle(const Position& obj1, const Position& obj2)
 {
-  Position pos1 = obj1.Unit();
-  Position pos2 = obj2.Unit();
+  // fast trig Cart() is not exactly length preserving so normalise *after* conversion
+  // (otherwise the angle between nearly (anti-)parallel vectors is badly affected)
+  bool     fast = FastTrig::Enabled();
+  Position pos1 = fast ? obj1.Cart().Unit() : obj1.Unit();
+  Position pos2 = fast ? obj2.Cart().Unit() : obj2.Unit();
   double   dot  = DotProduct(pos1, pos2);
   if ((dot < -1.01) || (dot > 1.01))
   {
@@ -1160,7 +1276,7 @@ double Angle(const Position& obj1, const Position& obj2)
           dot);
   }
   dot = limited::limit(dot, -1.0, 1.0);
-  return acos(dot) * 180.0 / M_PI;
+  return FastTrig::Enabled() ? FastTrig::Acos(dot) : acos(dot) * 180.0 / M_PI;
 }
 
 std::string Position::ToString() const
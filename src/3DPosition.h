@@ -496,19 +496,16 @@ public:
   /*--------------------------------------------------------------------------------*/
   void SetParameters(ParameterSet& parameters, const std::string& name) const;
 
-//  void ToRotationMatrix(std::vector<double>& r) const
-//  {
-//    r.resize(9);
-//    r[0] = 1 - (2 * y * y + 2 * z * z);
-//    r[1] = 2 * x * y + 2 * z * w;
-//    r[2] = 2 * x * z - 2 * y * w;
-//    r[3] = 2 * x * y - 2 * z * w;
-//    r[4] = 1 - (2 * x * x + 2 * z * z);
-//    r[5] = 2 * y * z + 2 * x * w;
-//    r[6] = 2 * x * z + 2 * y * w;
-//    r[7] = 2 * y * z - 2 * x * w;
-//    r[8] = 1 - (2 * x * x + 2 * y * y);
-//  }
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate 3x3 rotation matrix (row-major) equivalent to rotating a position by this Quaternion
+   *
+   * @param r array of 9 values to receive matrix
+   *
+   * @note the matrix is exactly equivalent to qp(q^-1) (including the scaling for non-unit Quaternions)
+   * and its transpose is equivalent to (q^-1)pq
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ToRotationMatrix(double *r) const;
 
   /*--------------------------------------------------------------------------------*/
   /** Generate friendly text string
@@ -600,12 +597,37 @@ public:
   Quaternion rotation;
   Position   posttranslation;
 
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate 3x4 affine matrix (row-major) equivalent to ApplyTransform(), i.e.
+   *
+   * x' = m[0] * x + m[1] * y + m[2]  * z + m[3]
+   * y' = m[4] * x + m[5] * y + m[6]  * z + m[7]
+   * z' = m[8] * x + m[9] * y + m[10] * z + m[11]
+   *
+   * @param m array of 12 values to receive matrix
+   */
+  /*--------------------------------------------------------------------------------*/
+  void CalcMatrix(double *m) const;
+
   /*--------------------------------------------------------------------------------*/
   /** Apply transform to position
    */
   /*--------------------------------------------------------------------------------*/
   void ApplyTransform(Position& pos) const;
 
+  /*--------------------------------------------------------------------------------*/
+  /** Apply transform to an array of positions
+   *
+   * @param in array of n positions (polar or cartesian)
+   * @param out array of n positions to receive transformed positions (in the same co-ordinate system as the corresponding input)
+   * @param n number of positions
+   *
+   * @note in and out may be the same array
+   * @note the matrix is calculated once per call
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ApplyTransform(const Position *in, Position *out, size_t n) const;
+
   /*--------------------------------------------------------------------------------*/
   /** Remove transform to position
    */
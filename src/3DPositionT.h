@@ -0,0 +1,656 @@
+#ifndef __3D_POSITION_T__
+#define __3D_POSITION_T__
+
+#include <cmath>
+
+#include "3DPosition.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Lightweight geometry types templated on scalar type
+ *
+ * These are parallel versions of Position, Quaternion, PositionTransform and ScreenTransform
+ * intended for real-time code that wants to work in float (e.g. Sample_t) rather than
+ * double - halving the memory footprint and doubling the number of values per SIMD register
+ *
+ * The conventions (angles in degrees, axes, polar/cartesian handling) are identical to the
+ * double classes but these types do not support parameters, JSON or text conversion
+ *
+ * Conversion between precisions and to/from the double classes is always explicit:
+ *
+ *   PositionF fpos(pos);                     // Position -> PositionF
+ *   Position  pos2 = fpos.ToPosition();      // PositionF -> Position
+ *   PositionT<double> dpos(fpos);            // PositionF -> PositionT<double>
+ */
+/*--------------------------------------------------------------------------------*/
+
+template<typename T> class QuaternionT;
+template<typename T> class PositionTransformT;
+template<typename T> class ScreenTransformT;
+
+/*--------------------------------------------------------------------------------*/
+/** Position object templated on scalar type (see Position)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+class PositionT
+{
+public:
+  typedef T value_type;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Default constructor, defaults to origin and cartesian co-ordinates
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT(T x = 0, T y = 0, T z = 0) : polar(false)
+  {
+    pos.x = x; pos.y = y; pos.z = z;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion from other precisions
+   */
+  /*--------------------------------------------------------------------------------*/
+  template<typename T2>
+  explicit PositionT(const PositionT<T2>& obj) : polar(obj.polar)
+  {
+    pos.elements[0] = (T)obj.pos.elements[0];
+    pos.elements[1] = (T)obj.pos.elements[1];
+    pos.elements[2] = (T)obj.pos.elements[2];
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion from (double) Position
+   */
+  /*--------------------------------------------------------------------------------*/
+  explicit PositionT(const Position& obj) : polar(obj.polar)
+  {
+    pos.elements[0] = (T)obj.pos.elements[0];
+    pos.elements[1] = (T)obj.pos.elements[1];
+    pos.elements[2] = (T)obj.pos.elements[2];
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion to (double) Position
+   */
+  /*--------------------------------------------------------------------------------*/
+  Position ToPosition() const
+  {
+    Position res((double)pos.elements[0], (double)pos.elements[1], (double)pos.elements[2]);
+    res.polar = polar;
+    return res;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return the same position but as polar co-ordinates
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT Polar() const
+  {
+    PositionT newpos = *this;
+
+    if (!polar)
+    {
+      newpos.polar  = true;
+      newpos.pos.az = newpos.pos.el = 0;
+      newpos.pos.d  = Mod();
+
+      // see Position::Polar() for derivation
+      if (newpos.pos.d > 0)
+      {
+        newpos.pos.el = std::asin(pos.z / newpos.pos.d) * (T)(180.0 / M_PI);
+        if ((pos.x != 0) || (pos.y != 0)) newpos.pos.az = std::atan2(-pos.x, pos.y) * (T)(180.0 / M_PI);
+      }
+    }
+
+    return newpos;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return the same position but as cartesian co-ordinates
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT Cart() const
+  {
+    PositionT newpos = *this;
+
+    if (polar)
+    {
+      // see Position::Cart() for derivation
+      T az = pos.az * (T)(M_PI / 180.0), el = pos.el * (T)(M_PI / 180.0);
+      T cosel = std::cos(el);
+
+      newpos.polar = false;
+      newpos.pos.x = pos.d * -std::sin(az) * cosel;
+      newpos.pos.y = pos.d *  std::cos(az) * cosel;
+      newpos.pos.z = pos.d *  std::sin(el);
+    }
+
+    return newpos;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Translate the current position by the supplied position in cartesian space
+   *
+   * @note the object remains in the same co-ordinate system as it was
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT& operator += (const PositionT& obj)
+  {
+    if (polar || obj.polar)
+    {
+      PositionT res = Cart() + obj.Cart();
+      *this = polar ? res.Polar() : res;
+    }
+    else
+    {
+      pos.x += obj.pos.x;
+      pos.y += obj.pos.y;
+      pos.z += obj.pos.z;
+    }
+    return *this;
+  }
+  PositionT& operator -= (const PositionT& obj) {return operator += (-obj.Cart());}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Scale/reduce the current position
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT& operator *= (T val)
+  {
+    if (polar) pos.d *= val;
+    else
+    {
+      pos.x *= val;
+      pos.y *= val;
+      pos.z *= val;
+    }
+    return *this;
+  }
+  PositionT& operator /= (T val) {return operator *= ((T)1 / val);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Binary arithmetic operations, doesn't modify supplied objects
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend PositionT operator + (const PositionT& obj1, const PositionT& obj2) {PositionT res = obj1; res += obj2; return res;}
+  friend PositionT operator - (const PositionT& obj1, const PositionT& obj2) {PositionT res = obj1; res -= obj2; return res;}
+  friend PositionT operator * (const PositionT& obj1, T val)                 {PositionT res = obj1; res *= val;  return res;}
+  friend PositionT operator / (const PositionT& obj1, T val)                 {PositionT res = obj1; res /= val;  return res;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return antipodean version of position
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT operator - () const
+  {
+    PositionT res = *this;
+
+    if (res.polar)
+    {
+      res.pos.az += 180;
+      if (res.pos.az >= 180) res.pos.az -= 360;
+      res.pos.el  = -res.pos.el;
+    }
+    else
+    {
+      res.pos.x = -res.pos.x;
+      res.pos.y = -res.pos.y;
+      res.pos.z = -res.pos.z;
+    }
+
+    return res;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return unit vector version of this position
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT Unit() const
+  {
+    PositionT res = *this;
+    T d = Mod();
+
+    if (d > 0) res *= (T)1 / d;
+
+    return res;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return modulus (distance) of position from origin
+   */
+  /*--------------------------------------------------------------------------------*/
+  T Mod() const {return polar ? pos.d : std::sqrt(pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return dot product of two positions
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend T DotProduct(const PositionT& obj1, const PositionT& obj2)
+  {
+    PositionT pos1 = obj1.Cart(), pos2 = obj2.Cart();
+    return pos1.pos.x * pos2.pos.x + pos1.pos.y * pos2.pos.y + pos1.pos.z * pos2.pos.z;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return cross product of two positions
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend PositionT CrossProduct(const PositionT& obj1, const PositionT& obj2)
+  {
+    PositionT pos1 = obj1.Cart(), pos2 = obj2.Cart();
+    return PositionT(pos1.pos.y * pos2.pos.z - pos2.pos.y * pos1.pos.z,
+                     pos2.pos.x * pos1.pos.z - pos1.pos.x * pos2.pos.z,
+                     pos1.pos.x * pos2.pos.y - pos2.pos.x * pos1.pos.y);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return angle (in degrees) between two vectors
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend T Angle(const PositionT& obj1, const PositionT& obj2)
+  {
+    return std::acos(limited::limit(DotProduct(obj1.Unit(), obj2.Unit()), (T)-1, (T)1)) * (T)(180.0 / M_PI);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Apply/remove rotation and transforms
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionT& operator *= (const QuaternionT<T>& rotation)          {*this = *this * rotation; return *this;}
+  PositionT& operator /= (const QuaternionT<T>& rotation)          {*this = *this / rotation; return *this;}
+  PositionT& operator *= (const PositionTransformT<T>& trans)      {trans.ApplyTransform(*this); return *this;}
+  PositionT& operator /= (const PositionTransformT<T>& trans)      {trans.RemoveTransform(*this); return *this;}
+  PositionT& operator *= (const ScreenTransformT<T>& trans)        {trans.ApplyTransform(*this); return *this;}
+  PositionT& operator /= (const ScreenTransformT<T>& trans)        {trans.RemoveTransform(*this); return *this;}
+  friend PositionT operator * (const PositionT& pos, const PositionTransformT<T>& trans) {PositionT res = pos; res *= trans; return res;}
+  friend PositionT operator / (const PositionT& pos, const PositionTransformT<T>& trans) {PositionT res = pos; res /= trans; return res;}
+  friend PositionT operator * (const PositionT& pos, const ScreenTransformT<T>& trans)   {PositionT res = pos; res *= trans; return res;}
+  friend PositionT operator / (const PositionT& pos, const ScreenTransformT<T>& trans)   {PositionT res = pos; res /= trans; return res;}
+
+  bool polar;                 // true if co-ordinates are polar
+  union
+  {
+    struct
+    {
+      T az, el, d;            // azimuth (degrees), elevation (degrees) and distance (m)
+    };
+    struct
+    {
+      T x, y, z;              // co-ordinates in m
+    };
+    T elements[3];            // {az,el,d} or {x,y,z}
+  } pos;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Quaternion templated on scalar type (see Quaternion)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+class QuaternionT
+{
+public:
+  typedef T value_type;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Construct from raw coeffs
+   */
+  /*--------------------------------------------------------------------------------*/
+  QuaternionT(T _w = 1, T _x = 0, T _y = 0, T _z = 0) : w(_w),
+                                                        x(_x),
+                                                        y(_y),
+                                                        z(_z) {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Construct from angle (in degrees) and axis
+   */
+  /*--------------------------------------------------------------------------------*/
+  QuaternionT(T angle, const PositionT<T>& axis) {SetFromAngleAxis(angle, axis);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion from other precisions and from (double) Quaternion
+   */
+  /*--------------------------------------------------------------------------------*/
+  template<typename T2>
+  explicit QuaternionT(const QuaternionT<T2>& obj) : w((T)obj.w),
+                                                     x((T)obj.x),
+                                                     y((T)obj.y),
+                                                     z((T)obj.z) {}
+  explicit QuaternionT(const Quaternion& obj) : w((T)obj.w),
+                                                x((T)obj.x),
+                                                y((T)obj.y),
+                                                z((T)obj.z) {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion to (double) Quaternion
+   */
+  /*--------------------------------------------------------------------------------*/
+  Quaternion ToQuaternion() const {return Quaternion((double)w, (double)x, (double)y, (double)z);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set the Quaternion from an axis and an angle (in degrees)
+   */
+  /*--------------------------------------------------------------------------------*/
+  QuaternionT& SetFromAngleAxis(T angle, const PositionT<T>& axis)
+  {
+    PositionT<T> _axis = axis.Cart();
+    T m = _axis.Mod(), s;
+
+    // see Quaternion::SetFromAngleAxis()
+    angle *= (T)(M_PI / 360.0);
+    w = std::cos(angle);
+    s = std::sin(angle) / ((m > 0) ? m : (T)1);
+    x = s * _axis.pos.x;
+    y = s * _axis.pos.y;
+    z = s * _axis.pos.z;
+    return *this;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Multiply operator - apply second rotation to first
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend QuaternionT operator * (const QuaternionT& obj1, const QuaternionT& obj2)
+  {
+    return QuaternionT(obj1.w * obj2.w - obj1.x * obj2.x - obj1.y * obj2.y - obj1.z * obj2.z,
+                       obj1.w * obj2.x + obj1.x * obj2.w + obj1.y * obj2.z - obj1.z * obj2.y,
+                       obj1.w * obj2.y - obj1.x * obj2.z + obj1.y * obj2.w + obj1.z * obj2.x,
+                       obj1.w * obj2.z + obj1.x * obj2.y - obj1.y * obj2.x + obj1.z * obj2.w);
+  }
+  QuaternionT& operator *= (const QuaternionT& obj) {*this = *this * obj; return *this;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Divide operator - remove second rotation from first
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend QuaternionT operator / (const QuaternionT& obj1, const QuaternionT& obj2) {return obj1 * obj2.Invert();}
+  QuaternionT& operator /= (const QuaternionT& obj) {*this = *this / obj; return *this;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Invert the rotation represented by the Quaternion
+   */
+  /*--------------------------------------------------------------------------------*/
+  QuaternionT Invert() const {return QuaternionT(w, -x, -y, -z);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return a normalised version of the Quaternion
+   */
+  /*--------------------------------------------------------------------------------*/
+  QuaternionT Normalised() const
+  {
+    T norm = (T)1 / std::sqrt(w * w + x * x + y * y + z * z);
+    return QuaternionT(w * norm, x * norm, y * norm, z * norm);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate 3x3 rotation matrix (row-major), see Quaternion::ToRotationMatrix()
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ToRotationMatrix(T *r) const
+  {
+    T ww = w * w, xx = x * x, yy = y * y, zz = z * z;
+    T wx = w * x, wy = w * y, wz = w * z;
+    T xy = x * y, xz = x * z, yz = y * z;
+
+    r[0] = ww + xx - yy - zz;
+    r[1] = 2 * (xy - wz);
+    r[2] = 2 * (xz + wy);
+    r[3] = 2 * (xy + wz);
+    r[4] = ww - xx + yy - zz;
+    r[5] = 2 * (yz - wx);
+    r[6] = 2 * (xz - wy);
+    r[7] = 2 * (yz + wx);
+    r[8] = ww - xx - yy + zz;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Rotate position by Quaternion
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend PositionT<T> operator * (const PositionT<T>& pos, const QuaternionT& rotation)
+  {
+    PositionT<T> _pos = pos.Cart();
+    T r[9];
+
+    rotation.ToRotationMatrix(r);
+    return PositionT<T>(r[0] * _pos.pos.x + r[1] * _pos.pos.y + r[2] * _pos.pos.z,
+                        r[3] * _pos.pos.x + r[4] * _pos.pos.y + r[5] * _pos.pos.z,
+                        r[6] * _pos.pos.x + r[7] * _pos.pos.y + r[8] * _pos.pos.z);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Reverse rotate position by Quaternion
+   */
+  /*--------------------------------------------------------------------------------*/
+  friend PositionT<T> operator / (const PositionT<T>& pos, const QuaternionT& rotation)
+  {
+    PositionT<T> _pos = pos.Cart();
+    T r[9];
+
+    rotation.ToRotationMatrix(r);
+    return PositionT<T>(r[0] * _pos.pos.x + r[3] * _pos.pos.y + r[6] * _pos.pos.z,
+                        r[1] * _pos.pos.x + r[4] * _pos.pos.y + r[7] * _pos.pos.z,
+                        r[2] * _pos.pos.x + r[5] * _pos.pos.y + r[8] * _pos.pos.z);
+  }
+
+  T w, x, y, z;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Position transform templated on scalar type (see PositionTransform)
+ *
+ * @note the affine matrix is calculated on each call, use the batch version of
+ * ApplyTransform() to calculate it once for many positions
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+class PositionTransformT
+{
+public:
+  typedef T value_type;
+
+  PositionTransformT() {}
+  PositionTransformT(const QuaternionT<T>& obj) : rotation(obj) {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion from other precisions and from (double) PositionTransform
+   */
+  /*--------------------------------------------------------------------------------*/
+  template<typename T2>
+  explicit PositionTransformT(const PositionTransformT<T2>& obj) : pretranslation(obj.pretranslation),
+                                                                   rotation(obj.rotation),
+                                                                   posttranslation(obj.posttranslation) {}
+  explicit PositionTransformT(const PositionTransform& obj) : pretranslation(obj.pretranslation),
+                                                              rotation(obj.rotation),
+                                                              posttranslation(obj.posttranslation) {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion to (double) PositionTransform
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionTransform ToPositionTransform() const
+  {
+    PositionTransform res;
+    res.pretranslation  = pretranslation.ToPosition();
+    res.rotation        = rotation.ToQuaternion();
+    res.posttranslation = posttranslation.ToPosition();
+    return res;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate 3x4 affine matrix (row-major) equivalent to ApplyTransform()
+   * (see PositionTransform::CalcMatrix())
+   */
+  /*--------------------------------------------------------------------------------*/
+  void CalcMatrix(T *m) const
+  {
+    PositionT<T> pre  = pretranslation.Cart();
+    PositionT<T> post = posttranslation.Cart();
+    T r[9];
+    uint_t i;
+
+    rotation.ToRotationMatrix(r);
+
+    // p' = R(p + pre) + post = Rp + (R.pre + post)
+    for (i = 0; i < 3; i++)
+    {
+      const T *row = r + 3 * i;
+
+      m[4 * i + 0] = row[0];
+      m[4 * i + 1] = row[1];
+      m[4 * i + 2] = row[2];
+      m[4 * i + 3] = row[0] * pre.pos.x + row[1] * pre.pos.y + row[2] * pre.pos.z + post.pos.elements[i];
+    }
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Apply transform to position
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ApplyTransform(PositionT<T>& pos) const {ApplyTransform(&pos, &pos, 1);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Apply transform to an array of positions
+   *
+   * @note in and out may be the same array
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ApplyTransform(const PositionT<T> *in, PositionT<T> *out, size_t n) const
+  {
+    T m[12];
+    size_t i;
+
+    CalcMatrix(m);
+
+    for (i = 0; i < n; i++)
+    {
+      PositionT<T> pos = in[i].Cart();
+      T x = pos.pos.x, y = pos.pos.y, z = pos.pos.z;
+
+      pos.pos.x = m[0] * x + m[1] * y + m[2]  * z + m[3];
+      pos.pos.y = m[4] * x + m[5] * y + m[6]  * z + m[7];
+      pos.pos.z = m[8] * x + m[9] * y + m[10] * z + m[11];
+
+      out[i] = in[i].polar ? pos.Polar() : pos;
+    }
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Remove transform to position
+   */
+  /*--------------------------------------------------------------------------------*/
+  void RemoveTransform(PositionT<T>& pos) const
+  {
+    bool polar = pos.polar;
+
+    pos  = pos.Cart();
+    pos -= posttranslation;
+    pos /= rotation;
+    pos -= pretranslation;
+    if (polar) pos = pos.Polar();
+  }
+
+  PositionT<T>   pretranslation;
+  QuaternionT<T> rotation;
+  PositionT<T>   posttranslation;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Screen transform templated on scalar type (see ScreenTransform)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+class ScreenTransformT
+{
+public:
+  typedef T value_type;
+
+  ScreenTransformT() : cx(0),
+                       cy(0),
+                       sx(1),
+                       sy(1),
+                       dist(0) {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion from other precisions and from (double) ScreenTransform
+   */
+  /*--------------------------------------------------------------------------------*/
+  template<typename T2>
+  explicit ScreenTransformT(const ScreenTransformT<T2>& obj) : cx((T)obj.cx),
+                                                               cy((T)obj.cy),
+                                                               sx((T)obj.sx),
+                                                               sy((T)obj.sy),
+                                                               dist((T)obj.dist) {}
+  explicit ScreenTransformT(const ScreenTransform& obj) : cx((T)obj.cx),
+                                                          cy((T)obj.cy),
+                                                          sx((T)obj.sx),
+                                                          sy((T)obj.sy),
+                                                          dist((T)obj.dist) {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion to (double) ScreenTransform
+   */
+  /*--------------------------------------------------------------------------------*/
+  ScreenTransform ToScreenTransform() const
+  {
+    ScreenTransform res;
+    res.cx   = (double)cx;
+    res.cy   = (double)cy;
+    res.sx   = (double)sx;
+    res.sy   = (double)sy;
+    res.dist = (double)dist;
+    return res;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return scale due to perspective for the specified Z co-ordinate
+   */
+  /*--------------------------------------------------------------------------------*/
+  T GetDistanceScale(T z) const {return (z != dist) ? dist / (dist - z) : (T)1;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Apply transform to position
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ApplyTransform(PositionT<T>& pos) const
+  {
+    PositionT<T> res = pos.Cart();
+    T m = GetDistanceScale(res.pos.z);
+
+    res.pos.x = cx + sx * m * res.pos.x;
+    res.pos.y = cy + sy * m * res.pos.y;
+    // NOTE: z is NOT changed (see ScreenTransform::ApplyTransform())
+
+    pos = pos.polar ? res.Polar() : res;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Remove transform to position
+   */
+  /*--------------------------------------------------------------------------------*/
+  void RemoveTransform(PositionT<T>& pos) const
+  {
+    PositionT<T> res = pos.Cart();
+    T m = GetDistanceScale(res.pos.z);
+
+    res.pos.x = (res.pos.x - cx) / (sx * m);
+    res.pos.y = (res.pos.y - cy) / (sy * m);
+
+    pos = pos.polar ? res.Polar() : res;
+  }
+
+  T cx, cy;                   // screen centre
+  T sx, sy;                   // screen scale
+  T dist;                     // perspective distance
+};
+
+typedef PositionT<float>          PositionF;
+typedef QuaternionT<float>        QuaternionF;
+typedef PositionTransformT<float> PositionTransformF;
+typedef ScreenTransformT<float>   ScreenTransformF;
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
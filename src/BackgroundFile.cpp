@@ -7,37 +7,98 @@
 #include "OSCompiler.h"
 
 #ifdef TARGET_OS_UNIXBSD
+#include <limits.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 #endif
 
-#ifdef TARGET_OS_WINDOWS
-#include "Windows_uSleep.h"
-#endif
+#include <vector>
 
 #define BBCDEBUG_LEVEL 2
 #include "BackgroundFile.h"
+#include "IOUring.h"
+#include "PerformanceMonitor.h"
 
 BBC_AUDIOTOOLBOX_START
 
 BackgroundFile::BackgroundFile() : EnhancedFile(),
                                    enablebackground(false),
-                                   first(NULL),
-                                   last(NULL)
+                                   buffersize(DEFAULT_BUFFER_SIZE),
+                                   chunksize(DEFAULT_CHUNK_SIZE),
+                                   memorylimit(DEFAULT_MEMORY_LIMIT),
+                                   overflowpolicy(OVERFLOW_BLOCK),
+                                   asyncwrites(false),
+                                   asyncdepth(DEFAULT_ASYNC_DEPTH),
+                                   directio(false),
+                                   tracking(false),
+                                   positioned(false),
+                                   filepos(0),
+                                   fileend(0),
+                                   memory(NULL),
+                                   current(NULL),
+                                   droppedbytes(0),
+                                   droppedwrites(0),
+                                   byteswritten(0),
+                                   writecalls(0),
+                                   writetime(0),
+                                   maxwritesize(0),
+                                   directbytes(0),
+                                   maxinflight(0)
 {
 }
 
 BackgroundFile::BackgroundFile(const char *filename, const char *mode) : EnhancedFile(),
                                                                          enablebackground(false),
-                                                                         first(NULL),
-                                                                         last(NULL)
+                                                                         buffersize(DEFAULT_BUFFER_SIZE),
+                                                                         chunksize(DEFAULT_CHUNK_SIZE),
+                                                                         memorylimit(DEFAULT_MEMORY_LIMIT),
+                                                                         overflowpolicy(OVERFLOW_BLOCK),
+                                                                         asyncwrites(false),
+                                                                         asyncdepth(DEFAULT_ASYNC_DEPTH),
+                                                                         directio(false),
+                                                                         tracking(false),
+                                                                         positioned(false),
+                                                                         filepos(0),
+                                                                         fileend(0),
+                                                                         memory(NULL),
+                                                                         current(NULL),
+                                                                         droppedbytes(0),
+                                                                         droppedwrites(0),
+                                                                         byteswritten(0),
+                                                                         writecalls(0),
+                                                                         writetime(0),
+                                                                         maxwritesize(0),
+                                                                         directbytes(0),
+                                                                         maxinflight(0)
 {
   fopen(filename, mode);
 }
 
 BackgroundFile::BackgroundFile(const BackgroundFile& obj) : EnhancedFile(),
                                                             enablebackground(false),
-                                                            first(NULL),
-                                                            last(NULL)
+                                                            buffersize(DEFAULT_BUFFER_SIZE),
+                                                            chunksize(DEFAULT_CHUNK_SIZE),
+                                                            memorylimit(DEFAULT_MEMORY_LIMIT),
+                                                            overflowpolicy(OVERFLOW_BLOCK),
+                                                            asyncwrites(false),
+                                                            asyncdepth(DEFAULT_ASYNC_DEPTH),
+                                                            directio(false),
+                                                            tracking(false),
+                                                            positioned(false),
+                                                            filepos(0),
+                                                            fileend(0),
+                                                            memory(NULL),
+                                                            current(NULL),
+                                                            droppedbytes(0),
+                                                            droppedwrites(0),
+                                                            byteswritten(0),
+                                                            writecalls(0),
+                                                            writetime(0),
+                                                            maxwritesize(0),
+                                                            directbytes(0),
+                                                            maxinflight(0)
 {
   operator = (obj);
 }
@@ -45,72 +106,441 @@ BackgroundFile::BackgroundFile(const BackgroundFile& obj) : EnhancedFile(),
 BackgroundFile::~BackgroundFile()
 {
   fclose();
+  FreeBuffers();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Duplicate file by assignment
+ *
+ * @note this will open the same file again (queued data and settings are not duplicated)!
+ */
+/*--------------------------------------------------------------------------------*/
+BackgroundFile& BackgroundFile::operator = (const BackgroundFile& obj)
+{
+  // write this object's queued data to the file it is about to close
+  FlushToDisk();
+  EnhancedFile::operator = (obj);
+  return *this;
 }
 
 /*--------------------------------------------------------------------------------*/
 /** Enable background writing behaviour
+ *
+ * @note enabling allocates the buffer pool, disabling flushes and frees it
  */
 /*--------------------------------------------------------------------------------*/
 void BackgroundFile::EnableBackground(bool enable)
 {
-  enablebackground = enable;
+  if (enable)
+  {
+    // allocate pool here so that fwrite() never allocates
+    enablebackground = (memory || AllocateBuffers());
+  }
+  else
+  {
+    // if background writing becomes disabled, flush buffers to disk and kill thread
+    FlushToDisk();
+    FreeBuffers();
+    enablebackground = false;
+  }
+}
 
-  // if background writing becomes disabled, flush buffers to disk and kill thread
-  if (!enablebackground) FlushToDisk();
+/*--------------------------------------------------------------------------------*/
+/** Set size of each buffer in the pool in bytes (rounded up to a whole number of pages)
+ *
+ * @note if background writing is enabled, queued data is flushed and the pool re-allocated
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::SetBufferSize(size_t bytes)
+{
+  const size_t pagesize = GetPageSize();
+
+  buffersize = std::max((bytes + pagesize - 1) & ~(pagesize - 1), pagesize);
+  if (enablebackground)
+  {
+    EnableBackground(false);
+    EnableBackground(true);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set maximum amount of memory used by the buffer pool in bytes
+ *
+ * @note the number of buffers is the largest power of 2 that fits (minimum 2)
+ * @note if background writing is enabled, queued data is flushed and the pool re-allocated
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::SetMemoryLimit(size_t bytes)
+{
+  memorylimit = bytes;
+  if (enablebackground)
+  {
+    EnableBackground(false);
+    EnableBackground(true);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set number of bytes the background thread gathers into each write
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::SetChunkSize(size_t bytes)
+{
+  // the thread uses the chunk size
+  FlushToDisk();
+  chunksize = bytes;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Enable asynchronous writes
+ *
+ * @note queued data is flushed first
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::SetAsyncWrites(bool enable, uint_t depth)
+{
+  FlushToDisk();
+  asyncwrites = enable;
+  asyncdepth  = std::max(depth, (uint_t)1);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Enable direct I/O (O_DIRECT, bypassing the page cache) for asynchronous writes
+ *
+ * @note queued data is flushed first
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::SetDirectIO(bool enable)
+{
+  FlushToDisk();
+  directio = enable;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return snapshot of statistics (can be called from any thread)
+ */
+/*--------------------------------------------------------------------------------*/
+BACKGROUNDFILESTATS BackgroundFile::GetStats() const
+{
+  BACKGROUNDFILESTATS stats;
+
+  stats.byteswritten     = byteswritten.load(std::memory_order_relaxed);
+  stats.writes           = writecalls.load(std::memory_order_relaxed);
+  stats.writetime        = writetime.load(std::memory_order_relaxed);
+  stats.maxwritesize     = maxwritesize.load(std::memory_order_relaxed);
+  stats.averagewritesize = stats.writes    ? stats.byteswritten / stats.writes : 0;
+  stats.throughput       = stats.writetime ? (uint64_t)((double)stats.byteswritten * 1.0e9 / (double)stats.writetime) : 0;
+  stats.droppedbytes     = droppedbytes.load(std::memory_order_relaxed);
+  stats.droppedwrites    = droppedwrites.load(std::memory_order_relaxed);
+  stats.directbytes      = directbytes.load(std::memory_order_relaxed);
+  stats.maxinflight      = maxinflight.load(std::memory_order_relaxed);
+
+  return stats;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Reset statistics
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::ResetStats()
+{
+  byteswritten.store(0, std::memory_order_relaxed);
+  writecalls.store(0, std::memory_order_relaxed);
+  writetime.store(0, std::memory_order_relaxed);
+  maxwritesize.store(0, std::memory_order_relaxed);
+  droppedbytes.store(0, std::memory_order_relaxed);
+  droppedwrites.store(0, std::memory_order_relaxed);
+  directbytes.store(0, std::memory_order_relaxed);
+  maxinflight.store(0, std::memory_order_relaxed);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Publish statistics into PerformanceMonitor as counters '<name>.<stat>'
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::PublishStats(const std::string& name) const
+{
+  BACKGROUNDFILESTATS stats = GetStats();
+  PerformanceMonitor& perfmon = PerformanceMonitor::Get();
+
+  perfmon.SetCounter(name + ".byteswritten",     stats.byteswritten);
+  perfmon.SetCounter(name + ".writes",           stats.writes);
+  perfmon.SetCounter(name + ".writetime",        stats.writetime);
+  perfmon.SetCounter(name + ".maxwritesize",     stats.maxwritesize);
+  perfmon.SetCounter(name + ".averagewritesize", stats.averagewritesize);
+  perfmon.SetCounter(name + ".throughput",       stats.throughput);
+  perfmon.SetCounter(name + ".droppedbytes",     stats.droppedbytes);
+  perfmon.SetCounter(name + ".droppedwrites",    stats.droppedwrites);
+  perfmon.SetCounter(name + ".directbytes",      stats.directbytes);
+  perfmon.SetCounter(name + ".maxinflight",      stats.maxinflight);
 }
 
 /*--------------------------------------------------------------------------------*/
 /** Return whether it will be 'quick' to close the file now - indicating the close will be quick
  *
- * @note this essentially returns whether there is more than one block queued to write
+ * @note this essentially returns whether there is no more than one chunk queued to write
  */
 /*--------------------------------------------------------------------------------*/
 bool BackgroundFile::ReadyToClose() const
 {
-  // return true in the case of none or only one block queued to write
-  // there appears to be a race condition here (first *could* become NULL between the two checks below)
-  // BUT first only becomes NULL when the file closes so as long as ReadyToClose() is called by
-  // the SAME thread as that will close the file (highly likely) this will never be an issue 
-  return (isopen() && !(first && first->next));
+  return (isopen() && (buffers.ReadBuffersAvailable() <= std::max(GetChunkBuffers(), (uint_t)1)));
 }
 
 /*--------------------------------------------------------------------------------*/
-/** Write the first block to disk
+/** Return number of buffers the background thread gathers into each write
  */
 /*--------------------------------------------------------------------------------*/
-void BackgroundFile::WriteBlock()
+uint_t BackgroundFile::GetChunkBuffers() const
 {
-  BLOCK *block = (BLOCK *)first;
+  uint_t n = (uint_t)std::min(chunksize / buffersize, (size_t)(GetBufferCount() / 2));
+  return std::max(n, (uint_t)1);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Allocate the buffer pool
+ */
+/*--------------------------------------------------------------------------------*/
+bool BackgroundFile::AllocateBuffers()
+{
+  const size_t pagesize = GetPageSize();
+  uint_t i, n = 2;
+
+  FreeBuffers();
+
+  // buffer size may not have been set through SetBufferSize()
+  buffersize = std::max((buffersize + pagesize - 1) & ~(pagesize - 1), pagesize);
 
-  size_t res = EnhancedFile::fwrite(block->data, block->size, block->count);
-  if (res == 0) BBCERROR("Failed to write %s * %s bytes to file in background: %s", StringFrom(block->size).c_str(), StringFrom(block->count).c_str(), strerror(ferror()));
+  // largest power of 2 number of buffers within the memory limit
+  while (((size_t)n * 2 * buffersize) <= memorylimit) n *= 2;
 
-  first = first->next;
-  free(block);
+  if ((memory = (uint8_t *)AlignedAlloc((size_t)n * buffersize, pagesize)) == NULL)
+  {
+    BBCERROR("Failed to allocate %u x %s bytes for background file writing", n, StringFrom(buffersize).c_str());
+    return false;
+  }
+
+  // after a resize the ring is empty and write-ahead reaches every slot
+  buffers.Resize(n);
+  for (i = 0; i < n; i++)
+  {
+    BUFFER *buffer = buffers.GetWriteBuffer(i);
+    buffer->data  = memory + (size_t)i * buffersize;
+    buffer->bytes = 0;
+  }
+
+  BBCDEBUG2(("Allocated %u x %s bytes for background file writing", n, StringFrom(buffersize).c_str()));
+
+  return true;
 }
 
 /*--------------------------------------------------------------------------------*/
-/** Flush any queued blocks to disk and shutdown thread
+/** Free the buffer pool
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::FreeBuffers()
+{
+  if (memory)
+  {
+    buffers.Resize(0);
+    AlignedFree(memory);
+    memory  = NULL;
+    current = NULL;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return number of bytes that can be written without waiting
+ */
+/*--------------------------------------------------------------------------------*/
+size_t BackgroundFile::GetFreeBytes() const
+{
+  size_t bytes     = (size_t)buffers.WriteBuffersAvailable() * buffersize;
+  size_t shortfall = 0;
+
+  // current buffer is included in the available write buffers (and may be shortened)
+  if (current) shortfall = current->bytes + buffersize - current->limit;
+  // otherwise the next buffer is shortened by StartBuffer() to realign direct writes (before the
+  // first write after a flush, the position is still stdio's)
+  else if (directio && (!tracking || positioned))
+  {
+    off_t pos = tracking ? (off_t)filepos : EnhancedFile::ftell();
+
+    shortfall = (pos >= 0) ? (size_t)((uint64_t)pos & (GetPageSize() - 1)) : (GetPageSize() - 1);
+  }
+
+  return bytes - std::min(bytes, shortfall);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Prepare the current buffer to receive data at the logical file position
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::StartBuffer()
+{
+  current->bytes  = 0;
+  current->limit  = buffersize;
+  current->offset = filepos;
+
+  // shorten this buffer so that the following ones start on page boundaries
+  if (positioned && directio) current->limit -= (size_t)(filepos & (GetPageSize() - 1));
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Hand the current buffer to the background thread (starting it if necessary)
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::CommitBuffer()
+{
+  // wakes the thread if it is waiting
+  buffers.IncrementWrite();
+  current = NULL;
+
+  // if the thread is not running, start it
+  if (!thread.IsRunning())
+  {
+    // the thread writes directly to the file so anything buffered by stdio must be written first
+    EnhancedFile::fflush();
+
+    if (thread.Start(&__ThreadStart, (void *)this))
+    {
+      BBCDEBUG2(("Created thread for background file writing"));
+    }
+    else
+    {
+      BBCERROR("Failed to create thread (%s)", strerror(errno));
+
+      // write synchronously instead
+      buffers.Shutdown();
+      Run();
+      buffers.ClearShutdown();
+    }
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Write (up to a chunk of) queued buffers to disk in a single write
+ *
+ * @return false if there are no buffers queued
+ */
+/*--------------------------------------------------------------------------------*/
+bool BackgroundFile::WriteBuffers()
+{
+  uint_t n = std::min(buffers.ReadBuffersAvailable(), GetChunkBuffers());
+  uint_t i;
+
+  if (!n) return false;
+
+  uint64_t t0    = GetNanosecondTicks();
+  size_t   total = 0;
+  bool     error = false;
+
+#ifdef TARGET_OS_UNIXBSD
+  // gather buffers into one write (they are not necessarily contiguous in memory)
+  struct iovec iov[IOV_MAX];
+  uint_t niov = 0;
+  int    fd   = fileno(fp);
+
+  n = std::min(n, (uint_t)IOV_MAX);
+  for (i = 0; i < n; i++)
+  {
+    const BUFFER *buffer = buffers.GetReadBuffer(i);
+
+    iov[i].iov_base = buffer->data;
+    iov[i].iov_len  = buffer->bytes;
+    total += buffer->bytes;
+  }
+  niov = n;
+
+  // handle partial writes
+  struct iovec *p = iov;
+  while (niov && !error)
+  {
+    ssize_t res = ::writev(fd, p, (int)niov);
+
+    if (res < 0)
+    {
+      if (errno != EINTR) error = true;
+      continue;
+    }
+
+    size_t nbytes = (size_t)res;
+    while (niov && (nbytes >= p->iov_len))
+    {
+      nbytes -= p->iov_len;
+      p++;
+      niov--;
+    }
+    if (niov)
+    {
+      p->iov_base = (uint8_t *)p->iov_base + nbytes;
+      p->iov_len -= nbytes;
+    }
+  }
+#else
+  // no gathering write: write buffers in turn
+  for (i = 0; (i < n) && !error; i++)
+  {
+    const BUFFER *buffer = buffers.GetReadBuffer(i);
+
+    error  = (EnhancedFile::fwrite(buffer->data, 1, buffer->bytes) < buffer->bytes);
+    total += buffer->bytes;
+  }
+#endif
+
+  if (error) BBCERROR("Failed to write %s bytes to file in background: %s", StringFrom(total).c_str(), strerror(errno));
+  else
+  {
+    uint64_t t = GetNanosecondTicks() - t0;
+
+    // only this thread updates these
+    byteswritten.store(byteswritten.load(std::memory_order_relaxed) + total, std::memory_order_relaxed);
+    writecalls.store(writecalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    writetime.store(writetime.load(std::memory_order_relaxed) + t, std::memory_order_relaxed);
+    if (total > maxwritesize.load(std::memory_order_relaxed)) maxwritesize.store(total, std::memory_order_relaxed);
+  }
+
+  // release buffers (waking the caller if it is waiting for one)
+  buffers.IncrementRead(n);
+
+  return true;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Flush any queued buffers to disk and shutdown thread
  */
 /*--------------------------------------------------------------------------------*/
 void BackgroundFile::FlushToDisk()
 {
-  if (thread.IsRunning() || first)
+  // queue partially filled buffer
+  if (current && current->bytes) buffers.IncrementWrite();
+  current = NULL;
+
+  if (thread.IsRunning() || buffers.ReadBuffersAvailable())
   {
-    BBCDEBUG2(("Flushing queued blocks to disk"));
+    BBCDEBUG2(("Flushing queued buffers to disk"));
 
-    // tell thread to quit
+    // tell thread to quit (it writes all queued buffers first)
+    buffers.Shutdown();
     thread.Stop();
 
-    // write remaining (including last) blocks
-    while (first)
+    // write any remaining buffers (e.g. if the thread could not be started)
+    if (buffers.ReadBuffersAvailable())
     {
-      WriteBlock();
+      EnhancedFile::fflush();
+      Run();
     }
 
-    first = last = NULL;
+    buffers.ClearShutdown();
 
-    BBCDEBUG2(("Flushed all queued blocks to disk"));
+    BBCDEBUG2(("Flushed all queued buffers to disk"));
+  }
+
+  // if anything has been written since the last flush
+  if (tracking)
+  {
+    // positioned writes do not move the file position
+    if (positioned) EnhancedFile::fseek((off_t)filepos, SEEK_SET);
+    tracking = false;
   }
 }
 
@@ -120,22 +550,229 @@ void BackgroundFile::FlushToDisk()
 /*--------------------------------------------------------------------------------*/
 void *BackgroundFile::Run()
 {
-  while (!thread.StopRequested())
+  if (positioned) RunPositioned();
+  else
   {
-    // ONLY write block if there is a next block to become first
-    // (the last block will be handled by FlushToDisk())
-    while (first && first->next)
+    // sleep until a chunk is queued, WaitForRead() only fails on shutdown
+    while (buffers.WaitForRead(GetChunkBuffers()))
     {
-      WriteBlock();
+      WriteBuffers();
     }
 
-    // thread yielding sleep
-    usleep(10000);
+    // write whatever is left
+    while (WriteBuffers()) ;
   }
-  
+
   return NULL;
 }
 
+#ifdef TARGET_OS_UNIXBSD
+/*--------------------------------------------------------------------------------*/
+/** Write iov[0..niov-1] to fd at offset, skipping the first skip bytes
+ *
+ * @return false if writing failed
+ */
+/*--------------------------------------------------------------------------------*/
+static bool WriteAt(int fd, const struct iovec *iov, uint_t niov, uint64_t offset, size_t skip)
+{
+  uint_t i = 0;
+
+  offset += skip;
+  while (i < niov)
+  {
+    ssize_t res;
+
+    // skip parts (or what is left of them) already written
+    if (skip >= iov[i].iov_len)
+    {
+      skip -= iov[i].iov_len;
+      i++;
+      continue;
+    }
+
+#ifdef __linux__
+    // gather whole parts into one write
+    if (!skip) res = ::pwritev(fd, iov + i, (int)std::min(niov - i, (uint_t)IOV_MAX), (off_t)offset);
+    else
+#endif
+    res = ::pwrite(fd, (const uint8_t *)iov[i].iov_base + skip, iov[i].iov_len - skip, (off_t)offset);
+
+    if (res < 0)
+    {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    offset += res;
+    skip   += res;
+  }
+
+  return true;
+}
+#endif
+
+/*--------------------------------------------------------------------------------*/
+/** Thread body for positioned (and asynchronous) writes
+ *
+ * Each run of contiguous buffers (up to a chunk) is written at its offset with one gathering write,
+ * with up to asyncdepth chunks in flight at once using io_uring if asynchronous writes are enabled
+ */
+/*--------------------------------------------------------------------------------*/
+void BackgroundFile::RunPositioned()
+{
+#ifdef TARGET_OS_UNIXBSD
+  typedef struct
+  {
+    std::vector<struct iovec> iov;
+    uint_t   nbuffers;
+    size_t   bytes;
+    uint64_t offset;
+    int      fd;
+    bool     done;
+  } INFLIGHT;
+
+  const size_t pagesize     = GetPageSize();
+  const uint_t chunkbuffers = GetChunkBuffers();
+  std::vector<INFLIGHT> inflight(asyncwrites ? asyncdepth : 1);
+  IOUring  ring;
+  uint64_t busystart = 0, nextoffset = 0;
+  uint_t   first = 0, ninflight = 0, buffersinflight = 0, i;
+  int      fd = fileno(fp), directfd = -1;
+
+  // io_uring is optional: without it each write completes before the next is started
+  bool useuring   = ((inflight.size() > 1) && ring.Open((uint_t)inflight.size()));
+  bool ringfailed = false;
+
+#if defined(__linux__) && defined(O_DIRECT)
+  // re-open the file through its descriptor (not by name, which may now refer to a different file)
+  // to get a separate open file description for direct I/O
+  if (directio && ((directfd = ::open(("/proc/self/fd/" + StringFrom(fd)).c_str(), O_WRONLY | O_DIRECT)) < 0))
+  {
+    BBCERROR("Failed to open '%s' for direct I/O, writing normally: %s", filename.c_str(), strerror(errno));
+  }
+#else
+  if (directio) BBCDEBUG2(("Direct I/O not supported, writing '%s' normally", filename.c_str()));
+#endif
+
+  for (i = 0; i < inflight.size(); i++) inflight[i].iov.resize(std::min(chunkbuffers, (uint_t)IOV_MAX));
+
+  while (true)
+  {
+    uint_t queued = buffers.ReadBuffersAvailable() - buffersinflight;
+
+    // writes that do not follow on from those in flight (e.g. header rewrites) may overlap them so must wait for them
+    if ((ninflight < inflight.size()) && queued && ((queued >= chunkbuffers) || buffers.IsShutdown()) &&
+        (!ninflight || (buffers.GetReadBuffer(buffersinflight)->offset == nextoffset)))
+    {
+      // start write of a run of contiguous buffers (up to a chunk)
+      INFLIGHT& write   = inflight[(first + ninflight) % inflight.size()];
+      bool      aligned = true;
+
+      write.offset = buffers.GetReadBuffer(buffersinflight)->offset;
+      write.bytes  = 0;
+      for (i = 0; (i < queued) && (i < write.iov.size()); i++)
+      {
+        const BUFFER *buffer = buffers.GetReadBuffer(buffersinflight + i);
+
+        if (buffer->offset != (write.offset + write.bytes)) break;
+
+        write.iov[i].iov_base = buffer->data;
+        write.iov[i].iov_len  = buffer->bytes;
+        write.bytes += buffer->bytes;
+
+        // direct I/O requires every part to be whole pages
+        aligned &= !(buffer->bytes & (pagesize - 1));
+      }
+      write.nbuffers = i;
+      write.fd       = ((directfd >= 0) && aligned && !(write.offset & (pagesize - 1))) ? directfd : fd;
+      write.done     = false;
+
+      if (!ninflight) busystart = GetNanosecondTicks();
+      ninflight++;
+      buffersinflight += write.nbuffers;
+      nextoffset       = write.offset + write.bytes;
+      if (ninflight > maxinflight.load(std::memory_order_relaxed)) maxinflight.store(ninflight, std::memory_order_relaxed);
+
+      if (!useuring || !ring.SubmitWrite(write.fd, &write.iov[0], write.nbuffers, write.offset, (uint64_t)(&write - &inflight[0])))
+      {
+        // write synchronously
+        bool success = WriteAt(write.fd, &write.iov[0], write.nbuffers, write.offset, 0);
+
+        // direct I/O may not be supported by the filesystem: write normally instead
+        if (!success && (write.fd != fd))
+        {
+          write.fd = fd;
+          success  = WriteAt(fd, &write.iov[0], write.nbuffers, write.offset, 0);
+        }
+        if (!success) BBCERROR("Failed to write %s bytes to file in background: %s", StringFrom(write.bytes).c_str(), strerror(errno));
+        write.done = true;
+      }
+    }
+    else if (ninflight)
+    {
+      uint64_t userdata;
+      sint_t   res;
+      bool     completed = ring.GetCompletion(userdata, res, !ringfailed);
+
+      if (!completed && !ringfailed)
+      {
+        // cannot wait for completions: stop submitting and poll for the completions of the writes in flight
+        // (their buffers may be in use by the kernel until then)
+        BBCERROR("Cannot wait for asynchronous writes, polling for the %u in flight", ninflight);
+        useuring   = false;
+        ringfailed = true;
+      }
+
+      if (completed && (userdata < inflight.size()))
+      {
+        INFLIGHT& write = inflight[userdata];
+
+        // complete short or failed writes synchronously (normally, in case direct I/O is the problem)
+        if ((res < 0) || ((size_t)res < write.bytes))
+        {
+          BBCDEBUG2(("Asynchronous write of %s bytes returned %d, completing synchronously", StringFrom(write.bytes).c_str(), res));
+          if (!WriteAt(fd, &write.iov[0], write.nbuffers, write.offset, (res > 0) ? (size_t)res : 0))
+          {
+            BBCERROR("Failed to write %s bytes to file in background: %s", StringFrom(write.bytes).c_str(), strerror(errno));
+          }
+          write.fd = fd;
+        }
+        write.done = true;
+      }
+      else if (!completed) usleep(100);
+    }
+    else if (buffers.IsShutdown()) break;
+    else
+    {
+      // sleep until a chunk is queued, WaitForRead() only fails on shutdown
+      buffers.WaitForRead(chunkbuffers);
+      continue;
+    }
+
+    // release buffers of completed writes in order (waking the caller if it is waiting for one)
+    while (ninflight && inflight[first].done)
+    {
+      const INFLIGHT& write = inflight[first];
+
+      // only this thread updates these
+      byteswritten.store(byteswritten.load(std::memory_order_relaxed) + write.bytes, std::memory_order_relaxed);
+      writecalls.store(writecalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      if (write.bytes > maxwritesize.load(std::memory_order_relaxed)) maxwritesize.store(write.bytes, std::memory_order_relaxed);
+      if (write.fd == directfd) directbytes.store(directbytes.load(std::memory_order_relaxed) + write.bytes, std::memory_order_relaxed);
+
+      buffers.IncrementRead(write.nbuffers);
+      buffersinflight -= write.nbuffers;
+      first = (first + 1) % inflight.size();
+
+      // time is only counted whilst writes are in flight
+      if (!--ninflight) writetime.store(writetime.load(std::memory_order_relaxed) + GetNanosecondTicks() - busystart, std::memory_order_relaxed);
+    }
+  }
+
+  if (directfd >= 0) close(directfd);
+#endif
+}
+
 void BackgroundFile::fclose()
 {
   FlushToDisk();
@@ -144,11 +781,18 @@ void BackgroundFile::fclose()
 
 size_t BackgroundFile::fread(void *ptr, size_t size, size_t count)
 {
-  // must make sure that all queued blocks are flushed to disk before reading
+  // must make sure that all queued buffers are flushed to disk before reading
   FlushToDisk();
   return EnhancedFile::fread(ptr, size, count);
 }
 
+int BackgroundFile::readline(char *line, uint_t maxlen)
+{
+  // must make sure that all queued buffers are flushed to disk before reading
+  FlushToDisk();
+  return EnhancedFile::readline(line, maxlen);
+}
+
 size_t BackgroundFile::fwrite(const void *ptr, size_t size, size_t count)
 {
   size_t res = 0;
@@ -156,87 +800,172 @@ size_t BackgroundFile::fwrite(const void *ptr, size_t size, size_t count)
   // if file is open and background writing is enabled
   if (isopen() && enablebackground)
   {
-    // create a block and queue it
-    BLOCK *block;
+    const uint8_t *src  = (const uint8_t *)ptr;
+    size_t        bytes = size * count;
 
-    if ((block = (BLOCK *)calloc(1, sizeof(*block) + (size * count))) != NULL)
+    // with any policy except blocking, decide up front what happens if the data will not fit
+    if ((overflowpolicy != OVERFLOW_BLOCK) && (bytes > GetFreeBytes()))
     {
-      // set block up with correct size and count
-      block->size  = size;
-      block->count = count;
-
-      // copy data
-      memcpy(block->data, ptr, size * count);
-
-      // queue block
-      if (last) last->next = block;
-      last = block;
-      if (!first) first = block;
+      if (overflowpolicy == OVERFLOW_DROP)
+      {
+        // only this thread updates these
+        droppedbytes.store(droppedbytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+        droppedwrites.store(droppedwrites.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count = bytes = 0;
+      }
+      else
+      {
+        // only whole items
+        count = GetFreeBytes() / size;
+        bytes = size * count;
+      }
+    }
 
-      // if the thread is not running, start it
-      if (!thread.IsRunning())
+    // copy data into buffers, committing each one as it fills
+    while (bytes)
+    {
+      if (!current)
       {
-        if (thread.Start(&__ThreadStart, (void *)this))
+        // (with OVERFLOW_BLOCK) wait for the thread to release a buffer
+        if ((current = buffers.GetWriteBuffer()) == NULL)
         {
-          BBCDEBUG2(("Created thread for background file writing"));
+          if (!buffers.WaitForWrite()) break;
+          continue;
         }
-        else
-		{
-          BBCERROR("Failed to create thread (%s)", strerror(errno));
-		}
+
+        // first buffer since the last flush
+        if (!tracking)
+        {
+          positioned = false;
+#ifdef TARGET_OS_UNIXBSD
+          struct stat st;
+          off_t pos;
+
+          // take over the file position from stdio (the thread writes directly to the file)
+          EnhancedFile::fflush();
+          if (((pos = EnhancedFile::ftell()) >= 0) && (fstat(fileno(fp), &st) == 0) && S_ISREG(st.st_mode))
+          {
+            positioned = true;
+            filepos    = (uint64_t)pos;
+            fileend    = std::max(filepos, (uint64_t)st.st_size);
+          }
+#endif
+          tracking = true;
+        }
+
+        StartBuffer();
       }
 
-      // indicate all data has been written
-      res = count;
+      size_t n = std::min(bytes, current->limit - current->bytes);
+
+      memcpy(current->data + current->bytes, src, n);
+      current->bytes += n;
+      src     += n;
+      bytes   -= n;
+      filepos += n;
+      fileend  = std::max(fileend, filepos);
+
+      if (current->bytes == current->limit) CommitBuffer();
     }
+
+    // indicate how many items have been written (data is only left over if waiting failed)
+    res = bytes ? (count - (bytes + size - 1) / size) : count;
   }
   else res = EnhancedFile::fwrite(ptr, size, count);
 
   return res;
 }
 
+off_t BackgroundFile::ftell() const
+{
+  // queued writes do not move the stdio position (and the thread is using the file) whilst tracking
+  if (tracking && positioned) return (off_t)filepos;
+
+  return EnhancedFile::ftell();
+}
+
 off_t BackgroundFile::ftell()
 {
-  // must make sure that all queued blocks are flushed to disk before performing any normal file operations
+  // the logical position is known without waiting for queued buffers
+  if (tracking && positioned) return (off_t)filepos;
+
+  // must make sure that all queued buffers are flushed to disk before performing any normal file operations
   FlushToDisk();
   return EnhancedFile::ftell();
 }
 
 int BackgroundFile::fseek(off_t offset, int origin)
 {
-  // must make sure that all queued blocks are flushed to disk before performing any normal file operations
+  if (tracking && positioned)
+  {
+    sint64_t pos = offset;
+
+    // move the logical position only: data written after this is queued for the new offset
+    if      (origin == SEEK_CUR) pos += (sint64_t)filepos;
+    else if (origin == SEEK_END) pos += (sint64_t)fileend;
+    else if (origin != SEEK_SET) pos  = -1;
+
+    if (pos < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+    if ((uint64_t)pos != filepos)
+    {
+      // the current buffer cannot cover both offsets
+      if (current && current->bytes) CommitBuffer();
+      current = NULL;
+      filepos = (uint64_t)pos;
+    }
+
+    return 0;
+  }
+
+  // must make sure that all queued buffers are flushed to disk before performing any normal file operations
   FlushToDisk();
   return EnhancedFile::fseek(offset, origin);
 }
 
 int BackgroundFile::fflush()
 {
-  // must make sure that all queued blocks are flushed to disk before performing any normal file operations
+  // must make sure that all queued buffers are flushed to disk before performing any normal file operations
   FlushToDisk();
   return EnhancedFile::fflush();
 }
 
 void BackgroundFile::rewind()
 {
-  // must make sure that all queued blocks are flushed to disk before performing any normal file operations
-  FlushToDisk();
-  return EnhancedFile::rewind();
+  if (tracking && positioned) fseek(0, SEEK_SET);
+  else
+  {
+    // must make sure that all queued buffers are flushed to disk before performing any normal file operations
+    FlushToDisk();
+    EnhancedFile::rewind();
+  }
 }
 
 int BackgroundFile::fprintf(const char *fmt, ...)
 {
   va_list ap;
   va_start(ap, fmt);
-  int res = vfprintf(fmt, ap);  // use this class's function to flush queued blocks to disk
+  int res = vfprintf(fmt, ap);  // use this class's function to queue the output
   va_end(ap);
   return res;
 }
 
 int BackgroundFile::vfprintf(const char *fmt, va_list ap)
 {
-  // must make sure that all queued blocks are flushed to disk before performing any normal file operations
-  FlushToDisk();
-  return EnhancedFile::vfprintf(fmt, ap);  
+  // format into memory and queue like any other write
+  if (isopen() && enablebackground)
+  {
+    std::string str;
+
+    VPrintf(str, fmt, ap);
+    return (int)fwrite(str.c_str(), 1, str.size());
+  }
+
+  return EnhancedFile::vfprintf(fmt, ap);
 }
 
 BBC_AUDIOTOOLBOX_END
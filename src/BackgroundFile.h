@@ -2,15 +2,27 @@
 #define __BACKGROUND_FILE__
 
 #include "EnhancedFile.h"
-#include "Thread.h"
-
-#ifdef COMPILER_MSVC
-#pragma warning( push )
-#pragma warning( disable : 4200 )
-#endif
+#include "WaitableLockFreeBuffer.h"
 
 BBC_AUDIOTOOLBOX_START
 
+/*--------------------------------------------------------------------------------*/
+/** Snapshot of BackgroundFile statistics
+ */
+/*--------------------------------------------------------------------------------*/
+typedef struct {
+  uint64_t byteswritten;        // total bytes written by background writing
+  uint64_t writes;              // number of write calls (each covering one or more buffers)
+  uint64_t writetime;           // total time spent in write calls (ns)
+  uint64_t maxwritesize;        // largest write call (bytes)
+  uint64_t averagewritesize;    // average write call (bytes)
+  uint64_t throughput;          // bytes per second whilst writing
+  uint64_t droppedbytes;        // bytes discarded because of OVERFLOW_DROP
+  uint64_t droppedwrites;       // writes discarded because of OVERFLOW_DROP
+  uint64_t directbytes;         // bytes written with direct I/O (see SetDirectIO())
+  uint64_t maxinflight;         // most writes in flight at once (see SetAsyncWrites())
+} BACKGROUNDFILESTATS;
+
 /*--------------------------------------------------------------------------------*/
 /** An enhancement of EnhancedFile that allows writes to be queued and written to
  * disk in a background thread
@@ -20,6 +32,28 @@ BBC_AUDIOTOOLBOX_START
  *
  * This class is thread safe as long as ONLY a single thread performs the high-level
  * file operations
+ *
+ * Writes are copied into a pool of fixed-size, page-aligned buffers (allocated by
+ * EnableBackground(), never by fwrite()) which are filled in turn, so small writes are
+ * coalesced into whole buffers.  Each full buffer is handed to the background thread through
+ * a lock-free ring and the thread sleeps until one is available, so an idle file costs no CPU
+ *
+ * The pool is bounded (see SetMemoryLimit()); when it is full the overflow policy (see
+ * SetOverflowPolicy()) decides whether fwrite() blocks, drops the write or writes short
+ *
+ * The background thread waits until a chunk's worth of buffers (see SetChunkSize()) is queued
+ * and then writes them with a single gathering write (writev() where available, bypassing stdio)
+ *
+ * Where the file is seekable (and pwrite() is available), the caller tracks the logical file
+ * position and every buffer records the offset its data belongs at, so ftell(), fseek(), rewind()
+ * and fprintf() do not flush the queue or stop the thread: rewriting a header is just another
+ * (small) buffer queued at an earlier offset and the thread writes each run of contiguous
+ * buffers with a positioned gathering write (pwritev()).  Otherwise, the thread writes
+ * sequentially and those operations flush the queue first
+ *
+ * With asynchronous writes (see SetAsyncWrites()) several chunks can be in flight at once through
+ * io_uring on Linux; direct I/O (see SetDirectIO()) writes page-aligned chunks with O_DIRECT so
+ * that long recordings do not fill the page cache
  */
 /*--------------------------------------------------------------------------------*/
 class BackgroundFile : public EnhancedFile {
@@ -29,16 +63,137 @@ public:
   BackgroundFile(const BackgroundFile& obj);
   virtual ~BackgroundFile();
 
+  /*--------------------------------------------------------------------------------*/
+  /** Duplicate file by assignment
+   *
+   * @note this will open the same file again (queued data and settings are not duplicated)!
+   */
+  /*--------------------------------------------------------------------------------*/
+  BackgroundFile& operator = (const BackgroundFile& obj);
+
+  enum
+  {
+    OVERFLOW_BLOCK = 0,                 // wait for the background thread to free a buffer (default)
+    OVERFLOW_DROP,                      // discard the whole write and count it (see GetDroppedBytes())
+    OVERFLOW_SHORT_WRITE,               // write as many whole items as will fit (like a full disk)
+  };
+
+  enum
+  {
+    DEFAULT_BUFFER_SIZE  = 256 * 1024,
+    DEFAULT_CHUNK_SIZE   = 4 * 1024 * 1024,
+    DEFAULT_MEMORY_LIMIT = 16 * 1024 * 1024,
+    DEFAULT_ASYNC_DEPTH  = 4,
+  };
+
   /*--------------------------------------------------------------------------------*/
   /** Enable background writing behaviour
+   *
+   * @note enabling allocates the buffer pool, disabling flushes and frees it
    */
   /*--------------------------------------------------------------------------------*/
   virtual void   EnableBackground(bool enable = true);
 
+  /*--------------------------------------------------------------------------------*/
+  /** Set size of each buffer in the pool in bytes (rounded up to a whole number of pages)
+   *
+   * @note if background writing is enabled, queued data is flushed and the pool re-allocated
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetBufferSize(size_t bytes);
+  size_t         GetBufferSize() const {return buffersize;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set maximum amount of memory used by the buffer pool in bytes
+   *
+   * @note the number of buffers is the largest power of 2 that fits (minimum 2)
+   * @note if background writing is enabled, queued data is flushed and the pool re-allocated
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetMemoryLimit(size_t bytes);
+  size_t         GetMemoryLimit() const {return memorylimit;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set number of bytes the background thread gathers into each write
+   *
+   * @note this is rounded down to whole buffers and limited to half the pool (so that the
+   * caller is never waiting for the thread whilst it waits for a full chunk)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetChunkSize(size_t bytes);
+  size_t         GetChunkSize() const {return chunksize;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Enable asynchronous writes: up to depth chunks can be in flight at once through io_uring
+   * where it is available (Linux), otherwise the thread writes each chunk with pwrite() in turn
+   *
+   * @note the file must be seekable (asynchronous writes are not used otherwise)
+   * @note a chunk at an offset that does not follow on from the previous one (e.g. a header
+   * rewrite) waits for all writes in flight to complete
+   * @note queued data is flushed first
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetAsyncWrites(bool enable = true, uint_t depth = DEFAULT_ASYNC_DEPTH);
+  bool           GetAsyncWrites() const {return asyncwrites;}
+  uint_t         GetAsyncDepth()  const {return asyncdepth;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Enable direct I/O (O_DIRECT, bypassing the page cache) for positioned writes
+   *
+   * A buffer started at an unaligned offset (e.g. the first one, or after a seek) is shortened so
+   * that the following ones start on page boundaries in the file; chunks which are not whole pages
+   * at page-aligned offsets are written normally
+   *
+   * @note has no effect if the file is not seekable, if the file system does not support
+   * direct I/O or on platforms other than Linux (the file is re-opened through /proc/self/fd)
+   * @note queued data is flushed first
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetDirectIO(bool enable = true);
+  bool           GetDirectIO() const {return directio;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set what fwrite() does when the buffer pool is full (OVERFLOW_xxx above)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetOverflowPolicy(uint_t policy) {overflowpolicy = policy;}
+  uint_t         GetOverflowPolicy() const {return overflowpolicy;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of buffers in the pool (0 if background writing is not enabled)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t         GetBufferCount() const {return memory ? buffers.GetCapacity() : 0;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of bytes and number of writes discarded because of OVERFLOW_DROP
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint64_t       GetDroppedBytes()  const {return droppedbytes.load(std::memory_order_relaxed);}
+  uint64_t       GetDroppedWrites() const {return droppedwrites.load(std::memory_order_relaxed);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return snapshot of statistics (can be called from any thread)
+   */
+  /*--------------------------------------------------------------------------------*/
+  BACKGROUNDFILESTATS GetStats() const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Reset statistics
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           ResetStats();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Publish statistics into PerformanceMonitor as counters '<name>.<stat>'
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           PublishStats(const std::string& name) const;
+
   /*--------------------------------------------------------------------------------*/
   /** Return whether it will be 'quick' to close the file now - indicating the close will be quick
    *
-   * @note this essentially returns whether there is fewer than 2 blocks queued to write
+   * @note this essentially returns whether there is no more than one chunk queued to write
    */
   /*--------------------------------------------------------------------------------*/
   virtual bool   ReadyToClose() const;
@@ -53,6 +208,7 @@ public:
 
   virtual size_t fread(void *ptr, size_t size, size_t count);
   virtual size_t fwrite(const void *ptr, size_t size, size_t count);
+  virtual off_t  ftell() const;
   virtual off_t  ftell();
   virtual int    fseek(off_t offset, int origin);
   virtual int    fflush();
@@ -60,16 +216,50 @@ public:
 
   virtual int    fprintf(const char *fmt, ...) PRINTF_FORMAT2;
   virtual int    vfprintf(const char *fmt, va_list ap);
+  virtual int    readline(char *line, uint_t maxlen);
 
 protected:
   /*--------------------------------------------------------------------------------*/
-  /** Write the first block to disk
+  /** Allocate and free the buffer pool
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual bool   AllocateBuffers();
+  virtual void   FreeBuffers();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of bytes that can be written without waiting
    */
   /*--------------------------------------------------------------------------------*/
-  virtual void WriteBlock();
+  size_t         GetFreeBytes() const;
 
   /*--------------------------------------------------------------------------------*/
-  /** Flush any queued blocks to disk and shutdown thread
+  /** Prepare the current buffer to receive data at the logical file position
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           StartBuffer();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Hand the current buffer to the background thread (starting it if necessary)
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual void   CommitBuffer();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of buffers the background thread gathers into each write
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t         GetChunkBuffers() const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Write (up to a chunk of) queued buffers to disk in a single write
+   *
+   * @return false if there are no buffers queued
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual bool   WriteBuffers();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Flush any queued buffers to disk and shutdown thread
    */
   /*--------------------------------------------------------------------------------*/
   virtual void   FlushToDisk();
@@ -91,24 +281,50 @@ protected:
   /*--------------------------------------------------------------------------------*/
   void *Run();
 
-  typedef struct _BLOCK
+  /*--------------------------------------------------------------------------------*/
+  /** Thread body for positioned (and asynchronous) writes
+   */
+  /*--------------------------------------------------------------------------------*/
+  void RunPositioned();
+
+  typedef struct
   {
-    struct _BLOCK *next;
-    size_t  size;
-    size_t  count;
-    uint8_t data[0];
-  } BLOCK;
-  
+    uint8_t  *data;                     // page-aligned storage (part of the pool)
+    size_t   bytes;                     // number of bytes used
+    size_t   limit;                     // number of bytes to fill before committing (less than the buffer size for realignment)
+    uint64_t offset;                    // file offset of the data (for positioned writes)
+  } BUFFER;
+
 protected:
   bool                   enablebackground;
+  size_t                 buffersize;
+  size_t                 chunksize;
+  size_t                 memorylimit;
+  uint_t                 overflowpolicy;
+  bool                   asyncwrites;
+  uint_t                 asyncdepth;
+  bool                   directio;
+  bool                   tracking;      // true from the first write after a flush until the next flush
+  bool                   positioned;    // true if buffers are written at explicit offsets (whilst tracking)
+  uint64_t               filepos;       // logical file position (for positioned writes)
+  uint64_t               fileend;       // logical file length (for positioned writes)
   Thread                 thread;
-  volatile BLOCK		 *first, *last;
+  uint8_t                *memory;       // buffer pool
+  // ring of buffers passed to the background thread (each slot's data ptr is fixed when the pool is allocated)
+  WaitableLockFreeBuffer<BUFFER, LockFreeBufferMaskIndexing> buffers;
+  BUFFER                 *current;      // buffer being filled (obtained from but not yet committed to the ring)
+  // updated by caller
+  std::atomic<uint64_t>  droppedbytes;
+  std::atomic<uint64_t>  droppedwrites;
+  // updated by whichever thread writes buffers
+  std::atomic<uint64_t>  byteswritten;
+  std::atomic<uint64_t>  writecalls;
+  std::atomic<uint64_t>  writetime;
+  std::atomic<uint64_t>  maxwritesize;
+  std::atomic<uint64_t>  directbytes;
+  std::atomic<uint64_t>  maxinflight;
 };
 
 BBC_AUDIOTOOLBOX_END
 
-#ifdef COMPILER_MSVC
-#pragma warning( pop )
-#endif
-
 #endif
@@ -1,23 +1,343 @@
 
 #include <math.h>
 
+#include <algorithm>
+#include <thread>
+
 #define BBCDEBUG_LEVEL 0
 #include "DistanceModel.h"
 
 BBC_AUDIOTOOLBOX_START
 
 /*--------------------------------------------------------------------------------*/
-/** A simple singleton to handle time and level calculation based on distance
+/** Create a decay law by name (e.g. "exponential", "inversesquare", "linear" or "curve")
  *
+ * @return new law or NULL if the name is unknown
+ */
+/*--------------------------------------------------------------------------------*/
+DistanceDecayLaw *DistanceDecayLaw::Create(const std::string& name, const ParameterSet& parameters)
+{
+  SelfRegisteringParametricObject *obj;
+  DistanceDecayLaw *law = NULL;
+
+  if ((obj = SelfRegisteringParametricObjectContainer::CreateObject(name, parameters)) != NULL)
+  {
+    if ((law = dynamic_cast<DistanceDecayLaw *>(obj)) == NULL)
+    {
+      BBCERROR("Object '%s' is not a distance decay law", name.c_str());
+      if (!obj->IsSingleton()) delete obj;
+    }
+  }
+  else BBCERROR("Unknown distance decay law '%s'", name.c_str());
+
+  return law;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Get levels for an array of distances (override for efficiency)
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceDecayLaw::GetLevels(const double *d, double *levels, uint_t n) const
+{
+  uint_t i;
+
+  for (i = 0; i < n; i++) levels[i] = GetLevel(d[i]);
+}
+
+/*----------------------------------------------------------------------------------------------------*/
+
+SELF_REGISTERING_PARAMETRIC_OBJECT(ExponentialDecayLaw, "exponential");
+
+static const PARAMETERDESC _exponentialparameters[] =
+{
+  {"power", "Decay power (level = power ^ -distance)"},
+};
+
+enum
+{
+  ExponentialParameter_power = 0,
+};
+
+ExponentialDecayLaw::ExponentialDecayLaw(double _power) : DistanceDecayLaw()
+{
+  SetPower(_power);
+}
+
+ExponentialDecayLaw::ExponentialDecayLaw(const ParameterSet& parameters) : DistanceDecayLaw(parameters)
+{
+  SetPower(2.0);
+  SetParameters(parameters);
+}
+
+void ExponentialDecayLaw::SetParameters(const ParameterSet& parameters)
+{
+  double _power;
+
+  DistanceDecayLaw::SetParameters(parameters);
+  if (parameters.Get(_exponentialparameters[ExponentialParameter_power].name, _power)) SetPower(_power);
+}
+
+void ExponentialDecayLaw::GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list)
+{
+  DistanceDecayLaw::GetParameterDescriptions(list);
+  AddParametersToList(_exponentialparameters, NUMBEROF(_exponentialparameters), list);
+}
+
+void ExponentialDecayLaw::SetPower(double _power)
+{
+  power = _power;
+  // pow(power, -d) = exp(-log(power) * d) for positive powers
+  coeff = (power > 0.0) ? -log(power) : 0.0;
+}
+
+double ExponentialDecayLaw::GetLevel(double d) const
+{
+  return pow(power, -d);
+}
+
+void ExponentialDecayLaw::GetLevels(const double *d, double *levels, uint_t n) const
+{
+  uint_t i;
+
+  if (power > 0.0)
+  {
+    // exp() is considerably cheaper than pow()
+    for (i = 0; i < n; i++) levels[i] = exp(coeff * d[i]);
+  }
+  else DistanceDecayLaw::GetLevels(d, levels, n);
+}
+
+/*----------------------------------------------------------------------------------------------------*/
+
+SELF_REGISTERING_PARAMETRIC_OBJECT(InverseSquareDecayLaw, "inversesquare");
+
+static const PARAMETERDESC _inversesquareparameters[] =
+{
+  {"reference", "Distance (m) at and within which the level is 1"},
+};
+
+enum
+{
+  InverseSquareParameter_reference = 0,
+};
+
+InverseSquareDecayLaw::InverseSquareDecayLaw(double _reference) : DistanceDecayLaw(),
+                                                                  reference(_reference)
+{
+}
+
+InverseSquareDecayLaw::InverseSquareDecayLaw(const ParameterSet& parameters) : DistanceDecayLaw(parameters),
+                                                                              reference(1.0)
+{
+  SetParameters(parameters);
+}
+
+void InverseSquareDecayLaw::SetParameters(const ParameterSet& parameters)
+{
+  DistanceDecayLaw::SetParameters(parameters);
+  parameters.Get(_inversesquareparameters[InverseSquareParameter_reference].name, reference);
+}
+
+void InverseSquareDecayLaw::GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list)
+{
+  DistanceDecayLaw::GetParameterDescriptions(list);
+  AddParametersToList(_inversesquareparameters, NUMBEROF(_inversesquareparameters), list);
+}
+
+/*----------------------------------------------------------------------------------------------------*/
+
+SELF_REGISTERING_PARAMETRIC_OBJECT(LinearDecayLaw, "linear");
+
+static const PARAMETERDESC _linearparameters[] =
+{
+  {"start", "Distance (m) at and within which the level is 1"},
+  {"end",   "Distance (m) at and beyond which the level is 0"},
+};
+
+enum
+{
+  LinearParameter_start = 0,
+  LinearParameter_end,
+};
+
+LinearDecayLaw::LinearDecayLaw(double _start, double _end) : DistanceDecayLaw(),
+                                                             start(_start),
+                                                             end(_end)
+{
+}
+
+LinearDecayLaw::LinearDecayLaw(const ParameterSet& parameters) : DistanceDecayLaw(parameters),
+                                                                 start(0.0),
+                                                                 end(100.0)
+{
+  SetParameters(parameters);
+}
+
+void LinearDecayLaw::SetParameters(const ParameterSet& parameters)
+{
+  DistanceDecayLaw::SetParameters(parameters);
+  parameters.Get(_linearparameters[LinearParameter_start].name, start);
+  parameters.Get(_linearparameters[LinearParameter_end].name, end);
+}
+
+void LinearDecayLaw::GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list)
+{
+  DistanceDecayLaw::GetParameterDescriptions(list);
+  AddParametersToList(_linearparameters, NUMBEROF(_linearparameters), list);
+}
+
+double LinearDecayLaw::GetLevel(double d) const
+{
+  double level;
+
+  if      (d <= start) level = 1.0;
+  else if (d >= end)   level = 0.0;
+  else                 level = (end - d) / (end - start);
+
+  return level;
+}
+
+/*----------------------------------------------------------------------------------------------------*/
+
+SELF_REGISTERING_PARAMETRIC_OBJECT(CurveDecayLaw, "curve");
+
+static const PARAMETERDESC _curveparameters[] =
+{
+  {"points", "Comma separated list of distance (m), level pairs in order of increasing distance"},
+};
+
+enum
+{
+  CurveParameter_points = 0,
+};
+
+CurveDecayLaw::CurveDecayLaw() : DistanceDecayLaw()
+{
+}
+
+CurveDecayLaw::CurveDecayLaw(const ParameterSet& parameters) : DistanceDecayLaw(parameters)
+{
+  SetParameters(parameters);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Add a point to the curve
+ *
+ * @note points must be added in order of increasing distance
+ */
+/*--------------------------------------------------------------------------------*/
+void CurveDecayLaw::AddPoint(double d, double level)
+{
+  if ((distances.size() == 0) || (d >= distances.back()))
+  {
+    distances.push_back(d);
+    levels.push_back(level);
+  }
+  else BBCERROR("Curve point distance %0.3lfm is less than previous distance %0.3lfm", d, distances.back());
+}
+
+void CurveDecayLaw::SetParameters(const ParameterSet& parameters)
+{
+  std::string str;
+
+  DistanceDecayLaw::SetParameters(parameters);
+  if (parameters.Get(_curveparameters[CurveParameter_points].name, str))
+  {
+    std::vector<std::string> list;
+    uint_t i, n;
+
+    SplitString(str, list, ',');
+    n = (uint_t)list.size();
+
+    distances.clear();
+    levels.clear();
+
+    if (!(n & 1))
+    {
+      for (i = 0; i < n; i += 2)
+      {
+        double d, level;
+
+        if (Evaluate(list[i], d) && Evaluate(list[i + 1], level)) AddPoint(d, level);
+        else
+        {
+          BBCERROR("Invalid curve point '%s', '%s'", list[i].c_str(), list[i + 1].c_str());
+          InvalidateObject();
+        }
+      }
+    }
+    else
+    {
+      BBCERROR("Curve points '%s' must be distance, level pairs", str.c_str());
+      InvalidateObject();
+    }
+  }
+}
+
+void CurveDecayLaw::GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list)
+{
+  DistanceDecayLaw::GetParameterDescriptions(list);
+  AddParametersToList(_curveparameters, NUMBEROF(_curveparameters), list);
+}
+
+double CurveDecayLaw::GetLevel(double d) const
+{
+  double level = 1.0;
+
+  if (distances.size() > 0)
+  {
+    // find first point beyond d
+    uint_t i = (uint_t)(std::upper_bound(distances.begin(), distances.end(), d) - distances.begin());
+
+    if      (i == 0)                        level = levels.front();
+    else if (i == distances.size())         level = levels.back();
+    else
+    {
+      double d0 = distances[i - 1], d1 = distances[i];
+      level = levels[i - 1] + (levels[i] - levels[i - 1]) * (d - d0) / (d1 - d0);
+    }
+  }
+
+  return level;
+}
+
+/*----------------------------------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------*/
+/** Registration function (ensures the decay law factories above are linked)
  */
 /*--------------------------------------------------------------------------------*/
-DistanceModel::DistanceModel() : decaypower(2.0),
-                                 speedofsound(340.0)
+void bbcat_register_DistanceModel()
 {
 }
 
+/*----------------------------------------------------------------------------------------------------*/
+
+DistanceModel::DistanceModel() : current(NULL),
+                                 epoch(0)
+{
+  PARAMETERS *params = new PARAMETERS;
+
+  readers[0] = readers[1] = 0;
+
+  params->decaypower       = 2.0;
+  params->speedofsound     = 340.0;
+  params->tablescale       = 0.0;
+  params->tablemaxdistance = 0.0;
+  params->tablesize        = 0;
+  params->law              = new ExponentialDecayLaw(params->decaypower);
+
+  ThreadLock lock(tlock);
+  Publish(params);
+}
+
+DistanceModel::~DistanceModel()
+{
+  delete current.load();
+}
+
 /*--------------------------------------------------------------------------------*/
-/** Return singleton instance of this object 
+/** Return process-wide default model
  */
 /*--------------------------------------------------------------------------------*/
 DistanceModel& DistanceModel::Get()
@@ -26,13 +346,102 @@ DistanceModel& DistanceModel::Get()
   return model;
 }
 
+/*--------------------------------------------------------------------------------*/
+/** Set decay power due to distance (==2 for inverse square law, set to 0 for no decay)
+ *
+ * @note this selects the exponential decay law (level = power ^ -d), the default
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::SetDecayPower(double power)
+{
+  ThreadLock lock(tlock);
+  PARAMETERS *params = CopyParameters();
+
+  params->decaypower = power;
+  params->law        = new ExponentialDecayLaw(power);
+
+  Publish(params);
+}
+
+double DistanceModel::GetDecayPower() const
+{
+  ParametersReader params(*this);
+  return params->decaypower;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set decay law
+ *
+ * @param law new law (ownership is taken, NULL selects the exponential law with the current decay power)
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::SetDecayLaw(DistanceDecayLaw *law)
+{
+  ThreadLock lock(tlock);
+  PARAMETERS *params = CopyParameters();
+
+  if (law) params->law = law;
+  else     params->law = new ExponentialDecayLaw(params->decaypower);
+
+  Publish(params);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set decay law by name (see DistanceDecayLaw::Create())
+ *
+ * @return false if the law is unknown
+ */
+/*--------------------------------------------------------------------------------*/
+bool DistanceModel::SetDecayLaw(const std::string& name, const ParameterSet& parameters)
+{
+  DistanceDecayLaw *law;
+  bool success = false;
+
+  if ((law = DistanceDecayLaw::Create(name, parameters)) != NULL)
+  {
+    if (law->IsObjectValid())
+    {
+      SetDecayLaw(law);
+      success = true;
+    }
+    else
+    {
+      BBCERROR("Failed to create distance decay law '%s'", name.c_str());
+      delete law;
+    }
+  }
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set speed of sound in m/s (set to 0 for no delay)
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::SetSpeedOfSound(double speed)
+{
+  ThreadLock lock(tlock);
+  PARAMETERS *params = CopyParameters();
+
+  params->speedofsound = speed;
+
+  Publish(params);
+}
+
+double DistanceModel::GetSpeedOfSound() const
+{
+  ParametersReader params(*this);
+  return params->speedofsound;
+}
+
 /*--------------------------------------------------------------------------------*/
 /** Get level due to distance
  */
 /*--------------------------------------------------------------------------------*/
 double DistanceModel::GetLevel(double d) const
 {
-  return pow(decaypower, -d);
+  ParametersReader params(*this);
+  return CalcLevel(*params, d);
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -41,7 +450,8 @@ double DistanceModel::GetLevel(double d) const
 /*--------------------------------------------------------------------------------*/
 double DistanceModel::GetDelay(double d, double delayscale) const
 {
-  return (speedofsound > 0.0) ? delayscale * d / speedofsound : 0.0;
+  ParametersReader params(*this);
+  return (params->speedofsound > 0.0) ? delayscale * d / params->speedofsound : 0.0;
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -50,8 +460,10 @@ double DistanceModel::GetDelay(double d, double delayscale) const
 /*--------------------------------------------------------------------------------*/
 void DistanceModel::GetLevelAndDelay(double d, double& level, double& delay, double delayscale) const
 {
-  level = GetLevel(d);
-  delay = GetDelay(d, delayscale);
+  ParametersReader params(*this);
+
+  level = CalcLevel(*params, d);
+  delay = (params->speedofsound > 0.0) ? delayscale * d / params->speedofsound : 0.0;
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -60,7 +472,7 @@ void DistanceModel::GetLevelAndDelay(double d, double& level, double& delay, dou
 /*--------------------------------------------------------------------------------*/
 double DistanceModel::GetLevel(const Position& pos) const
 {
-  return GetLevel(pos.Polar().pos.d);
+  return GetLevel(pos.Mod());
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -69,7 +481,7 @@ double DistanceModel::GetLevel(const Position& pos) const
 /*--------------------------------------------------------------------------------*/
 double DistanceModel::GetDelay(const Position& pos, double delayscale) const
 {
-  return GetDelay(pos.Polar().pos.d, delayscale);
+  return GetDelay(pos.Mod(), delayscale);
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -78,7 +490,188 @@ double DistanceModel::GetDelay(const Position& pos, double delayscale) const
 /*--------------------------------------------------------------------------------*/
 void DistanceModel::GetLevelAndDelay(const Position& pos, double& level, double& delay, double delayscale) const
 {
-  GetLevelAndDelay(pos.Polar().pos.d, level, delay, delayscale);
+  GetLevelAndDelay(pos.Mod(), level, delay, delayscale);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Get levels and delays for an array of distances
+ *
+ * @param d array of n distances
+ * @param levels array to receive n levels (or NULL)
+ * @param delays array to receive n delays (or NULL)
+ * @param n number of distances
+ * @param delayscale delay scaling (1 for seconds or samplerate for samples)
+ *
+ * @note levels or delays may be the same array as d (but not the same as each other)
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::GetLevelsAndDelays(const double *d, double *levels, double *delays, uint_t n, double delayscale) const
+{
+  ParametersReader params(*this);
+  double scale = (params->speedofsound > 0.0) ? delayscale / params->speedofsound : 0.0;
+  double buf[CHUNK_SIZE];
+  uint_t i, j;
+
+  for (i = 0; i < n;)
+  {
+    uint_t nchunk = std::min(n - i, (uint_t)CHUNK_SIZE);
+
+    // take a copy of the distances to allow levels or delays to overwrite them
+    std::copy(d + i, d + i + nchunk, buf);
+
+    if (delays) for (j = 0; j < nchunk; j++) delays[i + j] = scale * buf[j];
+    if (levels) CalcLevels(*params, buf, levels + i, nchunk);
+
+    i += nchunk;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Get levels and delays for arrays of cartesian co-ordinates
+ *
+ * @param x, y, z arrays of n co-ordinates
+ * @param levels array to receive n levels (or NULL)
+ * @param delays array to receive n delays (or NULL)
+ * @param n number of positions
+ * @param delayscale delay scaling (1 for seconds or samplerate for samples)
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::GetLevelsAndDelays(const double *x, const double *y, const double *z, double *levels, double *delays, uint_t n, double delayscale) const
+{
+  ParametersReader params(*this);
+  double scale = (params->speedofsound > 0.0) ? delayscale / params->speedofsound : 0.0;
+  double d[CHUNK_SIZE];
+  uint_t i, j;
+
+  for (i = 0; i < n;)
+  {
+    uint_t nchunk = std::min(n - i, (uint_t)CHUNK_SIZE);
+
+    // only the distance is needed so no need for a polar conversion
+    for (j = 0; j < nchunk; j++) d[j] = sqrt(x[i + j] * x[i + j] + y[i + j] * y[i + j] + z[i + j] * z[i + j]);
+
+    if (delays) for (j = 0; j < nchunk; j++) delays[i + j] = scale * d[j];
+    if (levels) CalcLevels(*params, d, levels + i, nchunk);
+
+    i += nchunk;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Get levels and delays for a block of (polar or cartesian) positions
+ *
+ * @param positions block of positions
+ * @param levels array to receive positions.GetCount() levels (or NULL)
+ * @param delays array to receive positions.GetCount() delays (or NULL)
+ * @param delayscale delay scaling (1 for seconds or samplerate for samples)
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::GetLevelsAndDelays(const PositionBlock& positions, double *levels, double *delays, double delayscale) const
+{
+  if (positions.IsPolar()) GetLevelsAndDelays(positions.GetD(), levels, delays, positions.GetCount(), delayscale);
+  else                     GetLevelsAndDelays(positions.GetX(), positions.GetY(), positions.GetZ(), levels, delays, positions.GetCount(), delayscale);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Enable/disable use of an interpolated table for level calculations
+ *
+ * @param enable true to use a table
+ * @param maxdistance maximum distance covered by the table (levels for distances outside the
+ * table range are calculated exactly)
+ * @param size number of table entries
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::EnableLevelTable(bool enable, double maxdistance, uint_t size)
+{
+  ThreadLock lock(tlock);
+  PARAMETERS *params = CopyParameters();
+
+  if (enable && (maxdistance > 0.0) && (size >= 2))
+  {
+    params->tablemaxdistance = maxdistance;
+    params->tablesize        = size;
+  }
+  else
+  {
+    if (enable) BBCERROR("Invalid distance model level table (max distance %0.3lfm, %u entries)", maxdistance, size);
+    params->tablemaxdistance = 0.0;
+    params->tablesize        = 0;
+  }
+
+  Publish(params);
+}
+
+bool DistanceModel::LevelTableEnabled() const
+{
+  ParametersReader params(*this);
+  return (params->leveltable.size() > 0);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Update derived values, publish parameters and delete the previous parameters once no longer in use
+ *
+ * @note tlock MUST be locked
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::Publish(PARAMETERS *params)
+{
+  PARAMETERS *oldparams;
+  uint_t i;
+
+  // (re-)calculate level table
+  params->leveltable.resize(params->tablesize);
+  if (params->tablesize > 0)
+  {
+    params->tablescale = (double)(params->tablesize - 1) / params->tablemaxdistance;
+    for (i = 0; i < params->tablesize; i++) params->leveltable[i] = CalcLevel(*params, (double)i / params->tablescale);
+  }
+  else params->tablescale = 0.0;
+
+  oldparams = current.exchange(params);
+
+  if (oldparams)
+  {
+    // any reader still using the old parameters registered before the exchange above so advancing
+    // the epoch twice and waiting for each previous epoch's readers to finish guarantees that
+    // no reader has the old parameters
+    for (i = 0; i < 2; i++)
+    {
+      uint_t slot = epoch++ & 1;
+      while (readers[slot].load() > 0) std::this_thread::yield();
+    }
+
+    delete oldparams;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate levels for an array of distances
+ */
+/*--------------------------------------------------------------------------------*/
+void DistanceModel::CalcLevels(const PARAMETERS& params, const double *d, double *levels, uint_t n)
+{
+  uint_t i;
+
+  if (params.leveltable.size() > 0)
+  {
+    const double maxindex = (double)(params.leveltable.size() - 1);
+    const double *table   = &params.leveltable[0];
+
+    for (i = 0; i < n; i++)
+    {
+      double x = d[i] * params.tablescale;
+
+      if ((x >= 0.0) && (x < maxindex))
+      {
+        uint_t index = (uint_t)x;
+        double frac  = x - (double)index;
+
+        levels[i] = table[index] + frac * (table[index + 1] - table[index]);
+      }
+      else levels[i] = CalcLevel(params, d[i]);
+    }
+  }
+  else params.law.Obj()->GetLevels(d, levels, n);
 }
 
 BBC_AUDIOTOOLBOX_END
@@ -1,37 +1,223 @@
 #ifndef __DISTANCE_MODEL__
 #define __DISTANCE_MODEL__
 
-#include "3DPosition.h"
+#include <vector>
+#include <atomic>
+
+#include "PositionBlock.h"
+#include "SelfRegisteringParametricObject.h"
+#include "RefCount.h"
+#include "ThreadLock.h"
 
 BBC_AUDIOTOOLBOX_START
 
 /*--------------------------------------------------------------------------------*/
-/** A simple singleton to handle time and level calculation based on distance
+/** Base class for laws giving level (gain) against distance
+ *
+ * Laws are self-registering parametric objects so can be created by name (see Create())
+ *
+ * @note once a law has been passed to a DistanceModel it is shared between (and read by) any
+ * number of threads so it must not be changed
+ */
+/*--------------------------------------------------------------------------------*/
+class DistanceDecayLaw : public SelfRegisteringParametricObject, public RefCountedObject
+{
+public:
+  DistanceDecayLaw() : SelfRegisteringParametricObject(),
+                       RefCountedObject() {}
+  DistanceDecayLaw(const ParameterSet& parameters) : SelfRegisteringParametricObject(parameters),
+                                                     RefCountedObject() {}
+  virtual ~DistanceDecayLaw() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Create a decay law by name (e.g. "exponential", "inversesquare", "linear" or "curve")
+   *
+   * @return new law or NULL if the name is unknown
+   */
+  /*--------------------------------------------------------------------------------*/
+  static DistanceDecayLaw *Create(const std::string& name, const ParameterSet& parameters = ParameterSet());
+
+  /*--------------------------------------------------------------------------------*/
+  /** Get level due to distance
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual double GetLevel(double d) const = 0;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Get levels for an array of distances (override for efficiency)
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual void   GetLevels(const double *d, double *levels, uint_t n) const;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Exponential decay: level = power ^ -d (the original DistanceModel law)
+ *
+ * Parameters:
+ *   power: decay power (default 2, 1 for no decay)
+ */
+/*--------------------------------------------------------------------------------*/
+class ExponentialDecayLaw : public DistanceDecayLaw
+{
+public:
+  ExponentialDecayLaw(double _power = 2.0);
+  ExponentialDecayLaw(const ParameterSet& parameters);
+  virtual ~ExponentialDecayLaw() {}
+
+  double GetPower() const {return power;}
+
+  virtual void SetParameters(const ParameterSet& parameters);
+  static void GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list);
+
+  virtual double GetLevel(double d) const;
+  virtual void   GetLevels(const double *d, double *levels, uint_t n) const;
+
+protected:
+  void SetPower(double _power);
+
+protected:
+  double power;
+  double coeff;               // -log(power) such that level = exp(coeff * d)
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Inverse square law: level (amplitude) = reference / d, i.e. intensity falls with the square of distance
+ *
+ * Parameters:
+ *   reference: distance (m) at and within which the level is 1 (default 1)
+ */
+/*--------------------------------------------------------------------------------*/
+class InverseSquareDecayLaw : public DistanceDecayLaw
+{
+public:
+  InverseSquareDecayLaw(double _reference = 1.0);
+  InverseSquareDecayLaw(const ParameterSet& parameters);
+  virtual ~InverseSquareDecayLaw() {}
+
+  virtual void SetParameters(const ParameterSet& parameters);
+  static void GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list);
+
+  virtual double GetLevel(double d) const {return (d > reference) ? reference / d : 1.0;}
+
+protected:
+  double reference;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Linear law: level falls linearly from 1 to 0 between two distances (clamped outside)
+ *
+ * Parameters:
+ *   start: distance (m) at and within which the level is 1 (default 0)
+ *   end: distance (m) at and beyond which the level is 0 (default 100)
+ */
+/*--------------------------------------------------------------------------------*/
+class LinearDecayLaw : public DistanceDecayLaw
+{
+public:
+  LinearDecayLaw(double _start = 0.0, double _end = 100.0);
+  LinearDecayLaw(const ParameterSet& parameters);
+  virtual ~LinearDecayLaw() {}
+
+  virtual void SetParameters(const ParameterSet& parameters);
+  static void GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list);
+
+  virtual double GetLevel(double d) const;
+
+protected:
+  double start, end;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Custom curve: level is linearly interpolated between (distance, level) points (clamped outside)
+ *
+ * Parameters:
+ *   points: comma separated list of distance, level pairs in order of increasing distance
+ *           (e.g. "0,1,10,0.5,100,0"), default is a level of 1 at all distances
+ */
+/*--------------------------------------------------------------------------------*/
+class CurveDecayLaw : public DistanceDecayLaw
+{
+public:
+  CurveDecayLaw();
+  CurveDecayLaw(const ParameterSet& parameters);
+  virtual ~CurveDecayLaw() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Add a point to the curve
+   *
+   * @note points must be added in order of increasing distance
+   */
+  /*--------------------------------------------------------------------------------*/
+  void AddPoint(double d, double level);
+
+  virtual void SetParameters(const ParameterSet& parameters);
+  static void GetParameterDescriptions(std::vector<const PARAMETERDESC *>& list);
+
+  virtual double GetLevel(double d) const;
+
+protected:
+  std::vector<double> distances;
+  std::vector<double> levels;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Time and level calculation based on distance
  *
+ * Any number of models can be created (e.g. one per renderer), Get() returns a process-wide
+ * default model
+ *
+ * All parameters are held in an immutable snapshot which is replaced (atomically) when any
+ * parameter is changed, so all Get...() functions can be called from any number of (real-time)
+ * threads whilst parameters are being changed by another thread.  Readers never block or
+ * allocate memory; the Set...() and Enable...() functions may block (briefly) until any readers
+ * of the previous snapshot have finished with it, so should not be called from real-time threads
+ *
+ * Each call to a Get...() function sees a consistent set of parameters
  */
 /*--------------------------------------------------------------------------------*/
 class DistanceModel
 {
 public:
+  DistanceModel();
+  ~DistanceModel();
+
   /*--------------------------------------------------------------------------------*/
-  /** Return singleton instance of this object 
+  /** Return process-wide default model
    */
   /*--------------------------------------------------------------------------------*/
   static DistanceModel& Get();
 
   /*--------------------------------------------------------------------------------*/
   /** Set decay power due to distance (==2 for inverse square law, set to 0 for no decay)
+   *
+   * @note this selects the exponential decay law (level = power ^ -d), the default
    */
   /*--------------------------------------------------------------------------------*/
-  void SetDecayPower(double power)   {decaypower   = power;}
-  double GetDecayPower() const       {return decaypower;}
+  void SetDecayPower(double power);
+  double GetDecayPower() const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set decay law
+   *
+   * @param law new law (ownership is taken, NULL selects the exponential law with the current decay power)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetDecayLaw(DistanceDecayLaw *law);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set decay law by name (see DistanceDecayLaw::Create())
+   *
+   * @return false if the law is unknown
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool SetDecayLaw(const std::string& name, const ParameterSet& parameters = ParameterSet());
 
   /*--------------------------------------------------------------------------------*/
   /** Set speed of sound in m/s (set to 0 for no delay)
    */
   /*--------------------------------------------------------------------------------*/
-  void SetSpeedOfSound(double speed) {speedofsound = speed;}
-  double GetSpeedOfSound() const     {return speedofsound;}
+  void SetSpeedOfSound(double speed);
+  double GetSpeedOfSound() const;
 
   /*--------------------------------------------------------------------------------*/
   /** Get level due to distance
@@ -69,13 +255,142 @@ public:
   /*--------------------------------------------------------------------------------*/
   void   GetLevelAndDelay(const Position& pos, double& level, double& delay, double delayscale = 1.0) const;
 
+  /*--------------------------------------------------------------------------------*/
+  /** Get levels and delays for an array of distances
+   *
+   * @param d array of n distances
+   * @param levels array to receive n levels (or NULL)
+   * @param delays array to receive n delays (or NULL)
+   * @param n number of distances
+   * @param delayscale delay scaling (1 for seconds or samplerate for samples)
+   *
+   * @note levels or delays may be the same array as d (but not the same as each other)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void   GetLevelsAndDelays(const double *d, double *levels, double *delays, uint_t n, double delayscale = 1.0) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Get levels and delays for arrays of cartesian co-ordinates
+   *
+   * @param x, y, z arrays of n co-ordinates
+   * @param levels array to receive n levels (or NULL)
+   * @param delays array to receive n delays (or NULL)
+   * @param n number of positions
+   * @param delayscale delay scaling (1 for seconds or samplerate for samples)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void   GetLevelsAndDelays(const double *x, const double *y, const double *z, double *levels, double *delays, uint_t n, double delayscale = 1.0) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Get levels and delays for a block of (polar or cartesian) positions
+   *
+   * @param positions block of positions
+   * @param levels array to receive positions.GetCount() levels (or NULL)
+   * @param delays array to receive positions.GetCount() delays (or NULL)
+   * @param delayscale delay scaling (1 for seconds or samplerate for samples)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void   GetLevelsAndDelays(const PositionBlock& positions, double *levels, double *delays, double delayscale = 1.0) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Enable/disable use of an interpolated table for level calculations
+   *
+   * @param enable true to use a table
+   * @param maxdistance maximum distance covered by the table (levels for distances outside the
+   * table range are calculated exactly)
+   * @param size number of table entries
+   *
+   * The table is linearly interpolated, for the exponential law the relative error in level is
+   * approximately (log(decaypower) * maxdistance / size)^2 / 8 (e.g. < 4e-5 for the defaults and
+   * decay power 2)
+   *
+   * @note the table is only used by the block functions above
+   */
+  /*--------------------------------------------------------------------------------*/
+  void   EnableLevelTable(bool enable = true, double maxdistance = 100.0, uint_t size = 4096);
+  bool   LevelTableEnabled() const;
+
 protected:
-  DistanceModel();
-  ~DistanceModel() {}
+  /*--------------------------------------------------------------------------------*/
+  /** Immutable set of parameters
+   */
+  /*--------------------------------------------------------------------------------*/
+  typedef struct {
+    RefCount<DistanceDecayLaw> law;
+    double decaypower;                  // power used by exponential law (set via SetDecayPower())
+    double speedofsound;
+    double tablescale;                  // (table size - 1) / maximum distance of table
+    double tablemaxdistance;
+    uint_t tablesize;
+    std::vector<double> leveltable;     // level at distances 0..maxdistance (empty if disabled)
+  } PARAMETERS;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Access to the current parameters for the lifetime of this object
+   *
+   * Readers register in one of two counters (selected by the current epoch) before reading
+   * the parameters pointer and deregister afterwards.  Writers advance the epoch twice after
+   * publishing new parameters, each time waiting for the counter of the previous epoch to become
+   * zero, after which no reader can still have the old parameters
+   */
+  /*--------------------------------------------------------------------------------*/
+  class ParametersReader
+  {
+  public:
+    ParametersReader(const DistanceModel& _model) : model(_model),
+                                                    slot(model.epoch.load() & 1)
+    {
+      model.readers[slot]++;
+      params = model.current.load();
+    }
+    ~ParametersReader() {model.readers[slot]--;}
+
+    const PARAMETERS *operator -> () const {return params;}
+    const PARAMETERS& operator * () const {return *params;}
+
+  protected:
+    const DistanceModel& model;
+    const PARAMETERS     *params;
+    uint_t               slot;
+  };
+  friend class ParametersReader;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return copy of current parameters for modification
+   *
+   * @note tlock MUST be locked
+   */
+  /*--------------------------------------------------------------------------------*/
+  PARAMETERS *CopyParameters() const {return new PARAMETERS(*current.load());}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Update derived values, publish parameters and delete the previous parameters once no longer in use
+   *
+   * @note tlock MUST be locked
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Publish(PARAMETERS *params);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate level and levels using parameters
+   */
+  /*--------------------------------------------------------------------------------*/
+  static double CalcLevel(const PARAMETERS& params, double d) {return params.law.Obj()->GetLevel(d);}
+  static void   CalcLevels(const PARAMETERS& params, const double *d, double *levels, uint_t n);
+
+  // maximum number of positions processed at once by the block functions (distances are held on the stack)
+  enum {CHUNK_SIZE = 256};
 
 protected:
-  double decaypower;
-  double speedofsound;
+  ThreadLockObject                 tlock;      // serialises writers
+  std::atomic<PARAMETERS *>        current;
+  mutable std::atomic<uint_t>      epoch;
+  mutable std::atomic<uint_t>      readers[2];
+
+private:
+  // prevent copying
+  DistanceModel(const DistanceModel& obj);
+  DistanceModel& operator = (const DistanceModel& obj);
 };
 
 BBC_AUDIOTOOLBOX_END
@@ -4,6 +4,17 @@
 #include <string.h>
 #include <errno.h>
 
+#include "OSCompiler.h"
+
+#ifdef TARGET_OS_UNIXBSD
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef TARGET_OS_WINDOWS
+#include <io.h>
+#endif
+
 #define BBCDEBUG_LEVEL 2
 #include "EnhancedFile.h"
 
@@ -11,20 +22,23 @@ BBC_AUDIOTOOLBOX_START
 
 EnhancedFile::EnhancedFile() : RefCountedObject(),
                                fp(NULL),
-                               allowclose(false)
+                               allowclose(false),
+                               poshandle(NULL)
 {
 }
 
 EnhancedFile::EnhancedFile(const char *filename, const char *mode) : RefCountedObject(),
                                                                      fp(NULL),
-                                                                     allowclose(false)
+                                                                     allowclose(false),
+                                                                     poshandle(NULL)
 {
   fopen(filename, mode);
 }
 
 EnhancedFile::EnhancedFile(const EnhancedFile& obj) : RefCountedObject(),
                                                       fp(NULL),
-                                                      allowclose(false)
+                                                      allowclose(false),
+                                                      poshandle(NULL)
 {
   operator = (obj);
 }
@@ -92,6 +106,18 @@ bool EnhancedFile::fopen(const char *filename, const char *mode)
       success        = true;
     }
     else BBCERROR("Failed to open '%s' for '%s' (%s)", filename, mode, strerror(errno));
+
+#ifdef TARGET_OS_WINDOWS
+    // open a second handle to the same file for positional I/O (see preadv())
+    if (success)
+    {
+      HANDLE handle = ::ReOpenFile((HANDLE)::_get_osfhandle(::_fileno(fp)),
+                                   strpbrk(this->mode.c_str(), "wa+") ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                   FILE_FLAG_OVERLAPPED);
+      poshandle = (handle != INVALID_HANDLE_VALUE) ? handle : NULL;
+    }
+#endif
   }
 
   return success;
@@ -101,9 +127,13 @@ void EnhancedFile::fclose()
 {
   if (fp)
   {
+#ifdef TARGET_OS_WINDOWS
+    if (poshandle) ::CloseHandle((HANDLE)poshandle);
+#endif
     if (allowclose) ::fclose(fp);
     fp         = NULL;
     allowclose = false;
+    poshandle  = NULL;
 
     filename = "";
     mode     = "";
@@ -200,6 +230,160 @@ int EnhancedFile::readline(char *line, uint_t maxlen)
   return l;
 }
 
+/*--------------------------------------------------------------------------------*/
+/** Transfer niov parts of data to or from fp starting at offset, continuing after short
+ * transfers until everything is transferred or the end of the file is reached
+ *
+ * @return number of bytes transferred or -1 on error
+ */
+/*--------------------------------------------------------------------------------*/
+static sint64_t TransferAt(FILE *fp, void *poshandle, const FILEIOVEC *iov, uint_t niov, off_t offset, bool write)
+{
+  sint64_t total = 0;
+  size_t   skip  = 0;   // bytes of the first part already transferred
+
+  if (!fp)
+  {
+    errno = EBADF;
+    return -1;
+  }
+  if (offset < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+#ifdef TARGET_OS_WINDOWS
+  // transfers use a separate (overlapped) handle so that the position of the stdio handle is not changed
+  HANDLE handle = (HANDLE)poshandle;
+
+  if (!handle)
+  {
+    errno = EBADF;
+    return -1;
+  }
+#else
+  int    fd     = ::fileno(fp);
+
+  UNUSED_PARAMETER(poshandle);
+#endif
+
+  while (niov)
+  {
+    sint64_t res;
+
+    // skip parts (or what is left of them) already transferred
+    if (skip >= iov->bytes)
+    {
+      skip -= iov->bytes;
+      iov++;
+      niov--;
+      continue;
+    }
+
+#ifdef TARGET_OS_WINDOWS
+    OVERLAPPED ov;
+    DWORD      n   = 0;
+    uint64_t   pos = (uint64_t)offset + total;
+    DWORD      len = (DWORD)std::min(iov->bytes - skip, (size_t)0x40000000);
+    DWORD      error;
+    BOOL       success;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset     = (DWORD)pos;
+    ov.OffsetHigh = (DWORD)(pos >> 32);
+
+    // each transfer waits on its own event so that several threads can use the handle at once
+    if ((ov.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+
+    if (write) success = ::WriteFile(handle, (const uint8_t *)iov->data + skip, len, NULL, &ov);
+    else       success = ::ReadFile(handle, (uint8_t *)iov->data + skip, len, NULL, &ov);
+
+    // wait for the transfer to complete
+    if (success || (::GetLastError() == ERROR_IO_PENDING)) success = ::GetOverlappedResult(handle, &ov, &n, TRUE);
+    error = success ? 0 : ::GetLastError();
+    ::CloseHandle(ov.hEvent);
+
+    if (!success && (write || (error != ERROR_HANDLE_EOF)))
+    {
+      errno = EIO;
+      return -1;
+    }
+    res = n;
+#else
+#ifdef __linux__
+    // gather whole parts into single transfers (FILEIOVEC is not necessarily laid out as struct iovec)
+    if (!skip && (niov > 1))
+    {
+      struct iovec vec[64];
+      uint_t i, n = std::min(niov, (uint_t)NUMBEROF(vec));
+
+      for (i = 0; i < n; i++)
+      {
+        vec[i].iov_base = iov[i].data;
+        vec[i].iov_len  = iov[i].bytes;
+      }
+
+      if (write) res = ::pwritev(fd, vec, (int)n, offset + (off_t)total);
+      else       res = ::preadv(fd, vec, (int)n, offset + (off_t)total);
+    }
+    else
+#endif
+    if (write) res = ::pwrite(fd, (const uint8_t *)iov->data + skip, iov->bytes - skip, offset + (off_t)total);
+    else       res = ::pread(fd, (uint8_t *)iov->data + skip, iov->bytes - skip, offset + (off_t)total);
+
+    if (res < 0)
+    {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+#endif
+
+    // end of file
+    if (!res) break;
+
+    total += res;
+    skip  += (size_t)res;
+  }
+
+  return total;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read or write at an explicit offset without using or changing the file position
+ *
+ * @param ptr/iov data (or list of niov parts of data to be transferred in order)
+ * @param offset offset within the file
+ *
+ * @return number of bytes transferred (fewer than requested only at the end of the file) or -1 on error
+ */
+/*--------------------------------------------------------------------------------*/
+sint64_t EnhancedFile::pread(void *ptr, size_t bytes, off_t offset)
+{
+  FILEIOVEC iov = {ptr, bytes};
+  return preadv(&iov, 1, offset);
+}
+
+sint64_t EnhancedFile::pwrite(const void *ptr, size_t bytes, off_t offset)
+{
+  FILEIOVEC iov = {(void *)ptr, bytes};
+  return pwritev(&iov, 1, offset);
+}
+
+sint64_t EnhancedFile::preadv(const FILEIOVEC *iov, uint_t niov, off_t offset)
+{
+  return TransferAt(fp, poshandle, iov, niov, offset, false);
+}
+
+sint64_t EnhancedFile::pwritev(const FILEIOVEC *iov, uint_t niov, off_t offset)
+{
+  return TransferAt(fp, poshandle, iov, niov, offset, true);
+}
+
 /*--------------------------------------------------------------------------------*/
 /** Return whether a file exists
  */
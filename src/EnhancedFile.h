@@ -14,6 +14,15 @@ BBC_AUDIOTOOLBOX_START
 typedef sint64_t off_t;
 #endif
 
+/*--------------------------------------------------------------------------------*/
+/** Part of a scatter/gather transfer (see EnhancedFile::preadv() and EnhancedFile::pwritev())
+ */
+/*--------------------------------------------------------------------------------*/
+typedef struct {
+  void   *data;
+  size_t bytes;
+} FILEIOVEC;
+
 /*--------------------------------------------------------------------------------*/
 /** Class mimicking FILE functions but which keeps the filename and open mode allowing duplication 
  */
@@ -71,7 +80,30 @@ public:
    * @return number of chracters in buffer (excluding terminator), EOF on end of file (with no characters stored)
    */
   /*--------------------------------------------------------------------------------*/
-  int readline(char *line, uint_t maxlen);
+  virtual int readline(char *line, uint_t maxlen);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Read or write at an explicit offset without using or changing the file position
+   *
+   * @param ptr/iov data (or list of niov parts of data to be transferred in order)
+   * @param offset offset within the file
+   *
+   * @return number of bytes transferred (fewer than requested only at the end of the file) or -1 on error
+   *
+   * These bypass stdio (and any buffering in derived classes) and can be called from several threads
+   * at once on the same open file (but not at the same time as fopen() or fclose())
+   *
+   * @note data buffered by fwrite() is not seen until fflush() is called and data written here
+   * may not be seen by fread() if it has already buffered that part of the file
+   * @note on Linux, files opened for appending ('a') are always written at the end
+   * @note on Windows, these use a second handle to the file (opened by fopen()) so that the
+   * position of the stdio handle is not changed, they fail if it could not be opened (e.g. consoles)
+   */
+  /*--------------------------------------------------------------------------------*/
+  sint64_t         pread(void *ptr, size_t bytes, off_t offset);
+  sint64_t         pwrite(const void *ptr, size_t bytes, off_t offset);
+  virtual sint64_t preadv(const FILEIOVEC *iov, uint_t niov, off_t offset);
+  virtual sint64_t pwritev(const FILEIOVEC *iov, uint_t niov, off_t offset);
 
   const std::string& getfilename() const {return filename;}
 
@@ -92,6 +124,7 @@ protected:
   std::string mode;
   FILE        *fp;
   bool        allowclose;
+  void        *poshandle;       // Windows only: separate handle for positional I/O
 };
 
 BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,8 @@
+
+#include "FastTrig.h"
+
+BBC_AUDIOTOOLBOX_START
+
+bool FastTrig::enabled = false;
+
+BBC_AUDIOTOOLBOX_END
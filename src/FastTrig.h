@@ -0,0 +1,104 @@
+#ifndef __FAST_TRIG__
+#define __FAST_TRIG__
+
+#include <math.h>
+
+#include "misc.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Fast approximate trigonometry (angles in degrees)
+ *
+ * Low order polynomial approximations for use where libm accuracy is not required (e.g. panning)
+ *
+ * sin()/cos():         range reduction to +/- 45 degrees and 7th/8th order Taylor polynomials
+ *                      (error < 3.2e-7, equivalent to < 2e-5 degrees)
+ * atan2()/asin()/acos(): reduction to atan() of 0..1 and the Abramowitz & Stegun 4.4.49
+ *                      polynomial (error < 4e-8 radians, equivalent to < 2.5e-6 degrees)
+ *
+ * Position::Polar(), Position::Cart(), Angle() and Quaternion::SetFromAngleAxis() use these
+ * when enabled with FastTrig::Enable(), in which case angles are within FASTTRIG_MAX_ERROR
+ * degrees of the exact (libm) versions
+ */
+/*--------------------------------------------------------------------------------*/
+
+#define FASTTRIG_MAX_ERROR 1.0e-4       // maximum error (in degrees) of any angle or direction
+
+class FastTrig
+{
+public:
+  /*--------------------------------------------------------------------------------*/
+  /** Enable/disable use of fast trig functions within the position classes
+   *
+   * @note this is *not* thread safe, call during initialisation only
+   */
+  /*--------------------------------------------------------------------------------*/
+  static void Enable(bool enable = true) {enabled = enable;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether the fast trig functions are enabled
+   */
+  /*--------------------------------------------------------------------------------*/
+  static bool Enabled() {return enabled;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate sin() and cos() of an angle in degrees
+   */
+  /*--------------------------------------------------------------------------------*/
+  static void SinCos(double angle, double& s, double& c)
+  {
+    // reduce to +/- 45 degrees around a multiple (j) of 90 degrees
+    double q  = angle * (1.0 / 90.0);
+    long   j  = (long)(q + ((q >= 0.0) ? 0.5 : -0.5));
+    double r  = (angle - (double)j * 90.0) * (M_PI / 180.0);
+    double z  = r * r;
+    double s0 = r * (1.0 + z * (-1.0 / 6.0 + z * (1.0 / 120.0 + z * (-1.0 / 5040.0))));
+    double c0 = 1.0 + z * (-0.5 + z * (1.0 / 24.0 + z * (-1.0 / 720.0 + z * (1.0 / 40320.0))));
+
+    switch (j & 3)
+    {
+      default:
+      case 0: s =  s0; c =  c0; break;
+      case 1: s =  c0; c = -s0; break;
+      case 2: s = -s0; c = -c0; break;
+      case 3: s = -c0; c =  s0; break;
+    }
+  }
+
+  static double Sin(double angle) {double s, c; SinCos(angle, s, c); return s;}
+  static double Cos(double angle) {double s, c; SinCos(angle, s, c); return c;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate atan2(y, x) in degrees
+   */
+  /*--------------------------------------------------------------------------------*/
+  static double Atan2(double y, double x)
+  {
+    double ax = fabs(x), ay = fabs(y);
+    double mx = (ax > ay) ? ax : ay, mn = (ax > ay) ? ay : ax;
+    double a  = (mx > 0.0) ? mn / mx : 0.0;
+    double z  = a * a;
+    double r  = a * (0.9999993329 + z * (-0.3332985605 + z * (0.1994653599 + z * (-0.1390853351 +
+                z * (0.0964200441 + z * (-0.0559098861 + z * (0.0218612288 + z * -0.0040540580))))))) * (180.0 / M_PI);
+
+    // expand to full circle
+    if (ay > ax) r = 90.0 - r;
+    if (x < 0.0) r = 180.0 - r;
+    return (y < 0.0) ? -r : r;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate asin() and acos() in degrees (argument is limited to -1..1)
+   */
+  /*--------------------------------------------------------------------------------*/
+  static double Asin(double x) {x = limited::limit(x, -1.0, 1.0); return Atan2(x, sqrt(1.0 - x * x));}
+  static double Acos(double x) {x = limited::limit(x, -1.0, 1.0); return Atan2(sqrt(1.0 - x * x), x);}
+
+protected:
+  static bool enabled;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
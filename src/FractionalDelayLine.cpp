@@ -0,0 +1,588 @@
+
+#include <math.h>
+
+#include <algorithm>
+
+#define BBCDEBUG_LEVEL 1
+#include "FractionalDelayLine.h"
+
+#if defined(COMPILER_GCC) && (defined(__x86_64__) || defined(__i386__))
+#define FRACTIONALDELAYLINE_X86
+#include <immintrin.h>
+#endif
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Scalar versions of the interpolation kernels
+ */
+/*--------------------------------------------------------------------------------*/
+static void ScalarInterpolate2(const float *src, float c0, float c1, float *dst, uint_t n)
+{
+  uint_t i;
+
+  for (i = 0; i < n; i++) dst[i] = src[i] * c0 + src[i + 1] * c1;
+}
+
+static void ScalarInterpolate4(const float *src, const float *c, float *dst, uint_t n)
+{
+  uint_t i;
+
+  for (i = 0; i < n; i++) dst[i] = (src[i] * c[0] + src[i + 2] * c[2]) + (src[i + 1] * c[1] + src[i + 3] * c[3]);
+}
+
+#ifdef FRACTIONALDELAYLINE_X86
+/*--------------------------------------------------------------------------------*/
+/** SSE versions
+ */
+/*--------------------------------------------------------------------------------*/
+namespace sse
+{
+  struct OPS
+  {
+    typedef __m128 V;
+    enum {N = 4};
+    static inline V    load(const float *p)     {return _mm_loadu_ps(p);}
+    static inline void store(float *p, V a)     {_mm_storeu_ps(p, a);}
+    static inline V    set1(float a)            {return _mm_set1_ps(a);}
+    static inline V    add(V a, V b)            {return _mm_add_ps(a, b);}
+    static inline V    mul(V a, V b)            {return _mm_mul_ps(a, b);}
+    static inline V    madd(V a, V b, V c)      {return _mm_add_ps(_mm_mul_ps(a, b), c);}
+  };
+
+#include "FractionalDelayLineSIMD.h"
+}
+
+/*--------------------------------------------------------------------------------*/
+/** AVX2/FMA versions, compiled for AVX2 regardless of build flags and only used if the processor supports it
+ */
+/*--------------------------------------------------------------------------------*/
+#ifdef __clang__
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+namespace avx2
+{
+  struct OPS
+  {
+    typedef __m256 V;
+    enum {N = 8};
+    static inline V    load(const float *p)     {return _mm256_loadu_ps(p);}
+    static inline void store(float *p, V a)     {_mm256_storeu_ps(p, a);}
+    static inline V    set1(float a)            {return _mm256_set1_ps(a);}
+    static inline V    add(V a, V b)            {return _mm256_add_ps(a, b);}
+    static inline V    mul(V a, V b)            {return _mm256_mul_ps(a, b);}
+    static inline V    madd(V a, V b, V c)      {return _mm256_fmadd_ps(a, b, c);}
+  };
+
+#include "FractionalDelayLineSIMD.h"
+}
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif
+
+/*--------------------------------------------------------------------------------*/
+/** Return best kernel type for this processor
+ */
+/*--------------------------------------------------------------------------------*/
+static uint_t GetBestDelayLineKernels()
+{
+  uint_t type;
+
+  if      (FractionalDelayLine::KernelsAvailable(FractionalDelayLine::KERNELS_AVX2)) type = FractionalDelayLine::KERNELS_AVX2;
+  else if (FractionalDelayLine::KernelsAvailable(FractionalDelayLine::KERNELS_SSE2)) type = FractionalDelayLine::KERNELS_SSE2;
+  else type = FractionalDelayLine::KERNELS_SCALAR;
+
+  BBCDEBUG2(("Using fractional delay line kernel type %u", type));
+
+  return type;
+}
+
+static uint_t& CurrentDelayLineKernels()
+{
+  static uint_t type = GetBestDelayLineKernels();
+  return type;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Dispatch interpolation kernels
+ */
+/*--------------------------------------------------------------------------------*/
+static void Interpolate2(const float *src, float c0, float c1, float *dst, uint_t n)
+{
+  uint_t i = 0;
+
+  switch (CurrentDelayLineKernels())
+  {
+#ifdef FRACTIONALDELAYLINE_X86
+    case FractionalDelayLine::KERNELS_AVX2:
+      i = avx2::Interpolate2(src, c0, c1, dst, n);
+      break;
+
+    case FractionalDelayLine::KERNELS_SSE2:
+      i = sse::Interpolate2(src, c0, c1, dst, n);
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  // remainder
+  ScalarInterpolate2(src + i, c0, c1, dst + i, n - i);
+}
+
+static void Interpolate4(const float *src, const float *c, float *dst, uint_t n)
+{
+  uint_t i = 0;
+
+  switch (CurrentDelayLineKernels())
+  {
+#ifdef FRACTIONALDELAYLINE_X86
+    case FractionalDelayLine::KERNELS_AVX2:
+      i = avx2::Interpolate4(src, c, dst, n);
+      break;
+
+    case FractionalDelayLine::KERNELS_SSE2:
+      i = sse::Interpolate4(src, c, dst, n);
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  // remainder
+  ScalarInterpolate4(src + i, c, dst + i, n - i);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate 3rd order Lagrange coefficients for fraction f (0 <= f < 1)
+ *
+ * Coefficients are for samples x[n - M - 2], x[n - M - 1], x[n - M] and x[n - M + 1] (in that order)
+ * for a delay of M + f samples
+ */
+/*--------------------------------------------------------------------------------*/
+static inline void CalcCubicCoeffs(double f, float *c)
+{
+  double fm1 = f - 1.0, fm2 = f - 2.0, fp1 = f + 1.0;
+
+  c[0] = (float)( fp1 * f   * fm1 / 6.0);
+  c[1] = (float)(-fp1 * f   * fm2 * .5);
+  c[2] = (float)( fp1 * fm1 * fm2 * .5);
+  c[3] = (float)(-f   * fm1 * fm2 / 6.0);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate Thiran allpass integer delay M and coefficient for a delay (>= 0.5 samples)
+ *
+ * The allpass provides a delay of d = delay - M, where 0.5 <= d < 1.5 (the range in
+ * which a 1st order Thiran allpass is well behaved)
+ */
+/*--------------------------------------------------------------------------------*/
+static inline float CalcThiranCoeff(double delay, uint_t& M)
+{
+  double d;
+
+  M = (uint_t)(delay - .5);
+  d = delay - (double)M;
+
+  return (float)((1.0 - d) / (1.0 + d));
+}
+
+FractionalDelayLine::FractionalDelayLine(uint_t _channels, uint_t _maxdelay, uint_t _interpolation) : maxdelay(0),
+                                                                                                      historylength(0),
+                                                                                                      historymask(0),
+                                                                                                      writepos(0),
+                                                                                                      interpolation(INTERPOLATION_LINEAR),
+                                                                                                      ramplength(0)
+{
+  SetInterpolation(_interpolation);
+  Configure(_channels, _maxdelay);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set number of channels and maximum delay (in samples)
+ *
+ * @note this resets the delay line (history is cleared and all delays are set to the minimum)
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::Configure(uint_t _channels, uint_t _maxdelay)
+{
+  uint_t i;
+
+  maxdelay = _maxdelay;
+
+  // history must hold the oldest sample required at the maximum delay (plus interpolation
+  // neighbours) *after* a chunk has been written, use a power of 2 for cheap wrapping
+  historylength = 1;
+  while (historylength < (maxdelay + CHUNK_SIZE + 4)) historylength <<= 1;
+  historymask = historylength - 1;
+
+  BBCDEBUG2(("Fractional delay line of %u channels, max delay %u samples, history %u samples", _channels, maxdelay, historylength));
+
+  channelstates.resize(_channels);
+  for (i = 0; i < _channels; i++)
+  {
+    CHANNELSTATE& state = channelstates[i];
+
+    state.delay = state.target = state.step = 0.0;
+    state.rampcount = 0;
+    state.allpassstate = 0.f;
+  }
+
+  // each channel's history is stored twice (see class description)
+  history.clear();
+  history.resize(_channels * 2 * historylength);
+
+  writepos = 0;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set interpolation type (one of INTERPOLATION_* above)
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::SetInterpolation(uint_t type)
+{
+  if (type <= INTERPOLATION_THIRAN)
+  {
+    uint_t i;
+
+    interpolation = type;
+
+    // allpass state is meaningless for a different interpolation
+    for (i = 0; i < channelstates.size(); i++) channelstates[i].allpassstate = 0.f;
+  }
+  else BBCERROR("Invalid fractional delay line interpolation type %u", type);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return minimum delay (in samples) of the current interpolation type
+ */
+/*--------------------------------------------------------------------------------*/
+double FractionalDelayLine::GetMinDelay() const
+{
+  static const double mindelays[] = {0.0, 1.0, .5};
+  return std::min(mindelays[interpolation], (double)maxdelay);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set delay of a channel
+ *
+ * @param channel channel index
+ * @param delay delay in samples (limited to the range GetMinDelay() .. GetMaxDelay())
+ * @param immediate true to jump to the new delay, false to ramp to it (see SetRampLength())
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::SetDelay(uint_t channel, double delay, bool immediate)
+{
+  if (channel < GetChannels())
+  {
+    CHANNELSTATE& state = channelstates[channel];
+
+    // the minimum delay is applied during processing since it depends on the interpolation type
+    state.target = limited::limit(delay, 0.0, (double)maxdelay);
+
+    if (immediate || !ramplength || (state.target == state.delay))
+    {
+      state.delay     = state.target;
+      state.step      = 0.0;
+      state.rampcount = 0;
+    }
+    else
+    {
+      // ramp from the current delay (which may be part-way through a previous ramp)
+      state.step      = (state.target - state.delay) / (double)ramplength;
+      state.rampcount = ramplength;
+    }
+  }
+  else BBCERROR("Channel %u out of range (%u channels)", channel, GetChannels());
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set delays of all channels
+ *
+ * @param delays array of GetChannels() delays in samples (e.g. from DistanceModel::GetLevelsAndDelays())
+ * @param immediate true to jump to the new delays, false to ramp to them (see SetRampLength())
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::SetDelays(const double *delays, bool immediate)
+{
+  uint_t i;
+
+  for (i = 0; i < GetChannels(); i++) SetDelay(i, delays[i], immediate);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return current delay of a channel (which may be part-way through a ramp)
+ */
+/*--------------------------------------------------------------------------------*/
+double FractionalDelayLine::GetDelay(uint_t channel) const
+{
+  return (channel < GetChannels()) ? channelstates[channel].delay : 0.0;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return target delay of a channel (the delay at the end of any ramp)
+ */
+/*--------------------------------------------------------------------------------*/
+double FractionalDelayLine::GetTargetDelay(uint_t channel) const
+{
+  return (channel < GetChannels()) ? channelstates[channel].target : 0.0;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Clear history (delays are unchanged)
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::Reset()
+{
+  uint_t i;
+
+  std::fill(history.begin(), history.end(), 0.f);
+  for (i = 0; i < channelstates.size(); i++) channelstates[i].allpassstate = 0.f;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Delay interleaved audio
+ *
+ * @param src interleaved input of nframes frames of GetChannels() channels
+ * @param dst interleaved output of nframes frames of GetChannels() channels
+ * @param nframes number of frames
+ *
+ * @note src and dst may be the same (for in-place processing) but must not partially overlap
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::Process(const Sample_t *src, Sample_t *dst, uint_t nframes)
+{
+  const uint_t nchannels = GetChannels();
+  float  output[CHUNK_SIZE];
+  uint_t i, j, k;
+
+  for (i = 0; i < nframes;)
+  {
+    uint_t nchunk = std::min(nframes - i, (uint_t)CHUNK_SIZE);
+
+    // write entire chunk of input into history before generating any output to allow in-place processing
+    for (j = 0; j < nchannels; j++)
+    {
+      float         *hist = &history[j * 2 * historylength];
+      const Sample_t *p   = src + i * nchannels + j;
+
+      for (k = 0; k < nchunk; k++, p += nchannels)
+      {
+        uint_t pos = (writepos + k) & historymask;
+        hist[pos] = hist[pos + historylength] = *p;
+      }
+    }
+
+    for (j = 0; j < nchannels; j++)
+    {
+      Sample_t *p = dst + i * nchannels + j;
+
+      ProcessChannel(j, writepos, output, nchunk);
+
+      for (k = 0; k < nchunk; k++, p += nchannels) *p = output[k];
+    }
+
+    writepos = (writepos + nchunk) & historymask;
+    i       += nchunk;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Generate nframes samples of delayed output for a single channel
+ *
+ * @param channel channel index
+ * @param pos buffer index of the first sample to be output
+ * @param dst output array
+ * @param n number of samples (<= CHUNK_SIZE)
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::ProcessChannel(uint_t channel, uint_t pos, float *dst, uint_t n)
+{
+  const float  *hist  = &history[channel * 2 * historylength];
+  CHANNELSTATE& state = channelstates[channel];
+  uint_t i = 0;
+
+  if (state.rampcount)
+  {
+    i = std::min(n, state.rampcount);
+    ProcessRamp(hist, state, pos, dst, i);
+  }
+
+  if (i < n) ProcessConstant(hist, state, state.delay, (pos + i) & historymask, dst + i, n - i);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Generate output at a constant delay
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::ProcessConstant(const float *hist, CHANNELSTATE& state, double delay, uint_t pos, float *dst, uint_t n) const
+{
+  uint_t M, i;
+
+  delay = limited::limit(delay, GetMinDelay(), (double)maxdelay);
+
+  switch (interpolation)
+  {
+    default:
+    case INTERPOLATION_LINEAR:
+    {
+      M = (uint_t)delay;
+      float f = (float)(delay - (double)M);
+
+      // src[0] = x[n - M - 1], src[1] = x[n - M]
+      Interpolate2(hist + ((pos + historylength - M - 1) & historymask), f, 1.f - f, dst, n);
+      break;
+    }
+
+    case INTERPOLATION_CUBIC:
+    {
+      float c[4];
+
+      M = (uint_t)delay;
+      CalcCubicCoeffs(delay - (double)M, c);
+
+      // src[0] = x[n - M - 2] ... src[3] = x[n - M + 1]
+      Interpolate4(hist + ((pos + historylength - M - 2) & historymask), c, dst, n);
+      break;
+    }
+
+    case INTERPOLATION_THIRAN:
+    {
+      float a = CalcThiranCoeff(delay, M);
+      float y = state.allpassstate;
+
+      // src[i] = x[n - M - 1], src[i + 1] = x[n - M]
+      const float *src = hist + ((pos + historylength - M - 1) & historymask);
+
+      // recursive so cannot be vectorised
+      for (i = 0; i < n; i++) dst[i] = y = a * (src[i + 1] - y) + src[i];
+
+      state.allpassstate = y;
+      break;
+    }
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Generate output whilst ramping the delay (and update state)
+ */
+/*--------------------------------------------------------------------------------*/
+void FractionalDelayLine::ProcessRamp(const float *hist, CHANNELSTATE& state, uint_t pos, float *dst, uint_t n) const
+{
+  const double mindelay = GetMinDelay();
+  uint_t i, M;
+
+  for (i = 0; i < n; i++)
+  {
+    double delay = limited::limit(state.delay, mindelay, (double)maxdelay);
+
+    switch (interpolation)
+    {
+      default:
+      case INTERPOLATION_LINEAR:
+      {
+        M = (uint_t)delay;
+        float f = (float)(delay - (double)M);
+
+        ScalarInterpolate2(hist + ((pos + i + historylength - M - 1) & historymask), f, 1.f - f, dst + i, 1);
+        break;
+      }
+
+      case INTERPOLATION_CUBIC:
+      {
+        float c[4];
+
+        M = (uint_t)delay;
+        CalcCubicCoeffs(delay - (double)M, c);
+
+        ScalarInterpolate4(hist + ((pos + i + historylength - M - 2) & historymask), c, dst + i, 1);
+        break;
+      }
+
+      case INTERPOLATION_THIRAN:
+      {
+        float a = CalcThiranCoeff(delay, M);
+        const float *src = hist + ((pos + i + historylength - M - 1) & historymask);
+
+        dst[i] = state.allpassstate = a * (src[1] - state.allpassstate) + src[0];
+        break;
+      }
+    }
+
+    // end ramp exactly on target
+    if (--state.rampcount) state.delay += state.step;
+    else                   state.delay  = state.target;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Select kernel type (normally only used for testing or benchmarking)
+ *
+ * @param type one of KERNELS_*
+ *
+ * @return true if the kernel type is available on this processor
+ */
+/*--------------------------------------------------------------------------------*/
+bool FractionalDelayLine::SetKernels(uint_t type)
+{
+  bool success = false;
+
+  if (type == KERNELS_AUTO)
+  {
+    CurrentDelayLineKernels() = GetBestDelayLineKernels();
+    success = true;
+  }
+  else if (KernelsAvailable(type))
+  {
+    CurrentDelayLineKernels() = type;
+    success = true;
+  }
+  else BBCERROR("Fractional delay line kernel type %u not available", type);
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return whether kernel type (one of KERNELS_*) is available on this processor
+ */
+/*--------------------------------------------------------------------------------*/
+bool FractionalDelayLine::KernelsAvailable(uint_t type)
+{
+  bool available = false;
+
+  switch (type)
+  {
+    case KERNELS_AUTO:
+    case KERNELS_SCALAR:
+      available = true;
+      break;
+
+#ifdef FRACTIONALDELAYLINE_X86
+    case KERNELS_SSE2:
+      available = (__builtin_cpu_supports("sse2") != 0);
+      break;
+
+    case KERNELS_AVX2:
+      available = ((__builtin_cpu_supports("avx2") != 0) && (__builtin_cpu_supports("fma") != 0));
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  return available;
+}
+
+BBC_AUDIOTOOLBOX_END
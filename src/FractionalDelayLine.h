@@ -0,0 +1,228 @@
+#ifndef __FRACTIONAL_DELAY_LINE__
+#define __FRACTIONAL_DELAY_LINE__
+
+#include <vector>
+#include <type_traits>
+
+#include "misc.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Multi-channel fractional delay line operating on interleaved Sample_t buffers
+ *
+ * Each channel has its own delay (in samples, which can be fractional) so delays calculated by
+ * DistanceModel::GetLevelsAndDelays() with delayscale = sample rate can be applied directly
+ * using SetDelays()
+ *
+ * Interpolation types:
+ *   Linear: 2-point linear interpolation (minimum delay 0 samples)
+ *   Cubic:  4-point (3rd order) Lagrange interpolation (minimum delay 1 sample)
+ *   Thiran: 1st order Thiran allpass interpolation (minimum delay 0.5 samples), flat magnitude
+ *           response but the filter is recursive so it is best suited to constant or slowly
+ *           changing delays
+ *   Delays are limited to the range minimum delay .. maximum delay (set by Configure())
+ *
+ * Delay changes are smoothed by ramping linearly from the current delay to the new delay over
+ * a number of samples (see SetRampLength()), which avoids clicks at the expense of a (Doppler)
+ * pitch shift during the ramp
+ *
+ * The history of each channel is stored twice (in a buffer of twice the power-of-two history
+ * length) so that any window of samples is contiguous in memory and constant-delay linear and
+ * cubic interpolation become short FIR filters over contiguous samples; these are vectorised
+ * (SSE and AVX2/FMA, selected at run-time, see SetKernels()).  Ramping
+ * delays and Thiran interpolation are processed sample-by-sample
+ *
+ * @note this object is *not* thread safe: delays must be set from the processing thread
+ */
+/*--------------------------------------------------------------------------------*/
+class FractionalDelayLine
+{
+public:
+  // the history and the vectorised kernels are single precision
+  static_assert(std::is_same<Sample_t, float>::value, "FractionalDelayLine requires Sample_t to be float");
+
+  enum
+  {
+    INTERPOLATION_LINEAR = 0,
+    INTERPOLATION_CUBIC,
+    INTERPOLATION_THIRAN,
+  };
+
+  enum
+  {
+    KERNELS_AUTO = 0,         // best available for this processor
+    KERNELS_SCALAR,
+    KERNELS_SSE2,
+    KERNELS_AVX2,             // AVX2 and FMA
+  };
+
+  FractionalDelayLine(uint_t _channels = 0, uint_t _maxdelay = 0, uint_t _interpolation = INTERPOLATION_LINEAR);
+  ~FractionalDelayLine() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set number of channels and maximum delay (in samples)
+   *
+   * @note this resets the delay line (history is cleared and all delays are set to the minimum)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Configure(uint_t _channels, uint_t _maxdelay);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of channels
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetChannels() const {return (uint_t)channelstates.size();}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return maximum delay (in samples)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetMaxDelay() const {return maxdelay;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set interpolation type (one of INTERPOLATION_* above)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetInterpolation(uint_t type);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return interpolation type
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetInterpolation() const {return interpolation;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return minimum delay (in samples) of the current interpolation type
+   */
+  /*--------------------------------------------------------------------------------*/
+  double GetMinDelay() const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set number of samples over which delay changes are ramped (0 for immediate changes)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetRampLength(uint_t samples) {ramplength = samples;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of samples over which delay changes are ramped
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetRampLength() const {return ramplength;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set delay of a channel
+   *
+   * @param channel channel index
+   * @param delay delay in samples (limited to the range GetMinDelay() .. GetMaxDelay())
+   * @param immediate true to jump to the new delay, false to ramp to it (see SetRampLength())
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetDelay(uint_t channel, double delay, bool immediate = false);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set delays of all channels
+   *
+   * @param delays array of GetChannels() delays in samples (e.g. from DistanceModel::GetLevelsAndDelays())
+   * @param immediate true to jump to the new delays, false to ramp to them (see SetRampLength())
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetDelays(const double *delays, bool immediate = false);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return current delay of a channel (which may be part-way through a ramp)
+   */
+  /*--------------------------------------------------------------------------------*/
+  double GetDelay(uint_t channel) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return target delay of a channel (the delay at the end of any ramp)
+   */
+  /*--------------------------------------------------------------------------------*/
+  double GetTargetDelay(uint_t channel) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Clear history (delays are unchanged)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Reset();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Delay interleaved audio
+   *
+   * @param src interleaved input of nframes frames of GetChannels() channels
+   * @param dst interleaved output of nframes frames of GetChannels() channels
+   * @param nframes number of frames
+   *
+   * @note src and dst may be the same (for in-place processing) but must not partially overlap
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Process(const Sample_t *src, Sample_t *dst, uint_t nframes);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Select kernel type (normally only used for testing or benchmarking)
+   *
+   * @param type one of KERNELS_* above
+   *
+   * @return true if the kernel type is available on this processor
+   *
+   * @note this is *not* thread safe, call during initialisation only
+   */
+  /*--------------------------------------------------------------------------------*/
+  static bool SetKernels(uint_t type = KERNELS_AUTO);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether kernel type (one of KERNELS_* above) is available on this processor
+   */
+  /*--------------------------------------------------------------------------------*/
+  static bool KernelsAvailable(uint_t type);
+
+protected:
+  typedef struct {
+    double delay;             // current delay (samples)
+    double target;            // delay at the end of the ramp
+    double step;              // delay change per sample during ramp
+    uint_t rampcount;         // number of samples left in ramp
+    float  allpassstate;      // previous output of Thiran allpass
+  } CHANNELSTATE;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Generate nframes samples of delayed output for a single channel
+   *
+   * @param channel channel index
+   * @param pos buffer index of the first sample to be output
+   * @param dst output array
+   * @param n number of samples (<= CHUNK_SIZE)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ProcessChannel(uint_t channel, uint_t pos, float *dst, uint_t n);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Generate output at a constant delay
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ProcessConstant(const float *hist, CHANNELSTATE& state, double delay, uint_t pos, float *dst, uint_t n) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Generate output whilst ramping the delay (and update state)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ProcessRamp(const float *hist, CHANNELSTATE& state, uint_t pos, float *dst, uint_t n) const;
+
+  // maximum number of frames processed at once (output is generated on the stack)
+  enum {CHUNK_SIZE = 256};
+
+protected:
+  std::vector<float>        history;
+  std::vector<CHANNELSTATE> channelstates;
+  uint_t                    maxdelay;
+  uint_t                    historylength;
+  uint_t                    historymask;
+  uint_t                    writepos;
+  uint_t                    interpolation;
+  uint_t                    ramplength;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
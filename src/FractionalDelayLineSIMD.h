@@ -0,0 +1,63 @@
+/*--------------------------------------------------------------------------------*/
+/** Vectorised bodies of the fractional delay line interpolation kernels
+ *
+ * This file is *private* to FractionalDelayLine.cpp and is deliberately NOT include-guarded:
+ * it is included once per instruction set, each time inside its own namespace and with
+ * an OPS class defined which wraps the intrinsics for that instruction set:
+ *
+ *   V                   vector type
+ *   N                   number of floats in V
+ *   load(), store()     unaligned load and store
+ *   set1()              constant
+ *   add(), mul(), madd(a, b, c) = a * b + c
+ *
+ * Each kernel processes as many whole vectors as possible and returns the number of samples
+ * processed, the remainder is processed by the scalar version
+ */
+/*--------------------------------------------------------------------------------*/
+
+typedef OPS::V V;
+
+/*--------------------------------------------------------------------------------*/
+/** 2-tap interpolation: dst[i] = c0 * src[i] + c1 * src[i + 1]
+ */
+/*--------------------------------------------------------------------------------*/
+static uint_t Interpolate2(const float *src, float c0, float c1, float *dst, uint_t n)
+{
+  const V v0 = OPS::set1(c0);
+  const V v1 = OPS::set1(c1);
+  uint_t i;
+
+  for (i = 0; (i + OPS::N) <= n; i += OPS::N)
+  {
+    OPS::store(dst + i, OPS::madd(OPS::load(src + i + 1), v1, OPS::mul(OPS::load(src + i), v0)));
+  }
+
+  return i;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** 4-tap interpolation: dst[i] = c[0] * src[i] + c[1] * src[i + 1] + c[2] * src[i + 2] + c[3] * src[i + 3]
+ */
+/*--------------------------------------------------------------------------------*/
+static uint_t Interpolate4(const float *src, const float *c, float *dst, uint_t n)
+{
+  const V v0 = OPS::set1(c[0]);
+  const V v1 = OPS::set1(c[1]);
+  const V v2 = OPS::set1(c[2]);
+  const V v3 = OPS::set1(c[3]);
+  uint_t i;
+
+  for (i = 0; (i + OPS::N) <= n; i += OPS::N)
+  {
+    V a = OPS::mul(OPS::load(src + i), v0);
+    V b = OPS::mul(OPS::load(src + i + 1), v1);
+
+    a = OPS::madd(OPS::load(src + i + 2), v2, a);
+    b = OPS::madd(OPS::load(src + i + 3), v3, b);
+
+    OPS::store(dst + i, OPS::add(a, b));
+  }
+
+  return i;
+}
@@ -0,0 +1,257 @@
+
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#ifdef SYS_io_uring_setup
+#include <linux/io_uring.h>
+#define USE_IO_URING
+#endif
+#endif
+
+#define BBCDEBUG_LEVEL 1
+#include "IOUring.h"
+
+BBC_AUDIOTOOLBOX_START
+
+// the rings' head and tail words are accessed (atomically) as std::atomic
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "std::atomic<uint32_t> must be the same size as uint32_t");
+
+IOUring::IOUring() : ringfd(-1),
+                     entries(0),
+                     sqring(NULL),
+                     sqringsize(0),
+                     cqring(NULL),
+                     cqringsize(0),
+                     sqes(NULL),
+                     sqessize(0),
+                     sqhead(NULL),
+                     sqtail(NULL),
+                     sqarray(NULL),
+                     sqmask(0),
+                     cqhead(NULL),
+                     cqtail(NULL),
+                     cqes(NULL),
+                     cqmask(0)
+{
+}
+
+IOUring::~IOUring()
+{
+  Close();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Create ring able to hold (at least) entries submissions
+ *
+ * @return false if io_uring is not available
+ */
+/*--------------------------------------------------------------------------------*/
+bool IOUring::Open(uint_t _entries)
+{
+  Close();
+
+#ifdef USE_IO_URING
+  struct io_uring_params params;
+  void *p;
+
+  memset(&params, 0, sizeof(params));
+  if ((ringfd = (int)syscall(SYS_io_uring_setup, std::max(_entries, (uint_t)1), &params)) < 0)
+  {
+    BBCDEBUG2(("io_uring not available: %s", strerror(errno)));
+    ringfd = -1;
+    return false;
+  }
+
+  sqringsize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cqringsize = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+  sqessize   = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  // newer kernels map both rings with one mapping
+  if (params.features & IORING_FEAT_SINGLE_MMAP) sqringsize = cqringsize = std::max(sqringsize, cqringsize);
+
+  if ((p = mmap(NULL, sqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING)) == MAP_FAILED)
+  {
+    BBCERROR("Failed to map io_uring submission ring: %s", strerror(errno));
+    Close();
+    return false;
+  }
+  sqring = (uint8_t *)p;
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) cqring = sqring;
+  else if ((p = mmap(NULL, cqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+  {
+    BBCERROR("Failed to map io_uring completion ring: %s", strerror(errno));
+    Close();
+    return false;
+  }
+  else cqring = (uint8_t *)p;
+
+  if ((p = mmap(NULL, sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES)) == MAP_FAILED)
+  {
+    BBCERROR("Failed to map io_uring submission entries: %s", strerror(errno));
+    Close();
+    return false;
+  }
+  sqes = (uint8_t *)p;
+
+  sqhead  = reinterpret_cast<std::atomic<uint32_t> *>(sqring + params.sq_off.head);
+  sqtail  = reinterpret_cast<std::atomic<uint32_t> *>(sqring + params.sq_off.tail);
+  sqarray = reinterpret_cast<uint32_t *>(sqring + params.sq_off.array);
+  sqmask  = *reinterpret_cast<uint32_t *>(sqring + params.sq_off.ring_mask);
+  cqhead  = reinterpret_cast<std::atomic<uint32_t> *>(cqring + params.cq_off.head);
+  cqtail  = reinterpret_cast<std::atomic<uint32_t> *>(cqring + params.cq_off.tail);
+  cqes    = cqring + params.cq_off.cqes;
+  cqmask  = *reinterpret_cast<uint32_t *>(cqring + params.cq_off.ring_mask);
+  entries = params.sq_entries;
+
+  BBCDEBUG2(("Created io_uring with %u entries", entries));
+
+  return true;
+#else
+  UNUSED_PARAMETER(_entries);
+  return false;
+#endif
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Destroy ring
+ *
+ * @note any writes still in flight are completed by the kernel but their completions are lost
+ */
+/*--------------------------------------------------------------------------------*/
+void IOUring::Close()
+{
+#ifdef USE_IO_URING
+  if (sqes) munmap(sqes, sqessize);
+  if (cqring && (cqring != sqring)) munmap(cqring, cqringsize);
+  if (sqring) munmap(sqring, sqringsize);
+  if (ringfd >= 0) close(ringfd);
+#endif
+
+  ringfd  = -1;
+  entries = 0;
+  sqring  = cqring = sqes = NULL;
+  sqringsize = cqringsize = sqessize = 0;
+  sqhead  = sqtail = cqhead = cqtail = NULL;
+  sqarray = NULL;
+  cqes    = NULL;
+  sqmask  = cqmask = 0;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Submit a gathering write of iov[0..niov-1] to fd at offset
+ *
+ * @param userdata value returned with the completion
+ *
+ * @return false if the submission queue is full or the submission failed (in which case the
+ * entry is withdrawn and the write will not happen)
+ *
+ * @note iov (and the data it points to) must remain valid until the completion is returned
+ */
+/*--------------------------------------------------------------------------------*/
+bool IOUring::SubmitWrite(int fd, const struct iovec *iov, uint_t niov, uint64_t offset, uint64_t userdata)
+{
+#ifdef USE_IO_URING
+  if (!IsOpen()) return false;
+
+  uint32_t tail = sqtail->load(std::memory_order_relaxed);
+
+  // the kernel consumes entries by advancing the head
+  if ((tail - sqhead->load(std::memory_order_acquire)) >= entries) return false;
+
+  uint32_t index = tail & sqmask;
+  struct io_uring_sqe *sqe = reinterpret_cast<struct io_uring_sqe *>(sqes) + index;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = IORING_OP_WRITEV;
+  sqe->fd        = fd;
+  sqe->addr      = (uint64_t)(uintptr_t)iov;
+  sqe->len       = niov;
+  sqe->off       = offset;
+  sqe->user_data = userdata;
+  sqarray[index] = index;
+
+  // publish entry to the kernel
+  sqtail->store(tail + 1, std::memory_order_release);
+
+  int res;
+  while (((res = (int)syscall(SYS_io_uring_enter, ringfd, 1, 0, 0, NULL, 0)) < 0) && (errno == EINTR)) ;
+  if (res < 1)
+  {
+    const char *error = (res < 0) ? strerror(errno) : "not consumed";
+
+    // without SQPOLL the kernel only consumes entries in io_uring_enter(): if it has, the write is in flight
+    if (sqhead->load(std::memory_order_acquire) != tail) return true;
+
+    // otherwise withdraw the entry so that a later submission does not submit it
+    sqtail->store(tail, std::memory_order_release);
+
+    BBCERROR("Failed to submit io_uring write: %s", error);
+    return false;
+  }
+
+  return true;
+#else
+  UNUSED_PARAMETER(fd);
+  UNUSED_PARAMETER(iov);
+  UNUSED_PARAMETER(niov);
+  UNUSED_PARAMETER(offset);
+  UNUSED_PARAMETER(userdata);
+  return false;
+#endif
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return the next completion, optionally waiting for one
+ *
+ * @param userdata receives the value passed to SubmitWrite()
+ * @param res receives the result of the write (number of bytes or -errno)
+ * @param wait true to wait until a completion is available
+ *
+ * @return false if no completion is available (or waiting failed)
+ */
+/*--------------------------------------------------------------------------------*/
+bool IOUring::GetCompletion(uint64_t& userdata, sint_t& res, bool wait)
+{
+#ifdef USE_IO_URING
+  if (!IsOpen()) return false;
+
+  while (true)
+  {
+    uint32_t head = cqhead->load(std::memory_order_relaxed);
+
+    // the kernel publishes completions by advancing the tail
+    if (head != cqtail->load(std::memory_order_acquire))
+    {
+      const struct io_uring_cqe *cqe = reinterpret_cast<const struct io_uring_cqe *>(cqes) + (head & cqmask);
+
+      userdata = cqe->user_data;
+      res      = cqe->res;
+
+      // release entry back to the kernel
+      cqhead->store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    if (!wait) return false;
+
+    if ((syscall(SYS_io_uring_enter, ringfd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) && (errno != EINTR))
+    {
+      BBCERROR("Failed to wait for io_uring completion: %s", strerror(errno));
+      return false;
+    }
+  }
+#else
+  UNUSED_PARAMETER(userdata);
+  UNUSED_PARAMETER(res);
+  UNUSED_PARAMETER(wait);
+  return false;
+#endif
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,100 @@
+#ifndef __IO_URING__
+#define __IO_URING__
+
+#include <atomic>
+
+#include "misc.h"
+
+struct iovec;
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Minimal wrapper around a Linux io_uring instance (using the system calls directly) for
+ * submitting positioned writes and collecting their completions
+ *
+ * On other platforms (or if the kernel does not support or allows io_uring), Open() fails and
+ * the caller should fall back to synchronous writes
+ *
+ * @note this object is *not* thread safe: submissions and completions must be handled by one thread
+ */
+/*--------------------------------------------------------------------------------*/
+class IOUring
+{
+public:
+  IOUring();
+  ~IOUring();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Create ring able to hold (at least) entries submissions
+   *
+   * @return false if io_uring is not available
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool   Open(uint_t entries);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Destroy ring
+   *
+   * @note any writes still in flight are completed by the kernel but their completions are lost
+   */
+  /*--------------------------------------------------------------------------------*/
+  void   Close();
+
+  bool   IsOpen()     const {return (ringfd >= 0);}
+  uint_t GetEntries() const {return entries;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Submit a gathering write of iov[0..niov-1] to fd at offset
+   *
+   * @param userdata value returned with the completion
+   *
+   * @return false if the submission queue is full or the submission failed (in which case the
+   * entry is withdrawn and the write will not happen)
+   *
+   * @note iov (and the data it points to) must remain valid until the completion is returned
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool   SubmitWrite(int fd, const struct iovec *iov, uint_t niov, uint64_t offset, uint64_t userdata);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return the next completion, optionally waiting for one
+   *
+   * @param userdata receives the value passed to SubmitWrite()
+   * @param res receives the result of the write (number of bytes or -errno)
+   * @param wait true to wait until a completion is available
+   *
+   * @return false if no completion is available (or waiting failed)
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool   GetCompletion(uint64_t& userdata, sint_t& res, bool wait = true);
+
+private:
+  // copying is not supported
+  IOUring(const IOUring& obj);
+  IOUring& operator = (const IOUring& obj);
+
+protected:
+  int                   ringfd;
+  uint_t                entries;
+  // kernel shared mappings
+  uint8_t               *sqring;
+  size_t                sqringsize;
+  uint8_t               *cqring;
+  size_t                cqringsize;
+  uint8_t               *sqes;
+  size_t                sqessize;
+  // pointers into mappings
+  std::atomic<uint32_t> *sqhead;
+  std::atomic<uint32_t> *sqtail;
+  uint32_t              *sqarray;
+  uint32_t              sqmask;
+  std::atomic<uint32_t> *cqhead;
+  std::atomic<uint32_t> *cqtail;
+  uint8_t               *cqes;
+  uint32_t              cqmask;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
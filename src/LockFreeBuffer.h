@@ -2,56 +2,104 @@
 #define __LOCK_FREE_BUFFER__
 
 #include <vector>
+#include <atomic>
 
 #include "misc.h"
+#include "LockFreeBufferStats.h"
 
 BBC_AUDIOTOOLBOX_START
 
 /*--------------------------------------------------------------------------------*/
-/** Lock-free fixed-size circular buffer
- *
- * To write:
- * Call GetWriteBuffer(), if it returns non-NULL, write to the buffer and then call IncrementWrite()
+/** Indexing policies for LockFreeBuffer
  *
- * To read:
- * Call GetReadBuffer(), if it returns non-NULL, read from the buffer and then call IncrementRead()
+ * A policy converts read and write positions to storage indices and calculates the number of
+ * items between positions:
  *
- * GetReadBuffersAvailable() always returns number of buffers that can be read
- * Read-ahead allows valid read buffers beyond the next one to be accessed, using GetReadBuffer(<x>)
+ *   Init(l)              set up for (at least) l items
+ *   GetSize()            number of storage slots
+ *   GetCapacity()        maximum number of items that can be held
+ *   Advance(pos, n)      position n items beyond pos
+ *   GetIndex(pos)        storage index of position
+ *   GetUsed(rd, wr)      number of items between read and write positions
+ */
+/*--------------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------*/
+/** Modulo indexing: positions are storage indices (wrapped using %)
  *
- * GetWriteBuffersAvailable() always returns number of buffers that can be written to
- * Write-ahead allows buffers to be written (but not committed) using GetWriteBuffer(<x>)
+ * Any capacity is allowed but *one* slot is always unused (to detect the difference between
+ * empty and full) and each advance requires an integer division
+ */
+/*--------------------------------------------------------------------------------*/
+class LockFreeBufferModuloIndexing
+{
+public:
+  LockFreeBufferModuloIndexing() : size(1) {}
+
+  void   Init(uint_t l)                       {size = l + 1;}
+  uint_t GetSize()                      const {return size;}
+  uint_t GetCapacity()                  const {return size - 1;}
+  uint_t Advance(uint_t pos, uint_t n)  const {return (pos + n) % size;}
+  uint_t GetIndex(uint_t pos)           const {return pos;}
+  uint_t GetUsed(uint_t rd, uint_t wr)  const {return (wr + size - rd) % size;}
+
+protected:
+  uint_t size;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Mask indexing: positions are free-running counters, storage is a power of 2 in size and
+ * storage indices are the positions masked to the storage size
  *
- * Notes:
- *  1. to detect empty/full, *one* of the slots is unavailable (to detect the difference between empty and full)
+ * The capacity is rounded *up* to a power of 2 but every slot can be used (the counters
+ * distinguish full from empty) and no divisions are required
  */
 /*--------------------------------------------------------------------------------*/
-template<typename T>
-class LockFreeBuffer
+class LockFreeBufferMaskIndexing
 {
 public:
-  /*--------------------------------------------------------------------------------*/
-  /** Initialise the buffer
-   *
-   * @note the buffer is initialised to one more than required because there must
-   * always be an unused item in the list
-   */
-  /*--------------------------------------------------------------------------------*/
-  LockFreeBuffer(uint_t l = 0) : buffer(l + 1),
-                                 rd(0),
-                                 wr(0) {}
-  virtual ~LockFreeBuffer() {}
+  LockFreeBufferMaskIndexing() : size(1),
+                                 mask(0) {}
+
+  void   Init(uint_t l)                       {size = 1; while (size < l) size <<= 1; mask = size - 1;}
+  uint_t GetSize()                      const {return size;}
+  uint_t GetCapacity()                  const {return size;}
+  uint_t Advance(uint_t pos, uint_t n)  const {return pos + n;}
+  uint_t GetIndex(uint_t pos)           const {return pos & mask;}
+  uint_t GetUsed(uint_t rd, uint_t wr)  const {return wr - rd;}
+
+protected:
+  uint_t size;
+  uint_t mask;
+};
 
+/*--------------------------------------------------------------------------------*/
+/** Single-writer/single-reader ring logic (cached positions, spans and copies), shared by
+ * LockFreeBuffer and SharedMemoryBuffer
+ *
+ * The STORAGE policy (a base class) says where the positions and items live:
+ *
+ *   HasStorage()         false if there are no items (nothing can then be written), positions
+ *                        must still be valid
+ *   WritePos()           atomic write position
+ *   ReadPos()            atomic read position
+ *   ReadCache()          writer's local copy of the read position
+ *   WriteCache()         reader's local copy of the write position
+ *   GetItems()           ptr to first storage slot
+ *   GetIndexing()        indexing policy (see above)
+ *
+ * See LockFreeBuffer for the interface and the notes on threading and statistics
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T, class STORAGE, class STATS = LockFreeBufferNoStats>
+class LockFreeRing : public STORAGE, public STATS
+{
+public:
   /*--------------------------------------------------------------------------------*/
-  /** Resize the buffer and reset the pointers
-   *
-   * @note the buffer is initialised to one more than required because there must
-   * always be an unused item in the list
-   *
-   * @note this will effectively empty the buffer
+  /** Return maximum number of items the buffer can hold
    */
   /*--------------------------------------------------------------------------------*/
-  void Resize(uint_t l) {buffer.resize(l + 1); rd = wr = 0;}
+  uint_t GetCapacity() const {return this->HasStorage() ? this->GetIndexing().GetCapacity() : 0;}
 
   /*--------------------------------------------------------------------------------*/
   /** Return ptr to item at write position
@@ -64,15 +112,22 @@ public:
    * from being used
    */
   /*--------------------------------------------------------------------------------*/
-  T *GetWriteBuffer(uint_t offset = 0) {return (offset < WriteBuffersAvailable()) ? &buffer[(wr + offset) % buffer.size()] : NULL;}
-  
+  T *GetWriteBuffer(uint_t offset = 0)
+  {
+    uint_t _wr = this->WritePos().load(std::memory_order_relaxed);
+    if (CheckWriteBuffersAvailable(_wr, offset + 1) > offset) return GetItem(this->GetIndexing().Advance(_wr, offset));
+    // buffer full (as opposed to the end of write-ahead)
+    if (!offset) this->WriteFailed();
+    return NULL;
+  }
+
   /*--------------------------------------------------------------------------------*/
   /** Return number of write buffers available
-   * 
-   * @note number of write buffers = rd - wr - 1 but each subtraction requires addition of buffer size to prevent underflow
+   *
+   * @note number of write buffers = capacity - number of read buffers
    */
   /*--------------------------------------------------------------------------------*/
-  uint_t WriteBuffersAvailable() const {return (uint_t)((rd + 2 * buffer.size() - wr - 1) % buffer.size());}
+  uint_t WriteBuffersAvailable() const {return CalcWriteBuffersAvailable(this->ReadPos().load(std::memory_order_acquire), this->WritePos().load(std::memory_order_acquire));}
 
   /*--------------------------------------------------------------------------------*/
   /** Increment the write pointer (after writing data, essentially committing buffers)
@@ -84,18 +139,25 @@ public:
   /*--------------------------------------------------------------------------------*/
   bool IncrementWrite(uint_t n = 1)
   {
-    uint_t avail = WriteBuffersAvailable();
-    if ((n = std::min(n, avail)) > 0) {wr = (wr + n) % buffer.size(); return true;}
+    uint_t _wr   = this->WritePos().load(std::memory_order_relaxed);
+    uint_t avail = CheckWriteBuffersAvailable(_wr, n);
+    if ((n = std::min(n, avail)) > 0)
+    {
+      this->WritePos().store(_wr = this->GetIndexing().Advance(_wr, n), std::memory_order_release);
+      if (STATS::ENABLED) this->ItemsWritten(n, CalcReadBuffersAvailable(this->ReadPos().load(std::memory_order_relaxed), _wr));
+      return true;
+    }
+    if (!avail) this->WriteFailed();
     return false;
   }
 
   /*--------------------------------------------------------------------------------*/
   /** Return how many occupied read buffers are available
-   * 
-   * @note number of read buffers = wr - rd but the subtraction requires addition of buffer size to prevent underflow
+   *
+   * @note number of read buffers = wr - rd (calculated by the indexing policy)
    */
   /*--------------------------------------------------------------------------------*/
-  uint_t ReadBuffersAvailable() const {return (uint_t)((wr + buffer.size() - rd) % buffer.size());}
+  uint_t ReadBuffersAvailable() const {return CalcReadBuffersAvailable(this->ReadPos().load(std::memory_order_acquire), this->WritePos().load(std::memory_order_acquire));}
 
   /*--------------------------------------------------------------------------------*/
   /** Return ptr to item at read position
@@ -105,8 +167,15 @@ public:
    * @return ptr to data to read from or NULL if no items available
    */
   /*--------------------------------------------------------------------------------*/
-  const T *GetReadBuffer(uint_t offset = 0) const {return (offset < ReadBuffersAvailable()) ? &buffer[(rd + offset) % buffer.size()] : NULL;}
-  T       *GetReadBuffer(uint_t offset = 0)       {return (offset < ReadBuffersAvailable()) ? &buffer[(rd + offset) % buffer.size()] : NULL;}
+  const T *GetReadBuffer(uint_t offset = 0) const
+  {
+    uint_t _rd = this->ReadPos().load(std::memory_order_relaxed);
+    if (CheckReadBuffersAvailable(_rd, offset + 1) > offset) return GetItem(this->GetIndexing().Advance(_rd, offset));
+    // buffer empty (as opposed to the end of read-ahead)
+    if (!offset) this->ReadFailed();
+    return NULL;
+  }
+  T *GetReadBuffer(uint_t offset = 0) {return const_cast<T *>(static_cast<const LockFreeRing *>(this)->GetReadBuffer(offset));}
 
   /*--------------------------------------------------------------------------------*/
   /** Increment the read pointer (after reading data)
@@ -118,22 +187,317 @@ public:
   /*--------------------------------------------------------------------------------*/
   bool IncrementRead(uint_t n = 1)
   {
-    uint_t avail = ReadBuffersAvailable();
-    if ((n = std::min(n, avail)) > 0) {rd = (rd + n) % buffer.size(); return true;}
+    uint_t _rd   = this->ReadPos().load(std::memory_order_relaxed);
+    uint_t avail = CheckReadBuffersAvailable(_rd, n);
+    if ((n = std::min(n, avail)) > 0)
+    {
+      if (STATS::ENABLED) this->ItemsRead(n, CalcReadBuffersAvailable(_rd, this->WritePos().load(std::memory_order_relaxed)));
+      this->ReadPos().store(this->GetIndexing().Advance(_rd, n), std::memory_order_release);
+      return true;
+    }
+    if (!avail) this->ReadFailed();
     return false;
   }
 
+  typedef struct {
+    T      *items;            // first item of span
+    uint_t count;             // number of items in span
+  } SPAN;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return contiguous spans of items at the write position
+   *
+   * @param spans array of two spans to be populated (the second span has zero items unless
+   * the items wrap around the end of the storage)
+   * @param n maximum number of items required
+   *
+   * @return total number of items in the spans (which can be less than n if there is not
+   * enough space)
+   *
+   * @note call IncrementWrite() to commit items after writing them
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetWriteSpans(SPAN spans[2], uint_t n = ~(uint_t)0)
+  {
+    uint_t _wr = this->WritePos().load(std::memory_order_relaxed);
+    n = std::min(n, CheckWriteBuffersAvailable(_wr, n));
+    GetSpans(this->GetIndexing().GetIndex(_wr), n, spans);
+    return n;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return contiguous spans of items at the read position
+   *
+   * @param spans array of two spans to be populated (the second span has zero items unless
+   * the items wrap around the end of the storage)
+   * @param n maximum number of items required
+   *
+   * @return total number of items in the spans (which can be less than n if there are not
+   * enough items available)
+   *
+   * @note call IncrementRead() to release items after reading them
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetReadSpans(SPAN spans[2], uint_t n = ~(uint_t)0)
+  {
+    uint_t _rd = this->ReadPos().load(std::memory_order_relaxed);
+    n = std::min(n, CheckReadBuffersAvailable(_rd, n));
+    GetSpans(this->GetIndexing().GetIndex(_rd), n, spans);
+    return n;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Copy items into the buffer and commit them
+   *
+   * @param src items to write
+   * @param n number of items
+   *
+   * @return number of items written (which can be less than n if there is not enough space)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t Write(const T *src, uint_t n)
+  {
+    SPAN   spans[2];
+    uint_t nwritten;
+
+    if ((nwritten = GetWriteSpans(spans, n)) > 0)
+    {
+      // for trivially copyable types (e.g. Sample_t), std::copy() is a memmove()
+      std::copy(src, src + spans[0].count, spans[0].items);
+      std::copy(src + spans[0].count, src + nwritten, spans[1].items);
+      IncrementWrite(nwritten);
+    }
+    if (nwritten < n) this->WriteFailed();
+
+    return nwritten;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Copy items out of the buffer and release them
+   *
+   * @param dst destination for items
+   * @param n maximum number of items to read
+   *
+   * @return number of items read (which can be less than n if there are not enough items available)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t Read(T *dst, uint_t n)
+  {
+    SPAN   spans[2];
+    uint_t nread;
+
+    if ((nread = GetReadSpans(spans, n)) > 0)
+    {
+      std::copy(spans[0].items, spans[0].items + spans[0].count, dst);
+      std::copy(spans[1].items, spans[1].items + spans[1].count, dst + spans[0].count);
+      IncrementRead(nread);
+    }
+    if (nread < n) this->ReadFailed();
+
+    return nread;
+  }
+
   /*--------------------------------------------------------------------------------*/
   /** Reset the buffer (losing all data)
+   *
+   * @note this must be called from the reading thread
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Reset()
+  {
+    this->WriteCache() = this->WritePos().load(std::memory_order_acquire);
+    this->ReadPos().store(this->WriteCache(), std::memory_order_release);
+  }
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Return ptr to item at position
    */
   /*--------------------------------------------------------------------------------*/
-  void Reset() {rd = wr;}
+  T *GetItem(uint_t pos) const {return static_cast<T *>(this->GetItems()) + this->GetIndexing().GetIndex(pos);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Split n items starting at storage index into (up to) two contiguous spans
+   */
+  /*--------------------------------------------------------------------------------*/
+  void GetSpans(uint_t index, uint_t n, SPAN spans[2]) const
+  {
+    T      *items = static_cast<T *>(this->GetItems());
+    uint_t n1     = std::min(n, this->GetIndexing().GetSize() - index);
+
+    spans[0].items = items + index;
+    spans[0].count = n1;
+    spans[1].items = items;
+    spans[1].count = n - n1;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of write/read buffers available for given read and write positions
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t CalcWriteBuffersAvailable(uint_t _rd, uint_t _wr) const {return GetCapacity() - this->GetIndexing().GetUsed(_rd, _wr);}
+  uint_t CalcReadBuffersAvailable(uint_t _rd, uint_t _wr)  const {return this->GetIndexing().GetUsed(_rd, _wr);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of write/read buffers available, only refreshing the cached copy of the other
+   * side's position if fewer than n are available according to the cached copy
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t CheckWriteBuffersAvailable(uint_t _wr, uint_t n) const
+  {
+    uint_t avail = CalcWriteBuffersAvailable(this->ReadCache(), _wr);
+    if (avail < n)
+    {
+      this->ReadCache() = this->ReadPos().load(std::memory_order_acquire);
+      avail = CalcWriteBuffersAvailable(this->ReadCache(), _wr);
+    }
+    return avail;
+  }
+  uint_t CheckReadBuffersAvailable(uint_t _rd, uint_t n) const
+  {
+    uint_t avail = CalcReadBuffersAvailable(_rd, this->WriteCache());
+    if (avail < n)
+    {
+      this->WriteCache() = this->WritePos().load(std::memory_order_acquire);
+      avail = CalcReadBuffersAvailable(_rd, this->WriteCache());
+    }
+    return avail;
+  }
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Storage policy for LockFreeRing holding the items in a vector and the positions in the
+ * object (on separate cache lines)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T, class INDEXING>
+class LockFreeBufferStorage
+{
+public:
+  LockFreeBufferStorage() : wr(0),
+                            rdcache(0),
+                            rd(0),
+                            wrcache(0) {}
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Allocate storage for l items and reset the positions
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Init(uint_t l)
+  {
+    indexing.Init(l);
+    buffer.resize(indexing.GetSize());
+    rd.store(0);
+    wr.store(0);
+    rdcache = wrcache = 0;
+  }
+
+  bool                       HasStorage()        const {return true;}
+  std::atomic<uint_t>&       WritePos()                {return wr;}
+  const std::atomic<uint_t>& WritePos()          const {return wr;}
+  std::atomic<uint_t>&       ReadPos()                 {return rd;}
+  const std::atomic<uint_t>& ReadPos()           const {return rd;}
+  uint_t&                    ReadCache()         const {return rdcache;}
+  uint_t&                    WriteCache()        const {return wrcache;}
+  T                          *GetItems()         const {return const_cast<T *>(buffer.data());}
+  const INDEXING&            GetIndexing()       const {return indexing;}
 
 protected:
-  std::vector<T> buffer;
-  volatile uint_t rd, wr;
+  // shared, read-only (except during Resize())
+  std::vector<T>      buffer;
+  INDEXING            indexing;
+
+  // written by writer
+  uint8_t             pad0[CACHE_LINE_SIZE];
+  std::atomic<uint_t> wr;
+  mutable uint_t      rdcache;        // writer's copy of rd
+
+  // written by reader
+  uint8_t             pad1[CACHE_LINE_SIZE];
+  std::atomic<uint_t> rd;
+  mutable uint_t      wrcache;        // reader's copy of wr
+  uint8_t             pad2[CACHE_LINE_SIZE];
 };
 
+/*--------------------------------------------------------------------------------*/
+/** Lock-free fixed-size circular buffer
+ *
+ * To write:
+ * Call GetWriteBuffer(), if it returns non-NULL, write to the buffer and then call IncrementWrite()
+ *
+ * To read:
+ * Call GetReadBuffer(), if it returns non-NULL, read from the buffer and then call IncrementRead()
+ *
+ * GetReadBuffersAvailable() always returns number of buffers that can be read
+ * Read-ahead allows valid read buffers beyond the next one to be accessed, using GetReadBuffer(<x>)
+ *
+ * GetWriteBuffersAvailable() always returns number of buffers that can be written to
+ * Write-ahead allows buffers to be written (but not committed) using GetWriteBuffer(<x>)
+ *
+ * Bulk transfers:
+ * GetWriteSpans() and GetReadSpans() return (up to) two contiguous spans of items (the second
+ * being non-empty only if the items wrap around the end of the storage) which are committed or
+ * released with IncrementWrite() or IncrementRead() as above
+ * Write() and Read() copy blocks of items in (at most) two copies
+ *
+ * Notes:
+ *  1. with the default (modulo) indexing, *one* of the slots is unavailable (to detect the difference between
+ *     empty and full), with mask indexing (MaskedLockFreeBuffer) the capacity is rounded up to a power of 2
+ *     and all slots are available (see indexing policies above)
+ *  2. safe for *one* writing thread and *one* reading thread
+ *  3. IncrementWrite() publishes written items with release semantics and the reader reads the write
+ *     position with acquire semantics (and vice versa for IncrementRead()) so items are always fully
+ *     written before they are read and fully read before they are overwritten, on any processor
+ *  4. the read and write positions are on separate cache lines and each side keeps a local copy of
+ *     the other side's position which is only refreshed when it appears to limit the operation, so
+ *     the common case touches no cache line written by the other thread
+ *     (WriteBuffersAvailable() and ReadBuffersAvailable() always read both positions and can be called
+ *     from any thread)
+ *  5. Resize() is *not* thread safe
+ *  6. with STATS = LockFreeBufferStats, occupancy watermarks, overruns (writes failing or cut short because
+ *     the buffer is full), underruns (reads failing or cut short because it is empty) and item counts are
+ *     collected (see GetStats() and PublishStats() in LockFreeBufferStats.h), by default (LockFreeBufferNoStats)
+ *     nothing is collected and no code is generated for statistics
+ *  7. the logic is in LockFreeRing (shared with SharedMemoryBuffer), this class provides the storage
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T, class INDEXING = LockFreeBufferModuloIndexing, class STATS = LockFreeBufferNoStats>
+class LockFreeBuffer : public LockFreeRing<T, LockFreeBufferStorage<T, INDEXING>, STATS>
+{
+public:
+  /*--------------------------------------------------------------------------------*/
+  /** Initialise the buffer
+   *
+   * @note with modulo indexing the buffer is initialised to one more than required because
+   * there must always be an unused item in the list
+   */
+  /*--------------------------------------------------------------------------------*/
+  LockFreeBuffer(uint_t l = 0)
+  {
+    this->Init(l);
+  }
+  virtual ~LockFreeBuffer() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Resize the buffer and reset the pointers
+   *
+   * @note with modulo indexing the buffer is initialised to one more than required because
+   * there must always be an unused item in the list
+   *
+   * @note this will effectively empty the buffer
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Resize(uint_t l) {this->Init(l);}
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Lock-free circular buffer with power-of-2 capacity and mask indexing (see LockFreeBufferMaskIndexing)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T, class STATS = LockFreeBufferNoStats>
+using MaskedLockFreeBuffer = LockFreeBuffer<T, LockFreeBufferMaskIndexing, STATS>;
+
 BBC_AUDIOTOOLBOX_END
 
 #endif
@@ -0,0 +1,25 @@
+
+#define BBCDEBUG_LEVEL 1
+#include "LockFreeBufferStats.h"
+#include "PerformanceMonitor.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Publish statistics into PerformanceMonitor as counters '<name>.<stat>'
+ */
+/*--------------------------------------------------------------------------------*/
+void LockFreeBufferCounters::PublishStats(const std::string& name) const
+{
+  LOCKFREEBUFFERSTATS stats = GetStats();
+  PerformanceMonitor& perfmon = PerformanceMonitor::Get();
+
+  perfmon.SetCounter(name + ".itemswritten", stats.itemswritten);
+  perfmon.SetCounter(name + ".itemsread",    stats.itemsread);
+  perfmon.SetCounter(name + ".overruns",     stats.overruns);
+  perfmon.SetCounter(name + ".underruns",    stats.underruns);
+  perfmon.SetCounter(name + ".maxused",      stats.maxused);
+  perfmon.SetCounter(name + ".minused",      stats.minused);
+}
+
+BBC_AUDIOTOOLBOX_END
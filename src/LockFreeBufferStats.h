@@ -0,0 +1,179 @@
+#ifndef __LOCK_FREE_BUFFER_STATS__
+#define __LOCK_FREE_BUFFER_STATS__
+
+#include <string>
+#include <atomic>
+
+#include "misc.h"
+
+BBC_AUDIOTOOLBOX_START
+
+// unless specified as enabled or disabled before this include, allow LockFreeBufferStats to collect statistics
+#ifndef LOCKFREEBUFFER_STATS_ENABLED
+#define LOCKFREEBUFFER_STATS_ENABLED 1
+#endif
+
+/*--------------------------------------------------------------------------------*/
+/** Snapshot of LockFreeBuffer statistics
+ */
+/*--------------------------------------------------------------------------------*/
+typedef struct {
+  uint64_t itemswritten;        // total items committed by the writer
+  uint64_t itemsread;           // total items released by the reader
+  uint64_t overruns;            // failed (or short) writes because the buffer was full
+  uint64_t underruns;           // failed (or short) reads because the buffer was empty
+  uint_t   maxused;             // high watermark: most items in the buffer (seen by the writer after committing)
+  uint_t   minused;             // low watermark: fewest items in the buffer (seen by the reader before releasing)
+} LOCKFREEBUFFERSTATS;
+
+/*--------------------------------------------------------------------------------*/
+/** Statistics policies for LockFreeBuffer
+ *
+ * A policy is a base class of LockFreeBuffer which is told about the writer's and reader's
+ * operations:
+ *
+ *   ENABLED                compile-time constant, false if the policy ignores everything (so the
+ *                          buffer does not calculate occupancy for it)
+ *   ItemsWritten(n, used)  writer committed n items, leaving used items in the buffer
+ *   WriteFailed()          writer found the buffer full
+ *   ItemsRead(n, used)     reader released n items, there having been used items in the buffer
+ *   ReadFailed()           reader found the buffer empty
+ *
+ * and provides (publicly, through the buffer):
+ *
+ *   GetStats()             return snapshot of statistics
+ *   ResetStats()           reset statistics
+ *   PublishStats(name)     publish statistics into PerformanceMonitor as counters '<name>.<stat>'
+ */
+/*--------------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------*/
+/** No statistics (the default): everything compiles away to nothing
+ */
+/*--------------------------------------------------------------------------------*/
+class LockFreeBufferNoStats
+{
+public:
+  static const bool ENABLED = false;
+
+  LOCKFREEBUFFERSTATS GetStats() const {LOCKFREEBUFFERSTATS stats = {0, 0, 0, 0, 0, 0}; return stats;}
+  void ResetStats() {}
+  void PublishStats(const std::string& name) const {UNUSED_PARAMETER(name);}
+
+protected:
+  void ItemsWritten(uint_t n, uint_t used) const {UNUSED_PARAMETER(n); UNUSED_PARAMETER(used);}
+  void WriteFailed()                       const {}
+  void ItemsRead(uint_t n, uint_t used)    const {UNUSED_PARAMETER(n); UNUSED_PARAMETER(used);}
+  void ReadFailed()                        const {}
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Lock-free statistics counters
+ *
+ * The writer's and reader's counters are on separate cache lines and each is only updated
+ * by its own side (so no atomic read-modify-write operations are required); GetStats() can be
+ * called from any thread
+ *
+ * @note ResetStats() should be called when neither side is active (otherwise a concurrent
+ * update may survive the reset)
+ */
+/*--------------------------------------------------------------------------------*/
+class LockFreeBufferCounters
+{
+public:
+  static const bool ENABLED = true;
+
+  LockFreeBufferCounters() {ResetStats();}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return snapshot of statistics
+   */
+  /*--------------------------------------------------------------------------------*/
+  LOCKFREEBUFFERSTATS GetStats() const
+  {
+    LOCKFREEBUFFERSTATS stats;
+
+    stats.itemswritten = itemswritten.load(std::memory_order_relaxed);
+    stats.overruns     = overruns.load(std::memory_order_relaxed);
+    stats.maxused      = maxused.load(std::memory_order_relaxed);
+    stats.itemsread    = itemsread.load(std::memory_order_relaxed);
+    stats.underruns    = underruns.load(std::memory_order_relaxed);
+    stats.minused      = minused.load(std::memory_order_relaxed);
+    // nothing read yet
+    if (stats.minused == ~(uint_t)0) stats.minused = 0;
+
+    return stats;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Reset statistics
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ResetStats()
+  {
+    itemswritten.store(0, std::memory_order_relaxed);
+    overruns.store(0, std::memory_order_relaxed);
+    maxused.store(0, std::memory_order_relaxed);
+    itemsread.store(0, std::memory_order_relaxed);
+    underruns.store(0, std::memory_order_relaxed);
+    minused.store(~(uint_t)0, std::memory_order_relaxed);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Publish statistics into PerformanceMonitor as counters '<name>.<stat>'
+   */
+  /*--------------------------------------------------------------------------------*/
+  void PublishStats(const std::string& name) const;
+
+protected:
+  // writer side
+  void ItemsWritten(uint_t n, uint_t used) const
+  {
+    itemswritten.store(itemswritten.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    if (used > maxused.load(std::memory_order_relaxed)) maxused.store(used, std::memory_order_relaxed);
+  }
+  void WriteFailed() const
+  {
+    overruns.store(overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // reader side
+  void ItemsRead(uint_t n, uint_t used) const
+  {
+    itemsread.store(itemsread.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    if (used < minused.load(std::memory_order_relaxed)) minused.store(used, std::memory_order_relaxed);
+  }
+  void ReadFailed() const
+  {
+    underruns.store(underruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    minused.store(0, std::memory_order_relaxed);
+  }
+
+protected:
+  // updated by writer
+  mutable std::atomic<uint64_t> itemswritten;
+  mutable std::atomic<uint64_t> overruns;
+  mutable std::atomic<uint_t>   maxused;
+  uint8_t                       pad0[CACHE_LINE_SIZE];
+  // updated by reader
+  mutable std::atomic<uint64_t> itemsread;
+  mutable std::atomic<uint64_t> underruns;
+  mutable std::atomic<uint_t>   minused;
+  uint8_t                       pad1[CACHE_LINE_SIZE];
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Statistics policy to use when statistics are wanted: LockFreeBufferCounters unless
+ * LOCKFREEBUFFER_STATS_ENABLED is defined as 0 (e.g. for release builds) in which case
+ * buffers using it collect nothing
+ */
+/*--------------------------------------------------------------------------------*/
+#if LOCKFREEBUFFER_STATS_ENABLED
+typedef LockFreeBufferCounters LockFreeBufferStats;
+#else
+typedef LockFreeBufferNoStats  LockFreeBufferStats;
+#endif
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef __LOCK_FREE_QUEUE__
+#define __LOCK_FREE_QUEUE__
+
+#include <algorithm>
+#include <atomic>
+
+#include "misc.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Lock-free bounded multi-producer, multi-consumer queue
+ *
+ * Unlike LockFreeBuffer (which is for *one* writing and *one* reading thread), any number of
+ * threads may write and read concurrently
+ *
+ * Each slot has a sequence number which tells writers and readers whether the slot is free for
+ * the current lap of the circular storage or holds an item for it (D. Vyukov's bounded MPMC queue):
+ * a slot is claimed by a compare-and-swap of the write (or read) position and released by setting
+ * its sequence number (with release semantics) so each item transfer requires one CAS on a
+ * shared position and no locks
+ *
+ * Simple interface:
+ * TryPush() copies an item into the queue, TryPop() copies an item out of the queue
+ *
+ * In-place interface (same style as LockFreeBuffer):
+ * To write: call GetWriteBuffer(), if it returns non-NULL, write to the item and then call IncrementWrite(item)
+ * To read:  call GetReadBuffer(), if it returns non-NULL, read the item and then call IncrementRead(item)
+ * The returned item is claimed by the calling thread and *must* be passed back to IncrementWrite() or
+ * IncrementRead() (by the same thread) - until then, readers (or writers) reaching that slot will see
+ * the queue as empty (or full)
+ *
+ * Notes:
+ *  1. the capacity is rounded up to a power of 2 (minimum 2)
+ *  2. items are read in the order they were written (although with multiple readers, items may
+ *     be *processed* in a different order)
+ *  3. the write and read positions are on separate cache lines
+ *  4. Resize() is *not* thread safe
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+class LockFreeQueue
+{
+public:
+  LockFreeQueue(uint_t l = 0) : cells(NULL),
+                                size(0),
+                                mask(0),
+                                wr(0),
+                                rd(0)
+  {
+    Resize(l);
+  }
+  virtual ~LockFreeQueue() {delete[] cells;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Resize the queue (rounding up to a power of 2) and empty it
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Resize(uint_t l)
+  {
+    uint_t i;
+
+    delete[] cells;
+
+    size = 2;
+    while (size < l) size <<= 1;
+    mask  = size - 1;
+    cells = new CELL[size];
+
+    // slot i is free for the write at position i
+    for (i = 0; i < size; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+
+    wr.store(0, std::memory_order_relaxed);
+    rd.store(0, std::memory_order_release);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return maximum number of items the queue can hold
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetCapacity() const {return size;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return (approximate, if other threads are active) number of items in the queue
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t ReadBuffersAvailable() const
+  {
+    uint_t _rd = rd.load(std::memory_order_acquire);
+    uint_t _wr = wr.load(std::memory_order_acquire);
+    return std::min((uint_t)std::max((sint_t)(_wr - _rd), (sint_t)0), size);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Claim a free item to write to
+   *
+   * @return ptr to item to write to or NULL if the queue is full
+   *
+   * @note the item *must* be committed by calling IncrementWrite() with the returned ptr
+   */
+  /*--------------------------------------------------------------------------------*/
+  T *GetWriteBuffer()
+  {
+    CELL   *cell;
+    uint_t pos = wr.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+      cell = &cells[pos & mask];
+
+      uint_t seq  = cell->seq.load(std::memory_order_acquire);
+      sint_t diff = (sint_t)(seq - pos);
+
+      if (diff == 0)
+      {
+        // slot is free for this position, try and claim it (on failure, pos is updated)
+        if (wr.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      }
+      // slot still holds an item from the previous lap: full
+      else if (diff < 0) return NULL;
+      // another writer has claimed this position
+      else pos = wr.load(std::memory_order_relaxed);
+    }
+
+    return &cell->item;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Commit an item claimed by GetWriteBuffer() (making it available to readers)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void IncrementWrite(T *item)
+  {
+    CELL *cell = GetCell(item);
+
+    // sequence number is still the claimed position
+    cell->seq.store(cell->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Claim an item to read from
+   *
+   * @return ptr to item to read from or NULL if the queue is empty
+   *
+   * @note the item *must* be released by calling IncrementRead() with the returned ptr
+   */
+  /*--------------------------------------------------------------------------------*/
+  T *GetReadBuffer()
+  {
+    CELL   *cell;
+    uint_t pos = rd.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+      cell = &cells[pos & mask];
+
+      uint_t seq  = cell->seq.load(std::memory_order_acquire);
+      sint_t diff = (sint_t)(seq - (pos + 1));
+
+      if (diff == 0)
+      {
+        // slot holds an item for this position, try and claim it (on failure, pos is updated)
+        if (rd.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      }
+      // slot has not been written for this position: empty
+      else if (diff < 0) return NULL;
+      // another reader has claimed this position
+      else pos = rd.load(std::memory_order_relaxed);
+    }
+
+    return &cell->item;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Release an item claimed by GetReadBuffer() (making the slot available to writers)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void IncrementRead(T *item)
+  {
+    CELL *cell = GetCell(item);
+
+    // sequence number is the claimed position + 1, make slot free for the next lap
+    cell->seq.store(cell->seq.load(std::memory_order_relaxed) + mask, std::memory_order_release);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Copy an item into the queue
+   *
+   * @return false if the queue is full
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool TryPush(const T& item)
+  {
+    T *p;
+
+    if ((p = GetWriteBuffer()) != NULL)
+    {
+      *p = item;
+      IncrementWrite(p);
+      return true;
+    }
+
+    return false;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Copy an item out of the queue
+   *
+   * @return false if the queue is empty
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool TryPop(T& item)
+  {
+    T *p;
+
+    if ((p = GetReadBuffer()) != NULL)
+    {
+      item = *p;
+      IncrementRead(p);
+      return true;
+    }
+
+    return false;
+  }
+
+protected:
+  typedef struct {
+    std::atomic<uint_t> seq;  // sequence number
+    T                   item;
+  } CELL;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return cell containing item
+   */
+  /*--------------------------------------------------------------------------------*/
+  CELL *GetCell(T *item) const {return &cells[((uint8_t *)item - (uint8_t *)&cells[0].item) / sizeof(CELL)];}
+
+private:
+  // copying is not supported
+  LockFreeQueue(const LockFreeQueue& obj);
+  LockFreeQueue& operator = (const LockFreeQueue& obj);
+
+protected:
+  // shared, read-only (except during Resize())
+  CELL                *cells;
+  uint_t              size;
+  uint_t              mask;
+
+  // written by writers
+  uint8_t             pad0[CACHE_LINE_SIZE];
+  std::atomic<uint_t> wr;
+
+  // written by readers
+  uint8_t             pad1[CACHE_LINE_SIZE];
+  std::atomic<uint_t> rd;
+  uint8_t             pad2[CACHE_LINE_SIZE];
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
@@ -0,0 +1,336 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+
+#include "OSCompiler.h"
+
+#ifdef TARGET_OS_UNIXBSD
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define BBCDEBUG_LEVEL 2
+#include "MappedFile.h"
+
+BBC_AUDIOTOOLBOX_START
+
+MappedFile::MappedFile() : EnhancedFile(),
+                           data(NULL),
+                           length(0),
+                           pos(0),
+                           pattern(ACCESS_NORMAL)
+{
+}
+
+MappedFile::MappedFile(const char *filename, const char *mode) : EnhancedFile(),
+                                                                 data(NULL),
+                                                                 length(0),
+                                                                 pos(0),
+                                                                 pattern(ACCESS_NORMAL)
+{
+  fopen(filename, mode);
+}
+
+MappedFile::MappedFile(const MappedFile& obj) : EnhancedFile(),
+                                                data(NULL),
+                                                length(0),
+                                                pos(0),
+                                                pattern(ACCESS_NORMAL)
+{
+  operator = (obj);
+}
+
+MappedFile::~MappedFile()
+{
+  fclose();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Duplicate file by assignment
+ *
+ * @note this will open (and map) the same file again!
+ */
+/*--------------------------------------------------------------------------------*/
+MappedFile& MappedFile::operator = (const MappedFile& obj)
+{
+  // access pattern is applied when the file is mapped
+  pattern = obj.pattern;
+  EnhancedFile::operator = (obj);
+  return *this;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Open file, mapping it if it is opened for reading only
+ */
+/*--------------------------------------------------------------------------------*/
+bool MappedFile::fopen(const char *filename, const char *mode)
+{
+  bool success = EnhancedFile::fopen(filename, mode);
+
+#ifdef TARGET_OS_UNIXBSD
+  // only map (regular) files opened for reading only
+  if (success && allowclose && (mode[0] == 'r') && !strchr(mode, '+'))
+  {
+    struct stat st;
+
+    if ((fstat(fileno(fp), &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0) && ((uint64_t)st.st_size <= (uint64_t)(size_t)~0))
+    {
+      void *p;
+
+      if ((p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fileno(fp), 0)) != MAP_FAILED)
+      {
+        data   = (uint8_t *)p;
+        length = (uint64_t)st.st_size;
+        pos    = 0;
+        ApplyAccessPattern();
+
+        BBCDEBUG2(("Mapped %s bytes of '%s'", StringFrom(length).c_str(), filename));
+      }
+      else BBCDEBUG2(("Failed to map '%s', reading normally: %s", filename, strerror(errno)));
+    }
+  }
+#endif
+
+  return success;
+}
+
+void MappedFile::fclose()
+{
+#ifdef TARGET_OS_UNIXBSD
+  if (data) munmap(data, (size_t)length);
+#endif
+  data   = NULL;
+  length = 0;
+  pos    = 0;
+
+  EnhancedFile::fclose();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return pointer to 'bytes' bytes of the file starting at offset (without copying)
+ *
+ * @return pointer or NULL if the file is not mapped or the range is not entirely within the file
+ *
+ * @note the pointer is valid until the file is closed
+ */
+/*--------------------------------------------------------------------------------*/
+const uint8_t *MappedFile::GetPointer(uint64_t offset, uint64_t bytes) const
+{
+  return (data && (offset <= length) && (bytes <= (length - offset))) ? data + offset : NULL;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Tell the kernel how the file will be accessed (ACCESS_xxx above)
+ *
+ * @return true if the hint was given
+ *
+ * @note the pattern is remembered and applied whenever a file is mapped
+ */
+/*--------------------------------------------------------------------------------*/
+bool MappedFile::SetAccessPattern(uint_t _pattern)
+{
+  pattern = _pattern;
+  return ApplyAccessPattern();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Apply access pattern to the mapping
+ */
+/*--------------------------------------------------------------------------------*/
+bool MappedFile::ApplyAccessPattern()
+{
+  bool success = false;
+
+#ifdef TARGET_OS_UNIXBSD
+  if (data)
+  {
+    int advice;
+
+    switch (pattern)
+    {
+      case ACCESS_SEQUENTIAL:
+        advice = MADV_SEQUENTIAL;
+        break;
+
+      case ACCESS_RANDOM:
+        advice = MADV_RANDOM;
+        break;
+
+      default:
+        advice = MADV_NORMAL;
+        break;
+    }
+
+    if (!(success = (madvise(data, (size_t)length, advice) == 0)))
+    {
+      BBCERROR("Failed to set access pattern %u for '%s': %s", pattern, filename.c_str(), strerror(errno));
+    }
+  }
+#endif
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Tell the kernel that 'bytes' bytes of the file starting at offset will be needed soon
+ *
+ * @return true if the hint was given
+ */
+/*--------------------------------------------------------------------------------*/
+bool MappedFile::Prefetch(uint64_t offset, uint64_t bytes)
+{
+  bool success = false;
+
+#ifdef TARGET_OS_UNIXBSD
+  if (data && (offset < length))
+  {
+    // the range must start on a page boundary
+    uint64_t start = offset & ~(uint64_t)(GetPageSize() - 1);
+    uint64_t end   = std::min(offset + bytes, length);
+
+    success = (madvise(data + start, (size_t)(end - start), MADV_WILLNEED) == 0);
+  }
+#else
+  UNUSED_PARAMETER(offset);
+  UNUSED_PARAMETER(bytes);
+#endif
+
+  return success;
+}
+
+size_t MappedFile::fread(void *ptr, size_t size, size_t count)
+{
+  if (data)
+  {
+    // like stdio, a partial item at the end of the file is read but not counted
+    size_t bytes = (pos < length) ? (size_t)std::min((uint64_t)size * count, length - pos) : 0;
+
+    memcpy(ptr, data + pos, bytes);
+    pos += bytes;
+
+    return size ? bytes / size : 0;
+  }
+
+  return EnhancedFile::fread(ptr, size, count);
+}
+
+off_t MappedFile::ftell() const
+{
+  return data ? (off_t)pos : EnhancedFile::ftell();
+}
+
+off_t MappedFile::ftell()
+{
+  return data ? (off_t)pos : EnhancedFile::ftell();
+}
+
+int MappedFile::fseek(off_t offset, int origin)
+{
+  if (data)
+  {
+    sint64_t newpos = offset;
+
+    if      (origin == SEEK_CUR) newpos += (sint64_t)pos;
+    else if (origin == SEEK_END) newpos += (sint64_t)length;
+    else if (origin != SEEK_SET) newpos  = -1;
+
+    // like stdio, seeking beyond the end is allowed
+    if (newpos < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+    pos = (uint64_t)newpos;
+    return 0;
+  }
+
+  return EnhancedFile::fseek(offset, origin);
+}
+
+void MappedFile::rewind()
+{
+  if (data) pos = 0;
+  else      EnhancedFile::rewind();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read a line of text from an open file
+ *
+ * @param line buffer to receive text
+ * @param maxlen maximum number of bytes that 'line' can hold (INCLUDING terminator)
+ *
+ * @return number of chracters in buffer (excluding terminator), EOF on end of file (with no characters stored)
+ */
+/*--------------------------------------------------------------------------------*/
+int MappedFile::readline(char *line, uint_t maxlen)
+{
+  if (data)
+  {
+    uint_t i = 0;
+
+    // at end of file
+    if (pos >= length)
+    {
+      line[0] = 0;
+      return EOF;
+    }
+
+    // reduce buffer space by one for terminator
+    maxlen--;
+
+    // copy characters until end of file or linefeed character (which is skipped)
+    while ((pos < length) && (data[pos] != '\n'))
+    {
+      char c = (char)data[pos++];
+
+      // ignore overspill characters carriage-returns
+      if ((i < maxlen) && (c != '\r')) line[i++] = c;
+    }
+    if (pos < length) pos++;
+
+    // add terminator
+    line[i] = 0;
+
+    return i;
+  }
+
+  return EnhancedFile::readline(line, maxlen);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read at an explicit offset without using or changing the file position (copied from the mapping)
+ */
+/*--------------------------------------------------------------------------------*/
+sint64_t MappedFile::preadv(const FILEIOVEC *iov, uint_t niov, off_t offset)
+{
+  if (data)
+  {
+    uint64_t readpos = (uint64_t)offset;
+    uint_t   i;
+
+    if (offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+    for (i = 0; (i < niov) && (readpos < length); i++)
+    {
+      size_t bytes = (size_t)std::min((uint64_t)iov[i].bytes, length - readpos);
+
+      memcpy(iov[i].data, data + readpos, bytes);
+      readpos += bytes;
+    }
+
+    return (sint64_t)(readpos - (uint64_t)offset);
+  }
+
+  return EnhancedFile::preadv(iov, niov, offset);
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,142 @@
+#ifndef __MAPPED_FILE__
+#define __MAPPED_FILE__
+
+#include "EnhancedFile.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** An enhancement of EnhancedFile that memory-maps files opened for reading only
+ *
+ * fread(), fseek(), ftell(), readline() and preadv() work on the mapping so reads are a single
+ * copy from the page cache (and seeks cost nothing); GetPointer() gives zero-copy access
+ * to any part of the file and SetAccessPattern() and Prefetch() pass hints to the kernel
+ * (madvise())
+ *
+ * Files opened for writing, files which cannot be mapped (e.g. pipes or empty files) and
+ * platforms without mmap() are handled exactly as EnhancedFile
+ *
+ * @note the mapping covers the file as it was when opened: data appended later is not seen
+ * and truncating the file whilst it is mapped may cause a bus error on access
+ */
+/*--------------------------------------------------------------------------------*/
+class MappedFile : public EnhancedFile {
+public:
+  MappedFile();
+  MappedFile(const char *filename, const char *mode = "rb");
+  MappedFile(const MappedFile& obj);
+  virtual ~MappedFile();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Duplicate file by assignment
+   *
+   * @note this will open (and map) the same file again!
+   */
+  /*--------------------------------------------------------------------------------*/
+  MappedFile& operator = (const MappedFile& obj);
+
+  enum
+  {
+    ACCESS_NORMAL = 0,                  // no particular access pattern (default)
+    ACCESS_SEQUENTIAL,                  // data will be read in order (aggressive read-ahead, pages freed after use)
+    ACCESS_RANDOM,                      // data will be read in no particular order (no read-ahead)
+  };
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit duplication via copy-constructor
+   *
+   * @note this will open (and map) the same file again!
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual MappedFile *dup() const {return new MappedFile(*this);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Open file, mapping it if it is opened for reading only
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual bool   fopen(const char *filename, const char *mode = "rb");
+  virtual void   fclose();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether the file is mapped
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool           IsMapped() const {return (data != NULL);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return length of the mapped file in bytes (0 if the file is not mapped)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint64_t       GetLength() const {return length;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return pointer to 'bytes' bytes of the file starting at offset (without copying)
+   *
+   * @return pointer or NULL if the file is not mapped or the range is not entirely within the file
+   *
+   * @note the pointer is valid until the file is closed
+   */
+  /*--------------------------------------------------------------------------------*/
+  const uint8_t *GetPointer(uint64_t offset, uint64_t bytes) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Tell the kernel how the file will be accessed (ACCESS_xxx above)
+   *
+   * @return true if the hint was given
+   *
+   * @note the pattern is remembered and applied whenever a file is mapped
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool           SetAccessPattern(uint_t pattern);
+  uint_t         GetAccessPattern() const {return pattern;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Tell the kernel that 'bytes' bytes of the file starting at offset will be needed soon
+   *
+   * @return true if the hint was given
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool           Prefetch(uint64_t offset, uint64_t bytes);
+
+  virtual size_t fread(void *ptr, size_t size, size_t count);
+  virtual off_t  ftell() const;
+  virtual off_t  ftell();
+  virtual int    fseek(off_t offset, int origin);
+  virtual void   rewind();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Read a line of text from an open file
+   *
+   * @param line buffer to receive text
+   * @param maxlen maximum number of bytes that 'line' can hold (INCLUDING terminator)
+   *
+   * @return number of chracters in buffer (excluding terminator), EOF on end of file (with no characters stored)
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual int    readline(char *line, uint_t maxlen);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Read at an explicit offset without using or changing the file position (copied from the mapping)
+   *
+   * @note like EnhancedFile::preadv(), this can be called from several threads at once
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual sint64_t preadv(const FILEIOVEC *iov, uint_t niov, off_t offset);
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Apply access pattern to the mapping
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool           ApplyAccessPattern();
+
+protected:
+  uint8_t  *data;                       // mapping (NULL if not mapped)
+  uint64_t length;                      // length of mapping
+  uint64_t pos;                         // position within mapping
+  uint_t   pattern;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
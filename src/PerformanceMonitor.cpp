@@ -155,6 +155,21 @@ std::string PerformanceMonitor::GetReportEx()
     }
   }
 
+  if (counters.size())
+  {
+    std::map<std::string,uint64_t>::const_iterator it;
+    uint_t maxlen = 0;
+
+    Printf(res, "Counters:\n");
+
+    for (it = counters.begin(); it != counters.end(); ++it) maxlen = std::max(maxlen, (uint_t)it->first.length());
+
+    for (it = counters.begin(); it != counters.end(); ++it)
+    {
+      Printf(res, "'%s'%s %20s\n", it->first.c_str(), std::string(maxlen - it->first.length(), ' ').c_str(), StringFrom((ullong_t)it->second).c_str());
+    }
+  }
+
   return res;
 }
 
@@ -431,4 +446,31 @@ void PerformanceMonitor::Stop(const std::string& id)
   else BBCERROR("No timing data for ID '%s'", id.c_str());
 }
 
+/*--------------------------------------------------------------------------------*/
+/** Set named counter (e.g. buffer statistics), creating it if necessary
+ *
+ * @note counters are included in the performance report
+ */
+/*--------------------------------------------------------------------------------*/
+void PerformanceMonitor::SetCounter(const std::string& id, uint64_t value)
+{
+  // abort quickly if measurement is not enabled
+  if (!measure) return;
+
+  ThreadLock lock(tlock);
+  counters[id] = value;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return value of named counter (or 0 if it does not exist)
+ */
+/*--------------------------------------------------------------------------------*/
+uint64_t PerformanceMonitor::GetCounter(const std::string& id) const
+{
+  ThreadLock lock(tlock);
+  std::map<std::string,uint64_t>::const_iterator it;
+
+  return ((it = counters.find(id)) != counters.end()) ? it->second : 0;
+}
+
 BBC_AUDIOTOOLBOX_END
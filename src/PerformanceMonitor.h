@@ -91,6 +91,20 @@ public:
   /*--------------------------------------------------------------------------------*/
   void Stop(const std::string& id);
 
+  /*--------------------------------------------------------------------------------*/
+  /** Set named counter (e.g. buffer statistics), creating it if necessary
+   *
+   * @note counters are included in the performance report
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetCounter(const std::string& id, uint64_t value);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return value of named counter (or 0 if it does not exist)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint64_t GetCounter(const std::string& id) const;
+
   /*--------------------------------------------------------------------------------*/
   /** Return textual performance report
    */
@@ -155,6 +169,7 @@ protected:
   uint_t           avglen;
   std::map<std::string,TIMING_DATA> timings;
   std::vector<const TIMING_DATA *>  timingslist;
+  std::map<std::string,uint64_t>    counters;
   std::string      logfiledir;
   
   FILE *fp;
@@ -0,0 +1,419 @@
+
+#include <cmath>
+
+#define BBCDEBUG_LEVEL 1
+#include "PositionBlock.h"
+#include "PositionKernels.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Construct block of n positions, all at the origin
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+PositionBlockT<T>::PositionBlockT(uint_t n, bool _polar) : count(0),
+                                                          stride(0),
+                                                          polar(_polar)
+{
+  Resize(n);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Construct block from a list of positions
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+PositionBlockT<T>::PositionBlockT(const std::vector<Position>& positions, bool _polar) : count(0),
+                                                                                        stride(0),
+                                                                                        polar(_polar)
+{
+  Set(positions);
+}
+
+template<typename T>
+PositionBlockT<T>::PositionBlockT(const PositionBlockT& obj) : data(obj.data),
+                                                              count(obj.count),
+                                                              stride(obj.stride),
+                                                              polar(obj.polar)
+{
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Assignment operator
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+PositionBlockT<T>& PositionBlockT<T>::operator = (const PositionBlockT& obj)
+{
+  if (&obj != this)
+  {
+    data   = obj.data;
+    count  = obj.count;
+    stride = obj.stride;
+    polar  = obj.polar;
+  }
+  return *this;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Change the number of positions in the block
+ *
+ * @note existing positions (up to the new size) are preserved, new positions are at the origin
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void PositionBlockT<T>::Resize(uint_t n)
+{
+  if (n != count)
+  {
+    uint_t newstride = CalcStride(n);
+
+    if (newstride != stride)
+    {
+      std::vector<T, AlignedAllocator<T> > newdata(3 * newstride, (T)0);
+      uint_t c, ncopy = std::min(n, count);
+
+      // copy each component array into its new location
+      for (c = 0; c < 3; c++)
+      {
+        std::copy(data.begin() + c * stride, data.begin() + c * stride + ncopy, newdata.begin() + c * newstride);
+      }
+
+      data.swap(newdata);
+      stride = newstride;
+    }
+    else if (n > count)
+    {
+      uint_t c;
+
+      // clear new positions
+      for (c = 0; c < 3; c++) std::fill(GetComponent(c) + count, GetComponent(c) + n, (T)0);
+    }
+
+    count = n;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set a single position, converting it to the co-ordinate system of this block
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void PositionBlockT<T>::Set(uint_t i, const Position& pos)
+{
+  if (i < count)
+  {
+    Position _pos = polar ? pos.Polar() : pos.Cart();
+    uint_t c;
+
+    for (c = 0; c < 3; c++) GetComponent(c)[i] = (T)_pos.pos.elements[c];
+  }
+  else BBCERROR("Position index %u out of range (%u positions)", i, count);
+}
+
+template<typename T>
+void PositionBlockT<T>::Set(uint_t i, const PositionT<T>& pos)
+{
+  if (i < count)
+  {
+    PositionT<T> _pos = polar ? pos.Polar() : pos.Cart();
+    uint_t c;
+
+    for (c = 0; c < 3; c++) GetComponent(c)[i] = _pos.pos.elements[c];
+  }
+  else BBCERROR("Position index %u out of range (%u positions)", i, count);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return a single position (in the co-ordinate system of this block)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+Position PositionBlockT<T>::Get(uint_t i) const
+{
+  Position pos;
+
+  pos.polar = polar;
+  if (i < count)
+  {
+    uint_t c;
+
+    for (c = 0; c < 3; c++) pos.pos.elements[c] = GetComponent(c)[i];
+  }
+  else BBCERROR("Position index %u out of range (%u positions)", i, count);
+
+  return pos;
+}
+
+template<typename T>
+PositionT<T> PositionBlockT<T>::GetT(uint_t i) const
+{
+  PositionT<T> pos;
+
+  pos.polar = polar;
+  if (i < count)
+  {
+    uint_t c;
+
+    for (c = 0; c < 3; c++) pos.pos.elements[c] = GetComponent(c)[i];
+  }
+  else BBCERROR("Position index %u out of range (%u positions)", i, count);
+
+  return pos;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set block from a list of positions (resizing the block)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void PositionBlockT<T>::Set(const std::vector<Position>& positions)
+{
+  uint_t i;
+
+  Resize((uint_t)positions.size());
+
+  for (i = 0; i < count; i++) Set(i, positions[i]);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Get list of positions from block
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void PositionBlockT<T>::Get(std::vector<Position>& positions) const
+{
+  uint_t i;
+
+  positions.resize(count);
+
+  for (i = 0; i < count; i++) positions[i] = Get(i);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return the same positions but as polar co-ordinates
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+PositionBlockT<T> PositionBlockT<T>::Polar() const
+{
+  PositionBlockT res;
+  Polar(res);
+  return res;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Convert positions to polar co-ordinates into an existing block
+ *
+ * @note res is only re-allocated if its size is different to this block
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void PositionBlockT<T>::Polar(PositionBlockT& res) const
+{
+  if (polar)
+  {
+    if (&res != this) res = *this;
+  }
+  else
+  {
+    res.Resize(count);
+    res.polar = true;
+
+    CartToPolar(GetX(), GetY(), GetZ(), res.GetAz(), res.GetEl(), res.GetD(), count);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return the same positions but as cartesian co-ordinates
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+PositionBlockT<T> PositionBlockT<T>::Cart() const
+{
+  PositionBlockT res;
+  Cart(res);
+  return res;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Convert positions to cartesian co-ordinates into an existing block
+ *
+ * @note res is only re-allocated if its size is different to this block
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void PositionBlockT<T>::Cart(PositionBlockT& res) const
+{
+  if (!polar)
+  {
+    if (&res != this) res = *this;
+  }
+  else
+  {
+    res.Resize(count);
+    res.polar = false;
+
+    PolarToCart(GetAz(), GetEl(), GetD(), res.GetX(), res.GetY(), res.GetZ(), count);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return unit vector versions of the positions
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+PositionBlockT<T> PositionBlockT<T>::Unit() const
+{
+  PositionBlockT res;
+  Unit(res);
+  return res;
+}
+
+template<typename T>
+void PositionBlockT<T>::Unit(PositionBlockT& res) const
+{
+  uint_t i;
+
+  if (&res != this) res = *this;
+
+  if (polar)
+  {
+    T *d = res.GetD();
+
+    for (i = 0; i < count; i++)
+    {
+      if (d[i] > 0) d[i] = 1;
+    }
+  }
+  else
+  {
+    T *x = res.GetX(), *y = res.GetY(), *z = res.GetZ();
+
+    for (i = 0; i < count; i++)
+    {
+      T d = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+
+      if (d > 0)
+      {
+        T m = (T)1 / d;
+        x[i] *= m;
+        y[i] *= m;
+        z[i] *= m;
+      }
+    }
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate modulus (distance) of each position from origin
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void PositionBlockT<T>::Mod(T *res) const
+{
+  uint_t i;
+
+  if (polar)
+  {
+    std::copy(GetD(), GetD() + count, res);
+  }
+  else
+  {
+    const T *x = GetX(), *y = GetY(), *z = GetZ();
+
+    for (i = 0; i < count; i++) res[i] = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate dot products of corresponding positions in two blocks of the same size
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void DotProduct(const PositionBlockT<T>& obj1, const PositionBlockT<T>& obj2, T *res)
+{
+  // both must be cartesian!
+  if (obj1.IsPolar() || obj2.IsPolar())
+  {
+    DotProduct(obj1.IsPolar() ? obj1.Cart() : obj1, obj2.IsPolar() ? obj2.Cart() : obj2, res);
+  }
+  else
+  {
+    const T *x1 = obj1.GetX(), *y1 = obj1.GetY(), *z1 = obj1.GetZ();
+    const T *x2 = obj2.GetX(), *y2 = obj2.GetY(), *z2 = obj2.GetZ();
+    uint_t i, n = std::min(obj1.GetCount(), obj2.GetCount());
+
+    if (obj1.GetCount() != obj2.GetCount()) BBCERROR("Dot product of different sized position blocks (%u and %u)", obj1.GetCount(), obj2.GetCount());
+
+    for (i = 0; i < n; i++) res[i] = x1[i] * x2[i] + y1[i] * y2[i] + z1[i] * z2[i];
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate dot products of each position with a single position
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void DotProduct(const PositionBlockT<T>& obj1, const Position& obj2, T *res)
+{
+  // both must be cartesian!
+  if (obj1.IsPolar()) DotProduct(obj1.Cart(), obj2, res);
+  else
+  {
+    const T *x1 = obj1.GetX(), *y1 = obj1.GetY(), *z1 = obj1.GetZ();
+    Position pos2 = obj2.Cart();
+    T        x2 = (T)pos2.pos.x, y2 = (T)pos2.pos.y, z2 = (T)pos2.pos.z;
+    uint_t   i;
+
+    for (i = 0; i < obj1.GetCount(); i++) res[i] = x1[i] * x2 + y1[i] * y2 + z1[i] * z2;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate angles (in degrees) between corresponding positions in two blocks of the same size
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void Angle(const PositionBlockT<T>& obj1, const PositionBlockT<T>& obj2, T *res)
+{
+  uint_t i, n = std::min(obj1.GetCount(), obj2.GetCount());
+
+  DotProduct(obj1.Cart().Unit(), obj2.Cart().Unit(), res);
+
+  for (i = 0; i < n; i++) res[i] = std::acos(limited::limit(res[i], (T)-1, (T)1)) * (T)(180.0 / M_PI);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate angles (in degrees) between each position and a single position
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void Angle(const PositionBlockT<T>& obj1, const Position& obj2, T *res)
+{
+  uint_t i;
+
+  DotProduct(obj1.Cart().Unit(), obj2.Unit(), res);
+
+  for (i = 0; i < obj1.GetCount(); i++) res[i] = std::acos(limited::limit(res[i], (T)-1, (T)1)) * (T)(180.0 / M_PI);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Explicit instantiations for double and float
+ */
+/*--------------------------------------------------------------------------------*/
+template class PositionBlockT<double>;
+template class PositionBlockT<float>;
+
+template void DotProduct(const PositionBlockT<double>& obj1, const PositionBlockT<double>& obj2, double *res);
+template void DotProduct(const PositionBlockT<double>& obj1, const Position& obj2, double *res);
+template void Angle(const PositionBlockT<double>& obj1, const PositionBlockT<double>& obj2, double *res);
+template void Angle(const PositionBlockT<double>& obj1, const Position& obj2, double *res);
+
+template void DotProduct(const PositionBlockT<float>& obj1, const PositionBlockT<float>& obj2, float *res);
+template void DotProduct(const PositionBlockT<float>& obj1, const Position& obj2, float *res);
+template void Angle(const PositionBlockT<float>& obj1, const PositionBlockT<float>& obj2, float *res);
+template void Angle(const PositionBlockT<float>& obj1, const Position& obj2, float *res);
+
+BBC_AUDIOTOOLBOX_END
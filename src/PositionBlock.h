@@ -0,0 +1,237 @@
+#ifndef __POSITION_BLOCK__
+#define __POSITION_BLOCK__
+
+#include <vector>
+
+#include "3DPositionT.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Structure-of-arrays container for a block of positions
+ *
+ * Holds a number of positions (all either polar or cartesian) with each component
+ * stored in its own aligned array, i.e. {x[0..n-1]}, {y[0..n-1]}, {z[0..n-1]} or
+ * {az[0..n-1]}, {el[0..n-1]}, {d[0..n-1]}
+ *
+ * This layout allows whole scenes of positions to be processed per audio block
+ * without virtual calls and in a way that the compiler (or explicit SIMD code) can vectorise
+ *
+ * Each component array starts on a 32-byte boundary
+ *
+ * The block is templated on scalar type: PositionBlock holds doubles and PositionBlockF holds
+ * floats (half the memory and twice the values per SIMD register), conversion between
+ * the two is explicit
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+class PositionBlockT
+{
+public:
+  typedef T value_type;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Construct block of n positions, all at the origin
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionBlockT(uint_t n = 0, bool _polar = false);
+  /*--------------------------------------------------------------------------------*/
+  /** Construct block from a list of positions
+   *
+   * @param positions list of positions
+   * @param _polar true to store positions as polar co-ordinates, false for cartesian
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionBlockT(const std::vector<Position>& positions, bool _polar = false);
+  PositionBlockT(const PositionBlockT& obj);
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit conversion from another precision
+   */
+  /*--------------------------------------------------------------------------------*/
+  template<typename T2>
+  explicit PositionBlockT(const PositionBlockT<T2>& obj) : count(0),
+                                                           stride(0),
+                                                           polar(obj.IsPolar())
+  {
+    uint_t c;
+
+    Resize(obj.GetCount());
+    for (c = 0; c < 3; c++) std::copy(obj.GetComponent(c), obj.GetComponent(c) + count, GetComponent(c));
+  }
+  ~PositionBlockT() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Assignment operator
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionBlockT& operator = (const PositionBlockT& obj);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Change the number of positions in the block
+   *
+   * @note existing positions (up to the new size) are preserved, new positions are at the origin
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Resize(uint_t n);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of positions in the block
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetCount() const {return count;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether the positions in this block are polar co-ordinates
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool IsPolar() const {return polar;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set co-ordinate system *without* converting values (for filling from raw data)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetPolar(bool _polar) {polar = _polar;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return component array (0 = x or az, 1 = y or el, 2 = z or d)
+   */
+  /*--------------------------------------------------------------------------------*/
+  T       *GetComponent(uint_t c)       {return data.data() + c * stride;}
+  const T *GetComponent(uint_t c) const {return data.data() + c * stride;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Named component access (use the set appropriate to IsPolar())
+   */
+  /*--------------------------------------------------------------------------------*/
+  T       *GetX()        {return GetComponent(0);}
+  const T *GetX() const  {return GetComponent(0);}
+  T       *GetY()        {return GetComponent(1);}
+  const T *GetY() const  {return GetComponent(1);}
+  T       *GetZ()        {return GetComponent(2);}
+  const T *GetZ() const  {return GetComponent(2);}
+  T       *GetAz()       {return GetComponent(0);}
+  const T *GetAz() const {return GetComponent(0);}
+  T       *GetEl()       {return GetComponent(1);}
+  const T *GetEl() const {return GetComponent(1);}
+  T       *GetD()        {return GetComponent(2);}
+  const T *GetD() const  {return GetComponent(2);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set a single position, converting it to the co-ordinate system of this block
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Set(uint_t i, const Position& pos);
+  void Set(uint_t i, const PositionT<T>& pos);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return a single position (in the co-ordinate system of this block)
+   */
+  /*--------------------------------------------------------------------------------*/
+  Position Get(uint_t i) const;
+  PositionT<T> GetT(uint_t i) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set block from a list of positions (resizing the block)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Set(const std::vector<Position>& positions);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Get list of positions from block
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Get(std::vector<Position>& positions) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return the same positions but as polar co-ordinates
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionBlockT Polar() const;
+  /*--------------------------------------------------------------------------------*/
+  /** Convert positions to polar co-ordinates into an existing block
+   *
+   * @note res is only re-allocated if its size is different to this block
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Polar(PositionBlockT& res) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return the same positions but as cartesian co-ordinates
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionBlockT Cart() const;
+  /*--------------------------------------------------------------------------------*/
+  /** Convert positions to cartesian co-ordinates into an existing block
+   *
+   * @note res is only re-allocated if its size is different to this block
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Cart(PositionBlockT& res) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return unit vector versions of the positions
+   */
+  /*--------------------------------------------------------------------------------*/
+  PositionBlockT Unit() const;
+  void Unit(PositionBlockT& res) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate modulus (distance) of each position from origin
+   *
+   * @param res array of GetCount() values to receive distances
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Mod(T *res) const;
+
+protected:
+  enum {ALIGNMENT_COUNT = 32 / sizeof(T)};  // number of values per 32 bytes
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return stride between component arrays for n positions (rounded up to keep 32-byte alignment)
+   */
+  /*--------------------------------------------------------------------------------*/
+  static uint_t CalcStride(uint_t n) {return (n + ALIGNMENT_COUNT - 1) & ~(ALIGNMENT_COUNT - 1);}
+
+protected:
+  std::vector<T, AlignedAllocator<T> > data;
+  uint_t count;
+  uint_t stride;
+  bool   polar;
+};
+
+typedef PositionBlockT<double> PositionBlock;
+typedef PositionBlockT<float>  PositionBlockF;
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate dot products of corresponding positions in two blocks of the same size
+ *
+ * @param res array of GetCount() values to receive dot products
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void DotProduct(const PositionBlockT<T>& obj1, const PositionBlockT<T>& obj2, T *res);
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate dot products of each position with a single position
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void DotProduct(const PositionBlockT<T>& obj1, const Position& obj2, T *res);
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate angles (in degrees) between corresponding positions in two blocks of the same size
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void Angle(const PositionBlockT<T>& obj1, const PositionBlockT<T>& obj2, T *res);
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate angles (in degrees) between each position and a single position
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+void Angle(const PositionBlockT<T>& obj1, const Position& obj2, T *res);
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
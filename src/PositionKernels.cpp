@@ -0,0 +1,406 @@
+
+#include <math.h>
+
+#define BBCDEBUG_LEVEL 1
+#include "PositionKernels.h"
+
+#if defined(COMPILER_GCC) && (defined(__x86_64__) || defined(__i386__))
+#define POSITIONKERNELS_X86
+#include <immintrin.h>
+#endif
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Scalar versions (identical calculations to Position::Polar() and Position::Cart(), in double precision for any T)
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+static void ScalarCartToPolar(const T *x, const T *y, const T *z, T *az, T *el, T *d, uint_t n)
+{
+  uint_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    // read all components first to allow in-place conversion
+    double _x = x[i], _y = y[i], _z = z[i];
+    double _d = sqrt(_x * _x + _y * _y + _z * _z);
+
+    az[i] = el[i] = 0;
+    d[i]  = (T)_d;
+
+    // see Position::Polar() for derivation
+    if (_d > 0.0)
+    {
+      el[i] = (T)(asin(_z / _d) * 180.0 / M_PI);
+      if ((_x != 0.0) || (_y != 0.0)) az[i] = (T)(atan2(-_x, _y) * 180.0 / M_PI);
+    }
+  }
+}
+
+template<typename T>
+static void ScalarPolarToCart(const T *az, const T *el, const T *d, T *x, T *y, T *z, uint_t n)
+{
+  uint_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    // read all components first to allow in-place conversion
+    double _az = az[i] * M_PI / 180.0, _el = el[i] * M_PI / 180.0, _d = d[i];
+    double cosel = cos(_el);
+
+    // see Position::Cart() for derivation
+    x[i] = (T)(_d * -sin(_az) * cosel);
+    y[i] = (T)(_d *  cos(_az) * cosel);
+    z[i] = (T)(_d *  sin(_el));
+  }
+}
+
+#ifdef POSITIONKERNELS_X86
+/*--------------------------------------------------------------------------------*/
+/** SSE2 versions (SSE2 is always available on x86-64 and the build requires SSE3 anyway)
+ */
+/*--------------------------------------------------------------------------------*/
+namespace sse2
+{
+  struct OPS
+  {
+    typedef double  T;
+    typedef __m128d V;
+    enum {N = 2, SINGLE = 0};
+    static inline V    load(const double *p)    {return _mm_loadu_pd(p);}
+    static inline void store(double *p, V a)    {_mm_storeu_pd(p, a);}
+    static inline V    set1(double a)           {return _mm_set1_pd(a);}
+    static inline V    zero()                   {return _mm_setzero_pd();}
+    static inline V    add(V a, V b)            {return _mm_add_pd(a, b);}
+    static inline V    sub(V a, V b)            {return _mm_sub_pd(a, b);}
+    static inline V    mul(V a, V b)            {return _mm_mul_pd(a, b);}
+    static inline V    div(V a, V b)            {return _mm_div_pd(a, b);}
+    static inline V    madd(V a, V b, V c)      {return _mm_add_pd(_mm_mul_pd(a, b), c);}
+    static inline V    sqrt(V a)                {return _mm_sqrt_pd(a);}
+    static inline V    min(V a, V b)            {return _mm_min_pd(a, b);}
+    static inline V    max(V a, V b)            {return _mm_max_pd(a, b);}
+    static inline V    and_(V a, V b)           {return _mm_and_pd(a, b);}
+    static inline V    or_(V a, V b)            {return _mm_or_pd(a, b);}
+    static inline V    xor_(V a, V b)           {return _mm_xor_pd(a, b);}
+    static inline V    andnot(V a, V b)         {return _mm_andnot_pd(a, b);}
+    static inline V    cmpeq(V a, V b)          {return _mm_cmpeq_pd(a, b);}
+    static inline V    cmplt(V a, V b)          {return _mm_cmplt_pd(a, b);}
+    static inline V    cmpgt(V a, V b)          {return _mm_cmpgt_pd(a, b);}
+    static inline V    blend(V m, V a, V b)     {return _mm_or_pd(_mm_and_pd(m, b), _mm_andnot_pd(m, a));}
+  };
+
+#include "PositionKernelsSIMD.h"
+}
+
+namespace sse2f
+{
+  struct OPS
+  {
+    typedef float  T;
+    typedef __m128 V;
+    enum {N = 4, SINGLE = 1};
+    static inline V    load(const float *p)     {return _mm_loadu_ps(p);}
+    static inline void store(float *p, V a)     {_mm_storeu_ps(p, a);}
+    static inline V    set1(float a)            {return _mm_set1_ps(a);}
+    static inline V    zero()                   {return _mm_setzero_ps();}
+    static inline V    add(V a, V b)            {return _mm_add_ps(a, b);}
+    static inline V    sub(V a, V b)            {return _mm_sub_ps(a, b);}
+    static inline V    mul(V a, V b)            {return _mm_mul_ps(a, b);}
+    static inline V    div(V a, V b)            {return _mm_div_ps(a, b);}
+    static inline V    madd(V a, V b, V c)      {return _mm_add_ps(_mm_mul_ps(a, b), c);}
+    static inline V    sqrt(V a)                {return _mm_sqrt_ps(a);}
+    static inline V    min(V a, V b)            {return _mm_min_ps(a, b);}
+    static inline V    max(V a, V b)            {return _mm_max_ps(a, b);}
+    static inline V    and_(V a, V b)           {return _mm_and_ps(a, b);}
+    static inline V    or_(V a, V b)            {return _mm_or_ps(a, b);}
+    static inline V    xor_(V a, V b)           {return _mm_xor_ps(a, b);}
+    static inline V    andnot(V a, V b)         {return _mm_andnot_ps(a, b);}
+    static inline V    cmpeq(V a, V b)          {return _mm_cmpeq_ps(a, b);}
+    static inline V    cmplt(V a, V b)          {return _mm_cmplt_ps(a, b);}
+    static inline V    cmpgt(V a, V b)          {return _mm_cmpgt_ps(a, b);}
+    static inline V    blend(V m, V a, V b)     {return _mm_or_ps(_mm_and_ps(m, b), _mm_andnot_ps(m, a));}
+  };
+
+#include "PositionKernelsSIMD.h"
+}
+
+/*--------------------------------------------------------------------------------*/
+/** AVX2/FMA versions, compiled for AVX2 regardless of build flags and only used if the processor supports it
+ */
+/*--------------------------------------------------------------------------------*/
+#ifdef __clang__
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+namespace avx2
+{
+  struct OPS
+  {
+    typedef double  T;
+    typedef __m256d V;
+    enum {N = 4, SINGLE = 0};
+    static inline V    load(const double *p)    {return _mm256_loadu_pd(p);}
+    static inline void store(double *p, V a)    {_mm256_storeu_pd(p, a);}
+    static inline V    set1(double a)           {return _mm256_set1_pd(a);}
+    static inline V    zero()                   {return _mm256_setzero_pd();}
+    static inline V    add(V a, V b)            {return _mm256_add_pd(a, b);}
+    static inline V    sub(V a, V b)            {return _mm256_sub_pd(a, b);}
+    static inline V    mul(V a, V b)            {return _mm256_mul_pd(a, b);}
+    static inline V    div(V a, V b)            {return _mm256_div_pd(a, b);}
+    static inline V    madd(V a, V b, V c)      {return _mm256_fmadd_pd(a, b, c);}
+    static inline V    sqrt(V a)                {return _mm256_sqrt_pd(a);}
+    static inline V    min(V a, V b)            {return _mm256_min_pd(a, b);}
+    static inline V    max(V a, V b)            {return _mm256_max_pd(a, b);}
+    static inline V    and_(V a, V b)           {return _mm256_and_pd(a, b);}
+    static inline V    or_(V a, V b)            {return _mm256_or_pd(a, b);}
+    static inline V    xor_(V a, V b)           {return _mm256_xor_pd(a, b);}
+    static inline V    andnot(V a, V b)         {return _mm256_andnot_pd(a, b);}
+    static inline V    cmpeq(V a, V b)          {return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);}
+    static inline V    cmplt(V a, V b)          {return _mm256_cmp_pd(a, b, _CMP_LT_OQ);}
+    static inline V    cmpgt(V a, V b)          {return _mm256_cmp_pd(a, b, _CMP_GT_OQ);}
+    static inline V    blend(V m, V a, V b)     {return _mm256_blendv_pd(a, b, m);}
+  };
+
+#include "PositionKernelsSIMD.h"
+}
+
+namespace avx2f
+{
+  struct OPS
+  {
+    typedef float  T;
+    typedef __m256 V;
+    enum {N = 8, SINGLE = 1};
+    static inline V    load(const float *p)     {return _mm256_loadu_ps(p);}
+    static inline void store(float *p, V a)     {_mm256_storeu_ps(p, a);}
+    static inline V    set1(float a)            {return _mm256_set1_ps(a);}
+    static inline V    zero()                   {return _mm256_setzero_ps();}
+    static inline V    add(V a, V b)            {return _mm256_add_ps(a, b);}
+    static inline V    sub(V a, V b)            {return _mm256_sub_ps(a, b);}
+    static inline V    mul(V a, V b)            {return _mm256_mul_ps(a, b);}
+    static inline V    div(V a, V b)            {return _mm256_div_ps(a, b);}
+    static inline V    madd(V a, V b, V c)      {return _mm256_fmadd_ps(a, b, c);}
+    static inline V    sqrt(V a)                {return _mm256_sqrt_ps(a);}
+    static inline V    min(V a, V b)            {return _mm256_min_ps(a, b);}
+    static inline V    max(V a, V b)            {return _mm256_max_ps(a, b);}
+    static inline V    and_(V a, V b)           {return _mm256_and_ps(a, b);}
+    static inline V    or_(V a, V b)            {return _mm256_or_ps(a, b);}
+    static inline V    xor_(V a, V b)           {return _mm256_xor_ps(a, b);}
+    static inline V    andnot(V a, V b)         {return _mm256_andnot_ps(a, b);}
+    static inline V    cmpeq(V a, V b)          {return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);}
+    static inline V    cmplt(V a, V b)          {return _mm256_cmp_ps(a, b, _CMP_LT_OQ);}
+    static inline V    cmpgt(V a, V b)          {return _mm256_cmp_ps(a, b, _CMP_GT_OQ);}
+    static inline V    blend(V m, V a, V b)     {return _mm256_blendv_ps(a, b, m);}
+  };
+
+#include "PositionKernelsSIMD.h"
+}
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif
+
+/*--------------------------------------------------------------------------------*/
+/** Return whether a kernel type is available on this processor
+ */
+/*--------------------------------------------------------------------------------*/
+bool PositionKernelsAvailable(uint_t type)
+{
+  bool available = false;
+
+  switch (type)
+  {
+    case POSITIONKERNELS_AUTO:
+    case POSITIONKERNELS_SCALAR:
+      available = true;
+      break;
+
+#ifdef POSITIONKERNELS_X86
+    case POSITIONKERNELS_SSE2:
+      available = (__builtin_cpu_supports("sse2") != 0);
+      break;
+
+    case POSITIONKERNELS_AVX2:
+      available = ((__builtin_cpu_supports("avx2") != 0) && (__builtin_cpu_supports("fma") != 0));
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  return available;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return best kernel type for this processor
+ */
+/*--------------------------------------------------------------------------------*/
+static uint_t GetBestPositionKernels()
+{
+  uint_t type;
+
+  if      (PositionKernelsAvailable(POSITIONKERNELS_AVX2)) type = POSITIONKERNELS_AVX2;
+  else if (PositionKernelsAvailable(POSITIONKERNELS_SSE2)) type = POSITIONKERNELS_SSE2;
+  else type = POSITIONKERNELS_SCALAR;
+
+  BBCDEBUG2(("Using position kernel type %u", type));
+
+  return type;
+}
+
+static uint_t& CurrentPositionKernels()
+{
+  static uint_t type = GetBestPositionKernels();
+  return type;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Select kernel type (normally only used for testing or benchmarking)
+ */
+/*--------------------------------------------------------------------------------*/
+bool SetPositionKernels(uint_t type)
+{
+  bool success = false;
+
+  if (type == POSITIONKERNELS_AUTO)
+  {
+    CurrentPositionKernels() = GetBestPositionKernels();
+    success = true;
+  }
+  else if (PositionKernelsAvailable(type))
+  {
+    CurrentPositionKernels() = type;
+    success = true;
+  }
+  else BBCERROR("Position kernel type %u not available", type);
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return currently selected kernel type
+ */
+/*--------------------------------------------------------------------------------*/
+uint_t GetPositionKernels()
+{
+  return CurrentPositionKernels();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Convert arrays of cartesian co-ordinates to polar co-ordinates (angles in degrees)
+ */
+/*--------------------------------------------------------------------------------*/
+void CartToPolar(const double *x, const double *y, const double *z, double *az, double *el, double *d, uint_t n)
+{
+  uint_t i = 0;
+
+  switch (CurrentPositionKernels())
+  {
+#ifdef POSITIONKERNELS_X86
+    case POSITIONKERNELS_AVX2:
+      i = avx2::CartToPolar(x, y, z, az, el, d, n);
+      break;
+
+    case POSITIONKERNELS_SSE2:
+      i = sse2::CartToPolar(x, y, z, az, el, d, n);
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  // remainder
+  ScalarCartToPolar(x + i, y + i, z + i, az + i, el + i, d + i, n - i);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Convert arrays of polar co-ordinates (angles in degrees) to cartesian co-ordinates
+ */
+/*--------------------------------------------------------------------------------*/
+void PolarToCart(const double *az, const double *el, const double *d, double *x, double *y, double *z, uint_t n)
+{
+  uint_t i = 0;
+
+  switch (CurrentPositionKernels())
+  {
+#ifdef POSITIONKERNELS_X86
+    case POSITIONKERNELS_AVX2:
+      i = avx2::PolarToCart(az, el, d, x, y, z, n);
+      break;
+
+    case POSITIONKERNELS_SSE2:
+      i = sse2::PolarToCart(az, el, d, x, y, z, n);
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  // remainder
+  ScalarPolarToCart(az + i, el + i, d + i, x + i, y + i, z + i, n - i);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Float versions of the above
+ */
+/*--------------------------------------------------------------------------------*/
+void CartToPolar(const float *x, const float *y, const float *z, float *az, float *el, float *d, uint_t n)
+{
+  uint_t i = 0;
+
+  switch (CurrentPositionKernels())
+  {
+#ifdef POSITIONKERNELS_X86
+    case POSITIONKERNELS_AVX2:
+      i = avx2f::CartToPolar(x, y, z, az, el, d, n);
+      break;
+
+    case POSITIONKERNELS_SSE2:
+      i = sse2f::CartToPolar(x, y, z, az, el, d, n);
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  // remainder
+  ScalarCartToPolar(x + i, y + i, z + i, az + i, el + i, d + i, n - i);
+}
+
+void PolarToCart(const float *az, const float *el, const float *d, float *x, float *y, float *z, uint_t n)
+{
+  uint_t i = 0;
+
+  switch (CurrentPositionKernels())
+  {
+#ifdef POSITIONKERNELS_X86
+    case POSITIONKERNELS_AVX2:
+      i = avx2f::PolarToCart(az, el, d, x, y, z, n);
+      break;
+
+    case POSITIONKERNELS_SSE2:
+      i = sse2f::PolarToCart(az, el, d, x, y, z, n);
+      break;
+#endif
+
+    default:
+      break;
+  }
+
+  // remainder
+  ScalarPolarToCart(az + i, el + i, d + i, x + i, y + i, z + i, n - i);
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,102 @@
+#ifndef __POSITION_KERNELS__
+#define __POSITION_KERNELS__
+
+#include "misc.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Batch polar <-> cartesian conversion kernels
+ *
+ * These convert arrays of positions (in structure-of-arrays form, see PositionBlock)
+ * using the same conventions as Position::Polar() and Position::Cart()
+ *
+ * Vectorised (SSE2 and AVX2/FMA) versions are selected at run-time depending on the
+ * capabilities of the processor, with a scalar (libm) fallback
+ *
+ * Accuracy of the vectorised versions against the scalar versions:
+ *   CartToPolar(): azimuth and elevation within POSITIONKERNELS_MAX_ANGLE_ERROR degrees,
+ *                  distance within POSITIONKERNELS_MAX_RELATIVE_ERROR * distance
+ *   PolarToCart(): x, y and z within POSITIONKERNELS_MAX_RELATIVE_ERROR * distance
+ *                  (for azimuths and elevations up to +/- 1.0e4 degrees, beyond which the
+ *                  scalar version loses accuracy converting to radians)
+ *
+ * The float versions have their own vectorised kernels (twice as many positions per
+ * vector, using the single precision polynomials) and the same bounds with
+ * POSITIONKERNELS_MAX_ANGLE_ERROR_FLOAT and POSITIONKERNELS_MAX_RELATIVE_ERROR_FLOAT
+ * against the scalar versions (which calculate in double precision)
+ */
+/*--------------------------------------------------------------------------------*/
+
+#define POSITIONKERNELS_MAX_ANGLE_ERROR    1.0e-11
+#define POSITIONKERNELS_MAX_RELATIVE_ERROR 1.0e-13
+
+#define POSITIONKERNELS_MAX_ANGLE_ERROR_FLOAT    1.0e-4
+#define POSITIONKERNELS_MAX_RELATIVE_ERROR_FLOAT 1.0e-6
+
+enum
+{
+  POSITIONKERNELS_AUTO = 0,         // best available for this processor
+  POSITIONKERNELS_SCALAR,
+  POSITIONKERNELS_SSE2,
+  POSITIONKERNELS_AVX2,
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Select kernel type (normally only used for testing or benchmarking)
+ *
+ * @param type one of POSITIONKERNELS_* above
+ *
+ * @return true if the kernel type is available on this processor
+ *
+ * @note this is *not* thread safe, call during initialisation only
+ */
+/*--------------------------------------------------------------------------------*/
+extern bool SetPositionKernels(uint_t type = POSITIONKERNELS_AUTO);
+
+/*--------------------------------------------------------------------------------*/
+/** Return currently selected kernel type (never POSITIONKERNELS_AUTO)
+ */
+/*--------------------------------------------------------------------------------*/
+extern uint_t GetPositionKernels();
+
+/*--------------------------------------------------------------------------------*/
+/** Return whether a kernel type is available on this processor
+ */
+/*--------------------------------------------------------------------------------*/
+extern bool PositionKernelsAvailable(uint_t type);
+
+/*--------------------------------------------------------------------------------*/
+/** Convert arrays of cartesian co-ordinates to polar co-ordinates (angles in degrees)
+ *
+ * @param x, y, z input arrays
+ * @param az, el, d output arrays
+ * @param n number of positions
+ *
+ * @note output arrays may be the *same* as input arrays (for in-place conversion) but must not partially overlap
+ */
+/*--------------------------------------------------------------------------------*/
+extern void CartToPolar(const double *x, const double *y, const double *z, double *az, double *el, double *d, uint_t n);
+
+/*--------------------------------------------------------------------------------*/
+/** Convert arrays of polar co-ordinates (angles in degrees) to cartesian co-ordinates
+ *
+ * @param az, el, d input arrays
+ * @param x, y, z output arrays
+ * @param n number of positions
+ *
+ * @note output arrays may be the *same* as input arrays (for in-place conversion) but must not partially overlap
+ */
+/*--------------------------------------------------------------------------------*/
+extern void PolarToCart(const double *az, const double *el, const double *d, double *x, double *y, double *z, uint_t n);
+
+/*--------------------------------------------------------------------------------*/
+/** Float versions of the above (see accuracy above)
+ */
+/*--------------------------------------------------------------------------------*/
+extern void CartToPolar(const float *x, const float *y, const float *z, float *az, float *el, float *d, uint_t n);
+extern void PolarToCart(const float *az, const float *el, const float *d, float *x, float *y, float *z, uint_t n);
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
@@ -0,0 +1,217 @@
+/*--------------------------------------------------------------------------------*/
+/** Vectorised bodies of the position kernels
+ *
+ * This file is *private* to PositionKernels.cpp and is deliberately NOT include-guarded:
+ * it is included once per instruction set and scalar type, each time inside its own namespace
+ * and with an OPS class defined which wraps the intrinsics for that instruction set:
+ *
+ *   T                   scalar type (double or float)
+ *   SINGLE              non-zero if T is float (selecting single precision polynomials)
+ *   V                   vector type
+ *   N                   number of values in V
+ *   load(), store()     unaligned load and store
+ *   set1(), zero()      constants
+ *   add(), sub(), mul(), div(), madd(a, b, c) = a * b + c, sqrt(), min(), max()
+ *   and_(), or_(), xor_(), andnot(a, b) = ~a & b
+ *   cmpeq(), cmplt(), cmpgt() (all bits set where true)
+ *   blend(m, a, b) = m ? b : a
+ *
+ * Trig functions use the Cephes polynomials (the single precision ones for float) with range
+ * reduction performed in degrees (which is exact for any sensible angle)
+ */
+/*--------------------------------------------------------------------------------*/
+
+typedef OPS::T T;
+typedef OPS::V V;
+
+/*--------------------------------------------------------------------------------*/
+/** Round to nearest integer (half to even) for |x| < 2^51 (2^22 for float)
+ */
+/*--------------------------------------------------------------------------------*/
+static inline V Round(V x)
+{
+  const V magic = OPS::set1(OPS::SINGLE ? 12582912.0 : 6755399441055744.0);   // 1.5 * 2^23 or 1.5 * 2^52
+  return OPS::sub(OPS::add(x, magic), magic);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate sin() and cos() of angles in degrees
+ */
+/*--------------------------------------------------------------------------------*/
+static inline void SinCosDegrees(V deg, V& s, V& c)
+{
+  const V signmask = OPS::set1(-0.0);
+  const V one      = OPS::set1(1.0);
+  const V two      = OPS::set1(2.0);
+
+  // reduce to +/- 45 degrees around a multiple (j) of 90 degrees
+  V j = Round(OPS::mul(deg, OPS::set1(1.0 / 90.0)));
+  V r = OPS::mul(OPS::sub(deg, OPS::mul(j, OPS::set1(90.0))), OPS::set1(M_PI / 180.0));
+  V z = OPS::mul(r, r);
+
+  // sin() and cos() polynomials
+  V p, q;
+  if (OPS::SINGLE)
+  {
+    p = OPS::set1(-1.9515295891E-4);
+    p = OPS::madd(p, z, OPS::set1(8.3321608736E-3));
+    p = OPS::madd(p, z, OPS::set1(-1.6666654611E-1));
+
+    q = OPS::set1(2.443315711809948E-5);
+    q = OPS::madd(q, z, OPS::set1(-1.388731625493765E-3));
+    q = OPS::madd(q, z, OPS::set1(4.166664568298827E-2));
+  }
+  else
+  {
+    p = OPS::set1(1.58962301576546568060E-10);
+    p = OPS::madd(p, z, OPS::set1(-2.50507477628578072866E-8));
+    p = OPS::madd(p, z, OPS::set1(2.75573136213857245213E-6));
+    p = OPS::madd(p, z, OPS::set1(-1.98412698295895385996E-4));
+    p = OPS::madd(p, z, OPS::set1(8.33333333332211858878E-3));
+    p = OPS::madd(p, z, OPS::set1(-1.66666666666666307295E-1));
+
+    q = OPS::set1(-1.13585365213876817300E-11);
+    q = OPS::madd(q, z, OPS::set1(2.08757008419747316778E-9));
+    q = OPS::madd(q, z, OPS::set1(-2.75573141792967388112E-7));
+    q = OPS::madd(q, z, OPS::set1(2.48015872888517045348E-5));
+    q = OPS::madd(q, z, OPS::set1(-1.38888888888730564116E-3));
+    q = OPS::madd(q, z, OPS::set1(4.16666666666665929218E-2));
+  }
+  V s0 = OPS::madd(OPS::mul(r, z), p, r);
+  V c0 = OPS::madd(OPS::mul(z, z), q, OPS::sub(one, OPS::mul(OPS::set1(0.5), z)));
+
+  // quadrant m = j mod 4, in the range -2..2
+  V m  = OPS::sub(j, OPS::mul(Round(OPS::mul(j, OPS::set1(0.25))), OPS::set1(4.0)));
+  V am = OPS::andnot(signmask, m);
+
+  // m = +/-1: swap sin and cos
+  // m = 1:    negate cos
+  // m = -1:   negate sin
+  // m = +/-2: negate both
+  V swap = OPS::cmpeq(am, one);
+  V both = OPS::cmpeq(am, two);
+  V negs = OPS::or_(both, OPS::cmpeq(m, OPS::set1(-1.0)));
+  V negc = OPS::or_(both, OPS::cmpeq(m, one));
+
+  s = OPS::xor_(OPS::blend(swap, s0, c0), OPS::and_(negs, signmask));
+  c = OPS::xor_(OPS::blend(swap, c0, s0), OPS::and_(negc, signmask));
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate atan2(y, x) in radians
+ */
+/*--------------------------------------------------------------------------------*/
+static inline V Atan2(V y, V x)
+{
+  const V signmask = OPS::set1(-0.0);
+  const V zero     = OPS::zero();
+  const V one      = OPS::set1(1.0);
+
+  V ax = OPS::andnot(signmask, x);
+  V ay = OPS::andnot(signmask, y);
+  V mx = OPS::max(ax, ay);
+  V mn = OPS::min(ax, ay);
+
+  // a = tan() of angle in range 0..45 degrees (avoiding 0 / 0)
+  V a = OPS::div(mn, OPS::blend(OPS::cmpeq(mx, zero), mx, one));
+
+  // further reduce to 0..tan(33.4 degrees) (0..tan(22.5 degrees) for float) for accuracy
+  V big = OPS::cmpgt(a, OPS::set1(OPS::SINGLE ? 0.4142135623730950 : 0.66));
+  V t   = OPS::blend(big, a, OPS::div(OPS::sub(a, one), OPS::add(a, one)));
+  V off = OPS::and_(big, OPS::set1(M_PI / 4.0));
+  V z   = OPS::mul(t, t);
+  V r;
+
+  if (OPS::SINGLE)
+  {
+    V p = OPS::set1(8.05374449538E-2);
+    p = OPS::madd(p, z, OPS::set1(-1.38776856032E-1));
+    p = OPS::madd(p, z, OPS::set1(1.99777106478E-1));
+    p = OPS::madd(p, z, OPS::set1(-3.33329491539E-1));
+
+    r = OPS::add(off, OPS::madd(OPS::mul(t, z), p, t));
+  }
+  else
+  {
+    V mb = OPS::and_(big, OPS::set1(0.5 * 6.123233995736765886130E-17));
+
+    V p = OPS::set1(-8.750608600031904122785E-1);
+    p = OPS::madd(p, z, OPS::set1(-1.615753718733365076637E1));
+    p = OPS::madd(p, z, OPS::set1(-7.500855792314704667340E1));
+    p = OPS::madd(p, z, OPS::set1(-1.228866684490136173410E2));
+    p = OPS::madd(p, z, OPS::set1(-6.485021904942025371773E1));
+
+    V q = OPS::add(z, OPS::set1(2.485846490142306297962E1));
+    q = OPS::madd(q, z, OPS::set1(1.650270098316988542046E2));
+    q = OPS::madd(q, z, OPS::set1(4.328810604912902668951E2));
+    q = OPS::madd(q, z, OPS::set1(4.853903996359136964868E2));
+    q = OPS::madd(q, z, OPS::set1(1.945506571482613964425E2));
+
+    r = OPS::add(off, OPS::add(OPS::madd(OPS::mul(t, z), OPS::div(p, q), t), mb));
+  }
+
+  // expand to full circle
+  r = OPS::blend(OPS::cmpgt(ay, ax), r, OPS::sub(OPS::set1(M_PI / 2.0), r));
+  r = OPS::blend(OPS::cmplt(x, zero), r, OPS::sub(OPS::set1(M_PI), r));
+
+  // r is positive here so just copy sign of y
+  return OPS::or_(r, OPS::and_(y, signmask));
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Cartesian -> polar conversion
+ *
+ * @return number of positions processed (a multiple of OPS::N)
+ */
+/*--------------------------------------------------------------------------------*/
+static uint_t CartToPolar(const T *x, const T *y, const T *z, T *az, T *el, T *d, uint_t n)
+{
+  const V signmask = OPS::set1(-0.0);
+  const V scale    = OPS::set1(180.0 / M_PI);
+  uint_t i;
+
+  for (i = 0; (i + OPS::N) <= n; i += OPS::N)
+  {
+    V vx  = OPS::load(x + i);
+    V vy  = OPS::load(y + i);
+    V vz  = OPS::load(z + i);
+    V xy2 = OPS::add(OPS::mul(vx, vx), OPS::mul(vy, vy));
+    V vd  = OPS::sqrt(OPS::add(xy2, OPS::mul(vz, vz)));
+
+    // see Position::Polar() for derivation (elevation calculated using atan2() rather than asin() for accuracy)
+    OPS::store(az + i, OPS::mul(Atan2(OPS::xor_(vx, signmask), vy), scale));
+    OPS::store(el + i, OPS::mul(Atan2(vz, OPS::sqrt(xy2)), scale));
+    OPS::store(d  + i, vd);
+  }
+
+  return i;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Polar -> cartesian conversion
+ *
+ * @return number of positions processed (a multiple of OPS::N)
+ */
+/*--------------------------------------------------------------------------------*/
+static uint_t PolarToCart(const T *az, const T *el, const T *d, T *x, T *y, T *z, uint_t n)
+{
+  const V signmask = OPS::set1(-0.0);
+  uint_t i;
+
+  for (i = 0; (i + OPS::N) <= n; i += OPS::N)
+  {
+    V saz, caz, sel, cel;
+    V vd = OPS::load(d + i);
+
+    SinCosDegrees(OPS::load(az + i), saz, caz);
+    SinCosDegrees(OPS::load(el + i), sel, cel);
+
+    // see Position::Cart() for derivation
+    V dcel = OPS::mul(vd, cel);
+    OPS::store(x + i, OPS::xor_(OPS::mul(dcel, saz), signmask));
+    OPS::store(y + i, OPS::mul(dcel, caz));
+    OPS::store(z + i, OPS::mul(vd, sel));
+  }
+
+  return i;
+}
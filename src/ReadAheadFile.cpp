@@ -0,0 +1,526 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define BBCDEBUG_LEVEL 2
+#include "ReadAheadFile.h"
+#include "PerformanceMonitor.h"
+
+BBC_AUDIOTOOLBOX_START
+
+ReadAheadFile::ReadAheadFile() : EnhancedFile(),
+                                 enablereadahead(false),
+                                 chunksize(DEFAULT_CHUNK_SIZE),
+                                 depth(DEFAULT_DEPTH),
+                                 prefetching(false),
+                                 filepos(0),
+                                 readpos(0),
+                                 chunkpos(0),
+                                 memory(NULL),
+                                 reads(0),
+                                 hits(0),
+                                 misses(0),
+                                 bytesread(0),
+                                 waittime(0),
+                                 invalidations(0),
+                                 prefetches(0),
+                                 prefetchedbytes(0)
+{
+}
+
+ReadAheadFile::ReadAheadFile(const char *filename, const char *mode) : EnhancedFile(),
+                                                                       enablereadahead(false),
+                                                                       chunksize(DEFAULT_CHUNK_SIZE),
+                                                                       depth(DEFAULT_DEPTH),
+                                                                       prefetching(false),
+                                                                       filepos(0),
+                                                                       readpos(0),
+                                                                       chunkpos(0),
+                                                                       memory(NULL),
+                                                                       reads(0),
+                                                                       hits(0),
+                                                                       misses(0),
+                                                                       bytesread(0),
+                                                                       waittime(0),
+                                                                       invalidations(0),
+                                                                       prefetches(0),
+                                                                       prefetchedbytes(0)
+{
+  fopen(filename, mode);
+}
+
+ReadAheadFile::ReadAheadFile(const ReadAheadFile& obj) : EnhancedFile(),
+                                                         enablereadahead(false),
+                                                         chunksize(DEFAULT_CHUNK_SIZE),
+                                                         depth(DEFAULT_DEPTH),
+                                                         prefetching(false),
+                                                         filepos(0),
+                                                         readpos(0),
+                                                         chunkpos(0),
+                                                         memory(NULL),
+                                                         reads(0),
+                                                         hits(0),
+                                                         misses(0),
+                                                         bytesread(0),
+                                                         waittime(0),
+                                                         invalidations(0),
+                                                         prefetches(0),
+                                                         prefetchedbytes(0)
+{
+  operator = (obj);
+}
+
+ReadAheadFile::~ReadAheadFile()
+{
+  fclose();
+  FreeBuffers();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Duplicate file by assignment
+ *
+ * @note this will open the same file again (prefetched data and settings are not duplicated)!
+ */
+/*--------------------------------------------------------------------------------*/
+ReadAheadFile& ReadAheadFile::operator = (const ReadAheadFile& obj)
+{
+  // the thread must not be using the file this object is about to close
+  StopReadAhead();
+  EnhancedFile::operator = (obj);
+  return *this;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Enable read-ahead behaviour
+ *
+ * @note enabling allocates the buffer pool, disabling stops the thread and frees it
+ */
+/*--------------------------------------------------------------------------------*/
+void ReadAheadFile::EnableReadAhead(bool enable)
+{
+  if (enable)
+  {
+    // allocate pool here so that fread() never allocates
+    enablereadahead = (memory || AllocateBuffers());
+  }
+  else
+  {
+    StopReadAhead();
+    FreeBuffers();
+    enablereadahead = false;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set number of bytes read by the background thread at a time (rounded up to a whole number of pages)
+ *
+ * @note if read-ahead is enabled, prefetched data is discarded and the pool re-allocated
+ */
+/*--------------------------------------------------------------------------------*/
+void ReadAheadFile::SetChunkSize(size_t bytes)
+{
+  const size_t pagesize = GetPageSize();
+
+  chunksize = std::max((bytes + pagesize - 1) & ~(pagesize - 1), pagesize);
+  if (enablereadahead)
+  {
+    EnableReadAhead(false);
+    EnableReadAhead(true);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set maximum number of chunks prefetched ahead of the reader (rounded up to a power of 2)
+ *
+ * @note if read-ahead is enabled, prefetched data is discarded and the pool re-allocated
+ */
+/*--------------------------------------------------------------------------------*/
+void ReadAheadFile::SetReadAheadDepth(uint_t _depth)
+{
+  // the ring's capacity is a power of 2
+  for (depth = 1; depth < _depth; depth <<= 1) ;
+  if (enablereadahead)
+  {
+    EnableReadAhead(false);
+    EnableReadAhead(true);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return snapshot of statistics (can be called from any thread)
+ */
+/*--------------------------------------------------------------------------------*/
+READAHEADFILESTATS ReadAheadFile::GetStats() const
+{
+  READAHEADFILESTATS stats;
+
+  stats.reads           = reads.load(std::memory_order_relaxed);
+  stats.hits            = hits.load(std::memory_order_relaxed);
+  stats.misses          = misses.load(std::memory_order_relaxed);
+  stats.bytesread       = bytesread.load(std::memory_order_relaxed);
+  stats.waittime        = waittime.load(std::memory_order_relaxed);
+  stats.prefetches      = prefetches.load(std::memory_order_relaxed);
+  stats.prefetchedbytes = prefetchedbytes.load(std::memory_order_relaxed);
+  stats.invalidations   = invalidations.load(std::memory_order_relaxed);
+
+  return stats;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Reset statistics
+ */
+/*--------------------------------------------------------------------------------*/
+void ReadAheadFile::ResetStats()
+{
+  reads.store(0, std::memory_order_relaxed);
+  hits.store(0, std::memory_order_relaxed);
+  misses.store(0, std::memory_order_relaxed);
+  bytesread.store(0, std::memory_order_relaxed);
+  waittime.store(0, std::memory_order_relaxed);
+  prefetches.store(0, std::memory_order_relaxed);
+  prefetchedbytes.store(0, std::memory_order_relaxed);
+  invalidations.store(0, std::memory_order_relaxed);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Publish statistics into PerformanceMonitor as counters '<name>.<stat>'
+ */
+/*--------------------------------------------------------------------------------*/
+void ReadAheadFile::PublishStats(const std::string& name) const
+{
+  READAHEADFILESTATS stats = GetStats();
+  PerformanceMonitor& perfmon = PerformanceMonitor::Get();
+
+  perfmon.SetCounter(name + ".reads",           stats.reads);
+  perfmon.SetCounter(name + ".hits",            stats.hits);
+  perfmon.SetCounter(name + ".misses",          stats.misses);
+  perfmon.SetCounter(name + ".bytesread",       stats.bytesread);
+  perfmon.SetCounter(name + ".waittime",        stats.waittime);
+  perfmon.SetCounter(name + ".prefetches",      stats.prefetches);
+  perfmon.SetCounter(name + ".prefetchedbytes", stats.prefetchedbytes);
+  perfmon.SetCounter(name + ".invalidations",   stats.invalidations);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Allocate the buffer pool
+ */
+/*--------------------------------------------------------------------------------*/
+bool ReadAheadFile::AllocateBuffers()
+{
+  const size_t pagesize = GetPageSize();
+  uint_t i;
+
+  FreeBuffers();
+
+  // chunk size may not have been set through SetChunkSize()
+  chunksize = std::max((chunksize + pagesize - 1) & ~(pagesize - 1), pagesize);
+
+  if ((memory = (uint8_t *)AlignedAlloc((size_t)depth * chunksize, pagesize)) == NULL)
+  {
+    BBCERROR("Failed to allocate %u x %s bytes for read-ahead", depth, StringFrom(chunksize).c_str());
+    return false;
+  }
+
+  // after a resize the ring is empty and write-ahead reaches every slot
+  chunks.Resize(depth);
+  for (i = 0; i < depth; i++)
+  {
+    CHUNK *chunk = chunks.GetWriteBuffer(i);
+    chunk->data   = memory + (size_t)i * chunksize;
+    chunk->bytes  = 0;
+    chunk->offset = 0;
+    chunk->end    = false;
+  }
+
+  BBCDEBUG2(("Allocated %u x %s bytes for read-ahead", depth, StringFrom(chunksize).c_str()));
+
+  return true;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Free the buffer pool
+ */
+/*--------------------------------------------------------------------------------*/
+void ReadAheadFile::FreeBuffers()
+{
+  if (memory)
+  {
+    chunks.Resize(0);
+    AlignedFree(memory);
+    memory = NULL;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Start prefetching from the current file position
+ *
+ * @return false if the thread could not be started
+ */
+/*--------------------------------------------------------------------------------*/
+bool ReadAheadFile::StartReadAhead()
+{
+  off_t pos;
+
+  // the logical position is needed to serve ftell() and fseek() (seeking also allows reading after writing)
+  if (((pos = EnhancedFile::ftell()) < 0) || (EnhancedFile::fseek(pos, SEEK_SET) != 0)) return false;
+
+  filepos  = readpos = (uint64_t)pos;
+  chunkpos = 0;
+
+  // from here on, the thread owns the stdio position
+  if (thread.Start(&__ThreadStart, (void *)this))
+  {
+    BBCDEBUG2(("Created thread for read-ahead at %s", StringFrom(filepos).c_str()));
+    prefetching = true;
+  }
+  else BBCERROR("Failed to create thread (%s)", strerror(errno));
+
+  return prefetching;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Stop prefetching, discard prefetched data and move the file position to the logical position
+ */
+/*--------------------------------------------------------------------------------*/
+void ReadAheadFile::StopReadAhead()
+{
+  if (prefetching)
+  {
+    // tell thread to quit (it is either waiting for a free chunk or finishing a read)
+    chunks.Shutdown();
+    thread.Stop();
+    chunks.Reset();
+    chunks.ClearShutdown();
+
+    chunkpos    = 0;
+    prefetching = false;
+
+    EnhancedFile::fseek((off_t)filepos, SEEK_SET);
+
+    BBCDEBUG2(("Stopped read-ahead at %s", StringFrom(filepos).c_str()));
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Thread
+ */
+/*--------------------------------------------------------------------------------*/
+void *ReadAheadFile::Run()
+{
+  // sleep until a chunk is free, WaitForWrite() only fails on shutdown
+  // (but returns immediately if a chunk is free so shutdown must be checked as well)
+  while (!chunks.IsShutdown() && chunks.WaitForWrite())
+  {
+    CHUNK *chunk = chunks.GetWriteBuffer();
+
+    // this thread owns the stdio position whilst prefetching
+    chunk->bytes  = EnhancedFile::fread(chunk->data, 1, chunksize);
+    chunk->offset = readpos;
+    chunk->end    = (chunk->bytes < chunksize);
+    if (chunk->end && EnhancedFile::ferror()) BBCERROR("Failed to read from file in background: %s", strerror(errno));
+
+    readpos += chunk->bytes;
+
+    // only this thread updates these
+    prefetches.store(prefetches.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    prefetchedbytes.store(prefetchedbytes.load(std::memory_order_relaxed) + chunk->bytes, std::memory_order_relaxed);
+
+    // the reader is discarding everything so don't bother handing the chunk over
+    if (chunks.IsShutdown()) break;
+
+    // hand chunk to the reader (waking it if it is waiting)
+    chunks.IncrementWrite();
+
+    // nothing more to read (the last chunk stays in the ring until the reader seeks)
+    if (chunk->end) break;
+  }
+
+  return NULL;
+}
+
+void ReadAheadFile::fclose()
+{
+  StopReadAhead();
+  EnhancedFile::fclose();
+}
+
+size_t ReadAheadFile::fread(void *ptr, size_t size, size_t count)
+{
+  // if file is open and read-ahead is enabled (and can be started)
+  if (isopen() && enablereadahead && size && (prefetching || StartReadAhead()))
+  {
+    uint8_t  *dst  = (uint8_t *)ptr;
+    size_t   bytes = size * count, total = 0;
+    uint64_t wait  = 0;
+    bool     miss  = false;
+
+    while (bytes)
+    {
+      if (!chunks.ReadBuffersAvailable())
+      {
+        uint64_t t0 = GetNanosecondTicks();
+
+        // the thread has not yet read the data
+        miss = true;
+        if (!chunks.WaitForRead()) break;
+        wait += GetNanosecondTicks() - t0;
+      }
+
+      CHUNK *chunk = chunks.GetReadBuffer();
+      size_t n     = std::min(bytes, chunk->bytes - chunkpos);
+
+      memcpy(dst, chunk->data + chunkpos, n);
+      chunkpos += n;
+      filepos  += n;
+      dst      += n;
+      total    += n;
+      bytes    -= n;
+
+      if (chunkpos == chunk->bytes)
+      {
+        // end of file
+        if (chunk->end) break;
+
+        // release chunk (waking the thread if it is waiting for one)
+        chunks.IncrementRead();
+        chunkpos = 0;
+      }
+    }
+
+    // only this thread updates these
+    reads.store(reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (miss) misses.store(misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    else      hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    bytesread.store(bytesread.load(std::memory_order_relaxed) + total, std::memory_order_relaxed);
+    waittime.store(waittime.load(std::memory_order_relaxed) + wait, std::memory_order_relaxed);
+
+    return total / size;
+  }
+
+  return EnhancedFile::fread(ptr, size, count);
+}
+
+size_t ReadAheadFile::fwrite(const void *ptr, size_t size, size_t count)
+{
+  // writing invalidates prefetched data
+  if (prefetching)
+  {
+    StopReadAhead();
+    invalidations.store(invalidations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  return EnhancedFile::fwrite(ptr, size, count);
+}
+
+off_t ReadAheadFile::ftell() const
+{
+  // the stdio position belongs to the thread (and is ahead of the logical position) whilst prefetching
+  return prefetching ? (off_t)filepos : EnhancedFile::ftell();
+}
+
+off_t ReadAheadFile::ftell()
+{
+  return prefetching ? (off_t)filepos : EnhancedFile::ftell();
+}
+
+int ReadAheadFile::fseek(off_t offset, int origin)
+{
+  if (prefetching && (origin != SEEK_END))
+  {
+    sint64_t pos = offset;
+
+    if      (origin == SEEK_CUR) pos += (sint64_t)filepos;
+    else if (origin != SEEK_SET) pos  = -1;
+
+    if (pos < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+    // discard prefetched chunks which end before the new position
+    while (chunks.ReadBuffersAvailable())
+    {
+      const CHUNK *chunk = chunks.GetReadBuffer();
+
+      if (((uint64_t)pos < (chunk->offset + chunk->bytes)) || chunk->end) break;
+
+      chunks.IncrementRead();
+      chunkpos = 0;
+    }
+
+    // seeking within prefetched data
+    if (chunks.ReadBuffersAvailable())
+    {
+      const CHUNK *chunk = chunks.GetReadBuffer();
+
+      if (((uint64_t)pos >= chunk->offset) && ((uint64_t)pos <= (chunk->offset + chunk->bytes)))
+      {
+        chunkpos = (size_t)((uint64_t)pos - chunk->offset);
+        filepos  = (uint64_t)pos;
+        return 0;
+      }
+    }
+
+    // anywhere else: discard everything, prefetching restarts at the next read
+    filepos = (uint64_t)pos;
+    StopReadAhead();
+    invalidations.store(invalidations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return 0;
+  }
+
+  // relative to the end of the file (the length is not tracked)
+  if (prefetching)
+  {
+    StopReadAhead();
+    invalidations.store(invalidations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  return EnhancedFile::fseek(offset, origin);
+}
+
+int ReadAheadFile::fflush()
+{
+  StopReadAhead();
+  return EnhancedFile::fflush();
+}
+
+void ReadAheadFile::rewind()
+{
+  if (prefetching) fseek(0, SEEK_SET);
+  else             EnhancedFile::rewind();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read a line of text from an open file
+ *
+ * @note prefetched data is discarded and the line read from the logical position
+ */
+/*--------------------------------------------------------------------------------*/
+int ReadAheadFile::readline(char *line, uint_t maxlen)
+{
+  StopReadAhead();
+  return EnhancedFile::readline(line, maxlen);
+}
+
+int ReadAheadFile::fprintf(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  int res = vfprintf(fmt, ap);  // use this class's function to stop read-ahead
+  va_end(ap);
+  return res;
+}
+
+int ReadAheadFile::vfprintf(const char *fmt, va_list ap)
+{
+  // writing invalidates prefetched data
+  if (prefetching)
+  {
+    StopReadAhead();
+    invalidations.store(invalidations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  return EnhancedFile::vfprintf(fmt, ap);
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,218 @@
+#ifndef __READ_AHEAD_FILE__
+#define __READ_AHEAD_FILE__
+
+#include "EnhancedFile.h"
+#include "WaitableLockFreeBuffer.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Snapshot of ReadAheadFile statistics
+ */
+/*--------------------------------------------------------------------------------*/
+typedef struct {
+  uint64_t reads;               // number of fread() calls served by read-ahead
+  uint64_t hits;                // reads served entirely from prefetched data
+  uint64_t misses;              // reads which had to wait for the background thread
+  uint64_t bytesread;           // total bytes returned by those reads
+  uint64_t waittime;            // total time reads spent waiting for the background thread (ns)
+  uint64_t prefetches;          // number of chunks read by the background thread
+  uint64_t prefetchedbytes;     // total bytes read by the background thread
+  uint64_t invalidations;       // seeks (or writes) that discarded prefetched data
+} READAHEADFILESTATS;
+
+/*--------------------------------------------------------------------------------*/
+/** An enhancement of EnhancedFile that prefetches sequential data in a background thread
+ * so that fread() is served from memory
+ *
+ * By default this class operates exactly as EnhancedFile until EnableReadAhead() is called
+ *
+ * This class is thread safe as long as ONLY a single thread performs the high-level
+ * file operations
+ *
+ * The background thread reads fixed-size chunks (see SetChunkSize()) into a pool of page-aligned
+ * buffers and hands them to fread() through a lock-free ring, keeping up to depth (see
+ * SetReadAheadDepth()) chunks ahead of the reader and sleeping whilst the ring is full
+ *
+ * The thread is started by the first fread() (at the current position) and ftell() and fseek()
+ * use the logical position: a seek within (or forward through) the prefetched data just discards
+ * what is skipped, any other seek stops the thread and discards everything (an invalidation),
+ * prefetching restarting at the new position on the next fread()
+ *
+ * Any other operation (fwrite(), fprintf(), fflush(), readline()) stops the thread, discards the
+ * prefetched data and restores the stdio position first
+ */
+/*--------------------------------------------------------------------------------*/
+class ReadAheadFile : public EnhancedFile {
+public:
+  ReadAheadFile();
+  ReadAheadFile(const char *filename, const char *mode = "rb");
+  ReadAheadFile(const ReadAheadFile& obj);
+  virtual ~ReadAheadFile();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Duplicate file by assignment
+   *
+   * @note this will open the same file again (prefetched data and settings are not duplicated)!
+   */
+  /*--------------------------------------------------------------------------------*/
+  ReadAheadFile& operator = (const ReadAheadFile& obj);
+
+  enum
+  {
+    DEFAULT_CHUNK_SIZE = 256 * 1024,
+    DEFAULT_DEPTH      = 8,
+  };
+
+  /*--------------------------------------------------------------------------------*/
+  /** Enable read-ahead behaviour
+   *
+   * @note enabling allocates the buffer pool, disabling stops the thread and frees it
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual void   EnableReadAhead(bool enable = true);
+  bool           GetReadAhead() const {return enablereadahead;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set number of bytes read by the background thread at a time (rounded up to a whole number of pages)
+   *
+   * @note if read-ahead is enabled, prefetched data is discarded and the pool re-allocated
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetChunkSize(size_t bytes);
+  size_t         GetChunkSize() const {return chunksize;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set maximum number of chunks prefetched ahead of the reader (rounded up to a power of 2)
+   *
+   * @note if read-ahead is enabled, prefetched data is discarded and the pool re-allocated
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           SetReadAheadDepth(uint_t depth);
+  uint_t         GetReadAheadDepth() const {return depth;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of chunks prefetched and not yet (completely) read
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t         GetPrefetchedChunks() const {return chunks.ReadBuffersAvailable();}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return snapshot of statistics (can be called from any thread)
+   */
+  /*--------------------------------------------------------------------------------*/
+  READAHEADFILESTATS GetStats() const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Reset statistics
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           ResetStats();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Publish statistics into PerformanceMonitor as counters '<name>.<stat>'
+   */
+  /*--------------------------------------------------------------------------------*/
+  void           PublishStats(const std::string& name) const;
+
+  virtual void   fclose();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Explicit duplication via copy-constructor
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual ReadAheadFile *dup() const {return new ReadAheadFile(*this);}
+
+  virtual size_t fread(void *ptr, size_t size, size_t count);
+  virtual size_t fwrite(const void *ptr, size_t size, size_t count);
+  virtual off_t  ftell() const;
+  virtual off_t  ftell();
+  virtual int    fseek(off_t offset, int origin);
+  virtual int    fflush();
+  virtual void   rewind();
+
+  virtual int    fprintf(const char *fmt, ...) PRINTF_FORMAT2;
+  virtual int    vfprintf(const char *fmt, va_list ap);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Read a line of text from an open file
+   *
+   * @note prefetched data is discarded and the line read from the logical position
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual int    readline(char *line, uint_t maxlen);
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Allocate and free the buffer pool
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual bool   AllocateBuffers();
+  virtual void   FreeBuffers();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Start prefetching from the current file position
+   *
+   * @return false if the thread could not be started
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual bool   StartReadAhead();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Stop prefetching, discard prefetched data and move the file position to the logical position
+   */
+  /*--------------------------------------------------------------------------------*/
+  virtual void   StopReadAhead();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Thread entry point
+   */
+  /*--------------------------------------------------------------------------------*/
+  static void *__ThreadStart(Thread& thread, void *arg)
+  {
+    UNUSED_PARAMETER(thread);
+    ReadAheadFile& reader = *(ReadAheadFile *)arg;
+    return reader.Run();
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Thread
+   */
+  /*--------------------------------------------------------------------------------*/
+  void *Run();
+
+  typedef struct
+  {
+    uint8_t  *data;                     // page-aligned storage (part of the pool)
+    size_t   bytes;                     // number of bytes read
+    uint64_t offset;                    // file offset of the data
+    bool     end;                       // true if this is the last chunk (end of file or error)
+  } CHUNK;
+
+protected:
+  bool                   enablereadahead;
+  size_t                 chunksize;
+  uint_t                 depth;
+  bool                   prefetching;   // true whilst the thread owns the file position
+  uint64_t               filepos;       // logical file position (whilst prefetching)
+  uint64_t               readpos;       // file position of the next chunk (used by the thread)
+  size_t                 chunkpos;      // position within the first chunk in the ring
+  Thread                 thread;
+  uint8_t                *memory;       // buffer pool
+  // ring of chunks passed from the background thread (each slot's data ptr is fixed when the pool is allocated)
+  WaitableLockFreeBuffer<CHUNK, LockFreeBufferMaskIndexing> chunks;
+  // updated by caller
+  std::atomic<uint64_t>  reads;
+  std::atomic<uint64_t>  hits;
+  std::atomic<uint64_t>  misses;
+  std::atomic<uint64_t>  bytesread;
+  std::atomic<uint64_t>  waittime;
+  std::atomic<uint64_t>  invalidations;
+  // updated by background thread
+  std::atomic<uint64_t>  prefetches;
+  std::atomic<uint64_t>  prefetchedbytes;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
@@ -0,0 +1,247 @@
+
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BBCDEBUG_LEVEL 1
+#include "SharedMemoryBuffer.h"
+
+BBC_AUDIOTOOLBOX_START
+
+// items in a shared segment must be accessed with address-free (lock-free) atomics
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "SharedMemoryRing requires lock-free 32-bit atomics");
+
+SharedMemoryRing::SharedMemoryRing() : header(NULL),
+                                       items(NULL),
+                                       mapsize(0),
+                                       owner(false),
+                                       wrpos(&nopos),
+                                       rdpos(&nopos),
+                                       nopos(0),
+                                       rdcache(0),
+                                       wrcache(0)
+{
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+  Detach();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Create (and attach to) a named shared memory segment
+ *
+ * @param name segment name (must start with '/', e.g. "/renderer-output")
+ * @param itemsize size of each item in bytes
+ * @param capacity number of items (rounded up to a power of 2)
+ * @param format user-defined format word stored in the header
+ * @param replace true to replace any existing segment of the same name (else fail if it exists)
+ *
+ * @return true if segment created
+ *
+ * @note the segment's name is removed when this object detaches (processes already attached
+ * keep their mappings)
+ */
+/*--------------------------------------------------------------------------------*/
+bool SharedMemoryRing::Create(const char *_name, uint_t itemsize, uint_t capacity, uint32_t format, bool replace)
+{
+  uint32_t size = 1;
+  int fd;
+
+  Detach();
+
+  if (!itemsize || (capacity > 0x80000000))
+  {
+    BBCERROR("Invalid item size (%u) or capacity (%u) for shared memory segment '%s'", itemsize, capacity, _name);
+    return false;
+  }
+
+  while (size < capacity) size <<= 1;
+
+  if (replace) shm_unlink(_name);
+
+  if ((fd = shm_open(_name, O_RDWR | O_CREAT | O_EXCL, 0666)) < 0)
+  {
+    BBCERROR("Failed to create shared memory segment '%s': %s", _name, strerror(errno));
+    return false;
+  }
+
+  size_t totalsize = sizeof(HEADER) + (size_t)size * itemsize;
+  bool   success   = false;
+
+  // new segment is zero-filled (magic is therefore invalid until the header is complete)
+  if (ftruncate(fd, (off_t)totalsize) != 0)
+  {
+    BBCERROR("Failed to set size of shared memory segment '%s' to %lu bytes: %s", _name, (ulong_t)totalsize, strerror(errno));
+  }
+  else if (Map(fd, totalsize))
+  {
+    header->version    = VERSION;
+    header->headersize = sizeof(HEADER);
+    header->itemsize   = itemsize;
+    header->capacity   = size;
+    header->format     = format;
+    UseSegment((uint8_t *)header + sizeof(HEADER));
+
+    // publish header to attaching processes
+    header->magic.store(MAGIC, std::memory_order_release);
+
+    name    = _name;
+    owner   = true;
+    success = true;
+
+    BBCDEBUG2(("Created shared memory segment '%s' (%u x %u bytes, format %08x)", _name, size, itemsize, format));
+  }
+
+  close(fd);
+
+  if (!success) shm_unlink(_name);
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Attach to an existing named shared memory segment
+ *
+ * @param name segment name
+ * @param itemsize required item size in bytes
+ * @param format required format word or ANY_FORMAT to accept any
+ *
+ * @return true if attached, false if the segment does not exist, is not (yet) initialised or does not match
+ */
+/*--------------------------------------------------------------------------------*/
+bool SharedMemoryRing::Attach(const char *_name, uint_t itemsize, uint32_t format)
+{
+  struct stat st;
+  bool success = false;
+  int  fd;
+
+  Detach();
+
+  if ((fd = shm_open(_name, O_RDWR, 0)) < 0)
+  {
+    BBCDEBUG2(("Failed to open shared memory segment '%s': %s", _name, strerror(errno)));
+    return false;
+  }
+
+  if (fstat(fd, &st) != 0)
+  {
+    BBCERROR("Failed to stat shared memory segment '%s': %s", _name, strerror(errno));
+  }
+  else if ((size_t)st.st_size < sizeof(HEADER))
+  {
+    BBCDEBUG2(("Shared memory segment '%s' is not initialised", _name));
+  }
+  else if (Map(fd, (size_t)st.st_size))
+  {
+    if (header->magic.load(std::memory_order_acquire) != MAGIC)
+    {
+      BBCDEBUG2(("Shared memory segment '%s' is not initialised", _name));
+    }
+    else if (header->version != VERSION)
+    {
+      BBCERROR("Shared memory segment '%s' is version %u, expected version %u", _name, header->version, (uint_t)VERSION);
+    }
+    else if (header->itemsize != itemsize)
+    {
+      BBCERROR("Shared memory segment '%s' has %u-byte items, expected %u-byte items", _name, header->itemsize, itemsize);
+    }
+    else if ((format != ANY_FORMAT) && (header->format != format))
+    {
+      BBCERROR("Shared memory segment '%s' has format %08x, expected format %08x", _name, header->format, format);
+    }
+    else if (!header->capacity ||
+             (header->capacity & (header->capacity - 1)) ||
+             (header->headersize < sizeof(HEADER)) ||
+             (((size_t)header->headersize + (size_t)header->capacity * header->itemsize) > mapsize))
+    {
+      BBCERROR("Shared memory segment '%s' has an invalid header", _name);
+    }
+    else
+    {
+      UseSegment((uint8_t *)header + header->headersize);
+      name    = _name;
+      success = true;
+
+      BBCDEBUG2(("Attached to shared memory segment '%s' (%u x %u bytes, format %08x)", _name, header->capacity, header->itemsize, header->format));
+    }
+
+    if (!success) Detach();
+  }
+
+  close(fd);
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Unmap the segment (removing its name if this object created it)
+ */
+/*--------------------------------------------------------------------------------*/
+void SharedMemoryRing::Detach()
+{
+  if (header)
+  {
+    munmap((void *)header, mapsize);
+    if (owner) shm_unlink(name.c_str());
+  }
+
+  name    = "";
+  header  = NULL;
+  items   = NULL;
+  mapsize = 0;
+  owner   = false;
+  wrpos   = rdpos = &nopos;
+  rdcache = wrcache = 0;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Remove a named segment (e.g. one left behind by a crashed process)
+ */
+/*--------------------------------------------------------------------------------*/
+bool SharedMemoryRing::Remove(const char *name)
+{
+  return (shm_unlink(name) == 0);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Map an open segment
+ */
+/*--------------------------------------------------------------------------------*/
+bool SharedMemoryRing::Map(int fd, size_t size)
+{
+  void *p;
+
+  if ((p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+  {
+    BBCERROR("Failed to map %lu bytes of shared memory: %s", (ulong_t)size, strerror(errno));
+    return false;
+  }
+
+  header  = (HEADER *)p;
+  mapsize = size;
+
+  return true;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Use the positions and items of the mapped (and validated) segment
+ */
+/*--------------------------------------------------------------------------------*/
+void SharedMemoryRing::UseSegment(uint8_t *_items)
+{
+  indexing.Init(header->capacity);
+  items = _items;
+  wrpos = &header->wr;
+  rdpos = &header->rd;
+
+  // local copies of positions
+  rdcache = rdpos->load(std::memory_order_acquire);
+  wrcache = wrpos->load(std::memory_order_acquire);
+}
+
+BBC_AUDIOTOOLBOX_END
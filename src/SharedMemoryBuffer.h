@@ -0,0 +1,198 @@
+#ifndef __SHARED_MEMORY_BUFFER__
+#define __SHARED_MEMORY_BUFFER__
+
+#include <string>
+#include <atomic>
+#include <type_traits>
+
+#include "LockFreeBuffer.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Lock-free circular buffer storage in a named POSIX shared memory segment (untyped part)
+ *
+ * One process Create()s the segment and any number of processes Attach() to it by name
+ * (one of which writes and one of which reads, see SharedMemoryBuffer)
+ *
+ * The segment starts with a header carrying a magic number, version, item size, capacity and
+ * a user-defined format word (e.g. channel count and sample format) which Attach() validates,
+ * followed by the read and write positions (on separate cache lines) and then the items
+ *
+ * Positions are free-running counters (indexed by LockFreeBufferMaskIndexing) and items are located
+ * relative to the mapping so the segment can be mapped at any address
+ *
+ * This is the storage policy of the LockFreeRing in SharedMemoryBuffer
+ */
+/*--------------------------------------------------------------------------------*/
+class SharedMemoryRing
+{
+public:
+  SharedMemoryRing();
+  virtual ~SharedMemoryRing();
+
+  enum
+  {
+    MAGIC      = 0x42425352,      // 'BBSR'
+    VERSION    = 1,
+    ANY_FORMAT = 0xffffffff,
+  };
+
+  /*--------------------------------------------------------------------------------*/
+  /** Create (and attach to) a named shared memory segment
+   *
+   * @param name segment name (must start with '/', e.g. "/renderer-output")
+   * @param itemsize size of each item in bytes
+   * @param capacity number of items (rounded up to a power of 2)
+   * @param format user-defined format word stored in the header
+   * @param replace true to replace any existing segment of the same name (else fail if it exists)
+   *
+   * @return true if segment created
+   *
+   * @note the segment's name is removed when this object detaches (processes already attached
+   * keep their mappings)
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Create(const char *name, uint_t itemsize, uint_t capacity, uint32_t format = 0, bool replace = false);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Attach to an existing named shared memory segment
+   *
+   * @param name segment name
+   * @param itemsize required item size in bytes
+   * @param format required format word or ANY_FORMAT to accept any
+   *
+   * @return true if attached, false if the segment does not exist, is not (yet) initialised or does not match
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Attach(const char *name, uint_t itemsize, uint32_t format = ANY_FORMAT);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Unmap the segment (removing its name if this object created it)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Detach();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Remove a named segment (e.g. one left behind by a crashed process)
+   */
+  /*--------------------------------------------------------------------------------*/
+  static bool Remove(const char *name);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether a segment is attached
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool IsAttached() const {return (header != NULL);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether this object created the attached segment
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool IsOwner() const {return owner;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return segment name and format (valid only when attached)
+   */
+  /*--------------------------------------------------------------------------------*/
+  const std::string& GetName() const {return name;}
+  uint32_t GetFormat()         const {return header ? header->format : 0;}
+
+protected:
+  // shared header, sizes and offsets are fixed for a given VERSION
+  typedef struct {
+    std::atomic<uint32_t> magic;          // MAGIC once the creator has initialised the header
+    uint32_t              version;
+    uint32_t              headersize;     // offset of items from start of segment
+    uint32_t              itemsize;
+    uint32_t              capacity;       // power of 2
+    uint32_t              format;
+    uint8_t               pad0[CACHE_LINE_SIZE - 6 * sizeof(uint32_t)];
+    std::atomic<uint32_t> wr;             // free-running write position
+    uint8_t               pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    std::atomic<uint32_t> rd;             // free-running read position
+    uint8_t               pad2[CACHE_LINE_SIZE - sizeof(uint32_t)];
+  } HEADER;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Storage policy for LockFreeRing (the positions refer to a local dummy when detached)
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool                              HasStorage()  const {return (items != NULL);}
+  std::atomic<uint32_t>&            WritePos()    const {return *wrpos;}
+  std::atomic<uint32_t>&            ReadPos()     const {return *rdpos;}
+  uint_t&                           ReadCache()   const {return rdcache;}
+  uint_t&                           WriteCache()  const {return wrcache;}
+  void                              *GetItems()   const {return items;}
+  const LockFreeBufferMaskIndexing& GetIndexing() const {return indexing;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Map an open segment and validate it (Attach()) or initialise it (Create())
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Map(int fd, size_t size);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Use the positions and items of the mapped (and validated) segment
+   */
+  /*--------------------------------------------------------------------------------*/
+  void UseSegment(uint8_t *_items);
+
+private:
+  // copying is not supported
+  SharedMemoryRing(const SharedMemoryRing& obj);
+  SharedMemoryRing& operator = (const SharedMemoryRing& obj);
+
+protected:
+  std::string                name;
+  HEADER                     *header;
+  uint8_t                    *items;
+  size_t                     mapsize;
+  bool                       owner;
+  LockFreeBufferMaskIndexing indexing;
+  std::atomic<uint32_t>      *wrpos;
+  std::atomic<uint32_t>      *rdpos;
+  std::atomic<uint32_t>      nopos;        // positions when detached
+  // local (per-process) copies of the other side's position
+  mutable uint_t             rdcache;
+  mutable uint_t             wrcache;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Lock-free circular buffer of T in a named POSIX shared memory segment
+ *
+ * Allows *one* writing process and *one* reading process to exchange items (e.g. blocks of
+ * Sample_t) through shared memory without any system calls or copies through the kernel
+ *
+ * The interface is LockFreeBuffer's (GetWriteBuffer()/IncrementWrite(), GetReadBuffer()/IncrementRead(),
+ * GetWriteSpans()/GetReadSpans() and Write()/Read(), all from LockFreeRing) once Create() or Attach()
+ * has succeeded, before that nothing can be written or read
+ *
+ * T must be trivially copyable and have the same layout in all processes
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+class SharedMemoryBuffer : public LockFreeRing<T, SharedMemoryRing>
+{
+public:
+  static_assert(std::is_trivially_copyable<T>::value, "SharedMemoryBuffer items must be trivially copyable");
+
+  SharedMemoryBuffer() {}
+  virtual ~SharedMemoryBuffer() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Create (and attach to) a named shared memory segment for capacity items (rounded up to a power of 2)
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Create(const char *name, uint_t capacity, uint32_t format = 0, bool replace = false) {return SharedMemoryRing::Create(name, sizeof(T), capacity, format, replace);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Attach to an existing named shared memory segment (which must have been created for items of type T)
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Attach(const char *name, uint32_t format = SharedMemoryRing::ANY_FORMAT) {return SharedMemoryRing::Attach(name, sizeof(T), format);}
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
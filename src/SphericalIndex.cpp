@@ -0,0 +1,391 @@
+
+#include <math.h>
+
+#include <algorithm>
+
+#define BBCDEBUG_LEVEL 1
+#include "SphericalIndex.h"
+
+BBC_AUDIOTOOLBOX_START
+
+SphericalIndex::SphericalIndex() : count(0),
+                                   resolution(0)
+{
+  Regrid();
+}
+
+SphericalIndex::SphericalIndex(const std::vector<Position>& positions) : count(0),
+                                                                         resolution(0)
+{
+  Set(positions);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Remove all entries
+ */
+/*--------------------------------------------------------------------------------*/
+void SphericalIndex::Clear()
+{
+  entries.clear();
+  freeids.clear();
+  count = 0;
+  Regrid();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Replace all entries with the list of positions (ids are the indices into the list)
+ */
+/*--------------------------------------------------------------------------------*/
+void SphericalIndex::Set(const std::vector<Position>& positions)
+{
+  uint_t i;
+
+  freeids.clear();
+  entries.resize(positions.size());
+  count = (uint_t)entries.size();
+
+  for (i = 0; i < count; i++)
+  {
+    GetUnitVector(positions[i], entries[i].dir);
+    entries[i].valid = true;
+  }
+
+  // grid cells of all entries set here
+  Regrid();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Add an entry
+ *
+ * @param pos position (only the direction is used)
+ *
+ * @return id of entry
+ */
+/*--------------------------------------------------------------------------------*/
+uint_t SphericalIndex::Add(const Position& pos)
+{
+  uint_t id;
+
+  // re-use ids of removed entries
+  if (freeids.size() > 0)
+  {
+    id = freeids.back();
+    freeids.pop_back();
+  }
+  else
+  {
+    id = (uint_t)entries.size();
+    entries.push_back(ENTRY());
+  }
+
+  ENTRY& entry = entries[id];
+  GetUnitVector(pos, entry.dir);
+  entry.cell  = GetCell(entry.dir);
+  entry.valid = true;
+  cells[entry.cell].push_back(id);
+  count++;
+
+  // grid becomes too coarse as entries are added
+  if (CalcResolution(count) >= (2 * resolution)) Regrid();
+
+  return id;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Move an existing entry
+ *
+ * @return false if the id is invalid
+ */
+/*--------------------------------------------------------------------------------*/
+bool SphericalIndex::Move(uint_t id, const Position& pos)
+{
+  bool success = false;
+
+  if (IsValid(id))
+  {
+    ENTRY& entry = entries[id];
+    uint_t cell;
+
+    GetUnitVector(pos, entry.dir);
+    if ((cell = GetCell(entry.dir)) != entry.cell)
+    {
+      std::vector<uint_t>& list = cells[entry.cell];
+      std::vector<uint_t>::iterator it;
+
+      if ((it = std::find(list.begin(), list.end(), id)) != list.end())
+      {
+        *it = list.back();
+        list.pop_back();
+      }
+
+      entry.cell = cell;
+      cells[cell].push_back(id);
+    }
+
+    success = true;
+  }
+  else BBCERROR("Invalid spherical index id %u", id);
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Remove an entry
+ *
+ * @return false if the id is invalid
+ */
+/*--------------------------------------------------------------------------------*/
+bool SphericalIndex::Remove(uint_t id)
+{
+  bool success = false;
+
+  if (IsValid(id))
+  {
+    ENTRY& entry = entries[id];
+    std::vector<uint_t>& list = cells[entry.cell];
+    std::vector<uint_t>::iterator it;
+
+    if ((it = std::find(list.begin(), list.end(), id)) != list.end())
+    {
+      *it = list.back();
+      list.pop_back();
+    }
+
+    entry.valid = false;
+    freeids.push_back(id);
+    count--;
+
+    // grid becomes too fine (and wasteful) as entries are removed
+    if ((2 * CalcResolution(count)) <= resolution) Regrid();
+
+    success = true;
+  }
+  else BBCERROR("Invalid spherical index id %u", id);
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return (unit, cartesian) direction of entry
+ */
+/*--------------------------------------------------------------------------------*/
+Position SphericalIndex::GetDirection(uint_t id) const
+{
+  Position pos;
+
+  if (IsValid(id))
+  {
+    const ENTRY& entry = entries[id];
+    pos = Position(entry.dir[0], entry.dir[1], entry.dir[2]);
+  }
+  else BBCERROR("Invalid spherical index id %u", id);
+
+  return pos;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Find the nearest entries to a position
+ *
+ * @param pos query position (only the direction is used)
+ * @param results list to be populated with (up to) k results, nearest first
+ * @param k maximum number of entries to find
+ *
+ * @return number of results
+ */
+/*--------------------------------------------------------------------------------*/
+uint_t SphericalIndex::FindNearest(const Position& pos, std::vector<RESULT>& results, uint_t k) const
+{
+  double dir[3];
+  uint_t i;
+
+  results.clear();
+  k = std::min(k, count);
+
+  if (k > 0)
+  {
+    // initial search angle (radians) is that of a cap expected to contain ~k entries (if evenly distributed)
+    double angle = 2.0 * sqrt((double)k / (double)count);
+
+    GetUnitVector(pos, dir);
+
+    // every entry within the search angle is found so if at least k are found, the nearest k are known,
+    // otherwise widen the search (eventually to the whole sphere)
+    while (true)
+    {
+      angle = std::min(angle, M_PI);
+
+      results.clear();
+      Search(dir, 2.0 * sin(.5 * angle), cos(angle), results);
+
+      if ((results.size() >= k) || (angle >= M_PI)) break;
+
+      angle *= 2.0;
+    }
+
+    // order by descending dot product
+    std::partial_sort(results.begin(), results.begin() + k, results.end(), DotGreater);
+    results.resize(k);
+
+    for (i = 0; i < k; i++) results[i].angle = DotToAngle(results[i].angle);
+  }
+
+  return (uint_t)results.size();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Find all entries within an angle of a position
+ *
+ * @param pos query position (only the direction is used)
+ * @param angle maximum angle (degrees, inclusive)
+ * @param results list to be populated with results
+ * @param sort true to sort results nearest first
+ *
+ * @return number of results
+ */
+/*--------------------------------------------------------------------------------*/
+uint_t SphericalIndex::FindWithinAngle(const Position& pos, double angle, std::vector<RESULT>& results, bool sort) const
+{
+  double dir[3];
+  uint_t i;
+
+  results.clear();
+
+  if ((count > 0) && (angle >= 0.0))
+  {
+    angle = std::min(angle, 180.0) * M_PI / 180.0;
+
+    GetUnitVector(pos, dir);
+    Search(dir, 2.0 * sin(.5 * angle), cos(angle), results);
+
+    if (sort) std::sort(results.begin(), results.end(), DotGreater);
+
+    for (i = 0; i < results.size(); i++) results[i].angle = DotToAngle(results[i].angle);
+  }
+
+  return (uint_t)results.size();
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Re-create grid with resolution suitable for the current number of entries
+ */
+/*--------------------------------------------------------------------------------*/
+void SphericalIndex::Regrid()
+{
+  uint_t i;
+
+  resolution = CalcResolution(count);
+
+  BBCDEBUG2(("Spherical index of %u entries using %u^3 grid", count, resolution));
+
+  cells.clear();
+  cells.resize(resolution * resolution * resolution);
+
+  for (i = 0; i < entries.size(); i++)
+  {
+    ENTRY& entry = entries[i];
+
+    if (entry.valid)
+    {
+      entry.cell = GetCell(entry.dir);
+      cells[entry.cell].push_back(i);
+    }
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return ideal grid resolution for a number of entries
+ */
+/*--------------------------------------------------------------------------------*/
+uint_t SphericalIndex::CalcResolution(uint_t n)
+{
+  // a grid of r^3 cells has approximately pi * r^2 cells intersecting the sphere,
+  // aim for approximately one entry per cell
+  return limited::limit((uint_t)sqrt((double)n / M_PI), (uint_t)1, (uint_t)64);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return grid index along one axis
+ */
+/*--------------------------------------------------------------------------------*/
+static inline uint_t GetGridIndex(double val, uint_t resolution)
+{
+  sint_t index = (sint_t)floor((val + 1.0) * .5 * (double)resolution);
+  return (uint_t)limited::limit(index, (sint_t)0, (sint_t)resolution - 1);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return grid cell index of unit vector
+ */
+/*--------------------------------------------------------------------------------*/
+uint_t SphericalIndex::GetCell(const double *dir) const
+{
+  return ((GetGridIndex(dir[0], resolution) * resolution + GetGridIndex(dir[1], resolution)) * resolution +
+          GetGridIndex(dir[2], resolution));
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Add entries within chord distance of dir to results (with angle set to the dot product)
+ */
+/*--------------------------------------------------------------------------------*/
+void SphericalIndex::Search(const double *dir, double chord, double mindot, std::vector<RESULT>& results) const
+{
+  uint_t lo[3], hi[3], ix, iy, iz, i;
+
+  // allow for rounding errors at cell boundaries
+  chord += 1.0e-9;
+
+  for (i = 0; i < 3; i++)
+  {
+    lo[i] = GetGridIndex(dir[i] - chord, resolution);
+    hi[i] = GetGridIndex(dir[i] + chord, resolution);
+  }
+
+  for (ix = lo[0]; ix <= hi[0]; ix++)
+  {
+    for (iy = lo[1]; iy <= hi[1]; iy++)
+    {
+      for (iz = lo[2]; iz <= hi[2]; iz++)
+      {
+        const std::vector<uint_t>& list = cells[(ix * resolution + iy) * resolution + iz];
+
+        for (i = 0; i < list.size(); i++)
+        {
+          const ENTRY& entry = entries[list[i]];
+          double dot = dir[0] * entry.dir[0] + dir[1] * entry.dir[1] + dir[2] * entry.dir[2];
+
+          if (dot >= mindot)
+          {
+            RESULT res = {list[i], dot};
+            results.push_back(res);
+          }
+        }
+      }
+    }
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Convert position to unit vector
+ */
+/*--------------------------------------------------------------------------------*/
+void SphericalIndex::GetUnitVector(const Position& pos, double *dir)
+{
+  Position cart = pos.Cart();
+  double   mod  = cart.Mod();
+
+  if (mod > 0.0)
+  {
+    dir[0] = cart.pos.x / mod;
+    dir[1] = cart.pos.y / mod;
+    dir[2] = cart.pos.z / mod;
+  }
+  else
+  {
+    // the origin has no direction, treat as straight ahead (az = el = 0)
+    dir[0] = 0.0;
+    dir[1] = 1.0;
+    dir[2] = 0.0;
+  }
+}
+
+BBC_AUDIOTOOLBOX_END
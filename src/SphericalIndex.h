@@ -0,0 +1,174 @@
+#ifndef __SPHERICAL_INDEX__
+#define __SPHERICAL_INDEX__
+
+#include <vector>
+
+#include "3DPosition.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Spatial index of directions (e.g. loudspeaker positions) for nearest and neighbourhood queries
+ *
+ * Positions are reduced to unit vectors and bucketed in a uniform 3D grid covering the unit
+ * sphere (only cells intersecting the sphere surface are ever occupied).  Because the chord
+ * distance between two unit vectors increases monotonically with the angle between them, an
+ * angular query is a ball query in the grid, so only a few cells are examined per query
+ *
+ * The grid resolution adapts to the number of entries (roughly one entry per occupied cell)
+ *
+ * Entries are identified by an id which stays the same until the entry is removed (ids of
+ * removed entries are reused by Add()); entries can be moved or removed individually without
+ * rebuilding the index
+ *
+ * All angles are in degrees and are the same as those returned by AbsAngle()
+ */
+/*--------------------------------------------------------------------------------*/
+class SphericalIndex
+{
+public:
+  SphericalIndex();
+  SphericalIndex(const std::vector<Position>& positions);
+  ~SphericalIndex() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Remove all entries
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Clear();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Replace all entries with the list of positions (ids are the indices into the list)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Set(const std::vector<Position>& positions);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Add an entry
+   *
+   * @param pos position (only the direction is used)
+   *
+   * @return id of entry
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t Add(const Position& pos);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Move an existing entry
+   *
+   * @return false if the id is invalid
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Move(uint_t id, const Position& pos);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Remove an entry
+   *
+   * @return false if the id is invalid
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Remove(uint_t id);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of entries
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetCount() const {return count;}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether an id refers to an entry
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool IsValid(uint_t id) const {return ((id < entries.size()) && entries[id].valid);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return (unit, cartesian) direction of entry
+   */
+  /*--------------------------------------------------------------------------------*/
+  Position GetDirection(uint_t id) const;
+
+  typedef struct {
+    uint_t id;                // entry id
+    double angle;             // angle (degrees) between entry and query direction
+  } RESULT;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Find the nearest entries to a position
+   *
+   * @param pos query position (only the direction is used)
+   * @param results list to be populated with (up to) k results, nearest first
+   * @param k maximum number of entries to find
+   *
+   * @return number of results
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t FindNearest(const Position& pos, std::vector<RESULT>& results, uint_t k = 1) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Find all entries within an angle of a position
+   *
+   * @param pos query position (only the direction is used)
+   * @param angle maximum angle (degrees, inclusive)
+   * @param results list to be populated with results
+   * @param sort true to sort results nearest first
+   *
+   * @return number of results
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t FindWithinAngle(const Position& pos, double angle, std::vector<RESULT>& results, bool sort = true) const;
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Re-create grid with resolution suitable for the current number of entries
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Regrid();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return ideal grid resolution for a number of entries
+   */
+  /*--------------------------------------------------------------------------------*/
+  static uint_t CalcResolution(uint_t n);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return grid cell index of unit vector
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetCell(const double *dir) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Add entries within chord distance of dir to results (with angle set to the dot product)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Search(const double *dir, double chord, double mindot, std::vector<RESULT>& results) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Convert position to unit vector
+   */
+  /*--------------------------------------------------------------------------------*/
+  static void GetUnitVector(const Position& pos, double *dir);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Sort and conversion helpers for results during searches (when angle holds the dot product)
+   */
+  /*--------------------------------------------------------------------------------*/
+  static bool   DotGreater(const RESULT& res1, const RESULT& res2) {return (res1.angle > res2.angle);}
+  static double DotToAngle(double dot) {return acos(limited::limit(dot, -1.0, 1.0)) * 180.0 / M_PI;}
+
+  typedef struct {
+    double dir[3];            // unit vector
+    uint_t cell;              // grid cell
+    bool   valid;             // false if entry has been removed
+  } ENTRY;
+
+protected:
+  std::vector<ENTRY>               entries;
+  std::vector<uint_t>              freeids;
+  std::vector<std::vector<uint_t> > cells;
+  uint_t                           count;
+  uint_t                           resolution;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
@@ -3,6 +3,21 @@
 
 #include <errno.h>
 
+#ifdef __linux__
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#ifdef SYS_membarrier
+#include <linux/membarrier.h>
+#endif
+#elif defined(USE_PTHREADS)
+#include <sys/time.h>
+#else
+#include <chrono>
+#endif
+
 #define BBCDEBUG_LEVEL 1
 #include "misc.h"
 #include "ThreadLock.h"
@@ -230,4 +245,179 @@ ThreadBoolSignalObject::~ThreadBoolSignalObject()
 {
 }
 
+/*----------------------------------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------*/
+/** Return whether the process-wide memory barrier is available (registering for it on the first call)
+ */
+/*--------------------------------------------------------------------------------*/
+static bool ThreadEventCountAsymmetricBarrier()
+{
+#if defined(__linux__) && defined(SYS_membarrier)
+  static const bool available = (syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0);
+  return available;
+#else
+  return false;
+#endif
+}
+
+ThreadEventCount::ThreadEventCount() : epoch(0),
+                                       waiters(0),
+                                       asymmetric(ThreadEventCountAsymmetricBarrier())
+{
+#if !defined(__linux__) && defined(USE_PTHREADS)
+  if (pthread_mutex_init(&mutex, NULL) != 0)
+  {
+    BBCERROR("Failed to initialise mutex<%s>: %s", StringFrom(&mutex).c_str(), strerror(errno));
+  }
+  if (pthread_cond_init(&condition, NULL) != 0)
+  {
+    BBCERROR("Failed to initialise cond<%s>: %s", StringFrom(&condition).c_str(), strerror(errno));
+  }
+#endif
+}
+
+ThreadEventCount::~ThreadEventCount()
+{
+#if !defined(__linux__) && defined(USE_PTHREADS)
+  pthread_cond_destroy(&condition);
+  pthread_mutex_destroy(&mutex);
+#endif
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Register the calling thread as a waiter and return the key to pass to Wait()
+ *
+ * @note the condition MUST be (re-)checked *after* calling this and either CancelWait()
+ * or Wait() MUST be called afterwards
+ */
+/*--------------------------------------------------------------------------------*/
+uint_t ThreadEventCount::PrepareWait()
+{
+  waiters.fetch_add(1, std::memory_order_relaxed);
+
+  // order the registration before the caller's check of the condition (pairs with barrier in Notify())
+#if defined(__linux__) && defined(SYS_membarrier)
+  // the process-wide barrier acts as a memory fence on every running thread, including any notifying thread
+  // (cannot fail once registered)
+  if (asymmetric) syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+  else
+#endif
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  return epoch.load(std::memory_order_acquire);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Deregister the calling thread as a waiter without waiting (condition already met)
+ */
+/*--------------------------------------------------------------------------------*/
+void ThreadEventCount::CancelWait()
+{
+  waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Wait until Notify() has been called since PrepareWait() returned key
+ *
+ * @param key value returned by PrepareWait()
+ * @param timeoutms maximum time to wait in ms (~0 = forever)
+ *
+ * @return false if the wait timed out
+ *
+ * @note returns immediately if Notify() has already been called since PrepareWait()
+ */
+/*--------------------------------------------------------------------------------*/
+bool ThreadEventCount::Wait(uint_t key, uint_t timeoutms)
+{
+  const bool forever = (timeoutms == ~(uint_t)0);
+  bool success = true;
+
+#ifdef __linux__
+  const uint64_t deadline = GetNanosecondTicks() + (uint64_t)timeoutms * 1000000;
+
+  while (epoch.load(std::memory_order_acquire) == key)
+  {
+    struct timespec timeout, *ptimeout = NULL;
+
+    if (!forever)
+    {
+      uint64_t now = GetNanosecondTicks();
+
+      if (now >= deadline)
+      {
+        success = false;
+        break;
+      }
+
+      timeout.tv_sec  = (time_t)((deadline - now) / 1000000000);
+      timeout.tv_nsec = (long)((deadline - now) % 1000000000);
+      ptimeout = &timeout;
+    }
+
+    // the kernel only sleeps if epoch still equals key (else returns EAGAIN), wake-ups and EINTR are handled by the loop
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch), FUTEX_WAIT_PRIVATE, (uint32_t)key, ptimeout, NULL, 0);
+  }
+#elif defined(USE_PTHREADS)
+  struct timespec deadline;
+
+  if (!forever)
+  {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    uint64_t ns = (uint64_t)now.tv_usec * 1000 + (uint64_t)timeoutms * 1000000;
+    deadline.tv_sec  = now.tv_sec + (time_t)(ns / 1000000000);
+    deadline.tv_nsec = (long)(ns % 1000000000);
+  }
+
+  pthread_mutex_lock(&mutex);
+  while (epoch.load(std::memory_order_acquire) == key)
+  {
+    if (forever) pthread_cond_wait(&condition, &mutex);
+    else if (pthread_cond_timedwait(&condition, &mutex, &deadline) == ETIMEDOUT)
+    {
+      success = (epoch.load(std::memory_order_acquire) != key);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+#else
+  std::unique_lock<std::mutex> lock(mutex);
+  auto notified = [this, key]() {return (epoch.load(std::memory_order_acquire) != key);};
+
+  if (forever) condition.wait(lock, notified);
+  else success = condition.wait_for(lock, std::chrono::milliseconds(timeoutms), notified);
+#endif
+
+  waiters.fetch_sub(1, std::memory_order_relaxed);
+
+  return success;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Advance the epoch and wake all waiting threads
+ */
+/*--------------------------------------------------------------------------------*/
+void ThreadEventCount::Wake()
+{
+#ifdef __linux__
+  epoch.fetch_add(1, std::memory_order_release);
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#elif defined(USE_PTHREADS)
+  // epoch must change under the lock so that a waiter cannot miss the wake-up between its check and its wait
+  pthread_mutex_lock(&mutex);
+  epoch.fetch_add(1, std::memory_order_release);
+  pthread_cond_broadcast(&condition);
+  pthread_mutex_unlock(&mutex);
+#else
+  {
+    // epoch must change under the lock so that a waiter cannot miss the wake-up between its check and its wait
+    std::lock_guard<std::mutex> lock(mutex);
+    epoch.fetch_add(1, std::memory_order_release);
+  }
+  condition.notify_all();
+#endif
+}
+
 BBC_AUDIOTOOLBOX_END
@@ -8,6 +8,8 @@
 #include <condition_variable>
 #endif
 
+#include <atomic>
+
 BBC_AUDIOTOOLBOX_START
 
 /*--------------------------------------------------------------------------------*/
@@ -177,6 +179,104 @@ protected:
   volatile bool ready;
 };
 
+/*--------------------------------------------------------------------------------*/
+/** Event count - allows threads to block until a lock-free condition (e.g. data being available
+ * in a LockFreeBuffer) may have changed, without the notifying side taking a lock
+ *
+ * To wait:
+ *   uint_t key = event.PrepareWait();
+ *   if (condition is met) event.CancelWait();
+ *   else event.Wait(key, timeout);
+ *   (and then re-check the condition)
+ *
+ * To notify:
+ *   change condition (with release semantics);
+ *   event.Notify();
+ *
+ * Notify() is just a load when no thread is waiting (no lock, no system call and, where the
+ * process-wide memory barrier system call is available (Linux membarrier()), no memory fence)
+ *
+ * PrepareWait() must order its registration before the waiter's check of the condition and
+ * Notify() must order the condition change before its check for waiters: with membarrier()
+ * available, PrepareWait() issues the process-wide barrier so Notify() only requires a compiler
+ * barrier, otherwise both sides use a memory fence
+ *
+ * Waiting uses a futex on Linux and a mutex and condition variable on other platforms
+ */
+/*--------------------------------------------------------------------------------*/
+class ThreadEventCount
+{
+public:
+  ThreadEventCount();
+  virtual ~ThreadEventCount();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Register the calling thread as a waiter and return the key to pass to Wait()
+   *
+   * @note the condition MUST be (re-)checked *after* calling this and either CancelWait()
+   * or Wait() MUST be called afterwards
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t PrepareWait();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Deregister the calling thread as a waiter without waiting (condition already met)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void CancelWait();
+
+  /*--------------------------------------------------------------------------------*/
+  /** Wait until Notify() has been called since PrepareWait() returned key
+   *
+   * @param key value returned by PrepareWait()
+   * @param timeoutms maximum time to wait in ms (~0 = forever)
+   *
+   * @return false if the wait timed out
+   *
+   * @note returns immediately if Notify() has already been called since PrepareWait()
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool Wait(uint_t key, uint_t timeoutms = ~(uint_t)0);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Wake all waiting threads
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Notify()
+  {
+    // order the caller's condition change before the check for waiters (pairs with barrier in PrepareWait())
+    if (asymmetric) std::atomic_signal_fence(std::memory_order_seq_cst);
+    else            std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed)) Wake();
+  }
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Advance the epoch and wake all waiting threads
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Wake();
+
+private:
+  // copying is not supported
+  ThreadEventCount(const ThreadEventCount& obj);
+  ThreadEventCount& operator = (const ThreadEventCount& obj);
+
+protected:
+  std::atomic<uint32_t>   epoch;        // incremented by each Wake(), a futex on Linux
+  std::atomic<uint_t>     waiters;      // number of threads between PrepareWait() and the end of Wait()/CancelWait()
+  const bool              asymmetric;   // true if PrepareWait() uses a process-wide barrier (see above)
+#ifndef __linux__
+#ifdef USE_PTHREADS
+  pthread_mutex_t         mutex;
+  pthread_cond_t          condition;
+#else
+  std::mutex              mutex;
+  std::condition_variable condition;
+#endif
+#endif
+};
+
 BBC_AUDIOTOOLBOX_END
 
 #endif
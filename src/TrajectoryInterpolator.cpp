@@ -0,0 +1,333 @@
+
+#include <math.h>
+
+#include <algorithm>
+
+#define BBCDEBUG_LEVEL 1
+#include "TrajectoryInterpolator.h"
+
+BBC_AUDIOTOOLBOX_START
+
+TrajectoryInterpolator::TrajectoryInterpolator(uint_t n)
+{
+  Resize(n);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set number of objects
+ *
+ * @note existing segments (up to the new size) are preserved, new objects are stationary
+ * at the origin with no rotation
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::Resize(uint_t n)
+{
+  uint_t i, n0 = GetCount();
+
+  rotations.resize(n);
+  positions.resize(n);
+
+  for (i = n0; i < n; i++)
+  {
+    SetRotationSegment(i, Quaternion(), Quaternion());
+    SetPositionSegment(i, Position(), Position());
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set rotation segment for an object
+ *
+ * @param object object index
+ * @param q0 rotation at t = 0
+ * @param q1 rotation at t = 1
+ *
+ * @note As with Slerp(), assumes that quaternions have unit-length
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::SetRotationSegment(uint_t object, const Quaternion& q0, const Quaternion& q1)
+{
+  if (object < GetCount())
+  {
+    ROTATION_SEGMENT& seg = rotations[object];
+    double dot  = q0.ScalarProduct(q1);
+    double sign = 1.0;
+
+    // see Slerp(): take the shortest path
+    if (dot < 0.0)
+    {
+      dot  = -dot;
+      sign = -1.0;
+    }
+
+    seg.q0[0] = q0.w;
+    seg.q0[1] = q0.x;
+    seg.q0[2] = q0.y;
+    seg.q0[3] = q0.z;
+    seg.q1[0] = sign * q1.w;
+    seg.q1[1] = sign * q1.x;
+    seg.q1[2] = sign * q1.y;
+    seg.q1[3] = sign * q1.z;
+
+    // same threshold as Slerp()
+    if ((seg.slerp = (dot < 0.95)) == true)
+    {
+      seg.angle  = acos(dot);
+      seg.invsin = 1.0 / sin(seg.angle);
+    }
+    else
+    {
+      seg.angle  = 0.0;
+      seg.invsin = 1.0;
+    }
+  }
+  else BBCERROR("Object index %u out of range (%u objects)", object, GetCount());
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Set position segment for an object
+ *
+ * @param object object index
+ * @param p0 position at t = 0
+ * @param p1 position at t = 1
+ * @param spherical true for great-circle interpolation, false for straight-line interpolation
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::SetPositionSegment(uint_t object, const Position& p0, const Position& p1, bool spherical)
+{
+  if (object < GetCount())
+  {
+    POSITION_SEGMENT& seg = positions[object];
+    Position c0 = p0.Cart(), c1 = p1.Cart();
+    double   d0 = c0.Mod(),  d1 = c1.Mod();
+
+    // directions are undefined at the origin
+    if ((d0 == 0.0) || (d1 == 0.0)) spherical = false;
+
+    seg.spherical = spherical;
+    seg.slerp     = false;
+    seg.angle     = 0.0;
+    seg.invsin    = 1.0;
+
+    if (spherical)
+    {
+      // interpolate unit directions and scale by (linearly interpolated) distance
+      c0 /= d0;
+      c1 /= d1;
+
+      seg.d0 = d0;
+      seg.dd = d1 - d0;
+
+      double dot = c0.pos.x * c1.pos.x + c0.pos.y * c1.pos.y + c0.pos.z * c1.pos.z;
+
+      // close to the same or opposite directions the great-circle is ill-conditioned (or undefined)
+      if ((dot > -0.9999) && (dot < 0.9999))
+      {
+        seg.slerp  = true;
+        seg.angle  = acos(dot);
+        seg.invsin = 1.0 / sin(seg.angle);
+      }
+    }
+    else
+    {
+      seg.d0 = 1.0;
+      seg.dd = 0.0;
+    }
+
+    seg.p0[0] = c0.pos.x;
+    seg.p0[1] = c0.pos.y;
+    seg.p0[2] = c0.pos.z;
+    seg.p1[0] = c1.pos.x;
+    seg.p1[1] = c1.pos.y;
+    seg.p1[2] = c1.pos.z;
+  }
+  else BBCERROR("Object index %u out of range (%u objects)", object, GetCount());
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Calculate interpolation coefficients a[i] and b[i] for n samples such that
+ * the result is a[i] * start + b[i] * end
+ *
+ * @param angle angle between start and end (radians)
+ * @param invsin 1 / sin(angle)
+ * @param slerp true for spherical interpolation, false for linear
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::CalcCoeffs(double angle, double invsin, bool slerp, double t0, double dt, double *a, double *b, uint_t n)
+{
+  uint_t i;
+
+  if (slerp)
+  {
+    // a[i] = sin((1 - t) * angle) / sin(angle), b[i] = sin(t * angle) / sin(angle) for t = t0 + i * dt
+    //
+    // with A = (1 - t0) * angle, B = t0 * angle and phasor (c, s) = (cos(i * delta), sin(i * delta)):
+    //   a[i] = sin(A - i * delta) = sin(A) * c - cos(A) * s
+    //   b[i] = sin(B + i * delta) = sin(B) * c + cos(B) * s
+    // the phasor is advanced by complex multiplication so no trig is required per sample
+    double sa = sin((1.0 - t0) * angle) * invsin, ca = cos((1.0 - t0) * angle) * invsin;
+    double sb = sin(t0 * angle) * invsin,         cb = cos(t0 * angle) * invsin;
+    double sd = sin(dt * angle),                  cd = cos(dt * angle);
+    double c  = 1.0, s = 0.0;
+
+    for (i = 0; i < n; i++)
+    {
+      a[i] = sa * c - ca * s;
+      b[i] = sb * c + cb * s;
+
+      double c1 = c * cd - s * sd;
+      s = s * cd + c * sd;
+      c = c1;
+    }
+  }
+  else
+  {
+    for (i = 0; i < n; i++)
+    {
+      double t = t0 + (double)i * dt;
+      a[i] = 1.0 - t;
+      b[i] = t;
+    }
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Generate rotations for a single object
+ *
+ * @param object object index
+ * @param t0 interpolation value of first sample
+ * @param dt interpolation value increment per sample
+ * @param res array of n results
+ * @param n number of samples
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::GenerateRotations(uint_t object, double t0, double dt, Quaternion *res, uint_t n) const
+{
+  if (object < GetCount())
+  {
+    const ROTATION_SEGMENT& seg = rotations[object];
+    double a[CHUNK_SIZE], b[CHUNK_SIZE];
+    uint_t i, j;
+
+    for (i = 0; i < n;)
+    {
+      uint_t nchunk = std::min(n - i, (uint_t)CHUNK_SIZE);
+
+      // coefficients are re-seeded each chunk to limit error accumulation
+      CalcCoeffs(seg.angle, seg.invsin, seg.slerp, t0 + (double)i * dt, dt, a, b, nchunk);
+
+      for (j = 0; j < nchunk; j++)
+      {
+        res[i + j] = Quaternion(a[j] * seg.q0[0] + b[j] * seg.q1[0],
+                                a[j] * seg.q0[1] + b[j] * seg.q1[1],
+                                a[j] * seg.q0[2] + b[j] * seg.q1[2],
+                                a[j] * seg.q0[3] + b[j] * seg.q1[3]);
+      }
+
+      i += nchunk;
+    }
+  }
+  else BBCERROR("Object index %u out of range (%u objects)", object, GetCount());
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Generate rotations for all objects
+ *
+ * @param t0 interpolation value of first sample
+ * @param dt interpolation value increment per sample
+ * @param res array of GetCount() * n results, object i's results start at res[i * n]
+ * @param n number of samples per object
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::GenerateRotations(double t0, double dt, Quaternion *res, uint_t n) const
+{
+  uint_t i;
+
+  for (i = 0; i < GetCount(); i++) GenerateRotations(i, t0, dt, res + i * n, n);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Generate cartesian positions for a single object
+ *
+ * @param object object index
+ * @param t0 interpolation value of first sample
+ * @param dt interpolation value increment per sample
+ * @param x, y, z arrays of n results
+ * @param n number of samples
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::GeneratePositions(uint_t object, double t0, double dt, double *x, double *y, double *z, uint_t n) const
+{
+  if (object < GetCount())
+  {
+    const POSITION_SEGMENT& seg = positions[object];
+    double a[CHUNK_SIZE], b[CHUNK_SIZE];
+    uint_t i, j;
+
+    for (i = 0; i < n;)
+    {
+      uint_t nchunk = std::min(n - i, (uint_t)CHUNK_SIZE);
+      double tc     = t0 + (double)i * dt;
+
+      CalcCoeffs(seg.angle, seg.invsin, seg.slerp, tc, dt, a, b, nchunk);
+
+      if (seg.spherical)
+      {
+        // scale coefficients by interpolated distance
+        for (j = 0; j < nchunk; j++)
+        {
+          double d = seg.d0 + (tc + (double)j * dt) * seg.dd;
+          a[j] *= d;
+          b[j] *= d;
+        }
+      }
+
+      for (j = 0; j < nchunk; j++)
+      {
+        x[i + j] = a[j] * seg.p0[0] + b[j] * seg.p1[0];
+        y[i + j] = a[j] * seg.p0[1] + b[j] * seg.p1[1];
+        z[i + j] = a[j] * seg.p0[2] + b[j] * seg.p1[2];
+      }
+
+      i += nchunk;
+    }
+  }
+  else BBCERROR("Object index %u out of range (%u objects)", object, GetCount());
+}
+
+void TrajectoryInterpolator::GeneratePositions(uint_t object, double t0, double dt, Position *res, uint_t n) const
+{
+  double x[CHUNK_SIZE], y[CHUNK_SIZE], z[CHUNK_SIZE];
+  uint_t i, j;
+
+  for (i = 0; i < n;)
+  {
+    uint_t nchunk = std::min(n - i, (uint_t)CHUNK_SIZE);
+
+    GeneratePositions(object, t0 + (double)i * dt, dt, x, y, z, nchunk);
+
+    for (j = 0; j < nchunk; j++) res[i + j] = Position(x[j], y[j], z[j]);
+
+    i += nchunk;
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Generate cartesian positions for all objects
+ *
+ * @param t0 interpolation value of first sample
+ * @param dt interpolation value increment per sample
+ * @param res block which is resized to GetCount() * n positions, object i's results start at index i * n
+ * @param n number of samples per object
+ */
+/*--------------------------------------------------------------------------------*/
+void TrajectoryInterpolator::GeneratePositions(double t0, double dt, PositionBlock& res, uint_t n) const
+{
+  uint_t i;
+
+  res.Resize(GetCount() * n);
+  res.SetPolar(false);
+
+  for (i = 0; i < GetCount(); i++) GeneratePositions(i, t0, dt, res.GetX() + i * n, res.GetY() + i * n, res.GetZ() + i * n, n);
+}
+
+BBC_AUDIOTOOLBOX_END
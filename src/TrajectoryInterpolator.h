@@ -0,0 +1,167 @@
+#ifndef __TRAJECTORY_INTERPOLATOR__
+#define __TRAJECTORY_INTERPOLATOR__
+
+#include <vector>
+
+#include "PositionBlock.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Block-based interpolation of rotations and positions for many objects
+ *
+ * Each object has a rotation segment (q0 -> q1) and a position segment (p0 -> p1) which are
+ * interpolated over t = 0..1.  All trig (acos(), sin()) is performed once per segment when it
+ * is set and a handful of sin()/cos() calls are made per object per *block*; each sample then
+ * costs only a few multiplies and adds so sample-accurate motion is affordable
+ *
+ * The per-sample sin() values needed by Slerp are generated by rotating a phasor through the
+ * (constant) angle step, which is numerically stable for any block length
+ *
+ * Samples are generated at t = t0 + i * dt (i = 0..n-1) where t0 and dt are chosen by the caller
+ * (e.g. t0 = (block start - segment start) / segment length, dt = 1 / segment length in samples)
+ *
+ * Rotations:
+ *   Results are identical (to rounding) to Slerp(q0, q1, t), including the use of linear
+ *   interpolation when q0 and q1 are close
+ *
+ * Positions:
+ *   Linear: straight-line interpolation in cartesian space
+ *   Spherical: great-circle interpolation of direction with linear interpolation of distance
+ *   (falls back to linear interpolation of direction when the directions are (nearly) the same
+ *   or (nearly) opposite)
+ *   Positions are always generated as *cartesian* co-ordinates
+ */
+/*--------------------------------------------------------------------------------*/
+class TrajectoryInterpolator
+{
+public:
+  TrajectoryInterpolator(uint_t n = 0);
+  ~TrajectoryInterpolator() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set number of objects
+   *
+   * @note existing segments (up to the new size) are preserved, new objects are stationary
+   * at the origin with no rotation
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Resize(uint_t n);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return number of objects
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t GetCount() const {return (uint_t)rotations.size();}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set rotation segment for an object
+   *
+   * @param object object index
+   * @param q0 rotation at t = 0
+   * @param q1 rotation at t = 1
+   *
+   * @note As with Slerp(), assumes that quaternions have unit-length
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetRotationSegment(uint_t object, const Quaternion& q0, const Quaternion& q1);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Set position segment for an object
+   *
+   * @param object object index
+   * @param p0 position at t = 0
+   * @param p1 position at t = 1
+   * @param spherical true for great-circle interpolation, false for straight-line interpolation
+   */
+  /*--------------------------------------------------------------------------------*/
+  void SetPositionSegment(uint_t object, const Position& p0, const Position& p1, bool spherical = false);
+
+  /*--------------------------------------------------------------------------------*/
+  /** Generate rotations for a single object
+   *
+   * @param object object index
+   * @param t0 interpolation value of first sample
+   * @param dt interpolation value increment per sample
+   * @param res array of n results
+   * @param n number of samples
+   */
+  /*--------------------------------------------------------------------------------*/
+  void GenerateRotations(uint_t object, double t0, double dt, Quaternion *res, uint_t n) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Generate rotations for all objects
+   *
+   * @param t0 interpolation value of first sample
+   * @param dt interpolation value increment per sample
+   * @param res array of GetCount() * n results, object i's results start at res[i * n]
+   * @param n number of samples per object
+   */
+  /*--------------------------------------------------------------------------------*/
+  void GenerateRotations(double t0, double dt, Quaternion *res, uint_t n) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Generate cartesian positions for a single object
+   *
+   * @param object object index
+   * @param t0 interpolation value of first sample
+   * @param dt interpolation value increment per sample
+   * @param x, y, z arrays of n results
+   * @param n number of samples
+   */
+  /*--------------------------------------------------------------------------------*/
+  void GeneratePositions(uint_t object, double t0, double dt, double *x, double *y, double *z, uint_t n) const;
+  void GeneratePositions(uint_t object, double t0, double dt, Position *res, uint_t n) const;
+
+  /*--------------------------------------------------------------------------------*/
+  /** Generate cartesian positions for all objects
+   *
+   * @param t0 interpolation value of first sample
+   * @param dt interpolation value increment per sample
+   * @param res block which is resized to GetCount() * n positions, object i's results start at index i * n
+   * @param n number of samples per object
+   */
+  /*--------------------------------------------------------------------------------*/
+  void GeneratePositions(double t0, double dt, PositionBlock& res, uint_t n) const;
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Calculate interpolation coefficients a[i] and b[i] for n samples such that
+   * the result is a[i] * start + b[i] * end
+   *
+   * @param angle angle between start and end (radians)
+   * @param invsin 1 / sin(angle)
+   * @param slerp true for spherical interpolation, false for linear
+   */
+  /*--------------------------------------------------------------------------------*/
+  static void CalcCoeffs(double angle, double invsin, bool slerp, double t0, double dt, double *a, double *b, uint_t n);
+
+  typedef struct {
+    double q0[4];             // w, x, y, z of start
+    double q1[4];             // w, x, y, z of end (negated if necessary to take the shortest path)
+    double angle;             // angle between q0 and q1 (radians)
+    double invsin;            // 1 / sin(angle)
+    bool   slerp;             // false to use linear interpolation
+  } ROTATION_SEGMENT;
+
+  typedef struct {
+    double p0[3];             // start (unit direction if spherical)
+    double p1[3];             // end (unit direction if spherical)
+    double d0, dd;            // start distance and change in distance (spherical only)
+    double angle;             // angle between directions (radians)
+    double invsin;            // 1 / sin(angle)
+    bool   spherical;         // true for great-circle interpolation
+    bool   slerp;             // false to use linear interpolation of p0 -> p1
+  } POSITION_SEGMENT;
+
+  // maximum number of samples processed at once (coefficients are held on the stack)
+  enum {CHUNK_SIZE = 256};
+
+protected:
+  std::vector<ROTATION_SEGMENT> rotations;
+  std::vector<POSITION_SEGMENT> positions;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef __WAITABLE_LOCK_FREE_BUFFER__
+#define __WAITABLE_LOCK_FREE_BUFFER__
+
+#include "LockFreeBuffer.h"
+#include "ThreadLock.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Lock-free circular buffer which allows the reader to block until items are available and the
+ * writer to block until space is available (instead of polling)
+ *
+ * Use exactly as LockFreeBuffer but call WaitForRead() or WaitForWrite() when there are not
+ * enough items or not enough space
+ *
+ * IncrementWrite(), IncrementRead(), Write(), Read() and Reset() notify the other side but this
+ * only costs a load when the other side is not waiting (see ThreadEventCount)
+ *
+ * Shutdown() wakes both sides and makes all waits fail until ClearShutdown() is called
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T, class INDEXING = LockFreeBufferModuloIndexing, class STATS = LockFreeBufferNoStats>
+class WaitableLockFreeBuffer : public LockFreeBuffer<T, INDEXING, STATS>
+{
+public:
+  typedef LockFreeBuffer<T, INDEXING, STATS> BASE;
+
+  WaitableLockFreeBuffer(uint_t l = 0) : BASE(l),
+                                         shutdown(false) {}
+  virtual ~WaitableLockFreeBuffer() {}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Increment the write pointer (after writing data, essentially committing buffers), waking the reader
+   *
+   * @param n number of buffers to commit
+   *
+   * @return true if pointer increments, false if it is not possible
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool IncrementWrite(uint_t n = 1)
+  {
+    bool success = BASE::IncrementWrite(n);
+    if (success) readevent.Notify();
+    return success;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Increment the read pointer (after reading data), waking the writer
+   *
+   * @param n number of buffers to release
+   *
+   * @return true if pointer increments, false if it is not possible
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool IncrementRead(uint_t n = 1)
+  {
+    bool success = BASE::IncrementRead(n);
+    if (success) writeevent.Notify();
+    return success;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Copy items into the buffer and commit them, waking the reader
+   *
+   * @return number of items written (which can be less than n if there is not enough space)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t Write(const T *src, uint_t n)
+  {
+    if ((n = BASE::Write(src, n)) > 0) readevent.Notify();
+    return n;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Copy items out of the buffer and release them, waking the writer
+   *
+   * @return number of items read (which can be less than n if there are not enough items available)
+   */
+  /*--------------------------------------------------------------------------------*/
+  uint_t Read(T *dst, uint_t n)
+  {
+    if ((n = BASE::Read(dst, n)) > 0) writeevent.Notify();
+    return n;
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Reset the buffer (losing all data), waking the writer
+   *
+   * @note this must be called from the reading thread
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Reset()
+  {
+    BASE::Reset();
+    writeevent.Notify();
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Wait until at least n items can be read
+   *
+   * @param n number of items required (limited to the capacity)
+   * @param timeoutms maximum time to wait in ms (~0 = forever)
+   *
+   * @return true if the items are available, false on timeout or shutdown
+   *
+   * @note this must be called from the reading thread
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool WaitForRead(uint_t n = 1, uint_t timeoutms = ~(uint_t)0)
+  {
+    return WaitFor(readevent, &BASE::ReadBuffersAvailable, n, timeoutms);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Wait until at least n items can be written
+   *
+   * @param n number of items required (limited to the capacity)
+   * @param timeoutms maximum time to wait in ms (~0 = forever)
+   *
+   * @return true if the space is available, false on timeout or shutdown
+   *
+   * @note this must be called from the writing thread
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool WaitForWrite(uint_t n = 1, uint_t timeoutms = ~(uint_t)0)
+  {
+    return WaitFor(writeevent, &BASE::WriteBuffersAvailable, n, timeoutms);
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Wake both sides and make all current and future waits fail (until ClearShutdown() is called)
+   */
+  /*--------------------------------------------------------------------------------*/
+  void Shutdown()
+  {
+    shutdown.store(true, std::memory_order_release);
+    readevent.Notify();
+    writeevent.Notify();
+  }
+
+  /*--------------------------------------------------------------------------------*/
+  /** Allow waits again after Shutdown()
+   */
+  /*--------------------------------------------------------------------------------*/
+  void ClearShutdown() {shutdown.store(false, std::memory_order_release);}
+
+  /*--------------------------------------------------------------------------------*/
+  /** Return whether Shutdown() has been called
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool IsShutdown() const {return shutdown.load(std::memory_order_acquire);}
+
+protected:
+  /*--------------------------------------------------------------------------------*/
+  /** Wait on event until available() returns at least n, timeout or shutdown
+   */
+  /*--------------------------------------------------------------------------------*/
+  bool WaitFor(ThreadEventCount& event, uint_t (BASE::*available)() const, uint_t n, uint_t timeoutms)
+  {
+    const bool     forever  = (timeoutms == ~(uint_t)0);
+    const uint64_t deadline = GetNanosecondTicks() + (uint64_t)timeoutms * 1000000;
+
+    n = std::min(n, BASE::GetCapacity());
+
+    while (true)
+    {
+      // fast path: no registration required
+      if ((this->*available)() >= n) return true;
+      if (IsShutdown()) return false;
+
+      uint_t key = event.PrepareWait();
+
+      // re-check after registering (the other side may have notified before seeing this thread waiting)
+      if (((this->*available)() >= n) || IsShutdown())
+      {
+        event.CancelWait();
+        continue;
+      }
+
+      uint_t wait = timeoutms;
+      if (!forever)
+      {
+        uint64_t now = GetNanosecondTicks();
+
+        if (now >= deadline)
+        {
+          event.CancelWait();
+          return false;
+        }
+
+        // round up so that the loop does not spin on a sub-ms remainder
+        wait = (uint_t)((deadline - now + 999999) / 1000000);
+      }
+
+      event.Wait(key, wait);
+    }
+  }
+
+protected:
+  ThreadEventCount  readevent;        // notified when items are written (reader waits on this)
+  ThreadEventCount  writeevent;       // notified when items are read (writer waits on this)
+  std::atomic<bool> shutdown;
+};
+
+BBC_AUDIOTOOLBOX_END
+
+#endif
@@ -447,15 +447,20 @@ void Printf(std::string& str, const char *fmt, ...)
 /*--------------------------------------------------------------------------------*/
 int vasprintf(char **buf, const char *fmt, va_list ap)
 {
+  va_list ap2;
+
   *buf = NULL;
 
+  // ap cannot be used twice so take a copy for the second pass
+  va_copy(ap2, ap);
   int l = vsnprintf(NULL, 0, fmt, ap);
   if (l >= 0) {
     if ((*buf = (char *)malloc(l + 1)) != NULL)
     {
-      l = vsnprintf(*buf, l + 1, fmt, ap);
+      l = vsnprintf(*buf, l + 1, fmt, ap2);
     }
   }
+  va_end(ap2);
   return l;
 }
 
@@ -692,6 +697,57 @@ double fix_denormal(double val)
   return res;
 }
 
+/*--------------------------------------------------------------------------------*/
+/** Allocate memory aligned to a boundary (which MUST be a power of 2)
+ *
+ * @note memory MUST be freed using AlignedFree()
+ */
+/*--------------------------------------------------------------------------------*/
+void *AlignedAlloc(size_t bytes, size_t alignment)
+{
+  void *ptr = NULL;
+
+  // posix_memalign() requires alignment to be at least sizeof(void *)
+  alignment = std::max(alignment, sizeof(void *));
+
+#ifdef TARGET_OS_WINDOWS
+  ptr = _aligned_malloc(bytes, alignment);
+#else
+  if (posix_memalign(&ptr, alignment, bytes) != 0) ptr = NULL;
+#endif
+
+  return ptr;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Free memory allocated by AlignedAlloc()
+ */
+/*--------------------------------------------------------------------------------*/
+void AlignedFree(void *ptr)
+{
+#ifdef TARGET_OS_WINDOWS
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return size of a virtual memory page in bytes (a power of 2)
+ */
+/*--------------------------------------------------------------------------------*/
+size_t GetPageSize()
+{
+#ifdef TARGET_OS_WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (size_t)info.dwPageSize;
+#else
+  long res = sysconf(_SC_PAGESIZE);
+  return (res > 0) ? (size_t)res : 4096;
+#endif
+}
+
 /*--------------------------------------------------------------------------------*/
 /** Factorial of an unsigned integer.
  *
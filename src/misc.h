@@ -3,10 +3,12 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <stddef.h>
 
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <new>
 
 #include "OSCompiler.h"
 
@@ -61,6 +63,11 @@ typedef unsigned long long ullong_t;
 #define MEMALIGNED(x, decl)  __declspec(align(x)) decl
 #endif
 
+// size of a cache line, used to separate data written by different threads (avoiding false sharing)
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
 BBC_AUDIOTOOLBOX_START
 
 #ifdef __BYTE_ORDER__
@@ -354,6 +361,68 @@ extern double fix_denormal(double val);
 /*--------------------------------------------------------------------------------*/
 extern uint_t factorial(uint_t n);
 
+/*--------------------------------------------------------------------------------*/
+/** Allocate memory aligned to a boundary (which MUST be a power of 2)
+ *
+ * @param bytes number of bytes to allocate
+ * @param alignment alignment boundary in bytes
+ *
+ * @return ptr to memory or NULL
+ *
+ * @note memory MUST be freed using AlignedFree()
+ */
+/*--------------------------------------------------------------------------------*/
+extern void *AlignedAlloc(size_t bytes, size_t alignment);
+
+/*--------------------------------------------------------------------------------*/
+/** Free memory allocated by AlignedAlloc()
+ */
+/*--------------------------------------------------------------------------------*/
+extern void AlignedFree(void *ptr);
+
+/*--------------------------------------------------------------------------------*/
+/** Return size of a virtual memory page in bytes (a power of 2)
+ */
+/*--------------------------------------------------------------------------------*/
+extern size_t GetPageSize();
+
+/*--------------------------------------------------------------------------------*/
+/** STL allocator returning memory aligned to ALIGNMENT bytes (default suits AVX)
+ *
+ * For example: std::vector<double, AlignedAllocator<double> > data;
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T, size_t ALIGNMENT = 32>
+class AlignedAllocator
+{
+public:
+  typedef T         value_type;
+  typedef T         *pointer;
+  typedef const T   *const_pointer;
+  typedef T&        reference;
+  typedef const T&  const_reference;
+  typedef size_t    size_type;
+  typedef ptrdiff_t difference_type;
+
+  template<typename U>
+  struct rebind {typedef AlignedAllocator<U, ALIGNMENT> other;};
+
+  AlignedAllocator() {}
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>& obj) {UNUSED_PARAMETER(obj);}
+
+  T *allocate(size_t n)
+  {
+    void *p = AlignedAlloc(n * sizeof(T), ALIGNMENT);
+    if (!p && n) throw std::bad_alloc();
+    return (T *)p;
+  }
+  void deallocate(T *p, size_t n) {UNUSED_PARAMETER(n); AlignedFree(p);}
+
+  friend bool operator == (const AlignedAllocator& obj1, const AlignedAllocator& obj2) {UNUSED_PARAMETER(obj1); UNUSED_PARAMETER(obj2); return true;}
+  friend bool operator != (const AlignedAllocator& obj1, const AlignedAllocator& obj2) {UNUSED_PARAMETER(obj1); UNUSED_PARAMETER(obj2); return false;}
+};
+
 typedef struct {
   const char *name;
   const char *desc;
@@ -4,6 +4,7 @@ BBC_AUDIOTOOLBOX_START
 // list of libraries this library is dependant on
 
 // list of this library's component registration functions
+extern void bbcat_register_DistanceModel();
 
 // registration function
 bool bbcat_register_bbcat_base()
@@ -18,6 +19,7 @@ bool bbcat_register_bbcat_base()
     // register this library's version number
     LoadedVersions::Get().Register("bbcat-base", "0.1.2.2-master");
     // register this library's components
+    bbcat_register_DistanceModel();
 
   }
   return registered;
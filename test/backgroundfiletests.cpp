@@ -0,0 +1,423 @@
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include <catch/catch.hpp>
+
+#include "BackgroundFile.h"
+#include "PerformanceMonitor.h"
+
+BBC_AUDIOTOOLBOX_START
+
+static const char *backgroundfiletestname = "backgroundfiletests.tmp";
+
+/*--------------------------------------------------------------------------------*/
+/** Write blocks of incrementing values
+ */
+/*--------------------------------------------------------------------------------*/
+static uint32_t BackgroundFileWriteBlocks(EnhancedFile& file, uint32_t val, uint_t nblocks, uint_t blocksize)
+{
+  std::vector<uint32_t> block(blocksize);
+  uint_t i, j;
+
+  for (i = 0; i < nblocks; i++)
+  {
+    for (j = 0; j < blocksize; j++) block[j] = val++;
+    CHECK(file.fwrite(&block[0], sizeof(block[0]), blocksize) == blocksize);
+  }
+
+  return val;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Check file contains incrementing values
+ */
+/*--------------------------------------------------------------------------------*/
+static uint32_t BackgroundFileCheck(const char *filename)
+{
+  EnhancedFile file;
+  uint32_t     val = 0, errors = 0, item;
+
+  REQUIRE(file.fopen(filename, "rb"));
+  while (file.fread(&item, sizeof(item), 1) == 1)
+  {
+    if (item != val++) errors++;
+  }
+  CHECK(errors == 0);
+
+  return val;
+}
+
+TEST_CASE("backgroundfile")
+{
+  const uint_t blocksize = 1000;
+
+  SECTION("foreground")
+  {
+    BackgroundFile file;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    CHECK(BackgroundFileWriteBlocks(file, 0, 100, blocksize) == (100 * blocksize));
+    CHECK(file.ftell() == (off_t)(100 * blocksize * sizeof(uint32_t)));
+    file.fclose();
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == (100 * blocksize));
+  }
+
+  SECTION("background")
+  {
+    BackgroundFile file;
+    uint32_t val;
+    uint_t   i;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    file.EnableBackground();
+
+    val = BackgroundFileWriteBlocks(file, 0, 1000, blocksize);
+
+    // thread writes all queued blocks without being prompted
+    for (i = 0; (i < 10000) && !file.ReadyToClose(); i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK(file.ReadyToClose());
+
+    // the position is known without flushing
+    CHECK(file.ftell() == (off_t)(val * sizeof(uint32_t)));
+    val = BackgroundFileWriteBlocks(file, val, 1000, blocksize);
+    file.fclose();
+    CHECK(!file.ReadyToClose());
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == val);
+  }
+
+  SECTION("pool")
+  {
+    BackgroundFile file;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    CHECK(file.GetBufferCount() == 0);
+
+    // buffers are whole pages and the number of buffers is a power of 2 within the limit
+    file.SetBufferSize(1);
+    CHECK(file.GetBufferSize() == GetPageSize());
+    file.SetMemoryLimit(7 * GetPageSize());
+    file.EnableBackground();
+    CHECK(file.GetBufferCount() == 4);
+    file.SetMemoryLimit(0);
+    CHECK(file.GetBufferCount() == 2);
+
+    // many small writes are coalesced into few buffers
+    CHECK(BackgroundFileWriteBlocks(file, 0, 10000, 3) == 30000);
+    file.EnableBackground(false);
+    CHECK(file.GetBufferCount() == 0);
+    file.fclose();
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == 30000);
+  }
+
+  SECTION("overflow")
+  {
+    BackgroundFile file;
+    const uint_t poolitems = (uint_t)(2 * GetPageSize() / sizeof(uint32_t));
+    std::vector<uint32_t> block(3 * poolitems);
+    uint_t i;
+
+    for (i = 0; i < block.size(); i++) block[i] = i;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    file.SetBufferSize(GetPageSize());
+    file.SetMemoryLimit(2 * GetPageSize());
+    file.EnableBackground();
+    REQUIRE(file.GetBufferCount() == 2);
+
+    // writes bigger than the whole pool
+    file.SetOverflowPolicy(BackgroundFile::OVERFLOW_SHORT_WRITE);
+    CHECK(file.fwrite(&block[0], sizeof(block[0]), block.size()) == poolitems);
+
+    file.SetOverflowPolicy(BackgroundFile::OVERFLOW_DROP);
+    CHECK(file.fwrite(&block[0], sizeof(block[0]), block.size()) == 0);
+    CHECK(file.GetDroppedBytes() == (block.size() * sizeof(block[0])));
+    CHECK(file.GetDroppedWrites() == 1);
+
+    file.SetOverflowPolicy(BackgroundFile::OVERFLOW_BLOCK);
+    CHECK(file.fwrite(&block[poolitems], sizeof(block[0]), block.size() - poolitems) == (block.size() - poolitems));
+    CHECK(file.GetDroppedWrites() == 1);
+    file.fclose();
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == block.size());
+
+    // with direct I/O, the first buffer after an unaligned position is shortened (and short writes must not wait)
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    CHECK(file.fwrite(&block[0], sizeof(block[0]), 11) == 11);
+    file.SetDirectIO();
+    file.SetOverflowPolicy(BackgroundFile::OVERFLOW_SHORT_WRITE);
+    CHECK(file.fwrite(&block[11], sizeof(block[0]), block.size() - 11) == (poolitems - 11));
+    file.fclose();
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == poolitems);
+  }
+
+  SECTION("chunks")
+  {
+    BackgroundFile file;
+    BACKGROUNDFILESTATS stats;
+    const size_t pagesize = GetPageSize();
+    uint32_t val;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    file.SetBufferSize(pagesize);
+    file.SetMemoryLimit(16 * pagesize);
+    file.SetChunkSize(4 * pagesize + 100);
+    file.EnableBackground();
+
+    // buffers are gathered into whole chunks
+    val = BackgroundFileWriteBlocks(file, 0, 1000, 100);
+    CHECK(file.ftell() == (off_t)(val * sizeof(uint32_t)));
+    file.fflush();
+    stats = file.GetStats();
+    CHECK(stats.byteswritten == (val * sizeof(uint32_t)));
+    CHECK(stats.maxwritesize == (4 * pagesize));
+    CHECK(stats.writes <= ((stats.byteswritten + 4 * pagesize - 1) / (4 * pagesize) + 1));
+    CHECK(stats.averagewritesize == (stats.byteswritten / stats.writes));
+    CHECK(stats.throughput > 0);
+
+    // chunk size is limited to half the pool
+    file.SetChunkSize(1024 * pagesize);
+    val = BackgroundFileWriteBlocks(file, val, 1000, 100);
+    file.fclose();
+    CHECK(file.GetStats().maxwritesize == (8 * pagesize));
+
+    PerformanceMonitor::StartMeasuring();
+    file.PublishStats("backgroundfile");
+    PerformanceMonitor::StopMeasuring();
+    CHECK(PerformanceMonitor::Get().GetCounter("backgroundfile.byteswritten") == (val * sizeof(uint32_t)));
+
+    file.ResetStats();
+    CHECK(file.GetStats().byteswritten == 0);
+    CHECK(file.GetStats().writes == 0);
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == val);
+  }
+
+  SECTION("async")
+  {
+    BackgroundFile file;
+    BACKGROUNDFILESTATS stats;
+    const size_t pagesize = GetPageSize();
+    uint32_t val;
+    uint_t   i;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    file.SetBufferSize(pagesize);
+    file.SetMemoryLimit(16 * pagesize);
+    file.SetChunkSize(2 * pagesize);
+    file.SetAsyncWrites(true, 4);
+    file.SetDirectIO();
+    CHECK(file.GetAsyncWrites());
+    CHECK(file.GetAsyncDepth() == 4);
+    CHECK(file.GetDirectIO());
+
+    // unaligned start (like a file header), written in the foreground
+    val = BackgroundFileWriteBlocks(file, 0, 1, 11);
+    file.EnableBackground();
+
+    val = BackgroundFileWriteBlocks(file, val, 1000, 100);
+    CHECK(file.ftell() == (off_t)(val * sizeof(uint32_t)));
+    file.fflush();
+    stats = file.GetStats();
+    CHECK(stats.byteswritten == ((val - 11) * sizeof(uint32_t)));
+    CHECK(stats.maxinflight >= 1);
+    CHECK(stats.maxinflight <= 4);
+    CHECK(stats.directbytes <= stats.byteswritten);
+
+    // writing continues from the flushed position
+    for (i = 0; i < 3; i++)
+    {
+      val = BackgroundFileWriteBlocks(file, val, 100, 77);
+      CHECK(file.ftell() == (off_t)(val * sizeof(uint32_t)));
+    }
+    file.fclose();
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == val);
+  }
+
+#ifndef _WIN32
+  SECTION("positioning")
+  {
+    BackgroundFile file;
+    const size_t pagesize = GetPageSize();
+    const uint32_t header = 0xffffffff;
+    uint32_t val, count = 0;
+    char     text[16];
+    uint_t   i;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    file.SetBufferSize(pagesize);
+    file.SetMemoryLimit(64 * pagesize);
+    file.SetChunkSize(32 * pagesize);
+    file.EnableBackground();
+
+    // placeholder header (like a WAV file's), patched after each block of data
+    CHECK(file.fwrite(&header, sizeof(header), 1) == 1);
+    for (i = 0, val = 1; i < 10; i++)
+    {
+      val = BackgroundFileWriteBlocks(file, val, 1, 100);
+      count += 100;
+
+      CHECK(file.ftell() == (off_t)(val * sizeof(uint32_t)));
+      CHECK(file.fseek(0, SEEK_SET) == 0);
+      CHECK(file.fwrite(&count, sizeof(count), 1) == 1);
+      CHECK(file.ftell() == (off_t)sizeof(uint32_t));
+      CHECK(file.fseek(0, SEEK_END) == 0);
+      CHECK(file.ftell() == (off_t)(val * sizeof(uint32_t)));
+    }
+
+    // less than a chunk is queued so nothing has been flushed by the position operations
+    CHECK(file.GetStats().byteswritten == 0);
+
+    CHECK(file.fseek(-(off_t)(100 * sizeof(uint32_t)), SEEK_CUR) == 0);
+    CHECK(file.ftell() == (off_t)((val - 100) * sizeof(uint32_t)));
+    CHECK(file.fseek(-1, SEEK_SET) < 0);
+    CHECK(file.fseek(0, SEEK_END) == 0);
+
+    // formatted output is queued too
+    file.fprintf("%08x", val);
+
+    file.rewind();
+    CHECK(file.ftell() == 0);
+    file.fclose();
+
+    // check patched header, data and text
+    EnhancedFile check;
+    std::vector<uint32_t> data(count + 1);
+    REQUIRE(check.fopen(backgroundfiletestname, "rb"));
+    REQUIRE(check.fread(&data[0], sizeof(data[0]), data.size()) == data.size());
+    CHECK(data[0] == count);
+    for (i = 1; (i < data.size()) && (data[i] == i); i++) ;
+    CHECK(i == data.size());
+    CHECK(check.fread(text, 1, sizeof(text)) == 8);
+    text[8] = 0;
+    std::string str;
+    Printf(str, "%08x", val);
+    CHECK(std::string(text) == str);
+  }
+
+  SECTION("duplicating")
+  {
+    BackgroundFile file;
+    uint32_t val;
+
+    // create the file first so that the duplicate (opened with the same mode) does not truncate it
+    {
+      EnhancedFile create;
+      REQUIRE(create.fopen(backgroundfiletestname, "wb"));
+    }
+
+    REQUIRE(file.fopen(backgroundfiletestname, "r+b"));
+    file.SetBufferSize(GetPageSize());
+    file.EnableBackground();
+
+    // duplicates start at the logical position (queued writes do not move the stdio position)
+    val = BackgroundFileWriteBlocks(file, 0, 10, 100);
+    CHECK(((const BackgroundFile&)file).ftell() == (off_t)(val * sizeof(uint32_t)));
+    {
+      BackgroundFile *file2 = file.dup();
+
+      CHECK(file2->ftell() == (off_t)(val * sizeof(uint32_t)));
+      delete file2;
+    }
+
+    val = BackgroundFileWriteBlocks(file, val, 10, 100);
+    file.fclose();
+
+    CHECK(BackgroundFileCheck(backgroundfiletestname) == val);
+  }
+#endif
+
+  remove(backgroundfiletestname);
+}
+
+TEST_CASE("backgroundfile-benchmark", "[.][benchmark]")
+{
+  BackgroundFile file;
+  uint64_t t;
+  uint_t   i;
+
+  REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+  file.EnableBackground();
+
+  // time flushing an idle file whose thread is running (the thread must be woken to stop)
+  for (i = 0, t = 0; i < 100; i++)
+  {
+    uint64_t t0;
+
+    // fill one buffer to start the thread
+    BackgroundFileWriteBlocks(file, 0, 1, (uint_t)(file.GetBufferSize() / sizeof(uint32_t)));
+    while (!file.ReadyToClose()) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    t0 = GetNanosecondTicks();
+    file.fflush();
+    t += GetNanosecondTicks() - t0;
+  }
+
+  printf("BackgroundFile (idle flush): %8.2lfus\n", (double)t / (100.0 * 1000.0));
+  file.fclose();
+
+  // cost of small writes, foreground, background and background with asynchronous direct writes
+  for (i = 0; i < 3; i++)
+  {
+    static const char *modes[] = {"foreground", "background", "async direct"};
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    file.SetAsyncWrites(i > 1);
+    file.SetDirectIO(i > 1);
+    file.EnableBackground(i > 0);
+    file.ResetStats();
+
+    t = GetNanosecondTicks();
+    BackgroundFileWriteBlocks(file, 0, 20000, 1024);
+    t = GetNanosecondTicks() - t;
+    file.fclose();
+
+    printf("BackgroundFile (4 kB writes, %s): %8.2lfus per write\n", modes[i], (double)t / (20000.0 * 1000.0));
+    if (i)
+    {
+      BACKGROUNDFILESTATS stats = file.GetStats();
+      printf("BackgroundFile (4 kB writes, %s): %s writes, average %s bytes, %.1lfMB/s, %s bytes direct, max %s in flight\n",
+             modes[i], StringFrom(stats.writes).c_str(), StringFrom(stats.averagewritesize).c_str(), (double)stats.throughput / 1.0e6,
+             StringFrom(stats.directbytes).c_str(), StringFrom(stats.maxinflight).c_str());
+    }
+  }
+
+  // cost of patching a header after every 10 writes (as WAV writers do), foreground and background
+  for (i = 0; i < 2; i++)
+  {
+    uint32_t val = 0;
+    uint_t   j;
+
+    REQUIRE(file.fopen(backgroundfiletestname, "wb"));
+    file.EnableBackground(i > 0);
+
+    t = GetNanosecondTicks();
+    for (j = 0; j < 2000; j++)
+    {
+      off_t pos;
+
+      val = BackgroundFileWriteBlocks(file, val, 10, 1024);
+      pos = file.ftell();
+      file.fseek(0, SEEK_SET);
+      file.fwrite(&val, sizeof(val), 1);
+      file.fseek(pos, SEEK_SET);
+    }
+    t = GetNanosecondTicks() - t;
+    file.fclose();
+
+    printf("BackgroundFile (4 kB writes with header patching, %s): %8.2lfus per write\n", i ? "background" : "foreground", (double)t / (20000.0 * 1000.0));
+  }
+
+  remove(backgroundfiletestname);
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+
+#include <thread>
+
+#include <catch/catch.hpp>
+
+#include "DistanceModel.h"
+#include "Thread.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Generate a repeatable list of random positions up to maxdistance in each axis (some polar, some cartesian)
+ */
+/*--------------------------------------------------------------------------------*/
+static void GenerateRandomDistances(std::vector<Position>& positions, uint_t n, double maxdistance)
+{
+  uint_t i;
+
+  srand(1);
+
+  positions.resize(n);
+  for (i = 0; i < n; i++)
+  {
+    positions[i] = Position((2.0 * (double)rand() / (double)RAND_MAX - 1.0) * maxdistance,
+                            (2.0 * (double)rand() / (double)RAND_MAX - 1.0) * maxdistance,
+                            (2.0 * (double)rand() / (double)RAND_MAX - 1.0) * maxdistance);
+    if (i & 1) positions[i] = positions[i].Polar();
+  }
+}
+
+TEST_CASE("distancemodel-block")
+{
+  DistanceModel& model = DistanceModel::Get();
+  std::vector<Position> positions;
+  std::vector<double>   levels, delays, d;
+  double maxdistance = 40.0, samplerate = 48000.0;
+  uint_t i, n = 1000;
+
+  GenerateRandomDistances(positions, n, maxdistance);
+
+  PositionBlock block(positions);
+  levels.resize(n);
+  delays.resize(n);
+
+  SECTION("cartesian")
+  {
+    model.GetLevelsAndDelays(block, &levels[0], &delays[0], samplerate);
+    for (i = 0; i < n; i++)
+    {
+      CHECK(levels[i] == Approx(model.GetLevel(positions[i])));
+      CHECK(delays[i] == Approx(model.GetDelay(positions[i], samplerate)));
+    }
+  }
+
+  SECTION("polar")
+  {
+    model.GetLevelsAndDelays(PositionBlock(positions, true), &levels[0], &delays[0], samplerate);
+    for (i = 0; i < n; i++)
+    {
+      CHECK(levels[i] == Approx(model.GetLevel(positions[i])));
+      CHECK(delays[i] == Approx(model.GetDelay(positions[i], samplerate)));
+    }
+  }
+
+  SECTION("in-place distances")
+  {
+    d.resize(n);
+    for (i = 0; i < n; i++) d[i] = positions[i].Mod();
+
+    // levels only then delays in-place
+    model.GetLevelsAndDelays(&d[0], &levels[0], NULL, n);
+    model.GetLevelsAndDelays(&d[0], NULL, &d[0], n, samplerate);
+    for (i = 0; i < n; i++)
+    {
+      CHECK(levels[i] == Approx(model.GetLevel(positions[i])));
+      CHECK(d[i] == Approx(model.GetDelay(positions[i], samplerate)));
+    }
+  }
+
+  SECTION("level table")
+  {
+    model.EnableLevelTable(true, maxdistance);
+    CHECK(model.LevelTableEnabled());
+
+    // include distances beyond the end of the table
+    model.GetLevelsAndDelays(block, &levels[0], &delays[0], samplerate);
+    for (i = 0; i < n; i++)
+    {
+      CHECK(levels[i] == Approx(model.GetLevel(positions[i])).epsilon(4.0e-5));
+    }
+
+    // table must follow decay power
+    model.SetDecayPower(1.5);
+    model.GetLevelsAndDelays(block, &levels[0], NULL);
+    for (i = 0; i < n; i++)
+    {
+      CHECK(levels[i] == Approx(model.GetLevel(positions[i])).epsilon(4.0e-5));
+    }
+
+    model.SetDecayPower(2.0);
+    model.EnableLevelTable(false);
+    CHECK(!model.LevelTableEnabled());
+  }
+}
+
+TEST_CASE("distancemodel-instances")
+{
+  DistanceModel model1, model2;
+
+  model1.SetDecayPower(1.5);
+  model1.SetSpeedOfSound(300.0);
+
+  CHECK(model1.GetDecayPower() == 1.5);
+  CHECK(model1.GetSpeedOfSound() == 300.0);
+  CHECK(model2.GetDecayPower() == 2.0);
+  CHECK(model2.GetSpeedOfSound() == 340.0);
+  CHECK(DistanceModel::Get().GetDecayPower() == 2.0);
+
+  CHECK(model1.GetLevel(2.0) == Approx(1.0 / (1.5 * 1.5)));
+  CHECK(model2.GetLevel(2.0) == Approx(0.25));
+  CHECK(model1.GetDelay(3.0, 100.0) == Approx(1.0));
+}
+
+TEST_CASE("distancemodel-laws")
+{
+  DistanceModel model;
+  std::vector<double> d, levels;
+  uint_t i;
+
+  for (i = 0; i <= 200; i++) d.push_back(0.1 * (double)i);
+  levels.resize(d.size());
+
+  SECTION("exponential")
+  {
+    REQUIRE(model.SetDecayLaw("exponential", ParameterSet().Set("power", "3")));
+    CHECK(model.GetLevel(2.0) == Approx(1.0 / 9.0));
+  }
+
+  SECTION("inversesquare")
+  {
+    REQUIRE(model.SetDecayLaw("inversesquare", ParameterSet().Set("reference", "2")));
+    CHECK(model.GetLevel(1.0) == 1.0);
+    CHECK(model.GetLevel(2.0) == 1.0);
+    CHECK(model.GetLevel(8.0) == Approx(0.25));
+  }
+
+  SECTION("linear")
+  {
+    REQUIRE(model.SetDecayLaw("linear", ParameterSet().Set("start", "1").Set("end", "11")));
+    CHECK(model.GetLevel(0.5) == 1.0);
+    CHECK(model.GetLevel(6.0) == Approx(0.5));
+    CHECK(model.GetLevel(12.0) == 0.0);
+  }
+
+  SECTION("curve")
+  {
+    REQUIRE(model.SetDecayLaw("curve", ParameterSet().Set("points", "1,1,3,0.5,5,0.25")));
+    CHECK(model.GetLevel(0.0) == 1.0);
+    CHECK(model.GetLevel(2.0) == Approx(0.75));
+    CHECK(model.GetLevel(4.0) == Approx(0.375));
+    CHECK(model.GetLevel(10.0) == 0.25);
+
+    // table follows law
+    model.EnableLevelTable(true, 10.0, 1001);
+    model.GetLevelsAndDelays(&d[0], &levels[0], NULL, (uint_t)d.size());
+    for (i = 0; i < d.size(); i++) CHECK(levels[i] == Approx(model.GetLevel(d[i])));
+  }
+
+  SECTION("invalid")
+  {
+    model.SetDecayPower(3.0);
+    CHECK(!model.SetDecayLaw("curve", ParameterSet().Set("points", "1,1,3")));
+    CHECK(!model.SetDecayLaw("nonexistent"));
+    CHECK(model.GetLevel(2.0) == Approx(1.0 / 9.0));
+  }
+
+  // block and single calls must agree
+  model.GetLevelsAndDelays(&d[0], &levels[0], NULL, (uint_t)d.size());
+  for (i = 0; i < d.size(); i++) CHECK(levels[i] == Approx(model.GetLevel(d[i])));
+
+  // NULL law reverts to exponential law
+  model.SetDecayLaw(NULL);
+  CHECK(model.GetLevel(2.0) == Approx(1.0 / (model.GetDecayPower() * model.GetDecayPower())));
+}
+
+typedef struct {
+  DistanceModel       *model;
+  uint_t              errors;
+  std::atomic<uint_t> reads;
+} DISTANCEMODELREADER;
+
+static void *DistanceModelReader(Thread& thread, void *arg)
+{
+  DISTANCEMODELREADER& reader = *(DISTANCEMODELREADER *)arg;
+  double d[16], levels[16];
+  uint_t i;
+
+  for (i = 0; i < NUMBEROF(d); i++) d[i] = 5.0;
+
+  while (!thread.StopRequested())
+  {
+    // every level must be that of one of the two laws and all levels in a block must be the same
+    reader.model->GetLevelsAndDelays(d, levels, NULL, NUMBEROF(d));
+    for (i = 0; i < NUMBEROF(d); i++)
+    {
+      if (((levels[i] != 0.5) && (levels[i] != 0.2)) || (levels[i] != levels[0])) reader.errors++;
+    }
+    reader.reads++;
+  }
+
+  return NULL;
+}
+
+TEST_CASE("distancemodel-threads")
+{
+  DistanceModel model;
+  DISTANCEMODELREADER readers[4];
+  Thread threads[NUMBEROF(readers)];
+  uint_t i;
+
+  model.SetDecayLaw(new LinearDecayLaw(0.0, 10.0));
+
+  for (i = 0; i < NUMBEROF(readers); i++)
+  {
+    readers[i].model  = &model;
+    readers[i].errors = 0;
+    readers[i].reads  = 0;
+    threads[i].Start(&DistanceModelReader, &readers[i]);
+  }
+
+  // wait for all readers to start
+  for (i = 0; i < NUMBEROF(readers); i++)
+  {
+    while (readers[i].reads == 0) std::this_thread::yield();
+  }
+
+  // change law whilst readers are reading
+  for (i = 0; i < 2000; i++)
+  {
+    if (i & 1) model.SetDecayLaw(new LinearDecayLaw(0.0, 10.0));
+    else       model.SetDecayLaw(new InverseSquareDecayLaw(1.0));
+  }
+
+  for (i = 0; i < NUMBEROF(readers); i++)
+  {
+    threads[i].Stop();
+    CHECK(readers[i].errors == 0);
+  }
+}
+
+TEST_CASE("distancemodel-benchmark", "[.][benchmark]")
+{
+  DistanceModel& model = DistanceModel::Get();
+  std::vector<Position> positions;
+  std::vector<double>   levels, delays;
+  uint_t i, j, n = 64, loops = 10000;
+
+  GenerateRandomDistances(positions, n, 20.0);
+  for (i = 0; i < n; i++) positions[i] = positions[i].Cart();
+
+  PositionBlock block(positions);
+  levels.resize(n);
+  delays.resize(n);
+
+  uint64_t tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++)
+  {
+    for (j = 0; j < n; j++) model.GetLevelAndDelay(positions[j], levels[j], delays[j], 48000.0);
+  }
+  tick = GetNanosecondTicks() - tick;
+  printf("GetLevelAndDelay():           %0.2lfns per position\n", (double)tick / (double)(n * loops));
+
+  tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++) model.GetLevelsAndDelays(block, &levels[0], &delays[0], 48000.0);
+  tick = GetNanosecondTicks() - tick;
+  printf("GetLevelsAndDelays():         %0.2lfns per position\n", (double)tick / (double)(n * loops));
+
+  model.EnableLevelTable();
+  tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++) model.GetLevelsAndDelays(block, &levels[0], &delays[0], 48000.0);
+  tick = GetNanosecondTicks() - tick;
+  printf("GetLevelsAndDelays() (table): %0.2lfns per position\n", (double)tick / (double)(n * loops));
+  model.EnableLevelTable(false);
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+
+#include <catch/catch.hpp>
+
+#include "EnhancedFile.h"
+#include "MappedFile.h"
+#include "Thread.h"
+
+BBC_AUDIOTOOLBOX_START
+
+static const char *enhancedfiletestname = "enhancedfiletests.tmp";
+
+typedef struct {
+  EnhancedFile *file;
+  uint_t       id;
+  uint_t       nthreads;
+  uint_t       nblocks;          // number of blocks in the file
+  uint_t       blocksize;        // values per block
+  bool         write;
+  uint64_t     errors;
+} ENHANCEDFILETHREAD;
+
+/*--------------------------------------------------------------------------------*/
+/** Write or read (and check) every nthreads'th block of incrementing values using
+ * positional calls (each block is transferred in two parts)
+ */
+/*--------------------------------------------------------------------------------*/
+static void *EnhancedFileTransfer(Thread& thread, void *arg)
+{
+  ENHANCEDFILETHREAD& transfer = *(ENHANCEDFILETHREAD *)arg;
+  std::vector<uint32_t> block(transfer.blocksize);
+  const uint_t half = transfer.blocksize / 2;
+  uint_t i, j;
+
+  UNUSED_PARAMETER(thread);
+
+  for (i = transfer.id; i < transfer.nblocks; i += transfer.nthreads)
+  {
+    const off_t    offset = (off_t)i * transfer.blocksize * sizeof(uint32_t);
+    const uint32_t val    = i * transfer.blocksize;
+    FILEIOVEC iov[2] = {
+      {&block[0],    half * sizeof(uint32_t)},
+      {&block[half], (transfer.blocksize - half) * sizeof(uint32_t)},
+    };
+
+    if (transfer.write)
+    {
+      for (j = 0; j < transfer.blocksize; j++) block[j] = val + j;
+      if (transfer.file->pwritev(iov, NUMBEROF(iov), offset) != (sint64_t)(transfer.blocksize * sizeof(uint32_t))) transfer.errors++;
+    }
+    else
+    {
+      memset(&block[0], 0, block.size() * sizeof(block[0]));
+      if (transfer.file->preadv(iov, NUMBEROF(iov), offset) != (sint64_t)(transfer.blocksize * sizeof(uint32_t))) transfer.errors++;
+      for (j = 0; j < transfer.blocksize; j++)
+      {
+        if (block[j] != (val + j)) transfer.errors++;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Transfer nblocks blocks of values using nthreads threads at once
+ */
+/*--------------------------------------------------------------------------------*/
+static uint64_t EnhancedFileParallelTransfer(EnhancedFile& file, uint_t nthreads, uint_t nblocks, uint_t blocksize, bool write)
+{
+  std::vector<ENHANCEDFILETHREAD> args(nthreads);
+  std::vector<Thread> threads(nthreads);
+  uint64_t errors = 0;
+  uint_t i;
+
+  for (i = 0; i < nthreads; i++)
+  {
+    ENHANCEDFILETHREAD& arg = args[i];
+
+    arg.file      = &file;
+    arg.id        = i;
+    arg.nthreads  = nthreads;
+    arg.nblocks   = nblocks;
+    arg.blocksize = blocksize;
+    arg.write     = write;
+    arg.errors    = 0;
+  }
+
+  for (i = 0; i < nthreads; i++) threads[i].Start(&EnhancedFileTransfer, &args[i]);
+  for (i = 0; i < nthreads; i++)
+  {
+    threads[i].Stop();
+    errors += args[i].errors;
+  }
+
+  return errors;
+}
+
+TEST_CASE("enhancedfile")
+{
+  const uint_t nblocks = 64, blocksize = 1000;
+
+  SECTION("positional")
+  {
+    EnhancedFile file;
+    uint32_t     val = 0;
+
+    CHECK(file.pread(&val, sizeof(val), 0) < 0);
+
+    // blocks written and read in parallel do not use (or disturb) the file position (on Windows
+    // they use a second handle)
+    REQUIRE(file.fopen(enhancedfiletestname, "w+b"));
+    CHECK(file.fwrite(&val, sizeof(val), 1) == 1);
+    CHECK(file.fflush() == 0);
+    CHECK(EnhancedFileParallelTransfer(file, 4, nblocks, blocksize, true) == 0);
+    CHECK(EnhancedFileParallelTransfer(file, 4, nblocks, blocksize, false) == 0);
+    CHECK(file.ftell() == (off_t)sizeof(val));
+
+    // the stream sees what was written
+    CHECK(file.fread(&val, sizeof(val), 1) == 1);
+    CHECK(val == 1);
+    CHECK(file.fseek(0, SEEK_END) == 0);
+    CHECK(file.ftell() == (off_t)(nblocks * blocksize * sizeof(uint32_t)));
+
+    // reads stop short at the end of the file
+    CHECK(file.pread(&val, sizeof(val), (off_t)(nblocks * blocksize * sizeof(uint32_t)) - 2) == 2);
+    CHECK(file.pread(&val, sizeof(val), (off_t)(nblocks * blocksize * sizeof(uint32_t))) == 0);
+    CHECK(file.pread(&val, sizeof(val), -1) < 0);
+
+    // writes after fwrite() and fflush() are seen by pread()
+    val = 0x12345678;
+    CHECK(file.fseek(4 * sizeof(uint32_t), SEEK_SET) == 0);
+    CHECK(file.fwrite(&val, sizeof(val), 1) == 1);
+    CHECK(file.fflush() == 0);
+    val = 0;
+    CHECK(file.pread(&val, sizeof(val), 4 * sizeof(uint32_t)) == (sint64_t)sizeof(val));
+    CHECK(val == 0x12345678);
+    file.fclose();
+  }
+
+  SECTION("vectored")
+  {
+    EnhancedFile file;
+    const char header[] = "HDR:", body[] = "body", tail[] = "-end";
+    char buf[16], part1[3], part2[16];
+    FILEIOVEC out[] = {
+      {(void *)header, 4},
+      {(void *)body,   0},
+      {(void *)body,   4},
+      {(void *)tail,   4},
+    };
+    FILEIOVEC in[] = {
+      {part1, sizeof(part1)},
+      {part2, sizeof(part2)},
+    };
+
+    REQUIRE(file.fopen(enhancedfiletestname, "w+b"));
+    CHECK(file.pwritev(out, NUMBEROF(out), 2) == 12);
+    CHECK(file.pwrite("..", 2, 0) == 2);
+
+    memset(buf, 0, sizeof(buf));
+    CHECK(file.fread(buf, 1, sizeof(buf)) == 14);
+    CHECK(std::string(buf) == "..HDR:body-end");
+
+    // scatter
+    memset(part2, 0, sizeof(part2));
+    CHECK(file.preadv(in, NUMBEROF(in), 1) == 13);
+    CHECK(std::string(part1, sizeof(part1)) == ".HD");
+    CHECK(std::string(part2) == "R:body-end");
+  }
+
+#ifndef _WIN32
+  SECTION("mapped")
+  {
+    MappedFile file;
+    std::vector<uint32_t> block(blocksize);
+    FILEIOVEC iov = {&block[0], block.size() * sizeof(block[0])};
+
+    REQUIRE(file.fopen(enhancedfiletestname, "wb"));
+    CHECK(EnhancedFileParallelTransfer(file, 4, nblocks, blocksize, true) == 0);
+    file.fclose();
+
+    REQUIRE(file.fopen(enhancedfiletestname, "rb"));
+    CHECK(file.IsMapped());
+    CHECK(EnhancedFileParallelTransfer(file, 4, nblocks, blocksize, false) == 0);
+    CHECK(file.ftell() == 0);
+    CHECK(file.preadv(&iov, 1, (off_t)((nblocks * blocksize - 10) * sizeof(uint32_t))) == (sint64_t)(10 * sizeof(uint32_t)));
+    CHECK(block[9] == (nblocks * blocksize - 1));
+    CHECK(file.preadv(&iov, 1, (off_t)(nblocks * blocksize * sizeof(uint32_t) + 10)) == 0);
+    CHECK(file.preadv(&iov, 1, -1) < 0);
+  }
+#endif
+
+  remove(enhancedfiletestname);
+}
+
+TEST_CASE("enhancedfile-benchmark", "[.][benchmark]")
+{
+  const uint_t nblocks = 4096, blocksize = 4096;
+  uint_t n;
+
+  {
+    EnhancedFile file;
+
+    REQUIRE(file.fopen(enhancedfiletestname, "wb"));
+    CHECK(EnhancedFileParallelTransfer(file, 1, nblocks, blocksize, true) == 0);
+  }
+
+  // 16 kB chunk reads spread across threads (the file is mostly cached)
+  for (n = 1; n <= std::max(4u, std::thread::hardware_concurrency()); n *= 2)
+  {
+    EnhancedFile file;
+    uint64_t t;
+
+    REQUIRE(file.fopen(enhancedfiletestname, "rb"));
+
+    t = GetNanosecondTicks();
+    CHECK(EnhancedFileParallelTransfer(file, n, nblocks, blocksize, false) == 0);
+    t = GetNanosecondTicks() - t;
+
+    printf("EnhancedFile (16 kB preadv() reads, %2u threads): %8.2lfus per read, %7.1lfMB/s\n",
+           n, (double)t / ((double)nblocks * 1000.0), 1.0e3 * (double)nblocks * blocksize * sizeof(uint32_t) / (double)t);
+  }
+
+  remove(enhancedfiletestname);
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,319 @@
+#include <math.h>
+
+#include <catch/catch.hpp>
+
+#include "FractionalDelayLine.h"
+#include "DistanceModel.h"
+
+BBC_AUDIOTOOLBOX_START
+
+static const uint_t interpolationtypes[] =
+{
+  FractionalDelayLine::INTERPOLATION_LINEAR,
+  FractionalDelayLine::INTERPOLATION_CUBIC,
+  FractionalDelayLine::INTERPOLATION_THIRAN,
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Generate interleaved test signal: channel c is sin(w * (n + c * 10)) with w increasing with channel
+ */
+/*--------------------------------------------------------------------------------*/
+static void GenerateSignal(std::vector<Sample_t>& signal, uint_t nchannels, uint_t nframes)
+{
+  uint_t i, j;
+
+  signal.resize(nchannels * nframes);
+  for (i = 0; i < nframes; i++)
+  {
+    for (j = 0; j < nchannels; j++)
+    {
+      signal[i * nchannels + j] = (Sample_t)sin(.01 * (double)(j + 1) * (double)(i + j * 10));
+    }
+  }
+}
+
+TEST_CASE("fractionaldelayline-integer")
+{
+  uint_t t, i;
+
+  for (t = 0; t < NUMBEROF(interpolationtypes); t++)
+  {
+    FractionalDelayLine delayline(2, 100, interpolationtypes[t]);
+    std::vector<Sample_t> signal(2 * 200);
+
+    // impulse on both channels
+    signal[0] = signal[1] = 1.f;
+
+    delayline.SetDelay(0, 5.0, true);
+    delayline.SetDelay(1, 73.0, true);
+    delayline.Process(&signal[0], &signal[0], 200);
+
+    for (i = 0; i < 200; i++)
+    {
+      INFO("type " << t << " sample " << i);
+      CHECK(signal[i * 2]     == ((i == 5)  ? 1.f : 0.f));
+      CHECK(signal[i * 2 + 1] == ((i == 73) ? 1.f : 0.f));
+    }
+  }
+}
+
+TEST_CASE("fractionaldelayline-fractional")
+{
+  const double delay = 10.3;
+  uint_t i;
+
+  SECTION("linear and cubic")
+  {
+    // linear and cubic interpolation are exact for a ramp
+    FractionalDelayLine delayline(1, 32);
+    std::vector<Sample_t> signal(1000), output(1000);
+
+    for (i = 0; i < signal.size(); i++) signal[i] = (Sample_t)i;
+
+    delayline.SetDelay(0, delay, true);
+    delayline.Process(&signal[0], &output[0], (uint_t)signal.size());
+    for (i = 20; i < output.size(); i++) CHECK(output[i] == Approx((double)i - delay));
+
+    delayline.Reset();
+    delayline.SetInterpolation(FractionalDelayLine::INTERPOLATION_CUBIC);
+    delayline.Process(&signal[0], &output[0], (uint_t)signal.size());
+    for (i = 20; i < output.size(); i++) CHECK(output[i] == Approx((double)i - delay));
+  }
+
+  SECTION("all types")
+  {
+    // all types should have close to the ideal delay for a low frequency sine
+    const double w = .05;
+    uint_t t;
+
+    for (t = 0; t < NUMBEROF(interpolationtypes); t++)
+    {
+      FractionalDelayLine delayline(1, 32, interpolationtypes[t]);
+      std::vector<Sample_t> signal(1000);
+
+      for (i = 0; i < signal.size(); i++) signal[i] = (Sample_t)sin(w * (double)i);
+
+      delayline.SetDelay(0, delay, true);
+      delayline.Process(&signal[0], &signal[0], (uint_t)signal.size());
+
+      for (i = 100; i < signal.size(); i++)
+      {
+        INFO("type " << t << " sample " << i);
+        CHECK(fabs(signal[i] - sin(w * ((double)i - delay))) < 1.0e-3);
+      }
+    }
+  }
+}
+
+TEST_CASE("fractionaldelayline-limits")
+{
+  FractionalDelayLine delayline(1, 50, FractionalDelayLine::INTERPOLATION_CUBIC);
+  std::vector<Sample_t> signal(400);
+  uint_t i;
+
+  for (i = 0; i < signal.size(); i++) signal[i] = (Sample_t)i;
+
+  CHECK(delayline.GetMinDelay() == 1.0);
+  delayline.SetInterpolation(FractionalDelayLine::INTERPOLATION_THIRAN);
+  CHECK(delayline.GetMinDelay() == .5);
+  delayline.SetInterpolation(FractionalDelayLine::INTERPOLATION_LINEAR);
+  CHECK(delayline.GetMinDelay() == 0.0);
+
+  // delays beyond the maximum are limited
+  delayline.SetDelay(0, 1000.0, true);
+  CHECK(delayline.GetDelay(0) == 50.0);
+  delayline.Process(&signal[0], &signal[0], (uint_t)signal.size());
+  for (i = 50; i < signal.size(); i++) CHECK(signal[i] == (Sample_t)(i - 50));
+
+  // zero delay
+  for (i = 0; i < signal.size(); i++) signal[i] = (Sample_t)i;
+  delayline.SetDelay(0, -1.0, true);
+  CHECK(delayline.GetDelay(0) == 0.0);
+  delayline.Process(&signal[0], &signal[0], (uint_t)signal.size());
+  for (i = 0; i < signal.size(); i++) CHECK(signal[i] == (Sample_t)i);
+}
+
+TEST_CASE("fractionaldelayline-ramp")
+{
+  const uint_t ramplength = 1000;
+  uint_t t, i;
+
+  for (t = 0; t < NUMBEROF(interpolationtypes); t++)
+  {
+    FractionalDelayLine delayline(1, 100, interpolationtypes[t]);
+    std::vector<Sample_t> signal(4000);
+
+    for (i = 0; i < signal.size(); i++) signal[i] = (Sample_t)i;
+
+    delayline.SetRampLength(ramplength);
+    delayline.SetDelay(0, 10.0, true);
+    delayline.Process(&signal[0], &signal[0], 500);
+
+    // ramp up by 50 samples
+    delayline.SetDelay(0, 60.0);
+    CHECK(delayline.GetDelay(0) == 10.0);
+    CHECK(delayline.GetTargetDelay(0) == 60.0);
+
+    // process in odd-sized blocks
+    for (i = 500; i < signal.size();)
+    {
+      uint_t n = std::min((uint_t)signal.size() - i, (uint_t)333);
+      delayline.Process(&signal[i], &signal[i], n);
+      i += n;
+    }
+
+    CHECK(delayline.GetDelay(0) == 60.0);
+
+    for (i = 20; i < signal.size(); i++)
+    {
+      double expected = (double)i - 10.0;
+
+      // during the ramp the delay increases by 0.05 samples per sample
+      if (i >= 500 + ramplength) expected = (double)i - 60.0;
+      else if (i >= 500)         expected = (double)i - 10.0 - .05 * (double)(i - 500);
+
+      // the Thiran allpass has small transients each time its integer delay changes
+      INFO("type " << t << " sample " << i);
+      CHECK(fabs(signal[i] - expected) < ((interpolationtypes[t] == FractionalDelayLine::INTERPOLATION_THIRAN) ? 5.0e-2 : 1.0e-2));
+
+      // no discontinuities
+      CHECK(fabs(signal[i] - signal[i - 1]) <= 1.0);
+    }
+  }
+}
+
+TEST_CASE("fractionaldelayline-kernels")
+{
+  const uint_t nchannels = 7, nframes = 1000;
+  std::vector<Sample_t> signal, reference, output;
+  std::vector<double>   delays(nchannels + 1);
+  uint_t t, k, i;
+
+  // second half uses delays shifted by one channel
+  GenerateSignal(signal, nchannels, nframes);
+  for (i = 0; i < delays.size(); i++) delays[i] = 1.0 + 13.7 * (double)i;
+
+  for (t = 0; t < NUMBEROF(interpolationtypes); t++)
+  {
+    FractionalDelayLine delayline(nchannels, 100, interpolationtypes[t]);
+
+    delayline.SetRampLength(100);
+
+    // reference using scalar kernels
+    REQUIRE(FractionalDelayLine::SetKernels(FractionalDelayLine::KERNELS_SCALAR));
+    reference.resize(signal.size());
+    delayline.SetDelays(&delays[0], true);
+    delayline.Process(&signal[0], &reference[0], nframes / 2);
+    delayline.SetDelays(&delays[1]);
+    delayline.Process(&signal[nchannels * nframes / 2], &reference[nchannels * nframes / 2], nframes / 2);
+
+    for (k = FractionalDelayLine::KERNELS_SSE2; k <= FractionalDelayLine::KERNELS_AVX2; k++)
+    {
+      if (FractionalDelayLine::KernelsAvailable(k))
+      {
+        REQUIRE(FractionalDelayLine::SetKernels(k));
+
+        delayline.Reset();
+        output.resize(signal.size());
+        delayline.SetDelays(&delays[0], true);
+        delayline.Process(&signal[0], &output[0], nframes / 2);
+        delayline.SetDelays(&delays[1]);
+        delayline.Process(&signal[nchannels * nframes / 2], &output[nchannels * nframes / 2], nframes / 2);
+
+        for (i = 0; i < output.size(); i++)
+        {
+          INFO("type " << t << " kernels " << k << " sample " << i);
+          CHECK(fabs(output[i] - reference[i]) < 1.0e-6);
+        }
+      }
+    }
+
+    FractionalDelayLine::SetKernels();
+  }
+}
+
+TEST_CASE("fractionaldelayline-distancemodel")
+{
+  const double samplerate = 48000.0;
+  const uint_t nchannels = 4, nframes = 4096;
+  DistanceModel model;
+  FractionalDelayLine delayline(nchannels, (uint_t)model.GetDelay(10.0, samplerate) + 1, FractionalDelayLine::INTERPOLATION_CUBIC);
+  std::vector<Sample_t> signal(nchannels * nframes);
+  double d[nchannels] = {1.0, 2.5, 5.3, 9.9}, delays[nchannels];
+  uint_t i, j;
+
+  // impulses at sample 0 on each channel
+  for (j = 0; j < nchannels; j++) signal[j] = 1.f;
+
+  model.GetLevelsAndDelays(d, NULL, delays, nchannels, samplerate);
+  delayline.SetDelays(delays, true);
+  delayline.Process(&signal[0], &signal[0], nframes);
+
+  // peak of each output should be at the (rounded) delay
+  for (j = 0; j < nchannels; j++)
+  {
+    uint_t peak = 0;
+
+    for (i = 1; i < nframes; i++)
+    {
+      if (signal[i * nchannels + j] > signal[peak * nchannels + j]) peak = i;
+    }
+
+    CHECK(fabs((double)peak - delays[j]) <= .5);
+  }
+}
+
+TEST_CASE("fractionaldelayline-benchmark", "[.][benchmark]")
+{
+  static const double samplerates[] = {48000.0, 96000.0};
+  static const char   *names[]      = {"linear", "cubic", "thiran"};
+  const uint_t nchannels = 64, blocksize = 512;
+  std::vector<Sample_t> signal;
+  std::vector<double>   delays(nchannels);
+  uint_t s, t, i, j;
+
+  for (s = 0; s < NUMBEROF(samplerates); s++)
+  {
+    // one second of audio with delays of up to 100m
+    uint_t nframes = (uint_t)samplerates[s];
+    uint_t maxdelay = (uint_t)(100.0 / 340.0 * samplerates[s]);
+
+    GenerateSignal(signal, nchannels, nframes);
+
+    for (t = 0; t < NUMBEROF(interpolationtypes); t++)
+    {
+      FractionalDelayLine delayline(nchannels, maxdelay, interpolationtypes[t]);
+
+      delayline.SetRampLength(blocksize);
+
+      for (j = 0; j < nchannels; j++) delays[j] = 1.0 + (double)(maxdelay - 2) * (double)j / (double)nchannels;
+      delayline.SetDelays(&delays[0], true);
+
+      // constant delays
+      uint64_t tick = GetNanosecondTicks();
+      for (i = 0; (i + blocksize) <= nframes; i += blocksize)
+      {
+        delayline.Process(&signal[i * nchannels], &signal[i * nchannels], blocksize);
+      }
+      tick = GetNanosecondTicks() - tick;
+      printf("%6.0lfHz %2u channels %-6s constant: %6.2lfns per sample (%5.2lf%% of real-time)\n",
+             samplerates[s], nchannels, names[t],
+             (double)tick / (double)(i * nchannels), 100.0 * (double)tick * 1.0e-9 * samplerates[s] / (double)i);
+
+      // delays changing every block (always ramping)
+      tick = GetNanosecondTicks();
+      for (i = 0; (i + blocksize) <= nframes; i += blocksize)
+      {
+        for (j = 0; j < nchannels; j++) delays[j] += (i & blocksize) ? 1.0 : -1.0;
+        delayline.SetDelays(&delays[0]);
+        delayline.Process(&signal[i * nchannels], &signal[i * nchannels], blocksize);
+      }
+      tick = GetNanosecondTicks() - tick;
+      printf("%6.0lfHz %2u channels %-6s ramping:  %6.2lfns per sample (%5.2lf%% of real-time)\n",
+             samplerates[s], nchannels, names[t],
+             (double)tick / (double)(i * nchannels), 100.0 * (double)tick * 1.0e-9 * samplerates[s] / (double)i);
+    }
+  }
+}
+
+BBC_AUDIOTOOLBOX_END
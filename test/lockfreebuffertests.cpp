@@ -0,0 +1,855 @@
+#include <thread>
+
+#include <catch/catch.hpp>
+
+#include "LockFreeBuffer.h"
+#include "WaitableLockFreeBuffer.h"
+#include "PerformanceMonitor.h"
+#include "Thread.h"
+
+BBC_AUDIOTOOLBOX_START
+
+TEST_CASE("lockfreebuffer")
+{
+  LockFreeBuffer<uint_t> buffer(10);
+  uint_t i;
+
+  CHECK(buffer.WriteBuffersAvailable() == 10);
+  CHECK(buffer.ReadBuffersAvailable() == 0);
+  CHECK(buffer.GetReadBuffer() == NULL);
+  CHECK(!buffer.IncrementRead());
+
+  // write-ahead
+  for (i = 0; i < 10; i++)
+  {
+    uint_t *p = buffer.GetWriteBuffer(i);
+    REQUIRE(p != NULL);
+    *p = i;
+  }
+  CHECK(buffer.GetWriteBuffer(10) == NULL);
+  CHECK(buffer.ReadBuffersAvailable() == 0);
+
+  CHECK(buffer.IncrementWrite(4));
+  CHECK(buffer.ReadBuffersAvailable() == 4);
+  CHECK(buffer.WriteBuffersAvailable() == 6);
+
+  // increments are limited to the number available
+  CHECK(buffer.IncrementWrite(100));
+  CHECK(buffer.ReadBuffersAvailable() == 10);
+  CHECK(buffer.WriteBuffersAvailable() == 0);
+  CHECK(buffer.GetWriteBuffer() == NULL);
+  CHECK(!buffer.IncrementWrite());
+
+  // read-ahead
+  for (i = 0; i < 10; i++)
+  {
+    const uint_t *p = buffer.GetReadBuffer(i);
+    REQUIRE(p != NULL);
+    CHECK(*p == i);
+  }
+  CHECK(buffer.GetReadBuffer(10) == NULL);
+
+  CHECK(buffer.IncrementRead(3));
+  CHECK(*buffer.GetReadBuffer() == 3);
+  CHECK(buffer.WriteBuffersAvailable() == 3);
+
+  // wrap around
+  for (i = 0; i < 3; i++) *buffer.GetWriteBuffer(i) = 10 + i;
+  CHECK(buffer.IncrementWrite(3));
+  for (i = 0; i < 10; i++) CHECK(*buffer.GetReadBuffer(i) == (3 + i));
+
+  buffer.Reset();
+  CHECK(buffer.ReadBuffersAvailable() == 0);
+  CHECK(buffer.WriteBuffersAvailable() == 10);
+
+  buffer.Resize(3);
+  CHECK(buffer.GetCapacity() == 3);
+  CHECK(buffer.ReadBuffersAvailable() == 0);
+  CHECK(buffer.WriteBuffersAvailable() == 3);
+}
+
+TEST_CASE("lockfreebuffer-masked")
+{
+  MaskedLockFreeBuffer<uint_t> buffer(10);
+  uint_t i, j;
+
+  // capacity is rounded up to a power of 2 and all slots are available
+  CHECK(buffer.GetCapacity() == 16);
+  CHECK(buffer.WriteBuffersAvailable() == 16);
+  CHECK(buffer.ReadBuffersAvailable() == 0);
+  CHECK(buffer.GetReadBuffer() == NULL);
+
+  // wrap around many times
+  for (i = 0; i < 100; i++)
+  {
+    for (j = 0; j < 16; j++) *buffer.GetWriteBuffer(j) = i * 16 + j;
+    CHECK(buffer.GetWriteBuffer(16) == NULL);
+    CHECK(buffer.IncrementWrite(16));
+    CHECK(buffer.WriteBuffersAvailable() == 0);
+    CHECK(!buffer.IncrementWrite());
+
+    CHECK(buffer.ReadBuffersAvailable() == 16);
+    for (j = 0; j < 16; j++) CHECK(*buffer.GetReadBuffer(j) == (i * 16 + j));
+    CHECK(buffer.GetReadBuffer(16) == NULL);
+
+    // leave a varying number in the buffer to move the positions relative to the storage
+    CHECK(buffer.IncrementRead(16 - (i % 3)));
+    buffer.Reset();
+    CHECK(buffer.ReadBuffersAvailable() == 0);
+  }
+
+  buffer.Resize(64);
+  CHECK(buffer.GetCapacity() == 64);
+  CHECK(buffer.WriteBuffersAvailable() == 64);
+
+  buffer.Resize(0);
+  CHECK(buffer.GetCapacity() == 1);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Simple, repeatable, per-thread random number generator
+ */
+/*--------------------------------------------------------------------------------*/
+static inline uint_t NextRandom(uint32_t& seed)
+{
+  seed = seed * 1103515245 + 12345;
+  return (uint_t)(seed >> 16);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Write and read blocks of random sizes using spans and Write()/Read(), checking values
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static void TestLockFreeBufferSpans(BUFFER& buffer)
+{
+  typename BUFFER::SPAN spans[2];
+  std::vector<Sample_t> block(buffer.GetCapacity() + 10);
+  uint32_t seed = 3;
+  uint_t   wrval = 0, rdval = 0, wraps = 0, i, j, n;
+
+  for (i = 0; i < 1000; i++)
+  {
+    // write a block using either spans or Write()
+    n = NextRandom(seed) % block.size();
+    if (i & 1)
+    {
+      uint_t avail = buffer.WriteBuffersAvailable();
+
+      CHECK(buffer.GetWriteSpans(spans, n) == std::min(n, avail));
+      CHECK((spans[0].count + spans[1].count) == std::min(n, avail));
+      if (spans[1].count) wraps++;
+
+      for (j = 0; j < spans[0].count; j++) spans[0].items[j] = (Sample_t)wrval++;
+      for (j = 0; j < spans[1].count; j++) spans[1].items[j] = (Sample_t)wrval++;
+      CHECK(buffer.ReadBuffersAvailable() == (buffer.GetCapacity() - avail));
+      buffer.IncrementWrite(spans[0].count + spans[1].count);
+    }
+    else
+    {
+      uint_t avail = buffer.WriteBuffersAvailable(), written;
+
+      for (j = 0; j < n; j++) block[j] = (Sample_t)(wrval + j);
+      written = buffer.Write(&block[0], n);
+      CHECK(written == std::min(n, avail));
+      wrval += written;
+    }
+
+    // read a block using either spans or Read()
+    n = NextRandom(seed) % block.size();
+    if (i & 2)
+    {
+      uint_t avail = buffer.ReadBuffersAvailable();
+
+      CHECK(buffer.GetReadSpans(spans, n) == std::min(n, avail));
+      for (j = 0; j < spans[0].count; j++) CHECK(spans[0].items[j] == (Sample_t)rdval++);
+      for (j = 0; j < spans[1].count; j++) CHECK(spans[1].items[j] == (Sample_t)rdval++);
+      buffer.IncrementRead(spans[0].count + spans[1].count);
+    }
+    else
+    {
+      uint_t avail = buffer.ReadBuffersAvailable(), nread;
+
+      nread = buffer.Read(&block[0], n);
+      CHECK(nread == std::min(n, avail));
+      for (j = 0; j < nread; j++) CHECK(block[j] == (Sample_t)rdval++);
+    }
+
+    CHECK(buffer.ReadBuffersAvailable() == (wrval - rdval));
+  }
+
+  // spans must have wrapped around the end of the storage
+  CHECK(wraps > 0);
+
+  // empty and full buffers
+  n = buffer.ReadBuffersAvailable();
+  CHECK(buffer.Read(&block[0], (uint_t)block.size()) == n);
+  CHECK(buffer.GetReadSpans(spans) == 0);
+  CHECK(spans[0].count == 0);
+  CHECK(spans[1].count == 0);
+  CHECK(buffer.Write(&block[0], (uint_t)block.size()) == buffer.GetCapacity());
+  CHECK(buffer.GetWriteSpans(spans) == 0);
+  CHECK(buffer.Write(&block[0], 1) == 0);
+}
+
+TEST_CASE("lockfreebuffer-spans")
+{
+  SECTION("modulo")
+  {
+    LockFreeBuffer<Sample_t> buffer(100);
+    TestLockFreeBufferSpans(buffer);
+  }
+
+  SECTION("masked")
+  {
+    MaskedLockFreeBuffer<Sample_t> buffer(100);
+    TestLockFreeBufferSpans(buffer);
+  }
+}
+
+template<class BUFFER>
+struct LOCKFREEBUFFERPRODUCER {
+  BUFFER   *buffer;
+  uint64_t count;
+  uint_t   maxbatch;
+};
+
+/*--------------------------------------------------------------------------------*/
+/** Write incrementing values in batches of random sizes
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static void *LockFreeBufferProducer(Thread& thread, void *arg)
+{
+  LOCKFREEBUFFERPRODUCER<BUFFER>& producer = *(LOCKFREEBUFFERPRODUCER<BUFFER> *)arg;
+  uint64_t val = 0;
+  uint32_t seed = 1;
+
+  while ((val < producer.count) && !thread.StopRequested())
+  {
+    uint_t n = 1 + (NextRandom(seed) % producer.maxbatch), i;
+    decltype(producer.buffer->GetWriteBuffer()) p;
+
+    // write-ahead as much of the batch as possible
+    for (i = 0; (i < n) && ((val + i) < producer.count) && ((p = producer.buffer->GetWriteBuffer(i)) != NULL); i++) *p = val + i;
+
+    if (i > 0)
+    {
+      producer.buffer->IncrementWrite(i);
+      val += i;
+    }
+    // allow consumer to run (essential on single-core machines)
+    else std::this_thread::yield();
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read values in batches of random sizes, returning the number of errors
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static uint64_t LockFreeBufferConsumer(BUFFER& buffer, uint64_t count, uint_t maxbatch)
+{
+  uint64_t val = 0, errors = 0;
+  uint32_t seed = 2;
+
+  while (val < count)
+  {
+    uint_t n = 1 + (NextRandom(seed) % maxbatch), i;
+    decltype(buffer.GetReadBuffer()) p;
+
+    // read-ahead as much of the batch as possible
+    for (i = 0; (i < n) && ((p = buffer.GetReadBuffer(i)) != NULL); i++)
+    {
+      if (*p != (val + i)) errors++;
+    }
+
+    if (i > 0)
+    {
+      buffer.IncrementRead(i);
+      val += i;
+    }
+    // allow producer to run
+    else std::this_thread::yield();
+  }
+
+  return errors;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Transfer count values between two threads, returning the number of errors
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static uint64_t LockFreeBufferTransfer(BUFFER& buffer, uint64_t count, uint_t maxbatch)
+{
+  LOCKFREEBUFFERPRODUCER<BUFFER> producer = {&buffer, count, maxbatch};
+  Thread thread;
+  uint64_t errors;
+
+  thread.Start(&LockFreeBufferProducer<BUFFER>, &producer);
+  errors = LockFreeBufferConsumer(buffer, count, maxbatch);
+  thread.Stop();
+
+  return errors;
+}
+
+TEST_CASE("lockfreebuffer-threads")
+{
+  static const uint_t lengths[]    = {1, 7, 64, 1000};
+  static const uint_t maxbatches[] = {1, 5, 100};
+  uint_t i, j;
+
+  for (i = 0; i < NUMBEROF(lengths); i++)
+  {
+    for (j = 0; j < NUMBEROF(maxbatches); j++)
+    {
+      INFO("length " << lengths[i] << " max batch " << maxbatches[j]);
+
+      {
+        LockFreeBuffer<uint64_t> buffer(lengths[i]);
+        CHECK(LockFreeBufferTransfer(buffer, 200000, maxbatches[j]) == 0);
+        CHECK(buffer.ReadBuffersAvailable() == 0);
+      }
+
+      {
+        MaskedLockFreeBuffer<uint64_t> buffer(lengths[i]);
+        CHECK(LockFreeBufferTransfer(buffer, 200000, maxbatches[j]) == 0);
+        CHECK(buffer.ReadBuffersAvailable() == 0);
+      }
+    }
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Write incrementing values in blocks using Write()
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static void *LockFreeBufferBlockProducer(Thread& thread, void *arg)
+{
+  LOCKFREEBUFFERPRODUCER<BUFFER>& producer = *(LOCKFREEBUFFERPRODUCER<BUFFER> *)arg;
+  std::vector<Sample_t> block(producer.maxbatch);
+  uint64_t val = 0;
+  uint_t   i, n;
+
+  while ((val < producer.count) && !thread.StopRequested())
+  {
+    n = (uint_t)std::min((uint64_t)block.size(), producer.count - val);
+    for (i = 0; i < n; i++) block[i] = (Sample_t)((val + i) & 0xffff);
+
+    // write the whole block, however many goes it takes
+    for (i = 0; (i < n) && !thread.StopRequested();)
+    {
+      uint_t nwritten = producer.buffer->Write(&block[i], n - i);
+      if (!nwritten) std::this_thread::yield();
+      i += nwritten;
+    }
+
+    val += n;
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read values in blocks using Read(), returning the number of errors
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static uint64_t LockFreeBufferBlockConsumer(BUFFER& buffer, uint64_t count, uint_t blocksize)
+{
+  std::vector<Sample_t> block(blocksize);
+  uint64_t val = 0, errors = 0;
+  uint_t   i, n;
+
+  while (val < count)
+  {
+    if ((n = buffer.Read(&block[0], blocksize)) > 0)
+    {
+      for (i = 0; i < n; i++)
+      {
+        if (block[i] != (Sample_t)((val + i) & 0xffff)) errors++;
+      }
+      val += n;
+    }
+    else std::this_thread::yield();
+  }
+
+  return errors;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Transfer count values in blocks between two threads, returning the number of errors
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static uint64_t LockFreeBufferBlockTransfer(BUFFER& buffer, uint64_t count, uint_t writeblocksize, uint_t readblocksize)
+{
+  LOCKFREEBUFFERPRODUCER<BUFFER> producer = {&buffer, count, writeblocksize};
+  Thread thread;
+  uint64_t errors;
+
+  thread.Start(&LockFreeBufferBlockProducer<BUFFER>, &producer);
+  errors = LockFreeBufferBlockConsumer(buffer, count, readblocksize);
+  thread.Stop();
+
+  return errors;
+}
+
+TEST_CASE("lockfreebuffer-blocks")
+{
+  {
+    LockFreeBuffer<Sample_t> buffer(1000);
+    CHECK(LockFreeBufferBlockTransfer(buffer, 1000000, 256, 333) == 0);
+    CHECK(buffer.ReadBuffersAvailable() == 0);
+  }
+
+  {
+    MaskedLockFreeBuffer<Sample_t> buffer(1024);
+    CHECK(LockFreeBufferBlockTransfer(buffer, 1000000, 700, 64) == 0);
+    CHECK(buffer.ReadBuffersAvailable() == 0);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Write incrementing values in blocks using Write(), blocking when the buffer is full
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static void *LockFreeBufferWaitingProducer(Thread& thread, void *arg)
+{
+  LOCKFREEBUFFERPRODUCER<BUFFER>& producer = *(LOCKFREEBUFFERPRODUCER<BUFFER> *)arg;
+  std::vector<Sample_t> block(producer.maxbatch);
+  uint64_t val = 0;
+  uint_t   i, n;
+
+  UNUSED_PARAMETER(thread);
+
+  while (val < producer.count)
+  {
+    n = (uint_t)std::min((uint64_t)block.size(), producer.count - val);
+    for (i = 0; i < n; i++) block[i] = (Sample_t)((val + i) & 0xffff);
+
+    // write the whole block, waiting for space as necessary
+    for (i = 0; i < n;)
+    {
+      if (!producer.buffer->WaitForWrite(1)) return NULL;
+      i += producer.buffer->Write(&block[i], n - i);
+    }
+
+    val += n;
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read values in blocks using Read(), blocking when the buffer is empty, returning the number of errors
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static uint64_t LockFreeBufferWaitingConsumer(BUFFER& buffer, uint64_t count, uint_t blocksize)
+{
+  std::vector<Sample_t> block(blocksize);
+  uint64_t val = 0, errors = 0;
+  uint_t   i, n;
+
+  while (val < count)
+  {
+    // wait for a whole block (or what remains)
+    if (!buffer.WaitForRead((uint_t)std::min((uint64_t)blocksize, count - val), 10000)) return errors + 1;
+
+    n = buffer.Read(&block[0], blocksize);
+    for (i = 0; i < n; i++)
+    {
+      if (block[i] != (Sample_t)((val + i) & 0xffff)) errors++;
+    }
+    val += n;
+  }
+
+  return errors;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Transfer count values in blocks between two threads that block rather than poll, returning the number of errors
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static uint64_t LockFreeBufferWaitingTransfer(BUFFER& buffer, uint64_t count, uint_t writeblocksize, uint_t readblocksize)
+{
+  LOCKFREEBUFFERPRODUCER<BUFFER> producer = {&buffer, count, writeblocksize};
+  Thread thread;
+  uint64_t errors;
+
+  buffer.ClearShutdown();
+  thread.Start(&LockFreeBufferWaitingProducer<BUFFER>, &producer);
+  errors = LockFreeBufferWaitingConsumer(buffer, count, readblocksize);
+  // release producer if the consumer gave up
+  buffer.Shutdown();
+  thread.Stop();
+
+  return errors;
+}
+
+typedef struct {
+  WaitableLockFreeBuffer<Sample_t> *buffer;
+  std::atomic<int>                 result;        // 0 = waiting, 1 = wait succeeded, 2 = wait failed
+} LOCKFREEBUFFERWAITER;
+
+/*--------------------------------------------------------------------------------*/
+/** Wait for data (or shutdown), recording the result
+ */
+/*--------------------------------------------------------------------------------*/
+static void *LockFreeBufferWaiter(Thread& thread, void *arg)
+{
+  LOCKFREEBUFFERWAITER& waiter = *(LOCKFREEBUFFERWAITER *)arg;
+
+  UNUSED_PARAMETER(thread);
+
+  // long timeout prevents the test hanging if the wake-up is lost
+  waiter.result = waiter.buffer->WaitForRead(1, 10000) ? 1 : 2;
+
+  return NULL;
+}
+
+TEST_CASE("lockfreebuffer-wait")
+{
+  {
+    WaitableLockFreeBuffer<Sample_t> buffer(100);
+    std::vector<Sample_t> block(10);
+
+    // timeouts
+    uint64_t tick = GetNanosecondTicks();
+    CHECK(!buffer.WaitForRead(1, 20));
+    tick = GetNanosecondTicks() - tick;
+    CHECK(tick >= 20000000);
+    CHECK(buffer.WaitForWrite(100, 0));
+    CHECK(buffer.WaitForWrite(1000, 0));                // limited to capacity
+
+    CHECK(buffer.Write(&block[0], 10) == 10);
+    CHECK(buffer.WaitForRead(10, 0));
+    CHECK(!buffer.WaitForRead(11, 0));
+    CHECK(!buffer.WaitForWrite(91, 0));
+    CHECK(buffer.WaitForWrite(90, 0));
+
+    // shutdown makes waits fail (unless the condition is already met)
+    buffer.Shutdown();
+    CHECK(buffer.IsShutdown());
+    CHECK(buffer.WaitForRead(10));
+    CHECK(!buffer.WaitForRead(11));
+    buffer.ClearShutdown();
+    CHECK(!buffer.IsShutdown());
+
+    buffer.Reset();
+    CHECK(!buffer.WaitForRead(1, 0));
+  }
+
+  // shutdown and writes wake a waiting thread
+  {
+    WaitableLockFreeBuffer<Sample_t> buffer(100);
+    LOCKFREEBUFFERWAITER waiter;
+    Sample_t val = 1.f;
+    Thread thread;
+    uint64_t tick;
+
+    waiter.buffer = &buffer;
+    waiter.result = 0;
+
+    tick = GetNanosecondTicks();
+    thread.Start(&LockFreeBufferWaiter, &waiter);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(waiter.result == 0);
+    buffer.Shutdown();
+    thread.Stop();
+    tick = GetNanosecondTicks() - tick;
+    CHECK(waiter.result == 2);
+    CHECK(tick < 5000000000ull);
+
+    buffer.ClearShutdown();
+    waiter.result = 0;
+
+    tick = GetNanosecondTicks();
+    thread.Start(&LockFreeBufferWaiter, &waiter);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(waiter.result == 0);
+    CHECK(buffer.Write(&val, 1) == 1);
+    thread.Stop();
+    tick = GetNanosecondTicks() - tick;
+    CHECK(waiter.result == 1);
+    CHECK(tick < 5000000000ull);
+  }
+
+  {
+    WaitableLockFreeBuffer<Sample_t> buffer(1000);
+    CHECK(LockFreeBufferWaitingTransfer(buffer, 1000000, 100, 100) == 0);
+    CHECK(LockFreeBufferWaitingTransfer(buffer, 1000000, 37, 512) == 0);
+    CHECK(LockFreeBufferWaitingTransfer(buffer, 1000000, 1000, 1) == 0);
+  }
+
+  {
+    WaitableLockFreeBuffer<Sample_t, LockFreeBufferMaskIndexing> buffer(1024);
+    CHECK(LockFreeBufferWaitingTransfer(buffer, 1000000, 100, 100) == 0);
+    CHECK(LockFreeBufferWaitingTransfer(buffer, 1000000, 1, 1000) == 0);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Test statistics collection (single thread)
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static void TestLockFreeBufferStats(BUFFER& buffer)
+{
+  std::vector<uint_t> block(buffer.GetCapacity() + 10);
+  LOCKFREEBUFFERSTATS stats;
+  uint_t n = buffer.GetCapacity();
+
+  stats = buffer.GetStats();
+  CHECK(stats.itemswritten == 0);
+  CHECK(stats.itemsread == 0);
+  CHECK(stats.overruns == 0);
+  CHECK(stats.underruns == 0);
+  CHECK(stats.maxused == 0);
+  CHECK(stats.minused == 0);
+
+  // read from empty buffer
+  CHECK(buffer.GetReadBuffer() == NULL);
+  CHECK(buffer.Read(&block[0], 1) == 0);
+  stats = buffer.GetStats();
+  CHECK(stats.underruns == 2);
+  // an underrun is a low watermark of zero
+  CHECK(stats.minused == 0);
+  buffer.ResetStats();
+
+  // write-ahead beyond what is available is *not* an overrun
+  CHECK(buffer.GetWriteBuffer(n) == NULL);
+  CHECK(buffer.GetStats().overruns == 0);
+
+  CHECK(buffer.Write(&block[0], 10) == 10);
+  CHECK(buffer.Write(&block[0], 5) == 5);
+  stats = buffer.GetStats();
+  CHECK(stats.itemswritten == 15);
+  CHECK(stats.maxused == 15);
+
+  // short write and failed writes are overruns
+  CHECK(buffer.Write(&block[0], n) == (n - 15));
+  CHECK(buffer.GetWriteBuffer() == NULL);
+  CHECK(!buffer.IncrementWrite());
+  stats = buffer.GetStats();
+  CHECK(stats.itemswritten == n);
+  CHECK(stats.overruns == 3);
+  CHECK(stats.maxused == n);
+
+  // read all but 3
+  CHECK(buffer.Read(&block[0], n - 3) == (n - 3));
+  stats = buffer.GetStats();
+  CHECK(stats.itemsread == (n - 3));
+  CHECK(stats.minused == n);
+  CHECK(buffer.IncrementRead());
+  CHECK(buffer.GetStats().minused == 3);
+
+  // short read is an underrun
+  CHECK(buffer.Read(&block[0], 10) == 2);
+  stats = buffer.GetStats();
+  CHECK(stats.itemsread == n);
+  CHECK(stats.underruns == 1);
+  CHECK(stats.minused == 0);
+
+  // counters can be published into the performance monitor (when it is measuring)
+  PerformanceMonitor::StartMeasuring();
+  buffer.PublishStats("lockfreebuffer-stats");
+  PerformanceMonitor::StopMeasuring();
+  CHECK(PerformanceMonitor::Get().GetCounter("lockfreebuffer-stats.itemswritten") == n);
+  CHECK(PerformanceMonitor::Get().GetCounter("lockfreebuffer-stats.overruns") == 3);
+  CHECK(PerformanceMonitor::Get().GetCounter("lockfreebuffer-stats.underruns") == 1);
+  CHECK(PerformanceMonitor::Get().GetCounter("lockfreebuffer-stats.maxused") == n);
+
+  buffer.ResetStats();
+  stats = buffer.GetStats();
+  CHECK(stats.itemswritten == 0);
+  CHECK(stats.itemsread == 0);
+  CHECK(stats.overruns == 0);
+  CHECK(stats.underruns == 0);
+}
+
+TEST_CASE("lockfreebuffer-stats")
+{
+  SECTION("modulo")
+  {
+    LockFreeBuffer<uint_t, LockFreeBufferModuloIndexing, LockFreeBufferCounters> buffer(100);
+    TestLockFreeBufferStats(buffer);
+  }
+
+  SECTION("masked")
+  {
+    MaskedLockFreeBuffer<uint_t, LockFreeBufferCounters> buffer(100);
+    TestLockFreeBufferStats(buffer);
+  }
+
+  SECTION("disabled")
+  {
+    LockFreeBuffer<uint_t> buffer(100);
+    uint_t val = 0;
+
+    CHECK(buffer.Read(&val, 1) == 0);
+    CHECK(buffer.Write(&val, 1) == 1);
+    CHECK(buffer.GetStats().itemswritten == 0);
+    CHECK(buffer.GetStats().underruns == 0);
+    // statistics take no space
+    CHECK(sizeof(LockFreeBuffer<uint_t>) < sizeof(LockFreeBuffer<uint_t, LockFreeBufferModuloIndexing, LockFreeBufferCounters>));
+  }
+
+  SECTION("threads")
+  {
+    MaskedLockFreeBuffer<uint64_t, LockFreeBufferCounters> buffer(64);
+    LOCKFREEBUFFERSTATS stats;
+
+    CHECK(LockFreeBufferTransfer(buffer, 200000, 5) == 0);
+    stats = buffer.GetStats();
+    CHECK(stats.itemswritten == 200000);
+    CHECK(stats.itemsread == 200000);
+    CHECK(stats.maxused <= 64);
+    CHECK(stats.maxused > 0);
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Time single-threaded write/read cycles, returning ns per item
+ */
+/*--------------------------------------------------------------------------------*/
+template<class BUFFER>
+static double LockFreeBufferSingleThread(BUFFER& buffer, uint_t loops)
+{
+  uint64_t sum = 0;
+  uint_t   i, j, n = buffer.GetCapacity();
+
+  uint64_t tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++)
+  {
+    for (j = 0; j < n; j++)
+    {
+      *buffer.GetWriteBuffer() = j;
+      buffer.IncrementWrite();
+    }
+    for (j = 0; j < n; j++)
+    {
+      sum += *buffer.GetReadBuffer();
+      buffer.IncrementRead();
+    }
+  }
+  tick = GetNanosecondTicks() - tick;
+
+  // prevent loop being optimised away
+  if (sum == 1) printf("!");
+
+  return (double)tick / (double)((uint64_t)loops * n);
+}
+
+TEST_CASE("lockfreebuffer-benchmark", "[.][benchmark]")
+{
+  static const uint_t maxbatches[] = {1, 64};
+  const uint64_t count = 20000000;
+  uint_t i;
+
+  {
+    LockFreeBuffer<uint64_t>       buffer1(1023);
+    MaskedLockFreeBuffer<uint64_t> buffer2(1024);
+
+    printf("LockFreeBuffer       (single thread):      %6.2lfns per item\n", LockFreeBufferSingleThread(buffer1, 20000));
+    printf("MaskedLockFreeBuffer (single thread):      %6.2lfns per item\n", LockFreeBufferSingleThread(buffer2, 20000));
+  }
+
+  {
+    // cost of statistics
+    LockFreeBuffer<uint64_t, LockFreeBufferModuloIndexing, LockFreeBufferCounters> buffer1(1023);
+    MaskedLockFreeBuffer<uint64_t, LockFreeBufferCounters>                         buffer2(1024);
+
+    printf("LockFreeBuffer       (single thread, stats): %6.2lfns per item\n", LockFreeBufferSingleThread(buffer1, 20000));
+    printf("MaskedLockFreeBuffer (single thread, stats): %6.2lfns per item\n", LockFreeBufferSingleThread(buffer2, 20000));
+  }
+
+  {
+    // cost of notifications with no thread waiting
+    WaitableLockFreeBuffer<uint64_t>                             buffer1(1023);
+    WaitableLockFreeBuffer<uint64_t, LockFreeBufferMaskIndexing> buffer2(1024);
+
+    printf("WaitableLockFreeBuffer (single thread):         %6.2lfns per item\n", LockFreeBufferSingleThread(buffer1, 20000));
+    printf("Masked WaitableLockFreeBuffer (single thread):  %6.2lfns per item\n", LockFreeBufferSingleThread(buffer2, 20000));
+  }
+
+  {
+    // blocking rather than polling transfers
+    WaitableLockFreeBuffer<Sample_t, LockFreeBufferMaskIndexing> buffer(4096);
+    uint64_t tick, errors;
+
+    tick   = GetNanosecondTicks();
+    errors = LockFreeBufferWaitingTransfer(buffer, count, 256, 256);
+    tick   = GetNanosecondTicks() - tick;
+    printf("WaitableLockFreeBuffer (256-item blocks, waiting): %6.2lfns per item, %6.1lfM items/s (%lu errors)\n",
+           (double)tick / (double)count, 1.0e3 * (double)count / (double)tick, (ulong_t)errors);
+  }
+
+  for (i = 0; i < NUMBEROF(maxbatches); i++)
+  {
+    LockFreeBuffer<uint64_t>       buffer1(1023);
+    MaskedLockFreeBuffer<uint64_t> buffer2(1024);
+    uint64_t tick, errors;
+
+    tick   = GetNanosecondTicks();
+    errors = LockFreeBufferTransfer(buffer1, count, maxbatches[i]);
+    tick   = GetNanosecondTicks() - tick;
+    printf("LockFreeBuffer       (batches up to %3u): %6.2lfns per item, %6.1lfM items/s (%lu errors)\n",
+           maxbatches[i], (double)tick / (double)count, 1.0e3 * (double)count / (double)tick, (ulong_t)errors);
+
+    tick   = GetNanosecondTicks();
+    errors = LockFreeBufferTransfer(buffer2, count, maxbatches[i]);
+    tick   = GetNanosecondTicks() - tick;
+    printf("MaskedLockFreeBuffer (batches up to %3u): %6.2lfns per item, %6.1lfM items/s (%lu errors)\n",
+           maxbatches[i], (double)tick / (double)count, 1.0e3 * (double)count / (double)tick, (ulong_t)errors);
+  }
+}
+
+TEST_CASE("lockfreebuffer-blocks-benchmark", "[.][benchmark]")
+{
+  const uint_t blocksize = 512, loops = 200000;
+  MaskedLockFreeBuffer<Sample_t> buffer(8 * blocksize - 1);
+  std::vector<Sample_t> block(blocksize);
+  Sample_t sum = 0.f;
+  uint_t   i, j;
+
+  for (i = 0; i < blocksize; i++) block[i] = (Sample_t)i;
+
+  // write and read blocks item-by-item
+  uint64_t tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++)
+  {
+    for (j = 0; j < blocksize; j++) *buffer.GetWriteBuffer(j) = block[j];
+    buffer.IncrementWrite(blocksize);
+    for (j = 0; j < blocksize; j++) block[j] = *buffer.GetReadBuffer(j);
+    buffer.IncrementRead(blocksize);
+    sum += block[i % blocksize];
+  }
+  tick = GetNanosecondTicks() - tick;
+  printf("MaskedLockFreeBuffer<Sample_t> %u-sample blocks (item by item): %6.3lfns per sample\n",
+         blocksize, (double)tick / (double)(loops * blocksize));
+
+  // write and read blocks using Write() and Read()
+  tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++)
+  {
+    buffer.Write(&block[0], blocksize);
+    buffer.Read(&block[0], blocksize);
+    sum += block[i % blocksize];
+  }
+  tick = GetNanosecondTicks() - tick;
+  printf("MaskedLockFreeBuffer<Sample_t> %u-sample blocks (Write/Read):   %6.3lfns per sample\n",
+         blocksize, (double)tick / (double)(loops * blocksize));
+
+  // prevent loops being optimised away
+  if (sum == 1.f) printf("!");
+}
+
+BBC_AUDIOTOOLBOX_END
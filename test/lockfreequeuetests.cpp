@@ -0,0 +1,265 @@
+#include <thread>
+
+#include <catch/catch.hpp>
+
+#include "LockFreeQueue.h"
+#include "Thread.h"
+
+BBC_AUDIOTOOLBOX_START
+
+TEST_CASE("lockfreequeue")
+{
+  LockFreeQueue<uint_t> queue(10);
+  uint_t i, val, *p;
+
+  // capacity is rounded up to a power of 2
+  CHECK(queue.GetCapacity() == 16);
+  CHECK(queue.ReadBuffersAvailable() == 0);
+  CHECK(!queue.TryPop(val));
+  CHECK(queue.GetReadBuffer() == NULL);
+
+  for (i = 0; i < queue.GetCapacity(); i++) CHECK(queue.TryPush(i));
+  CHECK(!queue.TryPush(i));
+  CHECK(queue.GetWriteBuffer() == NULL);
+  CHECK(queue.ReadBuffersAvailable() == 16);
+
+  for (i = 0; i < queue.GetCapacity(); i++)
+  {
+    REQUIRE(queue.TryPop(val));
+    CHECK(val == i);
+  }
+  CHECK(!queue.TryPop(val));
+  CHECK(queue.ReadBuffersAvailable() == 0);
+
+  // in-place interface: claimed items are invisible until committed
+  REQUIRE((p = queue.GetWriteBuffer()) != NULL);
+  *p = 100;
+  CHECK(queue.GetReadBuffer() == NULL);
+  CHECK(queue.TryPush(101));
+  CHECK(!queue.TryPop(val));
+  queue.IncrementWrite(p);
+
+  REQUIRE((p = queue.GetReadBuffer()) != NULL);
+  CHECK(*p == 100);
+  queue.IncrementRead(p);
+  REQUIRE((p = queue.GetReadBuffer()) != NULL);
+  CHECK(*p == 101);
+  queue.IncrementRead(p);
+  CHECK(queue.GetReadBuffer() == NULL);
+
+  // many laps of the storage
+  for (i = 0; i < 1000; i++)
+  {
+    CHECK(queue.TryPush(i));
+    CHECK(queue.TryPush(i + 1));
+    REQUIRE(queue.TryPop(val));
+    CHECK(val == i);
+    REQUIRE(queue.TryPop(val));
+    CHECK(val == (i + 1));
+  }
+
+  // minimum capacity
+  queue.Resize(0);
+  CHECK(queue.GetCapacity() == 2);
+  CHECK(queue.TryPush(1));
+  CHECK(queue.TryPush(2));
+  CHECK(!queue.TryPush(3));
+  REQUIRE(queue.TryPop(val));
+  CHECK(val == 1);
+  CHECK(queue.TryPush(3));
+  REQUIRE(queue.TryPop(val));
+  CHECK(val == 2);
+  REQUIRE(queue.TryPop(val));
+  CHECK(val == 3);
+  CHECK(!queue.TryPop(val));
+}
+
+typedef struct {
+  LockFreeQueue<uint64_t> *queue;
+  uint_t                  id;
+  uint_t                  nproducers;
+  uint64_t                count;           // items per producer
+  bool                    inplace;         // use GetWriteBuffer()/GetReadBuffer() instead of TryPush()/TryPop()
+  std::atomic<uint64_t>   *popped;         // total items read by all consumers
+  uint64_t                sum;             // consumer: sum of item values read
+  uint64_t                errors;          // consumer: number of out-of-order items
+} LOCKFREEQUEUETHREAD;
+
+/*--------------------------------------------------------------------------------*/
+/** Write incrementing values tagged with the producer id
+ */
+/*--------------------------------------------------------------------------------*/
+static void *LockFreeQueueProducer(Thread& thread, void *arg)
+{
+  LOCKFREEQUEUETHREAD& producer = *(LOCKFREEQUEUETHREAD *)arg;
+  uint64_t val = 0, item;
+  uint64_t *p;
+
+  while ((val < producer.count) && !thread.StopRequested())
+  {
+    item = ((uint64_t)producer.id << 32) | val;
+
+    if (producer.inplace)
+    {
+      if ((p = producer.queue->GetWriteBuffer()) != NULL)
+      {
+        *p = item;
+        producer.queue->IncrementWrite(p);
+        val++;
+      }
+      else std::this_thread::yield();
+    }
+    else if (producer.queue->TryPush(item)) val++;
+    else std::this_thread::yield();
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Read values until all producers' items have been read, checking that each
+ * producer's values arrive in order
+ */
+/*--------------------------------------------------------------------------------*/
+static void *LockFreeQueueConsumer(Thread& thread, void *arg)
+{
+  LOCKFREEQUEUETHREAD& consumer = *(LOCKFREEQUEUETHREAD *)arg;
+  std::vector<uint64_t> next(consumer.nproducers, 0);
+  const uint64_t total = consumer.count * consumer.nproducers;
+  uint64_t item, *p;
+  bool     valid;
+
+  while ((consumer.popped->load() < total) && !thread.StopRequested())
+  {
+    if (consumer.inplace)
+    {
+      if ((valid = ((p = consumer.queue->GetReadBuffer()) != NULL)) == true)
+      {
+        item = *p;
+        consumer.queue->IncrementRead(p);
+      }
+    }
+    else valid = consumer.queue->TryPop(item);
+
+    if (valid)
+    {
+      uint_t   id  = (uint_t)(item >> 32);
+      uint64_t val = item & 0xffffffff;
+
+      if ((id < consumer.nproducers) && (val >= next[id])) next[id] = val + 1;
+      else consumer.errors++;
+
+      consumer.sum += val;
+      (*consumer.popped)++;
+    }
+    else std::this_thread::yield();
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Transfer count items from each of nproducers threads to nconsumers threads
+ *
+ * @return number of errors (out-of-order, missing or corrupt items)
+ */
+/*--------------------------------------------------------------------------------*/
+static uint64_t LockFreeQueueTransfer(LockFreeQueue<uint64_t>& queue, uint_t nproducers, uint_t nconsumers, uint64_t count)
+{
+  std::vector<LOCKFREEQUEUETHREAD> args(nproducers + nconsumers);
+  std::vector<Thread> threads(nproducers + nconsumers);
+  std::atomic<uint64_t> popped(0);
+  const uint64_t total = count * nproducers;
+  uint64_t sum = 0, errors = 0, last = 0, tick;
+  uint_t i;
+
+  for (i = 0; i < args.size(); i++)
+  {
+    LOCKFREEQUEUETHREAD& arg = args[i];
+
+    arg.queue      = &queue;
+    arg.id         = (i < nproducers) ? i : i - nproducers;
+    arg.nproducers = nproducers;
+    arg.count      = count;
+    arg.inplace    = ((arg.id & 1) != 0);
+    arg.popped     = &popped;
+    arg.sum        = 0;
+    arg.errors     = 0;
+  }
+
+  for (i = 0; i < nconsumers; i++) threads[nproducers + i].Start(&LockFreeQueueConsumer, &args[nproducers + i]);
+  for (i = 0; i < nproducers; i++) threads[i].Start(&LockFreeQueueProducer, &args[i]);
+
+  // once every item has been read, all threads will have finished (give up if items stop
+  // arriving, e.g. because the queue has lost one, rather than hanging)
+  tick = GetNanosecondTicks();
+  while (popped.load() < total)
+  {
+    uint64_t n = popped.load();
+
+    if (n != last)
+    {
+      last = n;
+      tick = GetNanosecondTicks();
+    }
+    else if ((GetNanosecondTicks() - tick) > 10000000000ull) break;
+
+    std::this_thread::yield();
+  }
+  CHECK(popped.load() == total);
+  for (i = 0; i < threads.size(); i++) threads[i].Stop();
+
+  for (i = 0; i < nconsumers; i++)
+  {
+    sum    += args[nproducers + i].sum;
+    errors += args[nproducers + i].errors;
+  }
+
+  // each producer writes 0 .. count - 1
+  if (sum != (nproducers * ((count * (count - 1)) / 2))) errors++;
+  if (popped.load() != total) errors++;
+
+  return errors;
+}
+
+TEST_CASE("lockfreequeue-threads")
+{
+  static const uint_t lengths[]    = {2, 16, 1024};
+  static const uint_t producers[]  = {1, 2, 4, 1, 3};
+  static const uint_t consumers[]  = {1, 2, 1, 4, 3};
+  uint_t i, j;
+
+  for (i = 0; i < NUMBEROF(lengths); i++)
+  {
+    for (j = 0; j < NUMBEROF(producers); j++)
+    {
+      INFO("length " << lengths[i] << " producers " << producers[j] << " consumers " << consumers[j]);
+
+      LockFreeQueue<uint64_t> queue(lengths[i]);
+      CHECK(LockFreeQueueTransfer(queue, producers[j], consumers[j], 50000) == 0);
+      CHECK(queue.ReadBuffersAvailable() == 0);
+    }
+  }
+}
+
+TEST_CASE("lockfreequeue-benchmark", "[.][benchmark]")
+{
+  const uint_t   maxthreads = std::max(4u, std::thread::hardware_concurrency());
+  const uint64_t count      = 4000000;
+  uint_t n;
+
+  // n producers and n consumers contending for the same queue
+  for (n = 1; n <= maxthreads; n++)
+  {
+    LockFreeQueue<uint64_t> queue(1024);
+    uint64_t total = (count / n) * n, tick, errors;
+
+    tick   = GetNanosecondTicks();
+    errors = LockFreeQueueTransfer(queue, n, n, count / n);
+    tick   = GetNanosecondTicks() - tick;
+    printf("LockFreeQueue (%2u producers, %2u consumers): %6.2lfns per item, %6.1lfM items/s (%lu errors)\n",
+           n, n, (double)tick / (double)total, 1.0e3 * (double)total / (double)tick, (ulong_t)errors);
+  }
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <catch/catch.hpp>
+
+#include "MappedFile.h"
+#include "testbase.h"
+
+BBC_AUDIOTOOLBOX_START
+
+static const char *mappedfiletestname = "mappedfiletests.tmp";
+
+TEST_CASE("mappedfile")
+{
+  const uint32_t nvalues = (uint32_t)(10 * GetPageSize() / sizeof(uint32_t)) + 123;
+
+  SECTION("reading")
+  {
+    MappedFile file;
+    uint32_t   val;
+    uint16_t   vals[3];
+    uint_t     i, errors = 0;
+
+    TestCreateIncrementingFile(mappedfiletestname, nvalues);
+
+    REQUIRE(file.fopen(mappedfiletestname, "rb"));
+    REQUIRE(file.IsMapped());
+    CHECK(file.GetLength() == (nvalues * sizeof(uint32_t)));
+
+    for (i = 0; (i < nvalues) && (file.fread(&val, sizeof(val), 1) == 1); i++)
+    {
+      if (val != i) errors++;
+    }
+    CHECK(i == nvalues);
+    CHECK(errors == 0);
+    CHECK(file.ftell() == (off_t)(nvalues * sizeof(uint32_t)));
+    CHECK(file.fread(&val, sizeof(val), 1) == 0);
+
+    // partial items are read but not counted
+    CHECK(file.fseek(-2, SEEK_END) == 0);
+    CHECK(file.fread(vals, sizeof(vals), 1) == 0);
+    CHECK(file.ftell() == (off_t)(nvalues * sizeof(uint32_t)));
+
+    // seeking
+    CHECK(file.fseek(100 * sizeof(uint32_t), SEEK_SET) == 0);
+    CHECK(file.fread(&val, sizeof(val), 1) == 1);
+    CHECK(val == 100);
+    CHECK(file.fseek(-2 * (off_t)sizeof(uint32_t), SEEK_CUR) == 0);
+    CHECK(file.fread(&val, sizeof(val), 1) == 1);
+    CHECK(val == 99);
+    CHECK(file.fseek(-(off_t)sizeof(uint32_t), SEEK_END) == 0);
+    CHECK(file.fread(&val, sizeof(val), 1) == 1);
+    CHECK(val == (nvalues - 1));
+    CHECK(file.fseek(-1, SEEK_SET) < 0);
+    CHECK(file.fseek(16, SEEK_END) == 0);
+    CHECK(file.fread(&val, sizeof(val), 1) == 0);
+    file.rewind();
+    CHECK(file.ftell() == 0);
+
+    // zero-copy access
+    const uint32_t *p = (const uint32_t *)file.GetPointer(50 * sizeof(uint32_t), 10 * sizeof(uint32_t));
+    REQUIRE(p != NULL);
+    CHECK(p[0] == 50);
+    CHECK(p[9] == 59);
+    CHECK(file.GetPointer(0, file.GetLength()) != NULL);
+    CHECK(file.GetPointer(1, file.GetLength()) == NULL);
+    CHECK(file.GetPointer(file.GetLength() + 1, 0) == NULL);
+
+    // hints
+    CHECK(file.SetAccessPattern(MappedFile::ACCESS_RANDOM));
+    CHECK(file.GetAccessPattern() == MappedFile::ACCESS_RANDOM);
+    CHECK(file.Prefetch(GetPageSize() + 10, 1000));
+    CHECK(!file.Prefetch(file.GetLength(), 10));
+    CHECK(file.SetAccessPattern(MappedFile::ACCESS_SEQUENTIAL));
+
+    // duplication re-maps at the same position (and with the same access pattern)
+    CHECK(file.fseek(20 * sizeof(uint32_t), SEEK_SET) == 0);
+    {
+      MappedFile *file2 = file.dup();
+
+      CHECK(file2->IsMapped());
+      CHECK(file2->GetAccessPattern() == MappedFile::ACCESS_SEQUENTIAL);
+      CHECK(file2->ftell() == (off_t)(20 * sizeof(uint32_t)));
+      CHECK(file2->fread(&val, sizeof(val), 1) == 1);
+      CHECK(val == 20);
+      delete file2;
+    }
+
+    file.fclose();
+    CHECK(!file.IsMapped());
+    CHECK(file.GetPointer(0, 0) == NULL);
+  }
+
+  SECTION("readline")
+  {
+    static const char text[] = "first line\r\nsecond\n\nthis line is too long\nlast";
+    EnhancedFile ref;
+    MappedFile   file;
+    char line[12], refline[12];
+    int  l, refl;
+
+    REQUIRE(ref.fopen(mappedfiletestname, "wb"));
+    REQUIRE(ref.fwrite(text, 1, sizeof(text) - 1) == (sizeof(text) - 1));
+    ref.fclose();
+
+    // lines must be identical to those read by EnhancedFile
+    REQUIRE(ref.fopen(mappedfiletestname, "rb"));
+    REQUIRE(file.fopen(mappedfiletestname, "rb"));
+    REQUIRE(file.IsMapped());
+    do
+    {
+      refl = ref.readline(refline, sizeof(refline));
+      l    = file.readline(line, sizeof(line));
+      CHECK(l == refl);
+      if (refl != EOF) CHECK(std::string(line) == std::string(refline));
+    }
+    while (refl != EOF);
+    CHECK(file.ftell() == (off_t)(sizeof(text) - 1));
+
+    // through the base class
+    EnhancedFile& base = file;
+    base.rewind();
+    CHECK(base.readline(line, sizeof(line)) == 10);
+    CHECK(std::string(line) == "first line");
+  }
+
+  SECTION("fallback")
+  {
+    MappedFile file;
+    uint32_t   val = 1234;
+
+    // empty files cannot be mapped
+    REQUIRE(file.fopen(mappedfiletestname, "wb"));
+    CHECK(!file.IsMapped());
+    file.fclose();
+    REQUIRE(file.fopen(mappedfiletestname, "rb"));
+    CHECK(!file.IsMapped());
+    CHECK(file.fread(&val, sizeof(val), 1) == 0);
+    file.fclose();
+
+    // files opened for update are not mapped
+    TestCreateIncrementingFile(mappedfiletestname, 10);
+    REQUIRE(file.fopen(mappedfiletestname, "r+b"));
+    CHECK(!file.IsMapped());
+    CHECK(file.fseek(5 * sizeof(uint32_t), SEEK_SET) == 0);
+    CHECK(file.fread(&val, sizeof(val), 1) == 1);
+    CHECK(val == 5);
+    CHECK(file.GetPointer(0, 4) == NULL);
+    CHECK(!file.SetAccessPattern(MappedFile::ACCESS_RANDOM));
+  }
+
+  remove(mappedfiletestname);
+}
+
+TEST_CASE("mappedfile-benchmark", "[.][benchmark]")
+{
+  const uint32_t nvalues = 64 * 1024 * 1024 / sizeof(uint32_t);
+  const uint_t   nreads  = 100000;
+  std::vector<uint32_t> offsets(nreads);
+  uint32_t block[16];
+  uint64_t sum[3];
+  uint_t   i, j;
+
+  TestCreateIncrementingFile(mappedfiletestname, nvalues);
+
+  // pseudo-random 64-byte reads (the file is mostly cached)
+  for (i = 0; i < nreads; i++) offsets[i] = (uint32_t)(((uint64_t)i * 2654435761U) % (nvalues - 16));
+
+  for (i = 0; i < 3; i++)
+  {
+    EnhancedFile *file = i ? new MappedFile : new EnhancedFile;
+    uint64_t t;
+
+    REQUIRE(file->fopen(mappedfiletestname, "rb"));
+    if (i) ((MappedFile *)file)->SetAccessPattern(MappedFile::ACCESS_RANDOM);
+
+    sum[i] = 0;
+    t = GetNanosecondTicks();
+    for (j = 0; j < nreads; j++)
+    {
+      const uint32_t *p = block;
+
+      if (i < 2)
+      {
+        file->fseek((off_t)offsets[j] * sizeof(uint32_t), SEEK_SET);
+        file->fread(block, sizeof(block), 1);
+      }
+      else p = (const uint32_t *)((MappedFile *)file)->GetPointer((uint64_t)offsets[j] * sizeof(uint32_t), sizeof(block));
+
+      sum[i] += p[0] + p[15];
+    }
+    t = GetNanosecondTicks() - t;
+
+    printf("%s (random 64 byte reads%s): %8.3lfus per read\n", i ? "MappedFile" : "EnhancedFile", (i == 2) ? ", GetPointer()" : "", (double)t / ((double)nreads * 1000.0));
+
+    delete file;
+  }
+  CHECK(sum[1] == sum[0]);
+  CHECK(sum[2] == sum[0]);
+
+  remove(mappedfiletestname);
+}
+
+BBC_AUDIOTOOLBOX_END
@@ -0,0 +1,833 @@
+#include <stdlib.h>
+
+#include <catch/catch.hpp>
+
+#include "PositionBlock.h"
+#include "PositionKernels.h"
+#include "FastTrig.h"
+#include "SphericalIndex.h"
+#include "TrajectoryInterpolator.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Generate a repeatable list of random positions (some polar, some cartesian)
+ */
+/*--------------------------------------------------------------------------------*/
+static void GenerateRandomPositions(std::vector<Position>& positions, uint_t n, uint_t seed = 1)
+{
+  uint_t i;
+
+  srand(seed);
+
+  positions.resize(n);
+  for (i = 0; i < n; i++)
+  {
+    Position& pos = positions[i];
+
+    // positions may be re-used so reset to cartesian first
+    pos = Position();
+    pos.pos.x = 10.0 * ((double)rand() / (double)RAND_MAX - .5);
+    pos.pos.y = 10.0 * ((double)rand() / (double)RAND_MAX - .5);
+    pos.pos.z = 10.0 * ((double)rand() / (double)RAND_MAX - .5);
+    if (i & 1) pos = pos.Polar();
+  }
+}
+
+TEST_CASE("positionblock")
+{
+  std::vector<Position> positions, positions2, res;
+  std::vector<double>   vals;
+  uint_t i, n = 37;
+
+  GenerateRandomPositions(positions, n, 1);
+  GenerateRandomPositions(positions2, n, 2);
+  vals.resize(n);
+
+  PositionBlock block(positions), block2(positions2, true);
+
+  CHECK(block.GetCount() == n);
+  CHECK(block.IsPolar() == false);
+  CHECK(block2.IsPolar() == true);
+
+  // components must be aligned
+  for (i = 0; i < 3; i++) CHECK((((size_t)block.GetComponent(i)) & 31) == 0);
+
+  // conversion back to list
+  block.Get(res);
+  REQUIRE(res.size() == n);
+  for (i = 0; i < n; i++)
+  {
+    CHECK(res[i].polar == false);
+    CHECK(res[i].pos.x == Approx(positions[i].Cart().pos.x));
+    CHECK(res[i].pos.y == Approx(positions[i].Cart().pos.y));
+    CHECK(res[i].pos.z == Approx(positions[i].Cart().pos.z));
+  }
+
+  // polar conversion
+  PositionBlock polar = block.Polar();
+  CHECK(polar.IsPolar() == true);
+  for (i = 0; i < n; i++)
+  {
+    Position pos = positions[i].Polar();
+    CHECK(polar.GetAz()[i] == Approx(pos.pos.az));
+    CHECK(polar.GetEl()[i] == Approx(pos.pos.el));
+    CHECK(polar.GetD()[i]  == Approx(pos.pos.d));
+  }
+
+  // cartesian conversion
+  PositionBlock cart = block2.Cart();
+  CHECK(cart.IsPolar() == false);
+  for (i = 0; i < n; i++)
+  {
+    Position pos = positions2[i].Cart();
+    CHECK(cart.GetX()[i] == Approx(pos.pos.x));
+    CHECK(cart.GetY()[i] == Approx(pos.pos.y));
+    CHECK(cart.GetZ()[i] == Approx(pos.pos.z));
+  }
+
+  // unit vectors
+  PositionBlock unit = block.Unit();
+  for (i = 0; i < n; i++)
+  {
+    Position pos = positions[i].Cart().Unit();
+    CHECK(unit.GetX()[i] == Approx(pos.pos.x));
+    CHECK(unit.GetY()[i] == Approx(pos.pos.y));
+    CHECK(unit.GetZ()[i] == Approx(pos.pos.z));
+  }
+
+  // modulus
+  block2.Mod(&vals[0]);
+  for (i = 0; i < n; i++) CHECK(vals[i] == Approx(positions2[i].Mod()));
+
+  // dot products
+  DotProduct(block, block2, &vals[0]);
+  for (i = 0; i < n; i++) CHECK(vals[i] == Approx(DotProduct(positions[i], positions2[i])));
+
+  DotProduct(block2, positions[0], &vals[0]);
+  for (i = 0; i < n; i++) CHECK(vals[i] == Approx(DotProduct(positions2[i], positions[0])));
+
+  // angles
+  Angle(block, block2, &vals[0]);
+  for (i = 0; i < n; i++) CHECK(vals[i] == Approx(Angle(positions[i], positions2[i])));
+
+  Angle(block2, positions[0], &vals[0]);
+  for (i = 0; i < n; i++) CHECK(vals[i] == Approx(Angle(positions2[i], positions[0])));
+
+  // resizing preserves contents
+  block.Resize(n + 10);
+  CHECK(block.GetCount() == (n + 10));
+  for (i = 0; i < n; i++) CHECK(block.Get(i).pos.x == Approx(positions[i].Cart().pos.x));
+  for (; i < (n + 10); i++) CHECK(block.Get(i).Mod() == 0.0);
+}
+
+TEST_CASE("positionfloat")
+{
+  std::vector<Position> positions;
+  PositionTransform  trans;
+  ScreenTransform    screen;
+  uint_t i, n = 37;
+
+  GenerateRandomPositions(positions, n);
+
+  trans.pretranslation  = Position(1.0, -2.0, 0.5);
+  trans.rotation.SetFromAngleAxis(30.0, Position(1.0, 2.0, 3.0));
+  trans.posttranslation = Position(0.0, 3.0, -1.0);
+
+  screen.cx   = 0.5;
+  screen.sx   = 2.0;
+  screen.dist = 10.0;
+
+  PositionTransformF ftrans(trans);
+  ScreenTransformF   fscreen(screen);
+  std::vector<PositionF> fpositions, fres;
+
+  for (i = 0; i < n; i++) fpositions.push_back(PositionF(positions[i]));
+  fres.resize(n);
+  ftrans.ApplyTransform(&fpositions[0], &fres[0], n);
+
+  for (i = 0; i < n; i++)
+  {
+    const Position& pos = positions[i];
+    PositionF fpos(pos);
+
+    // explicit conversions
+    CHECK(fpos.polar == pos.polar);
+    CHECK(fpos.ToPosition().pos.x == Approx(pos.pos.x).epsilon(1.0e-6));
+    CHECK(PositionT<double>(fpos).pos.y == Approx(pos.pos.y).epsilon(1.0e-6));
+
+    // conversions and arithmetic
+    CHECK(fpos.Polar().pos.az == Approx(pos.Polar().pos.az).epsilon(1.0e-4));
+    CHECK(fpos.Polar().pos.el == Approx(pos.Polar().pos.el).epsilon(1.0e-4));
+    CHECK(fpos.Cart().pos.x   == Approx(pos.Cart().pos.x).epsilon(1.0e-4));
+    CHECK(fpos.Mod()          == Approx(pos.Mod()).epsilon(1.0e-5));
+    CHECK((fpos + PositionF(positions[0])).Mod() == Approx((pos + positions[0]).Mod()).epsilon(1.0e-4));
+    // (acos() of float loses precision near 0 degrees)
+    CHECK(fabs(Angle(fpos, PositionF(positions[0])) - Angle(pos, positions[0])) < 0.05);
+
+    // rotation and transforms
+    Position  ref  = (pos * trans).Cart();
+    PositionF fref = fres[i].Cart();
+    CHECK(fres[i].polar == pos.polar);
+    CHECK(fref.pos.x == Approx(ref.pos.x).epsilon(1.0e-4));
+    CHECK(fref.pos.y == Approx(ref.pos.y).epsilon(1.0e-4));
+    CHECK(fref.pos.z == Approx(ref.pos.z).epsilon(1.0e-4));
+
+    fpos /= ftrans;
+    ref   = (pos / trans).Cart();
+    CHECK(fpos.Cart().pos.x == Approx(ref.pos.x).epsilon(1.0e-4));
+    CHECK(fpos.Cart().pos.y == Approx(ref.pos.y).epsilon(1.0e-4));
+
+    fpos = PositionF(pos) * fscreen;
+    ref  = (pos * screen).Cart();
+    CHECK(fpos.Cart().pos.x == Approx(ref.pos.x).epsilon(1.0e-4));
+    CHECK(fpos.Cart().pos.y == Approx(ref.pos.y).epsilon(1.0e-4));
+  }
+
+  // blocks of floats
+  PositionBlock  block(positions);
+  PositionBlockF fblock(block);
+  std::vector<float> vals(n);
+
+  for (i = 0; i < 3; i++) CHECK((((size_t)fblock.GetComponent(i)) & 31) == 0);
+  CHECK(fblock.GetCount() == n);
+
+  PositionBlockF fpolar = fblock.Polar();
+  PositionBlock  polar(fpolar);
+  CHECK(polar.IsPolar());
+  for (i = 0; i < n; i++)
+  {
+    Position pos = positions[i].Polar();
+    CHECK(polar.GetAz()[i] == Approx(pos.pos.az).epsilon(1.0e-4));
+    CHECK(polar.GetEl()[i] == Approx(pos.pos.el).epsilon(1.0e-4));
+    CHECK(fpolar.GetT(i).pos.d == Approx(pos.pos.d).epsilon(1.0e-5));
+  }
+
+  Angle(fblock, positions[0], &vals[0]);
+  for (i = 0; i < n; i++) CHECK(fabs(vals[i] - Angle(positions[i], positions[0])) < 0.05);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return angle (in degrees) between two (nearly parallel) vectors accurately
+ */
+/*--------------------------------------------------------------------------------*/
+static double DirectionError(const Position& pos1, const Position& pos2)
+{
+  Position p1 = pos1.Cart().Unit(), p2 = pos2.Cart().Unit();
+
+  return atan2(CrossProduct(p1, p2).Mod(), DotProduct(p1, p2)) * 180.0 / M_PI;
+}
+
+TEST_CASE("fasttrig")
+{
+  double maxcarterr = 0.0, maxpolarerr = 0.0, maxangleerr = 0.0, maxroterr = 0.0, sumerr = 0.0;
+  uint_t i, j, n = 0, hist[4] = {0};
+
+  // whole sphere at 0.5 degree resolution
+  for (i = 0; i <= 720; i++)
+  {
+    for (j = 0; j <= 360; j++)
+    {
+      Position polar((double)i * .5 - 180.0, (double)j * .5 - 90.0, 2.0), exactcart, fastcart, fastpolar;
+      double err;
+
+      polar.polar = true;
+
+      FastTrig::Enable(false);
+      exactcart = polar.Cart();
+      FastTrig::Enable(true);
+      fastcart  = polar.Cart();
+      fastpolar = exactcart.Polar();
+      FastTrig::Enable(false);
+
+      // polar -> cartesian direction error
+      err = DirectionError(exactcart, fastcart);
+      maxcarterr = std::max(maxcarterr, err);
+      sumerr += err;
+      hist[(err < 1.0e-6) ? 0 : ((err < 1.0e-5) ? 1 : ((err < 1.0e-4) ? 2 : 3))]++;
+      n++;
+
+      // cartesian -> polar direction error
+      CHECK(fastpolar.pos.d == Approx(2.0));
+      maxpolarerr = std::max(maxpolarerr, DirectionError(exactcart, fastpolar));
+    }
+  }
+
+  INFO("Fast trig error distribution (degrees): <1e-6: " << hist[0] << ", <1e-5: " << hist[1] << ", <1e-4: " << hist[2] << ", >=1e-4: " << hist[3] << ", mean " << sumerr / (double)n);
+  CHECK(maxcarterr  <= FASTTRIG_MAX_ERROR);
+  CHECK(maxpolarerr <= FASTTRIG_MAX_ERROR);
+  CHECK((sumerr / (double)n) <= (.1 * FASTTRIG_MAX_ERROR));
+
+  // angles between random positions and rotation by Quaternions
+  std::vector<Position> positions, positions2;
+  GenerateRandomPositions(positions,  1000, 1);
+  GenerateRandomPositions(positions2, 1000, 2);
+  for (i = 0; i < positions.size(); i++)
+  {
+    Quaternion exactrot, fastrot;
+    double exactangle, fastangle;
+
+    exactangle = Angle(positions[i], positions2[i]);
+    exactrot.SetFromAngleAxis(exactangle, positions2[i]);
+    FastTrig::Enable(true);
+    fastangle = Angle(positions[i], positions2[i]);
+    fastrot.SetFromAngleAxis(exactangle, positions2[i]);
+    FastTrig::Enable(false);
+
+    maxangleerr = std::max(maxangleerr, fabs(fastangle - exactangle));
+    maxroterr   = std::max(maxroterr, DirectionError(positions[i] * exactrot, positions[i] * fastrot));
+  }
+
+  CHECK(maxangleerr <= FASTTRIG_MAX_ERROR);
+  CHECK(maxroterr   <= FASTTRIG_MAX_ERROR);
+}
+
+TEST_CASE("fasttrig-benchmark", "[.][benchmark]")
+{
+  std::vector<Position> positions;
+  uint_t i, j, n = 1024, loops = 1000;
+  double sum = 0.0;
+
+  GenerateRandomPositions(positions, n);
+
+  for (j = 0; j < 2; j++)
+  {
+    FastTrig::Enable(j == 1);
+
+    uint64_t tick = GetNanosecondTicks();
+    for (i = 0; i < (n * loops); i++)
+    {
+      const Position& pos = positions[i % n];
+      sum += pos.Polar().Cart().pos.x + Angle(pos, positions[(i + 1) % n]);
+    }
+    tick = GetNanosecondTicks() - tick;
+
+    printf("%s trig: %0.2lfns per position (polar, cart and angle)\n", (j == 1) ? "Fast" : "libm", (double)tick / (double)(n * loops));
+  }
+
+  FastTrig::Enable(false);
+
+  // prevent loops being optimised away
+  CHECK(sum != 0.0);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Reference (Quaternion product) version of PositionTransform::ApplyTransform()
+ */
+/*--------------------------------------------------------------------------------*/
+static Position ReferenceTransform(const PositionTransform& trans, const Position& pos)
+{
+  Position res = pos.Cart() + trans.pretranslation;
+
+  res  = ((trans.rotation * Quaternion(res)) * trans.rotation.Invert()).GetAxis();
+  res += trans.posttranslation;
+
+  return pos.polar ? res.Polar() : res;
+}
+
+TEST_CASE("positiontransform")
+{
+  std::vector<Position> positions, res;
+  PositionTransform trans;
+  uint_t i, n = 64;
+
+  GenerateRandomPositions(positions, n);
+  res.resize(n);
+
+  trans.pretranslation  = Position(1.0, -2.0, 0.5);
+  trans.rotation.SetFromAngleAxis(30.0, Position(1.0, 2.0, 3.0).Unit());
+  trans.posttranslation = Position(0.0, 3.0, -1.0);
+
+  // single positions
+  for (i = 0; i < n; i++)
+  {
+    Position pos = positions[i], ref = ReferenceTransform(trans, positions[i]);
+
+    pos *= trans;
+    CHECK(pos.polar == positions[i].polar);
+    CHECK(pos.Cart().pos.x == Approx(ref.Cart().pos.x));
+    CHECK(pos.Cart().pos.y == Approx(ref.Cart().pos.y));
+    CHECK(pos.Cart().pos.z == Approx(ref.Cart().pos.z));
+
+    // rotation and inverse rotation by Quaternion
+    Position rot = positions[i] * trans.rotation, _ref = ((trans.rotation * Quaternion(positions[i])) * trans.rotation.Invert()).GetAxis();
+    CHECK(rot.pos.x == Approx(_ref.pos.x));
+    CHECK(rot.pos.y == Approx(_ref.pos.y));
+    CHECK(rot.pos.z == Approx(_ref.pos.z));
+
+    rot /= trans.rotation;
+    CHECK(rot.pos.x == Approx(positions[i].Cart().pos.x));
+    CHECK(rot.pos.y == Approx(positions[i].Cart().pos.y));
+    CHECK(rot.pos.z == Approx(positions[i].Cart().pos.z));
+  }
+
+  // a different transform
+  trans.rotation.SetFromAngleAxis(-75.0, Position(0.0, 0.0, 1.0));
+  trans.posttranslation.pos.z = 2.0;
+
+  // batch (in-place)
+  res = positions;
+  trans.ApplyTransform(&res[0], &res[0], n);
+  for (i = 0; i < n; i++)
+  {
+    Position ref = ReferenceTransform(trans, positions[i]);
+
+    CHECK(res[i].polar == positions[i].polar);
+    CHECK(res[i].Cart().pos.x == Approx(ref.Cart().pos.x));
+    CHECK(res[i].Cart().pos.y == Approx(ref.Cart().pos.y));
+    CHECK(res[i].Cart().pos.z == Approx(ref.Cart().pos.z));
+
+    // and removing it gets back to the original
+    res[i] /= trans;
+    CHECK(res[i].Cart().pos.x == Approx(positions[i].Cart().pos.x));
+    CHECK(res[i].Cart().pos.y == Approx(positions[i].Cart().pos.y));
+    CHECK(res[i].Cart().pos.z == Approx(positions[i].Cart().pos.z));
+  }
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Return a repeatable random value in the range -range..range
+ */
+/*--------------------------------------------------------------------------------*/
+static double RandomValue(double range)
+{
+  return range * (2.0 * (double)rand() / (double)RAND_MAX - 1.0);
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Check vectorised kernels against the scalar versions for scalar type T
+ */
+/*--------------------------------------------------------------------------------*/
+template<typename T>
+static void PositionKernelsCheck(double maxangleerror, double maxrelativeerror)
+{
+  static const uint_t types[] = {POSITIONKERNELS_SSE2, POSITIONKERNELS_AVX2};
+  std::vector<T> cart[3], polar[3], ref[3], res[3];
+  uint_t i, j, t, n = 100003;   // odd number to test remainder handling
+
+  srand(1);
+  for (i = 0; i < 3; i++)
+  {
+    cart[i].resize(n);
+    polar[i].resize(n);
+    ref[i].resize(n);
+    res[i].resize(n);
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    cart[0][i]  = (T)RandomValue(100.0);
+    cart[1][i]  = (T)RandomValue(100.0);
+    cart[2][i]  = (T)RandomValue(100.0);
+    polar[0][i] = (T)RandomValue(1.0e4);
+    polar[1][i] = (T)RandomValue(1.0e4);
+    polar[2][i] = (T)RandomValue(100.0);
+  }
+
+  // special cases: origin, axes and multiples of 45 degrees
+  for (i = 0; i < 27; i++)
+  {
+    cart[0][i]  = (T)((int)(i % 3) - 1);
+    cart[1][i]  = (T)((int)((i / 3) % 3) - 1);
+    cart[2][i]  = (T)((int)(i / 9) - 1);
+    polar[0][i] = (T)(45 * ((int)i - 13));
+    polar[1][i] = (T)(45 * ((int)(i % 9) - 4));
+  }
+
+  for (t = 0; t < NUMBEROF(types); t++)
+  {
+    if (!PositionKernelsAvailable(types[t])) continue;
+
+    double maxangleerr = 0.0, maxdisterr = 0.0, maxcarterr = 0.0;
+
+    INFO("type " << types[t] << " size " << sizeof(T));
+
+    REQUIRE(SetPositionKernels(POSITIONKERNELS_SCALAR));
+    CartToPolar(&cart[0][0], &cart[1][0], &cart[2][0], &ref[0][0], &ref[1][0], &ref[2][0], n);
+    REQUIRE(SetPositionKernels(types[t]));
+    CartToPolar(&cart[0][0], &cart[1][0], &cart[2][0], &res[0][0], &res[1][0], &res[2][0], n);
+
+    for (i = 0; i < n; i++)
+    {
+      // azimuths of +/-180 are equivalent
+      double azerr = fabs((double)res[0][i] - (double)ref[0][i]);
+      if (azerr > 180.0) azerr = fabs(azerr - 360.0);
+
+      maxangleerr = std::max(maxangleerr, std::max(azerr, fabs((double)res[1][i] - (double)ref[1][i])));
+      maxdisterr  = std::max(maxdisterr, fabs((double)res[2][i] - (double)ref[2][i]) / std::max((double)ref[2][i], 1.0e-300));
+    }
+
+    REQUIRE(SetPositionKernels(POSITIONKERNELS_SCALAR));
+    PolarToCart(&polar[0][0], &polar[1][0], &polar[2][0], &ref[0][0], &ref[1][0], &ref[2][0], n);
+    REQUIRE(SetPositionKernels(types[t]));
+    PolarToCart(&polar[0][0], &polar[1][0], &polar[2][0], &res[0][0], &res[1][0], &res[2][0], n);
+
+    for (i = 0; i < n; i++)
+    {
+      for (j = 0; j < 3; j++) maxcarterr = std::max(maxcarterr, fabs((double)res[j][i] - (double)ref[j][i]) / std::max(fabs((double)polar[2][i]), 1.0e-300));
+    }
+
+    CHECK(maxangleerr <= maxangleerror);
+    CHECK(maxdisterr  <= maxrelativeerror);
+    CHECK(maxcarterr  <= maxrelativeerror);
+
+    // in-place conversion
+    PositionBlockT<T> block(n);
+    for (j = 0; j < 3; j++) std::copy(cart[j].begin(), cart[j].end(), block.GetComponent(j));
+    block.Polar(block);
+    CHECK(block.IsPolar());
+    for (i = 0; i < n; i += 997) CHECK(block.GetD()[i] == Approx(Position(cart[0][i], cart[1][i], cart[2][i]).Polar().pos.d).epsilon(maxrelativeerror));
+  }
+
+  SetPositionKernels();
+}
+
+TEST_CASE("positionkernels")
+{
+  PositionKernelsCheck<double>(POSITIONKERNELS_MAX_ANGLE_ERROR, POSITIONKERNELS_MAX_RELATIVE_ERROR);
+  PositionKernelsCheck<float>(POSITIONKERNELS_MAX_ANGLE_ERROR_FLOAT, POSITIONKERNELS_MAX_RELATIVE_ERROR_FLOAT);
+}
+
+TEST_CASE("positionkernels-benchmark", "[.][benchmark]")
+{
+  static const uint_t types[] = {POSITIONKERNELS_SCALAR, POSITIONKERNELS_SSE2, POSITIONKERNELS_AVX2};
+  std::vector<Position> positions;
+  uint_t i, t, n = 1024, loops = 1000;
+
+  GenerateRandomPositions(positions, n);
+
+  PositionBlock  block(positions), polar, cart;
+  PositionBlockF fblock(block), fpolar, fcart;
+
+  for (t = 0; t < NUMBEROF(types); t++)
+  {
+    if (!SetPositionKernels(types[t])) continue;
+
+    uint64_t tick = GetNanosecondTicks();
+    for (i = 0; i < loops; i++)
+    {
+      block.Polar(polar);
+      polar.Cart(cart);
+    }
+    tick = GetNanosecondTicks() - tick;
+
+    printf("Position kernel type %u: %0.2lfns per position (polar and back)\n", types[t], (double)tick / (double)(n * loops));
+
+    tick = GetNanosecondTicks();
+    for (i = 0; i < loops; i++)
+    {
+      fblock.Polar(fpolar);
+      fpolar.Cart(fcart);
+    }
+    tick = GetNanosecondTicks() - tick;
+
+    printf("Position kernel type %u (float): %0.2lfns per position (polar and back)\n", types[t], (double)tick / (double)(n * loops));
+  }
+
+  SetPositionKernels();
+}
+
+/*--------------------------------------------------------------------------------*/
+static Quaternion RandomRotation()
+{
+  Position axis(RandomValue(1.0), RandomValue(1.0), RandomValue(1.0));
+  return Quaternion(RandomValue(180.0), axis.Unit()).Normalised();
+}
+
+TEST_CASE("trajectoryinterpolator")
+{
+  uint_t i, j, nobjects = 20, n = 1000;
+  double dt = 1.0 / (double)n;
+
+  srand(1);
+
+  TrajectoryInterpolator interp(nobjects);
+  std::vector<Quaternion> q0(nobjects), q1(nobjects);
+  std::vector<Position>   p0, p1;
+
+  GenerateRandomPositions(p0, nobjects, 1);
+  GenerateRandomPositions(p1, nobjects, 2);
+
+  CHECK(interp.GetCount() == nobjects);
+
+  SECTION("rotations")
+  {
+    std::vector<Quaternion> res(nobjects * n);
+
+    for (i = 0; i < nobjects; i++)
+    {
+      q0[i] = RandomRotation();
+      // make some pairs close together (Lerp), some more than 90 degrees apart (negated)
+      if      (i % 3 == 1) q1[i] = (q0[i] + RandomRotation() * 0.01).Normalised();
+      else if (i % 3 == 2) q1[i] = -RandomRotation();
+      else                 q1[i] = RandomRotation();
+      interp.SetRotationSegment(i, q0[i], q1[i]);
+    }
+
+    interp.GenerateRotations(0.0, dt, &res[0], n);
+
+    for (i = 0; i < nobjects; i++)
+    {
+      for (j = 0; j < n; j++)
+      {
+        const Quaternion& q = res[i * n + j];
+        Quaternion ref = Slerp(q0[i], q1[i], (double)j * dt);
+
+        CHECK(q.w == Approx(ref.w).epsilon(1.0e-9));
+        CHECK(q.x == Approx(ref.x).epsilon(1.0e-9));
+        CHECK(q.y == Approx(ref.y).epsilon(1.0e-9));
+        CHECK(q.z == Approx(ref.z).epsilon(1.0e-9));
+      }
+    }
+  }
+
+  SECTION("linear positions")
+  {
+    PositionBlock res;
+
+    for (i = 0; i < nobjects; i++) interp.SetPositionSegment(i, p0[i], p1[i]);
+
+    interp.GeneratePositions(0.0, dt, res, n);
+
+    CHECK(res.GetCount() == (nobjects * n));
+    CHECK(!res.IsPolar());
+
+    for (i = 0; i < nobjects; i++)
+    {
+      Position c0 = p0[i].Cart(), c1 = p1[i].Cart();
+
+      for (j = 0; j < n; j++)
+      {
+        Position pos = res.Get(i * n + j);
+        Position ref = c0 + (c1 - c0) * ((double)j * dt);
+
+        CHECK(pos.pos.x == Approx(ref.pos.x));
+        CHECK(pos.pos.y == Approx(ref.pos.y));
+        CHECK(pos.pos.z == Approx(ref.pos.z));
+      }
+    }
+  }
+
+  SECTION("spherical positions")
+  {
+    std::vector<Position> res(n);
+
+    for (i = 0; i < nobjects; i++)
+    {
+      double angle = Angle(p0[i], p1[i]);
+
+      interp.SetPositionSegment(i, p0[i], p1[i], true);
+      interp.GeneratePositions(i, 0.0, dt, &res[0], n);
+
+      for (j = 0; j < n; j++)
+      {
+        double t = (double)j * dt;
+
+        // constant angular velocity along the great circle with linear change in distance
+        CHECK(fabs(Angle(p0[i], res[j]) - t * angle) < 1.0e-5);
+        CHECK(fabs(Angle(res[j], p1[i]) - (1.0 - t) * angle) < 1.0e-5);
+        CHECK(res[j].Mod() == Approx(p0[i].Mod() + t * (p1[i].Mod() - p0[i].Mod())));
+      }
+    }
+  }
+}
+
+TEST_CASE("trajectoryinterpolator-benchmark", "[.][benchmark]")
+{
+  uint_t i, j, nobjects = 64, n = 512, loops = 100;
+  double dt = 1.0 / (double)(n * loops);
+
+  srand(1);
+
+  TrajectoryInterpolator interp(nobjects);
+  std::vector<Quaternion> q0(nobjects), q1(nobjects), res(nobjects * n);
+
+  for (i = 0; i < nobjects; i++)
+  {
+    q0[i] = RandomRotation();
+    q1[i] = RandomRotation();
+    interp.SetRotationSegment(i, q0[i], q1[i]);
+  }
+
+  uint64_t tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++) interp.GenerateRotations((double)(i * n) * dt, dt, &res[0], n);
+  tick = GetNanosecondTicks() - tick;
+
+  printf("Trajectory interpolator: %0.2lfns per rotation\n", (double)tick / (double)(nobjects * n * loops));
+
+  tick = GetNanosecondTicks();
+  for (i = 0; i < loops; i++)
+  {
+    for (j = 0; j < (nobjects * n); j++) res[j] = Slerp(q0[j / n], q1[j / n], (double)(i * n + (j % n)) * dt);
+  }
+  tick = GetNanosecondTicks() - tick;
+
+  printf("Slerp():                 %0.2lfns per rotation\n", (double)tick / (double)(nobjects * n * loops));
+}
+
+/*--------------------------------------------------------------------------------*/
+/** Check spherical index queries against linear scans using AbsAngle()
+ */
+/*--------------------------------------------------------------------------------*/
+static void CheckSphericalIndex(const SphericalIndex& index, const std::vector<Position>& positions, const std::vector<bool>& valid)
+{
+  std::vector<SphericalIndex::RESULT> results;
+  uint_t i, j, k, n = 0;
+
+  for (i = 0; i < valid.size(); i++) if (valid[i]) n++;
+  CHECK(index.GetCount() == n);
+
+  for (i = 0; i < 100; i++)
+  {
+    Position query(RandomValue(1.0), RandomValue(1.0), RandomValue(1.0));
+    std::vector<double> angles;
+    double maxangle = 30.0;
+    uint_t nwithin  = 0;
+
+    for (j = 0; j < positions.size(); j++)
+    {
+      if (valid[j])
+      {
+        angles.push_back(AbsAngle(query, positions[j]));
+        if (angles.back() <= maxangle) nwithin++;
+      }
+    }
+    std::sort(angles.begin(), angles.end());
+
+    for (k = 1; k <= 5; k++)
+    {
+      REQUIRE(index.FindNearest(query, results, k) == std::min(k, n));
+      for (j = 0; j < results.size(); j++)
+      {
+        CHECK(index.IsValid(results[j].id));
+        CHECK(results[j].angle == Approx(angles[j]));
+        CHECK(results[j].angle == Approx(AbsAngle(query, positions[results[j].id])));
+      }
+    }
+
+    CHECK(index.FindWithinAngle(query, maxangle, results) == nwithin);
+    for (j = 0; j < results.size(); j++)
+    {
+      CHECK(results[j].angle <= maxangle);
+      CHECK(results[j].angle == Approx(angles[j]));
+    }
+  }
+}
+
+TEST_CASE("sphericalindex")
+{
+  std::vector<Position> positions;
+  std::vector<bool>     valid;
+  uint_t i, n = 500;
+
+  GenerateRandomPositions(positions, n);
+  valid.resize(n, true);
+
+  SphericalIndex index(positions);
+
+  SECTION("static")
+  {
+    CheckSphericalIndex(index, positions, valid);
+  }
+
+  SECTION("incremental")
+  {
+    srand(2);
+
+    // move and remove some entries
+    for (i = 0; i < n; i += 3)
+    {
+      positions[i] = Position(RandomValue(1.0), RandomValue(1.0), RandomValue(1.0));
+      CHECK(index.Move(i, positions[i]));
+    }
+    for (i = 1; i < n; i += 2)
+    {
+      CHECK(index.Remove(i));
+      valid[i] = false;
+    }
+    CHECK(!index.Remove(1));
+    CheckSphericalIndex(index, positions, valid);
+
+    // removed ids are re-used
+    for (i = 1; i < n; i += 2)
+    {
+      uint_t id = index.Add(Position(RandomValue(1.0), RandomValue(1.0), RandomValue(1.0)));
+      REQUIRE(id < n);
+      CHECK(!valid[id]);
+      positions[id] = index.GetDirection(id);
+      valid[id]     = true;
+    }
+    CheckSphericalIndex(index, positions, valid);
+  }
+
+  SECTION("small")
+  {
+    std::vector<SphericalIndex::RESULT> results;
+
+    index.Clear();
+    CHECK(index.FindNearest(Position(0.0, 1.0, 0.0), results, 3) == 0);
+    CHECK(index.Add(Position(0.0, -1.0, 0.0)) == 0);
+    REQUIRE(index.FindNearest(Position(0.0, 1.0, 0.0), results, 3) == 1);
+    CHECK(results[0].angle == Approx(180.0));
+    CHECK(index.FindWithinAngle(Position(0.0, 1.0, 0.0), 179.0, results) == 0);
+  }
+}
+
+TEST_CASE("sphericalindex-benchmark", "[.][benchmark]")
+{
+  static const uint_t sizes[] = {22, 64, 1024, 4096};
+  std::vector<SphericalIndex::RESULT> results;
+  std::vector<Position> positions, queries;
+  uint_t i, j, s, nqueries = 1000;
+
+  GenerateRandomPositions(queries, nqueries, 2);
+
+  for (s = 0; s < NUMBEROF(sizes); s++)
+  {
+    uint_t   n = sizes[s], total = 0;
+    uint64_t tick;
+
+    GenerateRandomPositions(positions, n);
+
+    SphericalIndex index(positions);
+
+    // linear scan for nearest using AbsAngle()
+    tick = GetNanosecondTicks();
+    for (i = 0; i < nqueries; i++)
+    {
+      double mina = 1000.0;
+      uint_t best = 0;
+
+      for (j = 0; j < n; j++)
+      {
+        double a = AbsAngle(queries[i], positions[j]);
+        if (a < mina) {mina = a; best = j;}
+      }
+      total += best;
+    }
+    tick = GetNanosecondTicks() - tick;
+    printf("%4u speakers: linear scan nearest:   %8.1lfns per query\n", n, (double)tick / (double)nqueries);
+
+    tick = GetNanosecondTicks();
+    for (i = 0; i < nqueries; i++) total += index.FindNearest(queries[i], results, 1);
+    tick = GetNanosecondTicks() - tick;
+    printf("%4u speakers: index nearest:         %8.1lfns per query\n", n, (double)tick / (double)nqueries);
+
+    tick = GetNanosecondTicks();
+    for (i = 0; i < nqueries; i++) total += index.FindNearest(queries[i], results, 3);
+    tick = GetNanosecondTicks() - tick;
+    printf("%4u speakers: index 3 nearest:       %8.1lfns per query\n", n, (double)tick / (double)nqueries);
+
+    tick = GetNanosecondTicks();
+    for (i = 0; i < nqueries; i++) total += index.FindWithinAngle(queries[i], 30.0, results);
+    tick = GetNanosecondTicks() - tick;
+    printf("%4u speakers: index within 30 deg:   %8.1lfns per query\n", n, (double)tick / (double)nqueries);
+
+    tick = GetNanosecondTicks();
+    for (i = 0; i < nqueries; i++) index.Move(i % n, queries[i]);
+    tick = GetNanosecondTicks() - tick;
+    printf("%4u speakers: index move:            %8.1lfns per update (%u)\n", n, (double)tick / (double)nqueries, total);
+  }
+}
+
+BBC_AUDIOTOOLBOX_END
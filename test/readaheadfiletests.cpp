@@ -0,0 +1,207 @@
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+
+#include <catch/catch.hpp>
+
+#include "ReadAheadFile.h"
+#include "PerformanceMonitor.h"
+#include "testbase.h"
+
+BBC_AUDIOTOOLBOX_START
+
+static const char *readaheadfiletestname = "readaheadfiletests.tmp";
+
+/*--------------------------------------------------------------------------------*/
+/** Read blocks of values and check they increment from val
+ */
+/*--------------------------------------------------------------------------------*/
+static uint32_t ReadAheadFileCheck(EnhancedFile& file, uint32_t val, uint_t nblocks, uint_t blocksize)
+{
+  std::vector<uint32_t> block(blocksize);
+  uint32_t errors = 0;
+  uint_t   i, j, n;
+
+  for (i = 0; i < nblocks; i++)
+  {
+    n = (uint_t)file.fread(&block[0], sizeof(block[0]), blocksize);
+    for (j = 0; j < n; j++)
+    {
+      if (block[j] != val++) errors++;
+    }
+    if (n < blocksize) break;
+  }
+  CHECK(errors == 0);
+
+  return val;
+}
+
+TEST_CASE("readaheadfile")
+{
+  const size_t   pagesize = GetPageSize();
+  const uint32_t nvalues  = (uint32_t)(100 * pagesize / sizeof(uint32_t)) + 123;
+
+  TestCreateIncrementingFile(readaheadfiletestname, nvalues);
+
+  SECTION("disabled")
+  {
+    ReadAheadFile file;
+
+    REQUIRE(file.fopen(readaheadfiletestname, "rb"));
+    CHECK(ReadAheadFileCheck(file, 0, 1000, 1000) == nvalues);
+    CHECK(file.GetStats().reads == 0);
+  }
+
+  SECTION("sequential")
+  {
+    ReadAheadFile file;
+    READAHEADFILESTATS stats;
+
+    REQUIRE(file.fopen(readaheadfiletestname, "rb"));
+    file.SetChunkSize(1);
+    CHECK(file.GetChunkSize() == pagesize);
+    file.SetReadAheadDepth(0);
+    CHECK(file.GetReadAheadDepth() == 1);
+    file.SetReadAheadDepth(5);
+    CHECK(file.GetReadAheadDepth() == 8);
+    file.EnableReadAhead();
+    CHECK(file.GetReadAhead());
+
+    // odd-sized reads cross chunk boundaries, reading stops short at the end of the file
+    CHECK(ReadAheadFileCheck(file, 0, 100000, 333) == nvalues);
+    CHECK(file.ftell() == (off_t)(nvalues * sizeof(uint32_t)));
+    CHECK(file.fread(&stats, 1, 1) == 0);
+
+    stats = file.GetStats();
+    CHECK(stats.reads == ((nvalues + 332) / 333 + 1));
+    CHECK((stats.hits + stats.misses) == stats.reads);
+    CHECK(stats.bytesread == (nvalues * sizeof(uint32_t)));
+    CHECK(stats.prefetchedbytes == (nvalues * sizeof(uint32_t)));
+    CHECK(stats.prefetches == 101);
+    CHECK(stats.invalidations == 0);
+
+    PerformanceMonitor::StartMeasuring();
+    file.PublishStats("readaheadfile");
+    PerformanceMonitor::StopMeasuring();
+    CHECK(PerformanceMonitor::Get().GetCounter("readaheadfile.bytesread") == (nvalues * sizeof(uint32_t)));
+
+    file.ResetStats();
+    CHECK(file.GetStats().reads == 0);
+  }
+
+  SECTION("seeking")
+  {
+    ReadAheadFile file;
+    uint32_t val;
+
+    REQUIRE(file.fopen(readaheadfiletestname, "rb"));
+    file.SetChunkSize(pagesize);
+    file.SetReadAheadDepth(4);
+    file.EnableReadAhead();
+
+    // wait for the thread to fill the ring
+    CHECK(ReadAheadFileCheck(file, 0, 1, 10) == 10);
+    while (file.GetPrefetchedChunks() < 4) std::this_thread::yield();
+
+    // within and forward through prefetched data
+    CHECK(file.fseek(5 * sizeof(uint32_t), SEEK_SET) == 0);
+    CHECK(file.ftell() == (off_t)(5 * sizeof(uint32_t)));
+    CHECK(ReadAheadFileCheck(file, 5, 1, 10) == 15);
+    val = (uint32_t)(2 * pagesize / sizeof(uint32_t)) + 7;
+    CHECK(file.fseek((off_t)((val - 15) * sizeof(uint32_t)), SEEK_CUR) == 0);
+    CHECK(ReadAheadFileCheck(file, val, 1, 10) == (val + 10));
+    CHECK(file.GetStats().invalidations == 0);
+
+    // backwards and relative to the end invalidate
+    CHECK(file.fseek(4, SEEK_SET) == 0);
+    CHECK(file.GetStats().invalidations == 1);
+    CHECK(file.ftell() == 4);
+    CHECK(ReadAheadFileCheck(file, 1, 1, 10) == 11);
+    CHECK(file.fseek(-40, SEEK_END) == 0);
+    CHECK(file.GetStats().invalidations == 2);
+    CHECK(ReadAheadFileCheck(file, nvalues - 10, 2, 10) == nvalues);
+    CHECK(file.fseek(-1, SEEK_SET) < 0);
+
+    // back within the last chunk after reaching the end
+    CHECK(file.fseek(-20, SEEK_CUR) == 0);
+    CHECK(ReadAheadFileCheck(file, nvalues - 5, 1, 10) == nvalues);
+    CHECK(file.GetStats().invalidations == 2);
+
+    file.rewind();
+    CHECK(file.ftell() == 0);
+
+    // duplicates start at the logical position
+    CHECK(ReadAheadFileCheck(file, 0, 1, 10) == 10);
+    CHECK(((const ReadAheadFile&)file).ftell() == (off_t)(10 * sizeof(uint32_t)));
+    {
+      ReadAheadFile *file2 = file.dup();
+
+      CHECK(file2->ftell() == (off_t)(10 * sizeof(uint32_t)));
+      CHECK(ReadAheadFileCheck(*file2, 10, 1, 10) == 20);
+      delete file2;
+    }
+
+    file.rewind();
+    CHECK(ReadAheadFileCheck(file, 0, 1000, 1000) == nvalues);
+  }
+
+  SECTION("writing")
+  {
+    ReadAheadFile file;
+    const uint32_t val = 0xffffffff;
+    uint32_t item;
+
+    REQUIRE(file.fopen(readaheadfiletestname, "r+b"));
+    file.EnableReadAhead();
+
+    // writing stops prefetching at the logical position
+    CHECK(ReadAheadFileCheck(file, 0, 1, 10) == 10);
+    CHECK(file.fwrite(&val, sizeof(val), 1) == 1);
+    CHECK(file.GetStats().invalidations == 1);
+    CHECK(file.ftell() == (off_t)(11 * sizeof(uint32_t)));
+    CHECK(ReadAheadFileCheck(file, 11, 1, 10) == 21);
+
+    file.rewind();
+    CHECK(ReadAheadFileCheck(file, 0, 1, 10) == 10);
+    CHECK(file.fread(&item, sizeof(item), 1) == 1);
+    CHECK(item == val);
+  }
+
+  remove(readaheadfiletestname);
+}
+
+TEST_CASE("readaheadfile-benchmark", "[.][benchmark]")
+{
+  const uint32_t nvalues = 64 * 1024 * 1024 / sizeof(uint32_t);
+  uint_t i;
+
+  TestCreateIncrementingFile(readaheadfiletestname, nvalues);
+
+  // cost of sequential 16 kB reads with and without read-ahead (the file is mostly cached)
+  for (i = 0; i < 2; i++)
+  {
+    ReadAheadFile file;
+    uint64_t t;
+
+    REQUIRE(file.fopen(readaheadfiletestname, "rb"));
+    file.EnableReadAhead(i > 0);
+
+    t = GetNanosecondTicks();
+    CHECK(ReadAheadFileCheck(file, 0, nvalues / 4096, 4096) == nvalues);
+    t = GetNanosecondTicks() - t;
+
+    printf("ReadAheadFile (16 kB reads, %s): %8.2lfus per read\n", i ? "read-ahead" : "direct", (double)t / ((double)(nvalues / 4096) * 1000.0));
+    if (i)
+    {
+      READAHEADFILESTATS stats = file.GetStats();
+      printf("ReadAheadFile (16 kB reads, read-ahead): %s hits, %s misses, %.2lfus average wait\n",
+             StringFrom(stats.hits).c_str(), StringFrom(stats.misses).c_str(), (double)stats.waittime / ((double)stats.reads * 1000.0));
+    }
+  }
+
+  remove(readaheadfiletestname);
+}
+
+BBC_AUDIOTOOLBOX_END
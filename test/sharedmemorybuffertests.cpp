@@ -0,0 +1,174 @@
+#include <string>
+#include <vector>
+#include <thread>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <catch/catch.hpp>
+
+#include "SharedMemoryBuffer.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Return a segment name unique to this process
+ */
+/*--------------------------------------------------------------------------------*/
+static std::string SharedMemoryTestName(const char *suffix)
+{
+  return "/bbcat-test-" + StringFrom((uint_t)getpid()) + "-" + suffix;
+}
+
+TEST_CASE("sharedmemorybuffer")
+{
+  const std::string name = SharedMemoryTestName("basic");
+  SharedMemoryBuffer<Sample_t> writer, reader;
+  std::vector<Sample_t> block(100);
+  uint_t i;
+
+  for (i = 0; i < block.size(); i++) block[i] = (Sample_t)i;
+
+  CHECK(!writer.IsAttached());
+  CHECK(writer.GetWriteBuffer() == NULL);
+  CHECK(writer.Write(&block[0], 1) == 0);
+  CHECK(!reader.Attach(name.c_str()));
+
+  REQUIRE(writer.Create(name.c_str(), 200, 0x12345678));
+  CHECK(writer.IsAttached());
+  CHECK(writer.IsOwner());
+  CHECK(writer.GetCapacity() == 256);
+  CHECK(writer.GetFormat() == 0x12345678);
+
+  // the name cannot be created twice (unless replacing)
+  {
+    SharedMemoryBuffer<Sample_t> other;
+    CHECK(!other.Create(name.c_str(), 200));
+  }
+
+  // header validation
+  {
+    SharedMemoryBuffer<double> other;
+    CHECK(!other.Attach(name.c_str()));
+    CHECK(!reader.Attach(name.c_str(), 0x87654321));
+  }
+
+  REQUIRE(reader.Attach(name.c_str(), 0x12345678));
+  CHECK(!reader.IsOwner());
+  CHECK(reader.GetCapacity() == 256);
+  CHECK(reader.GetFormat() == 0x12345678);
+
+  // separate mappings of the same memory
+  CHECK(writer.GetWriteBuffer() != reader.GetReadBuffer());
+  CHECK(reader.GetReadBuffer() == NULL);
+
+  // write via one mapping, read via the other, across the end of the storage
+  for (i = 0; i < 10; i++)
+  {
+    std::vector<Sample_t> dst(block.size());
+    uint_t j;
+
+    CHECK(writer.Write(&block[0], (uint_t)block.size()) == block.size());
+    CHECK(reader.ReadBuffersAvailable() == block.size());
+    CHECK(writer.WriteBuffersAvailable() == (256 - block.size()));
+    CHECK(reader.Read(&dst[0], (uint_t)dst.size()) == dst.size());
+    for (j = 0; j < dst.size(); j++) CHECK(dst[j] == block[j]);
+  }
+
+  // full
+  CHECK(writer.Write(&block[0], 100) == 100);
+  CHECK(writer.Write(&block[0], 100) == 100);
+  CHECK(writer.Write(&block[0], 100) == 56);
+  CHECK(writer.GetWriteBuffer() == NULL);
+  CHECK(reader.ReadBuffersAvailable() == 256);
+
+  // item interface
+  REQUIRE(reader.GetReadBuffer(1) != NULL);
+  CHECK(*reader.GetReadBuffer(1) == 1.f);
+  CHECK(reader.IncrementRead(2));
+  REQUIRE(writer.GetWriteBuffer() != NULL);
+  *writer.GetWriteBuffer() = -1.f;
+  CHECK(writer.IncrementWrite());
+  reader.Reset();
+  CHECK(reader.ReadBuffersAvailable() == 0);
+
+  // owner removes the name on detach but the reader keeps its mapping
+  writer.Detach();
+  CHECK(!writer.IsAttached());
+  CHECK(reader.IsAttached());
+  {
+    SharedMemoryBuffer<Sample_t> other;
+    CHECK(!other.Attach(name.c_str()));
+  }
+  reader.Detach();
+  CHECK(!SharedMemoryRing::Remove(name.c_str()));
+}
+
+TEST_CASE("sharedmemorybuffer-processes")
+{
+  const std::string name = SharedMemoryTestName("processes");
+  const uint_t   blocksize = 480;
+  const uint64_t count     = 2000000;
+  SharedMemoryBuffer<Sample_t> reader;
+  std::vector<Sample_t> block(blocksize);
+  uint64_t val = 0, errors = 0;
+  pid_t    pid;
+  int      status = -1;
+  bool     exited = false;
+  uint_t   i, n;
+
+  REQUIRE(reader.Create(name.c_str(), 4096, 1));
+
+  if ((pid = fork()) == 0)
+  {
+    // child process: attach and write incrementing values
+    SharedMemoryBuffer<Sample_t> writer;
+
+    if (!writer.Attach(name.c_str(), 1)) _exit(1);
+
+    while (val < count)
+    {
+      n = (uint_t)std::min((uint64_t)blocksize, count - val);
+      for (i = 0; i < n; i++) block[i] = (Sample_t)((val + i) & 0xffff);
+
+      for (i = 0; i < n;)
+      {
+        uint_t nwritten = writer.Write(&block[i], n - i);
+        if (!nwritten) std::this_thread::yield();
+        i += nwritten;
+      }
+
+      val += n;
+    }
+
+    _exit(0);
+  }
+
+  REQUIRE(pid > 0);
+
+  // parent process: read and check values
+  while (val < count)
+  {
+    if ((n = reader.Read(&block[0], blocksize)) > 0)
+    {
+      for (i = 0; i < n; i++)
+      {
+        if (block[i] != (Sample_t)((val + i) & 0xffff)) errors++;
+      }
+      val += n;
+    }
+    // once the child has exited, stop only when everything it wrote has been read
+    else if (exited) break;
+    else if (waitpid(pid, &status, WNOHANG) == pid) exited = true;
+    else std::this_thread::yield();
+  }
+
+  if (status < 0) waitpid(pid, &status, 0);
+
+  CHECK(WIFEXITED(status));
+  CHECK(WEXITSTATUS(status) == 0);
+  CHECK(val == count);
+  CHECK(errors == 0);
+}
+
+BBC_AUDIOTOOLBOX_END
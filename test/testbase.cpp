@@ -1,5 +1,9 @@
+#include <vector>
+
 #include "misc.h"
 #include "register.h"
+#include "EnhancedFile.h"
+#include "testbase.h"
 
 #define CATCH_CONFIG_MAIN
 #include <catch/catch.hpp>
@@ -10,3 +14,24 @@ TEST_CASE("init")
 {
   bbcat_register_bbcat_base();
 }
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Create file of n incrementing (uint32_t) values, shared by the file tests
+ */
+/*--------------------------------------------------------------------------------*/
+void TestCreateIncrementingFile(const char *filename, uint32_t n)
+{
+  EnhancedFile file;
+  std::vector<uint32_t> data(n);
+  uint32_t i;
+
+  for (i = 0; i < n; i++) data[i] = i;
+
+  REQUIRE(file.fopen(filename, "wb"));
+  REQUIRE(file.fwrite(&data[0], sizeof(data[0]), data.size()) == data.size());
+  file.fclose();
+}
+
+BBC_AUDIOTOOLBOX_END
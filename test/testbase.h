@@ -0,0 +1,16 @@
+#ifndef __TEST_BASE__
+#define __TEST_BASE__
+
+#include "misc.h"
+
+BBC_AUDIOTOOLBOX_START
+
+/*--------------------------------------------------------------------------------*/
+/** Create file of n incrementing (uint32_t) values, shared by the file tests
+ */
+/*--------------------------------------------------------------------------------*/
+extern void TestCreateIncrementingFile(const char *filename, uint32_t n);
+
+BBC_AUDIOTOOLBOX_END
+
+#endif